@@ -0,0 +1,386 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <queue>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include "boost/algorithm/string.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/FRCNN/util/frcnn_vis.hpp"
+#include "caffe/FRCNN/data_enhance/histgram/equalize_hist.hpp"
+#include "api/api.hpp"
+using caffe::Frcnn::FrcnnParam;
+using caffe::Frcnn::BBox;
+
+DEFINE_string(gpu, "",
+    "Optional; run in GPU mode on the given device ID, Empty is CPU");
+DEFINE_string(model, "",
+    "The model definition protocol buffer text file.");
+DEFINE_string(weights, "",
+    "Trained Model By Faster RCNN End-to-End Pipeline.");
+DEFINE_string(default_c, "",
+    "Default config file path.");
+DEFINE_string(image_list, "",
+    "Optional;Test images list.");
+DEFINE_string(image_root, "",
+    "Optional;Test images root directory.");
+DEFINE_string(out_file, "",
+    "Optional;Output images file.");
+DEFINE_int32(max_per_image, 100,
+    "Limit to max_per_image detections *over all classes*");
+DEFINE_int32(decode_threads, 4,
+    "Number of threads reading and decoding the images");
+DEFINE_int32(replicas, 2,
+    "Number of Detector replicas sharing the weights, each in its own thread");
+DEFINE_int32(checkpoint_interval, 100,
+    "Save the progress every checkpoint_interval images");
+DEFINE_string(checkpoint, "",
+    "Optional; progress file used to resume, default is out_file.ckpt");
+
+inline std::string INT(float x) { char A[100]; sprintf(A,"%.1f",x); return std::string(A);};
+inline std::string FloatToString(float x) { char A[100]; sprintf(A,"%.4f",x); return std::string(A);};
+
+// One entry of image_list on its way from the decoders to the writer.
+struct TestJob {
+  int position;     // entry number in image_list
+  int image_index;  // '# id' of the entry
+  std::string image;
+  cv::Mat cv_image;
+  std::vector<BBox<float> > results;
+  int ori_res_size;
+};
+
+// A queue of jobs; pop blocks until a job is pushed, NULL means no more jobs.
+class JobQueue {
+ public:
+  void push(TestJob* job) {
+    boost::mutex::scoped_lock lock(mutex_);
+    queue_.push(job);
+    condition_.notify_one();
+  }
+  TestJob* pop() {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (queue_.empty()) {
+      condition_.wait(lock);
+    }
+    TestJob* job = queue_.front();
+    queue_.pop();
+    return job;
+  }
+ private:
+  std::queue<TestJob*> queue_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+// Busy time of a stage, summed over its threads.
+struct StageTime {
+  StageTime() : ms(0), images(0) {}
+  void add(double t) {
+    boost::mutex::scoped_lock lock(mutex);
+    ms += t;
+    images++;
+  }
+  double ms;
+  int images;
+  boost::mutex mutex;
+};
+
+static void set_device(int gpu_id) {
+  if (gpu_id >= 0) {
+#ifndef CPU_ONLY
+    caffe::Caffe::SetDevice(gpu_id);
+    caffe::Caffe::set_mode(caffe::Caffe::GPU);
+#else
+    LOG(FATAL) << "CPU ONLY MODEL, BUT PROVIDE GPU ID";
+#endif
+  } else {
+    caffe::Caffe::set_mode(caffe::Caffe::CPU);
+  }
+}
+
+struct Pipeline {
+  std::vector<TestJob*> jobs;     // entries still to run, in list order
+  std::string image_root;
+  int max_per_image;
+  int gpu_id;
+  int next_job;                   // next entry to decode
+  int free_slots;                 // decoded images allowed in flight
+  int decoders_left;
+  boost::mutex mutex;
+  boost::condition_variable slot_freed;
+  JobQueue decoded;
+  // detected jobs waiting for their turn to be written, by position
+  std::map<int, TestJob*> detected;
+  boost::mutex detected_mutex;
+  boost::condition_variable detected_cond;
+  StageTime decode_time, detect_time, write_time;
+};
+
+static void decode_thread(Pipeline* pipe, int num_replicas) {
+  caffe::CPUTimer timer;
+  while (true) {
+    TestJob* job = NULL;
+    {
+      boost::mutex::scoped_lock lock(pipe->mutex);
+      while (pipe->next_job < static_cast<int>(pipe->jobs.size())
+          && pipe->free_slots == 0) {
+        pipe->slot_freed.wait(lock);
+      }
+      if (pipe->next_job < static_cast<int>(pipe->jobs.size())) {
+        job = pipe->jobs[pipe->next_job++];
+        pipe->free_slots--;
+      } else if (--pipe->decoders_left == 0) {
+        // The last decoder stops the detectors.
+        for (int i = 0; i < num_replicas; i++) {
+          pipe->decoded.push(NULL);
+        }
+      }
+    }
+    if (job == NULL) return;
+    timer.Start();
+    job->cv_image = cv::imread(pipe->image_root + job->image);
+    CHECK(job->cv_image.data) << "Can not read " << pipe->image_root + job->image;
+    //fyk : do equlize_hist,only for 3-channel
+    switch (FrcnnParam::use_hist_equalize) {
+    case 1:
+      job->cv_image = equalizeIntensityHist(job->cv_image);
+      break;
+    case 2:
+      job->cv_image = equalizeChannelHist(job->cv_image);
+      break;
+    }
+    timer.Stop();
+    pipe->decode_time.add(timer.MilliSeconds());
+    pipe->decoded.push(job);
+  }
+}
+
+static void detect_thread(Pipeline* pipe, API::Detector* detector) {
+  // Caffe's mode and device are per thread.
+  set_device(pipe->gpu_id);
+  caffe::CPUTimer timer;
+  while (TestJob* job = pipe->decoded.pop()) {
+    timer.Start();
+    std::vector<BBox<float> > &results = job->results;
+    detector->predict(job->cv_image, results);
+    job->cv_image.release();
+    {
+      boost::mutex::scoped_lock lock(pipe->mutex);
+      pipe->free_slots++;
+      pipe->slot_freed.notify_one();
+    }
+    float image_thresh = 0;
+    if ( pipe->max_per_image > 0 ) {
+      std::vector<float> image_score ;
+      for (size_t obj = 0; obj < results.size(); obj++) {
+        image_score.push_back(results[obj].confidence) ;
+      }
+      std::sort(image_score.begin(), image_score.end(), std::greater<float>());
+      if ( pipe->max_per_image > image_score.size() ) {
+        if ( image_score.size() > 0 )
+          image_thresh = image_score.back();
+      } else {
+        image_thresh = image_score[pipe->max_per_image-1];
+      }
+    }
+    std::vector<BBox<float> > filtered_res;
+    for (size_t obj = 0; obj < results.size(); obj++) {
+      if ( results[obj].confidence >= image_thresh ) {
+        filtered_res.push_back( results[obj] );
+      }
+    }
+    job->ori_res_size = results.size();
+    results = filtered_res;
+    timer.Stop();
+    pipe->detect_time.add(timer.MilliSeconds());
+    boost::mutex::scoped_lock lock(pipe->detected_mutex);
+    pipe->detected[job->position] = job;
+    pipe->detected_cond.notify_one();
+  }
+}
+
+// The checkpoint holds the number of list entries already written and the
+// size of out_file after them; anything after that offset is discarded.
+static void save_checkpoint(const std::string &checkpoint, int done,
+    std::streamoff bytes) {
+  const std::string tmp = checkpoint + ".tmp";
+  {
+    std::ofstream ckfile(tmp.c_str());
+    ckfile << done << " " << bytes << std::endl;
+    CHECK(ckfile.good()) << "Can not write " << tmp;
+  }
+  CHECK_EQ(std::rename(tmp.c_str(), checkpoint.c_str()), 0)
+    << "Can not rename " << tmp << " to " << checkpoint;
+}
+
+static void report(const std::string &stage, const StageTime &time,
+    int workers, double wall_ms) {
+  char buff[200];
+  snprintf(buff, sizeof(buff), "%-8s %6d images, %8.2f ms/image per thread, "
+      "%7.2f images/s with %d thread(s), busy %5.1f%%", stage.c_str(),
+      time.images, time.images > 0 ? time.ms / time.images : 0.,
+      time.ms > 0 ? time.images * workers * 1000. / time.ms : 0., workers,
+      wall_ms > 0 ? 100. * time.ms / (workers * wall_ms) : 0.);
+  LOG(INFO) << buff;
+}
+
+int main(int argc, char** argv){
+  // Print output to stderr (while still logging).
+  FLAGS_alsologtostderr = 1;
+  // Set version
+  gflags::SetVersionString(AS_STRING(CAFFE_VERSION));
+  // Usage message.
+  gflags::SetUsageMessage("command line brew\n"
+      "usage: batch_test_frcnn <args>\n\n"
+      "Same output as test_frcnn, with images decoded by a thread pool and\n"
+      "detected by several Detector replicas. An interrupted run resumes\n"
+      "from its checkpoint. Limit OMP_NUM_THREADS when running several CPU\n"
+      "replicas.\n\n"
+      "args:\n"
+      "  --gpu          7       use 7-th gpu device, default is cpu model\n"
+      "  --model        file    protocol buffer text file\n"
+      "  --weights      file    Trained Model\n"
+      "  --default_c    file    Default Config File\n"
+      "  --image_list   file    input image list\n"
+      "  --image_root   file    input image dir\n"
+      "  --max_per_image   file limit to max_per_image detections\n"
+      "  --decode_threads  4    image decoding threads\n"
+      "  --replicas        2    Detector replicas sharing the weights\n"
+      "  --checkpoint   file    progress file, default is out_file.ckpt\n"
+      "  --checkpoint_interval 100  images between checkpoints\n"
+      "  --out_file     file    output amswer file");
+
+  // Run tool or show usage.
+  caffe::GlobalInit(&argc, &argv);
+  CHECK( FLAGS_gpu.size() == 0 || FLAGS_gpu.size() == 1 || (FLAGS_gpu.size()==2&&FLAGS_gpu=="-1")) << "Can only support one gpu or none or -1(for cpu)";
+  CHECK_GT(FLAGS_decode_threads, 0);
+  CHECK_GT(FLAGS_replicas, 0);
+  CHECK_GT(FLAGS_checkpoint_interval, 0);
+  int gpu_id = -1;
+  if( FLAGS_gpu.size() > 0 )
+    gpu_id = boost::lexical_cast<int>(FLAGS_gpu);
+  set_device(gpu_id);
+
+  std::string proto_file             = FLAGS_model.c_str();
+  std::string model_file             = FLAGS_weights.c_str();
+  std::string default_config_file    = FLAGS_default_c.c_str();
+
+  const std::string image_list = FLAGS_image_list.c_str();
+  const std::string out_file = FLAGS_out_file.c_str();
+  const std::string checkpoint = FLAGS_checkpoint.size() > 0 ?
+      FLAGS_checkpoint : out_file + ".ckpt";
+
+  API::Set_Config(default_config_file);
+  std::vector<boost::shared_ptr<API::Detector> > detectors;
+  detectors.push_back(boost::shared_ptr<API::Detector>(
+      new API::Detector(proto_file, model_file)));
+  // The replicas are built here, on the main thread with its device set, which
+  // also moves the shared weights to the device before the detect threads.
+  for (int i = 1; i < FLAGS_replicas; i++) {
+    detectors.push_back(boost::shared_ptr<API::Detector>(
+        new API::Detector(proto_file, *detectors[0])));
+  }
+
+  LOG(INFO) << "image  list    : " << image_list;
+  LOG(INFO) << "output file    : " << out_file;
+  LOG(INFO) << "image  root    : " << FLAGS_image_root;
+  LOG(INFO) << "max_per_image  : " << FLAGS_max_per_image;
+  LOG(INFO) << "decode threads : " << FLAGS_decode_threads;
+  LOG(INFO) << "replicas       : " << FLAGS_replicas;
+
+  Pipeline pipe;
+  pipe.image_root = FLAGS_image_root;
+  pipe.max_per_image = FLAGS_max_per_image;
+  pipe.gpu_id = gpu_id;
+  std::ifstream infile(image_list.c_str());
+  CHECK(infile.is_open()) << "Can not open " << image_list;
+  API::DataPrepare data_load;
+  int total = 0;
+  int done = 0;
+  std::streamoff written = 0;
+  std::ifstream ckfile(checkpoint.c_str());
+  if (ckfile >> done >> written) {
+    CHECK(boost::filesystem::exists(out_file)) << "Checkpoint " << checkpoint
+      << " found but not the output file " << out_file;
+    CHECK_GE(static_cast<std::streamoff>(boost::filesystem::file_size(out_file)), written);
+    boost::filesystem::resize_file(out_file, written);
+    LOG(INFO) << "Resume after " << done << " images from " << checkpoint;
+  } else {
+    done = 0;
+    written = 0;
+  }
+  ckfile.close();
+  while ( data_load.load_WithDiff(infile) ) {
+    if (total++ < done) continue;
+    TestJob* job = new TestJob();
+    job->position = total - 1;
+    job->image_index = data_load.GetImageIndex();
+    job->image = data_load.GetImagePath("");
+    pipe.jobs.push_back(job);
+  }
+  infile.close();
+  CHECK_LE(done, total) << "Checkpoint is ahead of the image list";
+  std::ofstream otfile(out_file.c_str(), done > 0 ? std::ios::app : std::ios::trunc);
+  CHECK(otfile.is_open()) << "Can not open " << out_file;
+
+  pipe.next_job = 0;
+  pipe.free_slots = 2 * FLAGS_replicas;
+  pipe.decoders_left = FLAGS_decode_threads;
+  caffe::CPUTimer wall_timer, timer;
+  wall_timer.Start();
+  boost::thread_group threads;
+  for (int i = 0; i < FLAGS_decode_threads; i++) {
+    threads.create_thread(boost::bind(decode_thread, &pipe, FLAGS_replicas));
+  }
+  for (int i = 0; i < FLAGS_replicas; i++) {
+    threads.create_thread(boost::bind(detect_thread, &pipe, detectors[i].get()));
+  }
+
+  // Results are written in list order, whatever order they are detected in.
+  for (int position = done; position < total; position++) {
+    TestJob* job = NULL;
+    {
+      boost::mutex::scoped_lock lock(pipe.detected_mutex);
+      while (!pipe.detected.count(position)) {
+        pipe.detected_cond.wait(lock);
+      }
+      job = pipe.detected[position];
+      pipe.detected.erase(position);
+    }
+    timer.Start();
+    const std::vector<BBox<float> > &results = job->results;
+    otfile << "# " << job->image_index << std::endl;
+    otfile << job->image << std::endl;
+    otfile << results.size() << std::endl;
+    for (size_t obj = 0; obj < results.size(); obj++) {
+      otfile << results[obj].id << "  " << INT(results[obj][0]) << " " << INT(results[obj][1]) << " " << INT(results[obj][2]) << " " << INT(results[obj][3]) << "     " << FloatToString(results[obj].confidence) << std::endl;
+    }
+    LOG(INFO) << "Handle " << position + 1 << " th image : " << job->image << ", "
+        << job->ori_res_size << " -> " << results.size() << " boxes";
+    delete job;
+    if ((position + 1) % FLAGS_checkpoint_interval == 0 || position + 1 == total) {
+      otfile.flush();
+      CHECK(otfile.good()) << "Can not write " << out_file;
+      save_checkpoint(checkpoint, position + 1,
+          boost::filesystem::file_size(out_file));
+    }
+    timer.Stop();
+    pipe.write_time.add(timer.MilliSeconds());
+  }
+  threads.join_all();
+  otfile.close();
+  wall_timer.Stop();
+  // A finished run starts over next time.
+  boost::filesystem::remove(checkpoint);
+
+  const double wall_ms = wall_timer.MilliSeconds();
+  LOG(INFO) << "Processed " << total - done << " images in " << wall_ms / 1000.
+      << " s, " << (wall_ms > 0 ? (total - done) * 1000. / wall_ms : 0.) << " images/s";
+  report("decode", pipe.decode_time, FLAGS_decode_threads, wall_ms);
+  report("detect", pipe.detect_time, FLAGS_replicas, wall_ms);
+  report("write", pipe.write_time, 1, wall_ms);
+  return 0;
+}
@@ -0,0 +1,137 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include "boost/algorithm/string.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+#include "api/api.hpp"
+using caffe::Frcnn::FrcnnParam;
+
+DEFINE_string(gpu, "",
+    "Optional; run in GPU mode on the given device ID, Empty is CPU");
+DEFINE_string(model, "",
+    "The model definition protocol buffer text file.");
+DEFINE_string(weights, "",
+    "Trained Model By Faster RCNN End-to-End Pipeline.");
+DEFINE_string(default_c, "",
+    "Default config file path.");
+DEFINE_string(image_list, "",
+    "Calibration images list.");
+DEFINE_string(image_root, "",
+    "Optional;Calibration images root directory.");
+DEFINE_int32(max_images, 200,
+    "Number of images used for calibration, <= 0 for the whole list");
+DEFINE_string(fp32_layers, "rpn_,cls_score,bbox_pred",
+    "Comma separated name prefixes of the layers kept in FP32");
+DEFINE_string(out_model, "",
+    "Output model definition with INT8 quantization_param.");
+
+// Records the largest absolute input of every Convolution / InnerProduct.
+class RangeCollector : public caffe::Net<float>::Callback {
+ public:
+  explicit RangeCollector(const caffe::Net<float>* net) : net_(net) {}
+  const std::map<std::string, float>& ranges() const { return ranges_; }
+
+ protected:
+  virtual void run(int layer) {
+    const std::string type = net_->layers()[layer]->type();
+    if (type != "Convolution" && type != "InnerProduct") return;
+    const caffe::Blob<float>* bottom = net_->bottom_vecs()[layer][0];
+    const float* data = bottom->cpu_data();
+    float& range = ranges_[net_->layer_names()[layer]];
+    for (int i = 0; i < bottom->count(); i++) {
+      range = std::max(range, std::abs(data[i]));
+    }
+  }
+
+ private:
+  const caffe::Net<float>* net_;
+  std::map<std::string, float> ranges_;
+};
+
+int main(int argc, char** argv){
+  // Print output to stderr (while still logging).
+  FLAGS_alsologtostderr = 1;
+  // Set version
+  gflags::SetVersionString(AS_STRING(CAFFE_VERSION));
+  // Usage message.
+  gflags::SetUsageMessage("collect activation ranges for INT8 inference\n"
+      "usage: calibrate_int8 <args>\n\n"
+      "args:\n"
+      "  --gpu          7       use 7-th gpu device, default is cpu model\n"
+      "  --model        file    protocol buffer text file\n"
+      "  --weights      file    Trained Model\n"
+      "  --default_c    file    Default Config File\n"
+      "  --image_list   file    calibration image list\n"
+      "  --image_root   file    calibration image dir\n"
+      "  --max_images   200     number of calibration images\n"
+      "  --fp32_layers  rpn_    layer name prefixes kept in FP32\n"
+      "  --out_model    file    output INT8 protocol buffer text file");
+
+  // Run tool or show usage.
+  caffe::GlobalInit(&argc, &argv);
+  CHECK( FLAGS_gpu.size() == 0 || FLAGS_gpu.size() == 1 || (FLAGS_gpu.size()==2&&FLAGS_gpu=="-1")) << "Can only support one gpu or none or -1(for cpu)";
+  int gpu_id = -1;
+  if( FLAGS_gpu.size() > 0 )
+    gpu_id = boost::lexical_cast<int>(FLAGS_gpu);
+
+  if (gpu_id >= 0) {
+#ifndef CPU_ONLY
+    caffe::Caffe::SetDevice(gpu_id);
+    caffe::Caffe::set_mode(caffe::Caffe::GPU);
+#else
+    LOG(FATAL) << "CPU ONLY MODEL, BUT PROVIDE GPU ID";
+#endif
+  } else {
+    caffe::Caffe::set_mode(caffe::Caffe::CPU);
+  }
+  CHECK(FLAGS_out_model.size()) << "Need --out_model";
+
+  std::string proto_file             = FLAGS_model.c_str();
+  std::string model_file             = FLAGS_weights.c_str();
+  std::string default_config_file    = FLAGS_default_c.c_str();
+
+  API::Set_Config(default_config_file);
+  CHECK(!FrcnnParam::test_decrypt_model) << "Can not calibrate an encrypted model";
+  API::Detector detector(proto_file, model_file);
+  RangeCollector collector(detector.Get_Net().get());
+  detector.Get_Net()->add_before_forward(&collector);
+
+  std::ifstream infile(FLAGS_image_list.c_str());
+  API::DataPrepare data_load;
+  int count = 0;
+  while ( (FLAGS_max_images <= 0 || count < FLAGS_max_images) && data_load.load_WithDiff(infile) ) {
+    std::string image = data_load.GetImagePath("");
+    cv::Mat cv_image = cv::imread(FLAGS_image_root+image);
+    std::vector<caffe::Frcnn::BBox<float> > results;
+    detector.predict(cv_image, results);
+    LOG(INFO) << "Calibrate " << ++count << " th image : " << image;
+  }
+  infile.close();
+  CHECK_GT(count, 0) << "No calibration image in " << FLAGS_image_list;
+
+  std::vector<std::string> fp32_layers;
+  boost::split(fp32_layers, FLAGS_fp32_layers, boost::is_any_of(","));
+  caffe::NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(proto_file, &param);
+  const std::map<std::string, float>& ranges = collector.ranges();
+  for (int i = 0; i < param.layer_size(); i++) {
+    caffe::LayerParameter* layer = param.mutable_layer(i);
+    std::map<std::string, float>::const_iterator range = ranges.find(layer->name());
+    if (range == ranges.end()) continue;
+    bool keep_fp32 = range->second <= 0;
+    for (size_t j = 0; j < fp32_layers.size(); j++) {
+      if (fp32_layers[j].size() && boost::starts_with(layer->name(), fp32_layers[j]))
+        keep_fp32 = true;
+    }
+    LOG(INFO) << layer->name() << " : bottom_max " << range->second << (keep_fp32 ? ", keep FP32" : ", INT8");
+    if (keep_fp32) continue;
+    layer->mutable_quantization_param()->set_precision(caffe::QuantizationParameter_Precision_INT8);
+    layer->mutable_quantization_param()->set_bottom_max(range->second);
+  }
+  caffe::WriteProtoToTextFile(param, FLAGS_out_model);
+  LOG(INFO) << "Calibrated with " << count << " images, INT8 model : " << FLAGS_out_model;
+  return 0;
+}
@@ -0,0 +1,74 @@
+#!/usr/bin/env sh
+# This script times the CPU ConvolutionDepthwise kernels of the light detectors
+# with caffe time: the 3x3 stride 1 and stride 2 kernels (depthwise_kernel
+# DEPTHWISE_SPECIALIZED) against the generic kernel on the same layer
+# (DEPTHWISE_GENERIC), and reports the forward and backward time of each. The
+# backward pass is the same code for both, it is reported as a check that the
+# runs are comparable.
+# usage: conv_dw_bench.sh [channels] [size] [batch] [iterations]
+if [ ! -n "$1" ] ;then
+    CHANNELS=128
+else
+    CHANNELS=$1
+fi
+if [ ! -n "$2" ] ;then
+    SIZE=56
+else
+    SIZE=$2
+fi
+if [ ! -n "$3" ] ;then
+    BATCH=1
+else
+    BATCH=$3
+fi
+if [ ! -n "$4" ] ;then
+    ITERATIONS=50
+else
+    ITERATIONS=$4
+fi
+pid=$$
+CAFFE=build/tools/caffe
+MODEL=examples/FRCNN/results/conv_dw_bench_${pid}.prototxt
+LOG=examples/FRCNN/results/conv_dw_bench_${pid}.log
+
+layer() {
+    cat <<EOF
+layer {
+  name: "$1"
+  type: "ConvolutionDepthwise"
+  bottom: "data"
+  top: "$1"
+  convolution_param {
+    num_output: $CHANNELS
+    kernel_size: 3
+    stride: $2
+    pad: 1
+    weight_filler { type: "msra" }
+    bias_filler { type: "constant" value: 0.1 }
+    depthwise_kernel: $3
+  }
+}
+EOF
+}
+
+mkdir -p examples/FRCNN/results
+{
+    echo "name: \"conv_dw_bench\""
+    echo "force_backward: true"
+    echo "layer { name: \"data\" type: \"Input\" top: \"data\""
+    echo "  input_param { shape { dim: $BATCH dim: $CHANNELS dim: $SIZE dim: $SIZE } } }"
+    layer stride1 1 DEPTHWISE_SPECIALIZED
+    layer stride1_generic 1 DEPTHWISE_GENERIC
+    layer stride2 2 DEPTHWISE_SPECIALIZED
+    layer stride2_generic 2 DEPTHWISE_GENERIC
+} > $MODEL
+
+$CAFFE time --model $MODEL --iterations $ITERATIONS 2> $LOG || exit 1
+
+echo "ConvolutionDepthwise 3x3, input ${BATCH}x${CHANNELS}x${SIZE}x${SIZE}, $ITERATIONS iterations ($LOG)"
+printf "%-16s %-12s %s\n" layer "forward ms" "backward ms"
+for LAYER in stride1 stride1_generic stride2 stride2_generic; do
+    FORWARD=`grep " $LAYER	forward: " $LOG | head -1 | sed 's/.*forward: \([0-9.e-]*\) ms.*/\1/'`
+    BACKWARD=`grep " $LAYER	backward: " $LOG | head -1 | sed 's/.*backward: \([0-9.e-]*\) ms.*/\1/'`
+    printf "%-16s %-12s %s\n" $LAYER "$FORWARD" "$BACKWARD"
+done
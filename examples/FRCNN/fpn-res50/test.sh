@@ -45,12 +45,6 @@ time $BUILD --gpu $gpu \
     --image_root /home/gpu/fyk/RSI-mix/images/ \
     --image_list /home/gpu/fyk/RSI-mix/RSI-mix-3.test \
     --out_file exp/results/RSI_test_"$TYPE"_$fid.frcnn \
-    --max_per_image 100
-
-CAL_AP="examples/FRCNN/calculate_voc_ap.py"
-for cal in $CAL_AP;do
-python $cal --gt /home/gpu/fyk/RSI-mix/RSI-mix-3.test \
-    --answer exp/results/RSI_test_"$TYPE"_$fid.frcnn \
-    --overlap 0.5
-done
+    --max_per_image 100 \
+    --evaluate --overlap 0.5
 
@@ -0,0 +1,62 @@
+#!/usr/bin/env sh
+# This script calibrates an INT8 model from a faster rcnn model, then evaluates
+# the FP32 and the INT8 model on voc2007 test with the CPU and reports mAP and
+# the average detection time of both, to decide per model whether INT8 is used.
+# usage: int8_report.sh [type] [calibration images]
+if [ ! -n "$1" ] ;then
+    TYPE="res50" #vgg16/res101
+else
+    TYPE=$1
+fi
+if [ ! -n "$2" ] ;then
+    NUM_CALIB=200
+else
+    NUM_CALIB=$2
+fi
+pid=$$
+CALIB=build/examples/FRCNN/calibrate_int8.bin
+BUILD=build/examples/FRCNN/test_frcnn.bin
+CAL_AP=examples/FRCNN/calculate_voc_ap.py
+MODEL=models/FRCNN/"$TYPE"/test_inference.prototxt
+INT8_MODEL=examples/FRCNN/results/"$TYPE"_int8_${pid}.prototxt
+WEIGHTS=models/FRCNN/"$TYPE"_faster_rcnn_final_inference.caffemodel
+CONFIG=examples/FRCNN/config/voc_config.json
+
+$CALIB --gpu -1 \
+    --model $MODEL \
+    --weights $WEIGHTS \
+    --default_c $CONFIG \
+    --image_root VOCdevkit/VOC2007/JPEGImages/ \
+    --image_list examples/FRCNN/dataset/voc2007.trainval \
+    --max_images $NUM_CALIB \
+    --out_model $INT8_MODEL || exit 1
+
+for PRECISION in fp32 int8; do
+    if [ "$PRECISION" = "int8" ]; then
+        PROTO=$INT8_MODEL
+    else
+        PROTO=$MODEL
+    fi
+    OUT=examples/FRCNN/results/voc2007_test_"$TYPE"_"$PRECISION"_${pid}
+    $BUILD --gpu -1 \
+        --model $PROTO \
+        --weights $WEIGHTS \
+        --default_c $CONFIG \
+        --image_root VOCdevkit/VOC2007/JPEGImages/ \
+        --image_list examples/FRCNN/dataset/voc2007.test \
+        --out_file $OUT.frcnn \
+        --max_per_image 100 2> $OUT.log || exit 1
+    python $CAL_AP --gt examples/FRCNN/dataset/voc2007.test \
+        --answer $OUT.frcnn \
+        --overlap 0.5 > $OUT.ap
+done
+
+echo "model: $TYPE, INT8 calibrated with $NUM_CALIB images ($INT8_MODEL)"
+printf "%-10s %-16s %s\n" precision "mAP [07] [12]" "ms/image"
+for PRECISION in fp32 int8; do
+    OUT=examples/FRCNN/results/voc2007_test_"$TYPE"_"$PRECISION"_${pid}
+    MAP=`grep "mAP = " $OUT.ap | sed 's/\x1b\[[0-9;]*m//g' | sed 's/mAP = //'`
+    MS=`grep "detection use" $OUT.log | sed 's/.*detection use \([0-9.]*\) ms/\1/' \
+        | awk '{ s += $1; n++ } END { if (n > 0) printf "%.1f", s / n }'`
+    printf "%-10s %-16s %s\n" $PRECISION "$MAP" "$MS"
+done
@@ -4,6 +4,7 @@
 #include "caffe/util/benchmark.hpp"
 #include "caffe/util/signal_handler.h"
 #include "caffe/FRCNN/util/frcnn_vis.hpp"
+#include "caffe/FRCNN/util/frcnn_evaluate.hpp"
 #include "api/api.hpp"
 
 DEFINE_string(gpu, "", 
@@ -22,6 +23,10 @@ DEFINE_string(out_file, "",
     "Optional;Output images file."); 
 DEFINE_int32(max_per_image, 100,
     "Limit to max_per_image detections *over all classes*");
+DEFINE_string(gt_file, "",
+    "Optional; ground truth of the frames as 'shot_dir/image', compute VOC and COCO AP against it");
+DEFINE_double(overlap, 0.5,
+    "Optional; IoU threshold of the VOC AP");
 
 inline std::string INT(float x) { char A[100]; sprintf(A,"%.1f",x); return std::string(A);};
 inline std::string FloatToString(float x) { char A[100]; sprintf(A,"%.4f",x); return std::string(A);};
@@ -42,6 +47,8 @@ int main(int argc, char** argv){
       "  --image_list   file    input image list\n"
       "  --image_root   file    input image dir\n"
       "  --max_per_image   file limit to max_per_image detections\n"
+      "  --gt_file      file    ground truth to evaluate against\n"
+      "  --overlap      0.5     IoU threshold of the VOC AP\n"
       "  --out_file     file    output amswer file");
 
   // Run tool or show usage.
@@ -82,6 +89,24 @@ int main(int argc, char** argv){
   std::ifstream infile(image_list.c_str());
   std::ofstream otfile(out_file.c_str());
   API::DataPrepare data_load;
+  // ground truth boxes and difficult flags of every evaluated frame
+  std::map<std::string, std::pair<std::vector<caffe::Frcnn::BBox<float> >, std::vector<int> > > ground_truth;
+  if (FLAGS_gt_file.size() > 0) {
+    std::ifstream gtfile(FLAGS_gt_file.c_str());
+    CHECK(gtfile.is_open()) << "Can not open " << FLAGS_gt_file;
+    while ( data_load.load_WithDiff(gtfile) ) {
+      std::vector<std::vector<float> > rois = data_load.GetRois(true);
+      std::vector<caffe::Frcnn::BBox<float> > &gts = ground_truth[data_load.GetImagePath("")].first;
+      for (size_t i = 0; i < rois.size(); i++) {
+        gts.push_back(caffe::Frcnn::BBox<float>(rois[i][API::DataPrepare::X1],
+            rois[i][API::DataPrepare::Y1], rois[i][API::DataPrepare::X2],
+            rois[i][API::DataPrepare::Y2], 1, rois[i][API::DataPrepare::LABEL]));
+      }
+      ground_truth[data_load.GetImagePath("")].second = data_load.GetDiffs();
+    }
+    LOG(INFO) << "ground truth   : " << ground_truth.size() << " frames";
+  }
+  caffe::Frcnn::DetectionEvaluator evaluator(caffe::Frcnn::FrcnnParam::n_classes);
   int count = 0;
   std::string shot_dir;
   int frames;
@@ -125,11 +150,22 @@ int main(int argc, char** argv){
       for (size_t obj = 0; obj < results.size(); obj++) {
         otfile << results[obj].id << "  " << INT(results[obj][0]) << " " << INT(results[obj][1]) << " " << INT(results[obj][2]) << " " << INT(results[obj][3]) << "     " << FloatToString(results[obj].confidence) << std::endl;
       }
+      if (ground_truth.size() > 0) {
+        const std::string key = shot_dir + "/" + image;
+        if (ground_truth.count(key)) {
+          evaluator.AddImage(ground_truth[key].first, ground_truth[key].second, results);
+        } else {
+          LOG(WARNING) << "No ground truth for " << key << ", not evaluated";
+        }
+      }
       LOG(INFO) << "Handle " << count << " th shot[" << shot_dir << "] : " << ii << " / " << frames << " frame : " << image << ", with image_thresh : " << image_thresh << ", "  << ori_res_size << " -> " << results.size() << " boxes";
     }
     count ++;
   }
   infile.close();
   otfile.close();
+  if (evaluator.num_images() > 0) {
+    evaluator.Summarize(FLAGS_overlap);
+  }
   return 0;
 }
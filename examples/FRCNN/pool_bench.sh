@@ -0,0 +1,79 @@
+#!/usr/bin/env sh
+# This script times the CPU MAX and AVE pooling of the detectors with caffe
+# time, in the TEST phase: the 3x3 stride 2 pad 1 and 2x2 stride 2 MAX layers
+# through the plane kernel without the argmax, against the same layers forced
+# to the masked loop of the TRAIN phase (_masked), plus the AVE layers, which
+# always use the plane kernel. The backward of a TEST MAX layer first finds
+# the argmax, so only its forward time is comparable.
+# usage: pool_bench.sh [channels] [size] [batch] [iterations]
+if [ ! -n "$1" ] ;then
+    CHANNELS=64
+else
+    CHANNELS=$1
+fi
+if [ ! -n "$2" ] ;then
+    SIZE=112
+else
+    SIZE=$2
+fi
+if [ ! -n "$3" ] ;then
+    BATCH=1
+else
+    BATCH=$3
+fi
+if [ ! -n "$4" ] ;then
+    ITERATIONS=50
+else
+    ITERATIONS=$4
+fi
+pid=$$
+CAFFE=build/tools/caffe
+MODEL=examples/FRCNN/results/pool_bench_${pid}.prototxt
+LOG=examples/FRCNN/results/pool_bench_${pid}.log
+
+# layer name pool kernel pad phase
+layer() {
+    PHASE=""
+    if [ -n "$5" ] ;then
+        PHASE="phase: $5"
+    fi
+    cat <<EOF
+layer {
+  name: "$1"
+  type: "Pooling"
+  bottom: "data"
+  top: "$1"
+  $PHASE
+  pooling_param {
+    pool: $2
+    kernel_size: $3
+    stride: 2
+    pad: $4
+  }
+}
+EOF
+}
+
+mkdir -p examples/FRCNN/results
+{
+    echo "name: \"pool_bench\""
+    echo "force_backward: true"
+    echo "layer { name: \"data\" type: \"Input\" top: \"data\""
+    echo "  input_param { shape { dim: $BATCH dim: $CHANNELS dim: $SIZE dim: $SIZE } } }"
+    layer max3x3 MAX 3 1
+    layer max3x3_masked MAX 3 1 TRAIN
+    layer max2x2 MAX 2 0
+    layer max2x2_masked MAX 2 0 TRAIN
+    layer ave3x3 AVE 3 1
+    layer ave2x2 AVE 2 0
+} > $MODEL
+
+$CAFFE time --model $MODEL --phase TEST --iterations $ITERATIONS 2> $LOG || exit 1
+
+echo "Pooling stride 2, input ${BATCH}x${CHANNELS}x${SIZE}x${SIZE}, $ITERATIONS iterations ($LOG)"
+printf "%-16s %-12s %s\n" layer "forward ms" "backward ms"
+for LAYER in max3x3 max3x3_masked max2x2 max2x2_masked ave3x3 ave2x2; do
+    FORWARD=`grep " $LAYER	forward: " $LOG | head -1 | sed 's/.*forward: \([0-9.e-]*\) ms.*/\1/'`
+    BACKWARD=`grep " $LAYER	backward: " $LOG | head -1 | sed 's/.*backward: \([0-9.e-]*\) ms.*/\1/'`
+    printf "%-16s %-12s %s\n" $LAYER "$FORWARD" "$BACKWARD"
+done
@@ -4,6 +4,7 @@
 #include "caffe/util/benchmark.hpp"
 #include "caffe/util/signal_handler.h"
 #include "caffe/FRCNN/util/frcnn_vis.hpp"
+#include "caffe/FRCNN/util/frcnn_evaluate.hpp"
 #include "caffe/FRCNN/data_enhance/histgram/equalize_hist.hpp"
 #include "api/api.hpp"
 using caffe::Frcnn::FrcnnParam;
@@ -24,6 +25,10 @@ DEFINE_string(out_file, "",
     "Optional;Output images file."); 
 DEFINE_int32(max_per_image, 100,
     "Limit to max_per_image detections *over all classes*");
+DEFINE_bool(evaluate, false,
+    "Optional; compute VOC and COCO AP against the boxes of image_list");
+DEFINE_double(overlap, 0.5,
+    "Optional; IoU threshold of the VOC AP");
 
 inline std::string INT(float x) { char A[100]; sprintf(A,"%.1f",x); return std::string(A);};
 inline std::string FloatToString(float x) { char A[100]; sprintf(A,"%.4f",x); return std::string(A);};
@@ -44,6 +49,8 @@ int main(int argc, char** argv){
       "  --image_list   file    input image list\n"
       "  --image_root   file    input image dir\n"
       "  --max_per_image   file limit to max_per_image detections\n"
+      "  --evaluate     bool    report VOC/COCO AP of the detections\n"
+      "  --overlap      0.5     IoU threshold of the VOC AP\n"
       "  --out_file     file    output amswer file");
 
   // Run tool or show usage.
@@ -87,6 +94,7 @@ int main(int argc, char** argv){
   //#include <boost/timer/timer.hpp>
   //boost::timer::auto_cpu_timer t;//display time info in destructor
   caffe::CPUTimer timer;
+  caffe::Frcnn::DetectionEvaluator evaluator(FrcnnParam::n_classes);
   int count = 0;
   while ( data_load.load_WithDiff(infile) ) {
     std::string image = data_load.GetImagePath("");
@@ -138,8 +146,21 @@ int main(int argc, char** argv){
     }
     LOG(INFO) << "Handle " << ++count << " th image : " << image << ", with image_thresh : " << image_thresh << ", " 
         << ori_res_size << " -> " << results.size() << " boxes, detection use " << timer.MilliSeconds() << " ms";
+    if (FLAGS_evaluate) {
+      std::vector<std::vector<float> > rois = data_load.GetRois(true);
+      std::vector<caffe::Frcnn::BBox<float> > gts;
+      for (size_t i = 0; i < rois.size(); i++) {
+        gts.push_back(caffe::Frcnn::BBox<float>(rois[i][API::DataPrepare::X1],
+            rois[i][API::DataPrepare::Y1], rois[i][API::DataPrepare::X2],
+            rois[i][API::DataPrepare::Y2], 1, rois[i][API::DataPrepare::LABEL]));
+      }
+      evaluator.AddImage(gts, data_load.GetDiffs(), results);
+    }
   }
   infile.close();
   otfile.close();
+  if (FLAGS_evaluate) {
+    evaluator.Summarize(FLAGS_overlap);
+  }
   return 0;
 }
@@ -0,0 +1,132 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include "caffe/util/benchmark.hpp"
+#include "caffe/FRCNN/util/frcnn_utils.hpp"
+#include "api/api.hpp"
+
+DEFINE_string(gpu, "",
+    "Optional; run in GPU mode on the given device ID, Empty is CPU");
+DEFINE_string(model, "",
+    "The model definition protocol buffer text file.");
+DEFINE_string(weights, "",
+    "Trained Model By Faster RCNN End-to-End Pipeline.");
+DEFINE_string(default_c, "",
+    "Default config file path.");
+DEFINE_string(image, "",
+    "The image the synthetic sequence is cropped from.");
+DEFINE_int32(frames, 100,
+    "Optional; number of frames in the sequence.");
+DEFINE_int32(shift, 4,
+    "Optional; pixels the crop window pans per frame.");
+DEFINE_int32(keyframe_interval, 5,
+    "Optional; run the full RPN every keyframe_interval frames.");
+DEFINE_double(reuse_thresh, 0.5,
+    "Optional; detections fed back to the next frame.");
+DEFINE_int32(num_proposals, 50,
+    "Optional; proposals kept between keyframes, 0 for none.");
+DEFINE_double(thresh, 0.5,
+    "Optional; per-frame detections above thresh are the recall reference.");
+DEFINE_double(overlap, 0.5,
+    "Optional; IoU for a reference detection to be recalled.");
+
+// Frame t of a camera panning left and right over the image.
+static cv::Mat synthetic_frame(const cv::Mat &image, int t) {
+  const int range = std::min(image.cols / 4, FLAGS_shift * FLAGS_frames);
+  const int period = std::max(1, 2 * range);
+  int x = (t * FLAGS_shift) % period;
+  if (x > range) x = period - x;
+  return image(cv::Rect(x, 0, image.cols - range, image.rows)).clone();
+}
+
+int main(int argc, char** argv){
+  FLAGS_alsologtostderr = 1;
+  gflags::SetVersionString(AS_STRING(CAFFE_VERSION));
+  gflags::SetUsageMessage("Compare VideoDetector with per-frame detection\n"
+      "usage: video_bench_frcnn <args>\n\n"
+      "args:\n"
+      "  --gpu               7       use 7-th gpu device, default is cpu model\n"
+      "  --model             file    protocol buffer text file\n"
+      "  --weights           file    Trained Model\n"
+      "  --default_c         file    Default Config File\n"
+      "  --image             file    image the sequence is cropped from\n"
+      "  --frames            100     frames in the sequence\n"
+      "  --shift             4       pan in pixels per frame\n"
+      "  --keyframe_interval 5       full RPN every N frames\n"
+      "  --reuse_thresh      0.5     detections fed back to the next frame\n"
+      "  --num_proposals     50      proposals between keyframes\n"
+      "  --thresh            0.5     reference detection threshold\n"
+      "  --overlap           0.5     IoU to count a reference as recalled");
+  caffe::GlobalInit(&argc, &argv);
+  CHECK( FLAGS_gpu.size() == 0 || FLAGS_gpu.size() == 1 || (FLAGS_gpu.size()==2&&FLAGS_gpu=="-1")) << "Can only support one gpu or none or -1(for cpu)";
+  int gpu_id = -1;
+  if( FLAGS_gpu.size() > 0 )
+    gpu_id = boost::lexical_cast<int>(FLAGS_gpu);
+  if (gpu_id >= 0) {
+#ifndef CPU_ONLY
+    caffe::Caffe::SetDevice(gpu_id);
+    caffe::Caffe::set_mode(caffe::Caffe::GPU);
+#else
+    LOG(FATAL) << "CPU ONLY MODEL, BUT PROVIDE GPU ID";
+#endif
+  } else {
+    caffe::Caffe::set_mode(caffe::Caffe::CPU);
+  }
+  CHECK_GT(FLAGS_frames, 0);
+
+  std::string proto_file             = FLAGS_model.c_str();
+  std::string model_file             = FLAGS_weights.c_str();
+  std::string default_config_file    = FLAGS_default_c.c_str();
+
+  API::Set_Config(default_config_file);
+  API::Detector detector(proto_file, model_file);
+  API::VideoDetector video_detector(proto_file, detector);
+  video_detector.Set_Reuse(FLAGS_keyframe_interval, FLAGS_reuse_thresh, FLAGS_num_proposals);
+
+  cv::Mat image = cv::imread(FLAGS_image);
+  CHECK(image.data) << "Unable to read " << FLAGS_image;
+  std::vector<cv::Mat> frames;
+  for (int t = 0; t < FLAGS_frames; t++) {
+    frames.push_back(synthetic_frame(image, t));
+  }
+
+  // Warm up both, so neither pays for the first allocations.
+  std::vector<caffe::Frcnn::BBox<float> > results;
+  detector.predict(frames[0], results);
+  video_detector.predict(frames[0], results);
+  video_detector.reset();
+
+  caffe::Timer timer;
+  double frame_ms = 0, video_ms = 0;
+  int references = 0, recalled = 0;
+  std::vector<caffe::Frcnn::BBox<float> > reference;
+  for (int t = 0; t < FLAGS_frames; t++) {
+    timer.Start();
+    detector.predict(frames[t], reference);
+    frame_ms += timer.MilliSeconds();
+    timer.Start();
+    video_detector.predict(frames[t], results);
+    video_ms += timer.MilliSeconds();
+    for (size_t i = 0; i < reference.size(); i++) {
+      if (reference[i].confidence < FLAGS_thresh) continue;
+      references++;
+      for (size_t j = 0; j < results.size(); j++) {
+        if (results[j].id == reference[i].id
+            && caffe::Frcnn::get_iou(results[j], reference[i]) >= FLAGS_overlap) {
+          recalled++;
+          break;
+        }
+      }
+    }
+  }
+
+  LOG(INFO) << FLAGS_frames << " frames of " << frames[0].cols << " x " << frames[0].rows
+            << ", " << video_detector.keyframes() << " keyframes";
+  LOG(INFO) << "per-frame : " << FLAGS_frames * 1000. / frame_ms << " fps";
+  LOG(INFO) << "video     : " << FLAGS_frames * 1000. / video_ms << " fps, speedup "
+            << frame_ms / video_ms;
+  LOG(INFO) << "recall    : " << recalled << " / " << references << " = "
+            << (references > 0 ? float(recalled) / references : 1.f)
+            << " of the per-frame detections >= " << FLAGS_thresh;
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include <string>
 #include <boost/make_shared.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -24,21 +25,88 @@ using caffe::Frcnn::BBox;
 
 class Detector {
 public:
-  Detector(std::string &proto_file, std::string &model_file){
+  Detector(std::string &proto_file, std::string &model_file) : reload_ok_(false) {
     Set_Model(proto_file, model_file);
   }
-  void Set_Model(std::string &proto_file, std::string &model_file);
+  // The weights are shared with the other processes using shm_name, see
+  // Net::ShareTrainedLayersFromShm.
+  Detector(std::string &proto_file, std::string &model_file, const std::string &shm_name)
+    : reload_ok_(false) {
+    Set_Model(proto_file, model_file, shm_name);
+  }
+  // A replica with its own net (and blobs) sharing the trained weights of
+  // other, so that several images can be detected at once. Build it on the
+  // thread, mode and device it will predict with: in GPU mode the shared
+  // weights are copied to the device here, before any replica predicts.
+  Detector(std::string &proto_file, const Detector &other) : reload_ok_(false) {
+    Share_Model(proto_file, other);
+  }
+  void Set_Model(std::string &proto_file, std::string &model_file, const std::string &shm_name = "");
+  void Share_Model(std::string &proto_file, const Detector &other);
+  // Loads a new model on a background thread and returns at once. The new net
+  // runs a warm-up forward and is checked against FrcnnParam (the config stays
+  // the process-wide one). If it passes, the next predict swaps it in; the
+  // predictions in progress finish on the old net, which is freed with its last
+  // reference. A reload still loading is waited for first.
+  // Files that cannot be parsed, unknown layer types and weights that do not
+  // fit the net are rejected; the rest of the net is checked by Caffe as when
+  // the service starts. The weights must be a binary proto, and are loaded
+  // into this process only: a detector built with shm_name does not reload
+  // through shared memory, and the replicas of Share_Model keep the weights
+  // they were built with, reload each of them as well.
+  void Reload_Model(const std::string &proto_file, const std::string &model_file);
+  // Waits for the last Reload_Model, returns whether its model was accepted.
+  bool Wait_Reload();
   void predict(const cv::Mat &img_in, vector<BBox<float> > &results);
   void predict_original(const cv::Mat &img_in, vector<BBox<float> > &results);
   void predict_cascade(const cv::Mat &img_in, vector<vector<BBox<float> > > &results);
   void predict_iterative(const cv::Mat &img_in, vector<BBox<float> > &results);
-private:
+  // Detects overlapping tiles of FrcnnParam::test_tile_size one at a time,
+  // the memory use is bounded by the tile size instead of the image size.
+  void predict_tiled(const cv::Mat &img_in, vector<BBox<float> > &results);
+  // the underlying net, e.g. to observe the layers during calibration
+  boost::shared_ptr<Net<float> > Get_Net() const { return net_; }
+  virtual ~Detector();
+protected:
   void preprocess(const cv::Mat &img_in, const int blob_idx);
   void preprocess(const vector<float> &data, const int blob_idx);
-  vector<boost::shared_ptr<Blob<float> > > predict(const vector<std::string> blob_names);
+  // Runs the net on the input blobs, subclasses may run a part of it only.
+  virtual vector<boost::shared_ptr<Blob<float> > > predict(const vector<std::string> blob_names);
+  // Fills the input blobs with img_in at test_scales[scale_idx], returns the scale factor.
+  float prepare(const cv::Mat &img_in, int scale_idx);
+  // Appends the detections of the last forward, in the coordinates of an image
+  // of width x height placed at (offset_x, offset_y), to bboxes_by_class.
+  void decode(float scale_factor, int width, int height, int offset_x, int offset_y,
+      vector<vector<BBox<float> > > &bboxes_by_class);
+  // Per-class NMS (and box voting) of bboxes_by_class into results.
+  void nms(vector<vector<BBox<float> > > &bboxes_by_class, vector<BBox<float> > &results);
+  // Starts of the tiles along one side of length: every stride, the last one
+  // flush with the border. A side shorter than tile has a single, shorter tile.
+  static vector<int> tile_starts(int length, int tile, int stride);
+  // Highest foreground score among the rpn scores fed to the proposal layer.
+  float objectness() const;
+  // Swaps in the model of a finished Reload_Model, if any. Called when a
+  // predict starts, by the thread predicting.
+  void update_model();
   boost::shared_ptr<Net<float> > net_;
   float mean_[3];
   int roi_pool_layer;
+  // the layer producing the "rois" blob, -1 if none
+  int proposal_layer;
+  // decode's boxes of every roi and class, [rois, classes, 4]
+  vector<float> boxes_;
+private:
+  explicit Detector(const boost::shared_ptr<Net<float> > &net) : net_(net), reload_ok_(false) {
+    find_layers();
+  }
+  // Sets the mean and the layer indices from net_ and FrcnnParam.
+  void find_layers();
+  void load_model(std::string proto_file, std::string model_file,
+      caffe::Caffe::Brew mode, int device);
+  // Set by the reload thread, taken by update_model, both atomically.
+  boost::shared_ptr<Detector> next_;
+  boost::shared_ptr<boost::thread> reload_thread_;
+  bool reload_ok_;
 };
 
 }
@@ -0,0 +1,71 @@
+#include <vector>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/core/core.hpp>
+
+#include "api/FRCNN/frcnn_api.hpp"
+
+namespace caffe { namespace Frcnn { class ProposalCap; } }
+
+namespace FRCNN_API{
+
+/*************************************************
+VideoDetector detects the frames of one video stream in order. The RPN only
+runs in full on keyframes, every keyframe_interval frames. On the frames in
+between the detections of the previous frame (confidence >= reuse_thresh)
+are fed back as rois, together with the top num_proposals proposals of the
+current frame (0 skips the proposal layer).
+
+Only the work after the RPN convolutions shrinks. The backbone and the RPN
+convolutions run on every frame. With num_proposals > 0 the proposal layer
+runs as well: it still decodes and sorts every anchor, and only its NMS gets
+fewer candidates. The saving is the head, which sees num_proposals plus the
+tracked rois instead of test_rpn_post_nms_top_n. num_proposals = 0 also
+skips the proposal layer. video_bench_frcnn measures what this gives on a
+given net.
+
+The net needs a single test scale and a proposal layer whose first top is
+"rois"; FPN heads should pool with MultiLevelROIAlign, the per-level tops of
+FPNProposal do not see the fed back rois. The reduced proposal count (and
+pre-NMS count, in the same ratio) is a ProposalCap of this detector's
+proposal layer, FrcnnParam and the other detectors are left alone.
+
+  VideoDetector detector(proto_file, model_file);
+  detector.Set_Reuse(5, 0.5, 50);
+  for each frame: detector.predict(frame, results);
+  detector.reset();  // before the next video
+**************************************************/
+class VideoDetector : public Detector {
+public:
+  VideoDetector(std::string &proto_file, std::string &model_file)
+    : Detector(proto_file, model_file) {
+    Init();
+  }
+  VideoDetector(std::string &proto_file, const Detector &other)
+    : Detector(proto_file, other) {
+    Init();
+  }
+  void Set_Reuse(int keyframe_interval, float reuse_thresh, int num_proposals);
+  void predict(const cv::Mat &img_in, vector<BBox<float> > &results);
+  // Starts a new stream: the next frame is a keyframe.
+  void reset();
+  inline int keyframes() const { return keyframes_; }
+  inline int frames() const { return frames_; }
+protected:
+  virtual vector<boost::shared_ptr<Blob<float> > > predict(const vector<std::string> blob_names);
+private:
+  void Init();
+  // the proposal layer of net_, if it can be capped
+  caffe::Frcnn::ProposalCap* proposal_cap() const;
+  int keyframe_interval_;
+  float reuse_thresh_;
+  int num_proposals_;
+  // frames and keyframes since the last reset
+  int frames_;
+  int keyframes_;
+  int last_keyframe_;
+  // detections of the previous frame, in image coordinates
+  vector<BBox<float> > tracked_;
+};
+
+}
@@ -14,6 +14,7 @@
 #include "caffe/FRCNN/util/frcnn_helper.hpp"
 #include "api/FRCNN/frcnn_api.hpp"
 #include "api/FRCNN/rpn_api.hpp"
+#include "api/FRCNN/video_api.hpp"
 
 namespace API{
 
@@ -26,6 +27,7 @@ using caffe::Frcnn::BBox;
 using caffe::Frcnn::DataPrepare;
 using FRCNN_API::Detector;
 using FRCNN_API::Rpn_Det;
+using FRCNN_API::VideoDetector;
 
 inline void Set_Config(std::string default_config) {
   caffe::Frcnn::FrcnnParam::load_param(default_config);
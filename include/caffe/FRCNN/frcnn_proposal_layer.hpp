@@ -16,6 +16,28 @@ namespace caffe {
 
 namespace Frcnn {
 
+/*************************************************
+ProposalCap
+Caps the TEST proposals of one proposal layer below
+FrcnnParam::test_rpn_post_nms_top_n, the pre-NMS count in the same ratio,
+without touching the FrcnnParam shared by the other nets. The owner of
+the net sets it between forwards, e.g. VideoDetector on its non-keyframes.
+**************************************************/
+class ProposalCap {
+ public:
+  ProposalCap() : max_proposals_(0) {}
+  virtual ~ProposalCap();
+  // 0 lifts the cap.
+  void set_max_proposals(int max_proposals);
+  inline int max_proposals() const { return max_proposals_; }
+
+ protected:
+  void cap_top_n(int* pre_nms_top_n, int* post_nms_top_n) const;
+
+ private:
+  int max_proposals_;
+};
+
 /*************************************************
 FrcnnProposalLayer
 Outputs object detection proposals by applying estimated bounding-box
@@ -26,7 +48,7 @@ bottom: 'im_info'
 top: 'rpn_rois'
 **************************************************/
 template <typename Dtype>
-class FrcnnProposalLayer : public Layer<Dtype> {
+class FrcnnProposalLayer : public Layer<Dtype>, public ProposalCap {
  public:
   explicit FrcnnProposalLayer(const LayerParameter& param)
 #ifndef CPU_ONLY //fyk: fix problem of runtest
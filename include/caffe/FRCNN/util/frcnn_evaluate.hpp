@@ -0,0 +1,87 @@
+// ------------------------------------------------------------------
+// Detection evaluation: VOC (07 11-point and area) and COCO-style AP,
+// the same matching as examples/FRCNN/calculate_voc_ap.py
+// ------------------------------------------------------------------
+#ifndef CAFFE_FRCNN_EVALUATE_HPP_
+#define CAFFE_FRCNN_EVALUATE_HPP_
+
+#include <cfloat>
+#include <climits>
+#include <string>
+#include <vector>
+
+#include "caffe/FRCNN/util/frcnn_utils.hpp"
+
+namespace caffe {
+
+namespace Frcnn {
+
+/*************************************************
+DetectionEvaluator collects the ground truth and the detections of every test
+image, then computes the average precision of every class. Classes are
+evaluated in parallel; class 0 is the background and is skipped.
+
+Boxes are matched with get_iou, so areas follow the (x2 - x1 + 1) convention
+of the rest of FRCNN. A class without any (non difficult) ground truth gets an
+AP of -1 and is left out of MeanAP.
+
+  DetectionEvaluator evaluator(FrcnnParam::n_classes);
+  for each image: evaluator.AddImage(gts, difficult, detections);
+  evaluator.Summarize(0.5);
+**************************************************/
+class DetectionEvaluator {
+ public:
+  explicit DetectionEvaluator(int num_classes);
+
+  // gts[i].id is the label of ground truth i, difficult[i] its difficult flag
+  // and detections[j].id / .confidence the label and score of detection j.
+  void AddImage(const vector<BBox<float> > &gts, const vector<int> &difficult,
+      const vector<BBox<float> > &detections);
+
+  // VOC AP of every class at one IoU threshold. Difficult ground truth is
+  // neither a positive nor a false positive when matched.
+  vector<float> VocAP(float overlap, bool use_07_metric) const;
+  // COCO-style AP of every class: 101 point interpolated precision averaged
+  // over the IoU thresholds. Ground truth whose area is outside
+  // [min_area, max_area) is ignored like difficult ground truth, and so are
+  // unmatched detections outside the range. Only the max_detections best
+  // detections of a class in an image count (maxDets of pycocotools).
+  vector<float> CocoAP(const vector<float> &overlaps, float min_area = 0,
+      float max_area = FLT_MAX, int max_detections = 100) const;
+  // Logs the VOC 07 / area AP at overlap and the COCO AP@[.5:.95], AP50,
+  // AP75 and small / medium / large AP.
+  void Summarize(float overlap = 0.5) const;
+
+  static float MeanAP(const vector<float> &ap);
+  // IoU thresholds .50:.05:.95
+  static vector<float> CocoOverlaps();
+
+  inline int num_images() const { return num_images_; }
+  inline int num_classes() const { return num_classes_; }
+
+ private:
+  struct Detection {
+    float confidence;
+    int image;
+    Point4f<float> box;
+  };
+  static bool HigherConfidence(const Detection &a, const Detection &b);
+  // Detections of one class sorted by decreasing confidence, at most
+  // max_detections of them per image.
+  vector<Detection> SortedDetections(int cls,
+      int max_detections = INT_MAX) const;
+
+  int num_classes_;
+  int num_images_;
+  // [class][image] ground truth boxes and difficult flags
+  vector<vector<vector<Point4f<float> > > > gt_boxes_;
+  vector<vector<vector<bool> > > gt_difficult_;
+  // [class] detections in the order they were added
+  vector<vector<Detection> > detections_;
+};
+
+}  // namespace Frcnn
+
+}  // namespace caffe
+
+#endif  // CAFFE_FRCNN_EVALUATE_HPP_
@@ -53,6 +53,17 @@ public:
   static bool test_use_gpu_nms;
   static bool test_bbox_vote;
   static bool test_decrypt_model;
+  // fold BatchNorm/Scale/ReLU into the preceding Convolution (fold_inference_layers)
+  static bool test_fold_layers;
+  // tiled prediction of large images: overlapping tiles of test_tile_size
+  // pixels every test_tile_stride pixels (0: 3/4 of the tile), tiles whose
+  // max rpn objectness is below test_tile_objectness are skipped
+  static int test_tile_size;
+  static int test_tile_stride;
+  static float test_tile_objectness;
+  // keep the test_max_per_image most confident detections over all classes
+  // of an image, 0 keeps them all
+  static int test_max_per_image;
 
   // Train bounding-box regressors
   static bool bbox_reg;
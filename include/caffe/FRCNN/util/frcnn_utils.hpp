@@ -76,6 +76,11 @@ public:
     }
     return _rois;
   }
+  // Difficult flags, in the order of GetRois(true).
+  inline vector<int> GetDiffs() {
+    CHECK(this->ok) << "illegal status(ok=" << ok << ")";
+    return this->diff;
+  }
   inline bool load_WithDiff(std::ifstream &infile) {
     string hashtag;
     if(!(infile >> hashtag)) return ok=false;
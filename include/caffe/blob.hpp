@@ -263,6 +263,23 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Make this Blob's data a view of count() elements of other's data,
+   *        starting offset elements in: writes through either are seen by
+   *        both, with no copy.
+   *
+   * The view lasts until Reshape grows this Blob, or its data is shared or set
+   * again.
+   */
+  void ShareDataView(const Blob& other, const int offset);
+  /// @brief Make this Blob's diff a view of other's diff; see ShareDataView.
+  void ShareDiffView(const Blob& other, const int offset);
+  /// @brief Whether this Blob's data is a view of other's, offset elements in.
+  bool IsDataViewOf(const Blob& other, const int offset) const;
+  /// @brief Whether this Blob's diff is a view of other's, offset elements in.
+  bool IsDiffViewOf(const Blob& other, const int offset) const;
+  /// @brief Copy the data and diff that are views into memory of their own.
+  void ReleaseViews();
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -1,12 +1,15 @@
 #ifndef CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 #define CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 
+#include <stdint.h>
+#include <map>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/int8_gemm.hpp"
 
 namespace caffe {
 
@@ -35,6 +38,19 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
+  // Adds the (optional) bias and applies the fused ReLU in a single pass.
+  void forward_cpu_bias_relu(Dtype* output, const Dtype* bias);
+  // Masks the output gradient by the derivative of the fused ReLU, in place.
+  void backward_cpu_relu(const Dtype* output, Dtype* output_diff,
+      const int count);
+  // INT8 inference (quantization_param): forward_cpu_gemm_int8 replaces
+  // forward_cpu_gemm, with the weights Reshape quantized.
+  void forward_cpu_gemm_int8(const Dtype* input, Dtype* output);
+  // CPU engines (cpu_engine): Reshape picks the engine for the input shape
+  // and prepares the weights; forward_cpu_engine then replaces
+  // forward_cpu_gemm.
+  void forward_cpu_engine(const Dtype* input, const Dtype* weights,
+      Dtype* output);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
@@ -90,6 +106,14 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int weight_offset_;
   int num_output_;
   bool bias_term_;
+  /// @brief Whether a ReLU is applied to the output (fused_relu_param).
+  bool fused_relu_;
+  Dtype relu_negative_slope_;
+  /// @brief Whether the CPU forward pass runs in INT8 (quantization_param).
+  bool int8_;
+  Dtype int8_input_scale_;
+  /// @brief The CPU engine selected for the current input shape.
+  ConvolutionParameter_CPUEngine cpu_engine_;
   bool is_1x1_;
   bool force_nd_im2col_;
 
@@ -167,6 +191,33 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
+
+  // Quantizes the weights again if they changed since int8_weight_version_.
+  void quantize_weights_cpu();
+
+  /// @brief The int8 gemms of the groups, with their quantized weights.
+  vector<shared_ptr<Int8Gemm<Dtype> > > int8_gemm_;
+  uint64_t int8_weight_version_;
+
+  bool cpu_engine_applicable(const ConvolutionParameter_CPUEngine engine);
+  // Sets cpu_engine_, timing the candidates on the given image for AUTO in
+  // the TEST phase.
+  void select_cpu_engine(const Dtype* input, Dtype* output);
+  ConvolutionParameter_CPUEngine benchmark_cpu_engine(const Dtype* input,
+      Dtype* output);
+  // Shapes the workspaces of cpu_engine_ and transforms the weights again if
+  // they changed since winograd_weights_version_.
+  void prepare_cpu_engine();
+  int winograd_tile() const {
+    return cpu_engine_ == ConvolutionParameter_CPUEngine_WINOGRAD_2X2 ? 2 : 4;
+  }
+
+  /// @brief The engines AUTO picked, by output size up to a factor of 2.
+  std::map<int, ConvolutionParameter_CPUEngine> cpu_engine_by_size_;
+  Blob<Dtype> winograd_weights_;
+  uint64_t winograd_weights_version_;
+  Blob<Dtype> winograd_data_;
+  Blob<Dtype> winograd_output_;
 };
 
 }  // namespace caffe
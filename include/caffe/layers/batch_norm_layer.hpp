@@ -30,6 +30,11 @@ namespace caffe {
  * with `bias_term: true` after each `BatchNormLayer` to handle both the bias
  * and scaling factor.
  *
+ * With use_global_stats the layer is a per-channel affine map, computed in one
+ * pass over the data. For inference it can also apply the following Scale
+ * layer (scale_bias_term, with the scale and bias in blobs (3) and (4)) and
+ * ReLU (fused_relu_param); Net::FoldInferenceLayers sets both.
+ *
  * [1] S. Ioffe and C. Szegedy, "Batch Normalization: Accelerating Deep Network
  *     Training by Reducing Internal Covariate Shift." arXiv preprint
  *     arXiv:1502.03167 (2015).
@@ -60,8 +65,19 @@ class BatchNormLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// @brief Compute inference_scale_ and inference_shift_ from the blobs, on
+  /// the host; Forward_gpu computes them on the device.
+  void compute_inference_affine();
+
   Blob<Dtype> mean_, variance_, temp_, x_norm_;
+  // With use_global_stats the output is inference_scale_ * x +
+  // inference_shift_ per channel, followed by the fused ReLU; temp_ and
+  // x_norm_ are only used with the batch statistics.
+  Blob<Dtype> inference_scale_, inference_shift_;
   bool use_global_stats_;
+  bool scale_bias_term_;
+  bool fused_relu_;
+  Dtype relu_negative_slope_;
   Dtype moving_average_fraction_;
   int channels_;
   Dtype eps_;
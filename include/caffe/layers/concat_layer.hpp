@@ -27,6 +27,21 @@ class ConcatLayer : public Layer<Dtype> {
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  /**
+   * @brief Make each bottom a view of its slice of the top, so that the layers
+   *        producing the bottoms write straight into the top and neither
+   *        Forward nor Backward copies anything (see Net::ShareBlobViews).
+   *
+   * roots[i] is the blob bottom[i] takes its data from: bottom[i] itself, or
+   * the bottom of the Flatten and Reshape layers in between, which becomes a
+   * view too. Only possible if every axis before the concat axis is 1, so
+   * that each bottom is one contiguous range of the top; returns whether the
+   * views were made. If a shape changes later, Forward copies them back into
+   * memory of their own and the layer copies from then on.
+   */
+  bool ShareTopViews(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& roots, Blob<Dtype>* top);
+
  protected:
   /**
    * @param bottom input Blob vector (length 2+)
@@ -76,10 +91,17 @@ class ConcatLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// @brief Whether the views of ShareTopViews still hold; releases them if
+  ///        not.
+  bool CheckTopViews(const vector<Blob<Dtype>*>& bottom,
+      const Blob<Dtype>* top);
+
   int count_;
   int num_concats_;
   int concat_input_size_;
   int concat_axis_;
+  /// The roots given to ShareTopViews, empty once the views are released.
+  vector<Blob<Dtype>*> view_roots_;
 };
 
 }  // namespace caffe
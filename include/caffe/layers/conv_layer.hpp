@@ -58,6 +58,12 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  first group and input channels 3-4 and output channels 5-8 into the second
    *  group.
    *  - bias_term (\b optional, default true). Whether to have a bias.
+   *  - fused_relu_param (\b optional). If present, a ReLU is applied to the
+   *    output; set by Net::FoldInferenceLayers.
+   *  - quantization_param (\b optional, in LayerParameter). With precision
+   *    INT8, the CPU forward pass of the TEST phase runs an int8 gemm.
+   *  - cpu_engine (\b optional, default AUTO). The CPU forward pass: im2col +
+   *    gemm, direct or Winograd convolution, picked by timing them if AUTO.
    *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
    *    kernels + stream parallelism) engines.
    */
@@ -77,6 +83,13 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+#ifndef CPU_ONLY
+  // Apply the fused ReLU (fused_relu_param) to a whole top blob.
+  void forward_gpu_relu(Dtype* output, const int count);
+  void backward_gpu_relu(const Dtype* output, Dtype* output_diff,
+      const int count);
+#endif
 };
 
 }  // namespace caffe
@@ -1,11 +1,13 @@
 #ifndef CAFFE_INNER_PRODUCT_LAYER_HPP_
 #define CAFFE_INNER_PRODUCT_LAYER_HPP_
 
+#include <stdint.h>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/int8_gemm.hpp"
 
 namespace caffe {
 
@@ -45,6 +47,13 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  /// @brief Whether the CPU forward pass runs in INT8 (quantization_param).
+  bool int8_;
+  Dtype int8_input_scale_;
+  /// @brief The int8 gemm, with the weights quantized by Reshape when they
+  ///        changed since int8_weight_version_.
+  Int8Gemm<Dtype> int8_gemm_;
+  uint64_t int8_weight_version_;
 };
 
 }  // namespace caffe
@@ -53,6 +53,9 @@ class PoolingLayer : public Layer<Dtype> {
   bool global_pooling_;
   Blob<Dtype> rand_idx_;
   Blob<int> max_idx_;
+  // Whether max_idx_ holds the argmax of the last CPU forward pass, which
+  // skips it in the TEST phase.
+  bool max_idx_valid_;
 };
 
 }  // namespace caffe
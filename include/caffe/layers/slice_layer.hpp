@@ -19,7 +19,7 @@ template <typename Dtype>
 class SliceLayer : public Layer<Dtype> {
  public:
   explicit SliceLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), shares_views_(false) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -29,6 +29,17 @@ class SliceLayer : public Layer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
 
+  /**
+   * @brief Make each top a view of its slice of the bottom, so that neither
+   *        Forward nor Backward copies anything (see Net::ShareBlobViews).
+   *
+   * Only possible if every axis before the slice axis is 1, so that each top
+   * is one contiguous range of the bottom; returns whether the views were
+   * made. If a shape changes later, Forward copies them back into memory of
+   * their own and the layer copies from then on.
+   */
+  bool ShareBottomViews(Blob<Dtype>* bottom, const vector<Blob<Dtype>*>& top);
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -39,11 +50,18 @@ class SliceLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// @brief Whether the views of ShareBottomViews still hold; releases them
+  ///        if not.
+  bool CheckBottomViews(const Blob<Dtype>* bottom,
+      const vector<Blob<Dtype>*>& top);
+
   int count_;
   int num_slices_;
   int slice_size_;
   int slice_axis_;
   vector<int> slice_point_;
+  /// Whether the tops are views of the bottom (see ShareBottomViews).
+  bool shares_views_;
 };
 
 }  // namespace caffe
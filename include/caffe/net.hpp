@@ -11,6 +11,7 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/shared_memory.hpp"
 
 namespace caffe {
 
@@ -111,9 +112,37 @@ class Net {
    *        another Net.
    */
   void CopyTrainedLayersFrom(const NetParameter& param);
+  /**
+   * @brief Returns whether CopyTrainedLayersFrom(param) would load param,
+   *        i.e. its layers have the number and shapes of blobs of this net,
+   *        and describes the first mismatch in error otherwise.
+   */
+  bool CanCopyTrainedLayersFrom(const NetParameter& param,
+                                string* error) const;
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
   void CopyTrainedLayersFromHDF5(const string trained_filename);
+  /**
+   * @brief Like CopyTrainedLayersFrom, but the weights are shared between
+   *        processes through the POSIX shared memory segment shm_name.
+   *
+   * The first net to use shm_name loads trained_filename and publishes its
+   * (folded) parameter blobs there, later nets map them read-only instead of
+   * loading the file. The weights are identified by the device, inode, size
+   * and modification time of source_filename (trained_filename if empty), a
+   * stat rather than a read of the file: pass the file a temporary copy of
+   * the weights comes from as source_filename. A segment of another file is
+   * not attached to, the net loads trained_filename itself: publish new
+   * weights under a new name, or remove the segment first. If the publisher
+   * dies before the segment is complete, the next net publishes it.
+   *
+   * For TEST nets only. The mapped blobs are read-only: their mutable_*_data
+   * fail a CHECK, so the weights of such a net cannot be updated, folded or
+   * reloaded in place; build a new net for new weights.
+   */
+  void ShareTrainedLayersFromShm(const string trained_filename,
+                                 const string& shm_name,
+                                 const string& source_filename = "");
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
@@ -191,6 +220,8 @@ class Net {
     return param_names_index_;
   }
   inline const vector<int>& param_owners() const { return param_owners_; }
+  /// @brief The number of elements in the top blobs, counted by Init
+  inline size_t memory_used() const { return memory_used_; }
   inline const vector<string>& param_display_names() const {
     return param_display_names_;
   }
@@ -226,6 +257,20 @@ class Net {
   /// @brief return whether NetState state meets NetStateRule rule
   static bool StateMeetsRule(const NetState& state, const NetStateRule& rule,
       const string& layer_name);
+  /**
+   * @brief Remove the BatchNorm, Scale and ReLU layers that can be folded into
+   *        the Convolution feeding them (see fold_inference_layers).
+   *
+   * The rewritten Convolution takes over the top of the last folded layer,
+   * gains a bias term if BatchNorm or Scale were folded, and carries a
+   * fused_relu_param if a ReLU was folded. A BatchNorm left over folds the
+   * Scale and ReLU after it the same way, with scale_bias_term and
+   * fused_relu_param. The removed BatchNorm and Scale layers are returned in
+   * folded_layers, keyed by the name of the layer that absorbed them.
+   */
+  static void FoldInferenceLayers(const NetParameter& param,
+      NetParameter* param_folded,
+      map<string, vector<LayerParameter> >* folded_layers);
 
   // Invoked at specific points during an iteration
   class Callback {
@@ -266,6 +311,24 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /// @brief Allocate the parameters of the folded layers and fold them.
+  void InitFoldedParams();
+  /**
+   * @brief Fold the parameters of the layers absorbed by each of the given
+   *        Convolutions into its weights and bias, or by each BatchNorm into
+   *        its scale and bias. Their own parameters must have just been
+   *        (re)loaded.
+   */
+  void FoldParams(const set<string>& conv_names,
+      const set<string>& loaded_folded_layers);
+  /**
+   * @brief Let the Concat and Slice layers that can share memory with their
+   *        bottoms or tops (see ConcatLayer::ShareTopViews and
+   *        SliceLayer::ShareBottomViews) do so, unless a layer computes in
+   *        place on the shared memory.
+   */
+  void ShareBlobViews();
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -330,6 +393,13 @@ class Net {
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// BatchNorm/Scale layers folded away, keyed by the Convolution that
+  /// absorbed them (see FoldInferenceLayers).
+  map<string, vector<LayerParameter> > folded_layers_;
+  /// The parameters of the folded layers, keyed by layer name.
+  map<string, vector<shared_ptr<Blob<Dtype> > > > folded_params_;
+  /// The mapping the parameters point into, after ShareTrainedLayersFromShm.
+  shared_ptr<SharedMemorySegment> shared_weights_;
   // Callbacks
   vector<Callback*> before_forward_;
   vector<Callback*> after_forward_;
@@ -1,8 +1,6 @@
 #ifndef CAFFE_PARALLEL_HPP_
 #define CAFFE_PARALLEL_HPP_
 
-#ifdef USE_NCCL
-
 #include <boost/thread.hpp>
 
 #include <string>
@@ -16,7 +14,9 @@
 #include "caffe/solver.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#ifdef USE_NCCL
 #include "caffe/util/nccl.hpp"
+#endif
 
 namespace caffe {
 
@@ -48,6 +48,60 @@ class Params {
 DISABLE_COPY_AND_ASSIGN(Params);
 };
 
+// Params stored in host memory.
+template<typename Dtype>
+class CPUParams : public Params<Dtype> {
+ public:
+  explicit CPUParams(shared_ptr<Solver<Dtype> > root_solver);
+  virtual ~CPUParams();
+
+  void Configure(Solver<Dtype>* solver) const;
+
+ protected:
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
+/**
+ * Data parallel training on the CPU: N solver replicas run in threads of one
+ * process, each on its own shard of the data. Once every replica has its
+ * gradients, the replicas average them in shared memory: replica r sums the
+ * r-th slice of all the diff buffers and writes the mean back into each of
+ * them, so the slices are reduced in parallel and without locks. N replicas
+ * of batch B train like one solver with iter_size N.
+ */
+template<typename Dtype>
+class CPUSync : public CPUParams<Dtype>,
+                public Solver<Dtype>::Callback {
+ public:
+  explicit CPUSync(shared_ptr<Solver<Dtype> > solver);
+
+  /**
+   * Trains with count replicas, the calling thread runs solver. Caffe's
+   * solver_count must already be count when solver is created, so its data
+   * layers take their shard.
+   */
+  void Run(int count, const char* restore);
+
+  // A replica stopped early along with rank 0.
+  inline bool stopped() const { return stopped_; }
+
+ protected:
+  void on_start() {}
+  void on_gradients_ready();
+
+  shared_ptr<Solver<Dtype> > solver_;
+  boost::barrier* barrier_;
+  vector<CPUSync<Dtype>*>* syncs_;
+  bool stopped_;
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
+#ifdef USE_NCCL
+
 // Params stored in GPU memory.
 template<typename Dtype>
 class GPUParams : public Params<Dtype> {
@@ -117,7 +171,8 @@ class NCCL : public GPUParams<Dtype>,
   using Params<Dtype>::diff_;
 };
 
+#endif  // USE_NCCL
+
 }  // namespace caffe
 
-#endif  // USE_NCCL
 #endif  // header
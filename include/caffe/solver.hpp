@@ -1,5 +1,6 @@
 #ifndef CAFFE_SOLVER_HPP_
 #define CAFFE_SOLVER_HPP_
+#include <boost/atomic.hpp>
 #include <boost/function.hpp>
 #include <string>
 #include <vector>
@@ -7,6 +8,7 @@
 #include "caffe/net.hpp"
 #include "caffe/solver_factory.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/snapshot_writer.hpp"
 
 namespace caffe {
 
@@ -101,10 +103,13 @@ class Solver {
   string SnapshotFilename(const string extension);
   string SnapshotToBinaryProto();
   string SnapshotToHDF5();
+  void SnapshotAsync();
   // The test routine
   void TestAll();
   void Test(const int test_net_id = 0);
   virtual void SnapshotSolverState(const string& model_filename) = 0;
+  virtual void SnapshotSolverStateToProto(const string& model_filename,
+                                          SolverState* state) = 0;
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
   void DisplayOutputBlobs(const int net_id);
@@ -123,8 +128,15 @@ class Solver {
   // that it wants a snapshot saved and/or to exit early.
   ActionCallback action_request_function_;
 
-  // True if a request to stop early was received.
-  bool requested_early_exit_;
+  // True if a request to stop early was received. Atomic, the data parallel
+  // workers poll the flag of the root solver from their own threads.
+  boost::atomic<bool> requested_early_exit_;
+
+  // Background writer for async_snapshot, with the protos the next snapshot
+  // is copied into.
+  shared_ptr<SnapshotWriter> snapshot_writer_;
+  NetParameter snapshot_net_;
+  SolverState snapshot_state_;
 
   // Timing information, handy to tune e.g. nbr of GPUs
   Timer iteration_timer_;
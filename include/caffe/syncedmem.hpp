@@ -1,6 +1,7 @@
 #ifndef CAFFE_SYNCEDMEM_HPP_
 #define CAFFE_SYNCEDMEM_HPP_
 
+#include <stdint.h>
 #include <cstdlib>
 
 #ifdef USE_MKL
@@ -58,16 +59,46 @@ class SyncedMemory {
  public:
   SyncedMemory();
   explicit SyncedMemory(size_t size);
+  /**
+   * @brief A view of size bytes of parent, starting offset bytes in. It
+   *        allocates nothing: the bytes live in parent, which it keeps alive,
+   *        and move between host and device with the whole of parent.
+   *        Setting its data detaches it from parent.
+   */
+  SyncedMemory(const shared_ptr<SyncedMemory>& parent, size_t offset,
+      size_t size);
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
+  /**
+   * @brief Like set_cpu_data, for data this process must not write (e.g. a
+   *        read-only mapping): mutable_cpu_data and mutable_gpu_data fail a
+   *        CHECK until other data is set.
+   */
+  void set_read_only_cpu_data(const void* data);
   const void* gpu_data();
   void set_gpu_data(void* data);
   void* mutable_cpu_data();
   void* mutable_gpu_data();
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
-  SyncedHead head() { return head_; }
+  SyncedHead head() { return parent_ ? parent_->head() : head_; }
+  bool read_only() const {
+    return parent_ ? parent_->read_only() : read_only_;
+  }
   size_t size() { return size_; }
+  /**
+   * @brief A stamp that changes whenever the data may be written
+   *        (mutable_*_data, set_*_data) and is never shared by two memories,
+   *        so that what is computed from the data can tell when it is stale.
+   *        A view has the version of its parent.
+   */
+  uint64_t version() const {
+    return parent_ ? parent_->version() : version_;
+  }
+  bool is_view() const { return parent_.get() != NULL; }
+  bool is_view_of(const SyncedMemory* parent, size_t offset) const {
+    return parent_.get() == parent && offset_ == offset;
+  }
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -78,6 +109,7 @@ class SyncedMemory {
 
   void to_cpu();
   void to_gpu();
+  void bump_version();
   void* cpu_ptr_;
   void* gpu_ptr_;
   size_t size_;
@@ -85,7 +117,11 @@ class SyncedMemory {
   bool own_cpu_data_;
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
+  bool read_only_;
   int device_;
+  shared_ptr<SyncedMemory> parent_;
+  size_t offset_;
+  uint64_t version_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
@@ -0,0 +1,49 @@
+#ifndef CAFFE_UTIL_CPU_CONV_HPP_
+#define CAFFE_UTIL_CPU_CONV_HPP_
+
+namespace caffe {
+
+// CPU convolution kernels that do not materialize the im2col buffer. All of
+// them compute a single image and a single group, in NCHW layout, without the
+// bias: output (num_output x height_out x width_out) =
+// weights (num_output x channels x kernel_h x kernel_w) * data.
+
+// Direct convolution for any 2D kernel, stride, padding and dilation. Each
+// output row is accumulated for a block of 4 output channels at a time, so
+// every input value loaded is reused 4 times; the inner loop runs over the
+// output columns that do not touch the padding, so it has no bounds checks.
+template <typename Dtype>
+void direct_conv_cpu(const Dtype* data, const int channels,
+    const int height, const int width, const Dtype* weights,
+    const int num_output, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, Dtype* output,
+    const int height_out, const int width_out);
+
+// Winograd convolution F(tile x tile, 3 x 3) for 3x3 kernels with stride 1
+// and no dilation, with tile 2 or 4. The element-wise products of the
+// transformed tiles are summed over the channels by
+// (tile + 2)^2 gemms of num_output x channels x num_tiles.
+inline int winograd_num_tiles(const int tile, const int height_out,
+    const int width_out) {
+  return ((height_out + tile - 1) / tile) * ((width_out + tile - 1) / tile);
+}
+
+// Transforms weights (num_output x channels x 3 x 3) into
+// weights_t ((tile + 2)^2 x num_output x channels).
+template <typename Dtype>
+void winograd_transform_weights_cpu(const int tile, const Dtype* weights,
+    const int num_output, const int channels, Dtype* weights_t);
+
+// data_t and output_t are workspaces of (tile + 2)^2 x channels x num_tiles
+// and (tile + 2)^2 x num_output x num_tiles.
+template <typename Dtype>
+void winograd_conv_cpu(const int tile, const Dtype* data, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const Dtype* weights_t, const int num_output, Dtype* output,
+    const int height_out, const int width_out, Dtype* data_t,
+    Dtype* output_t);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CPU_CONV_HPP_
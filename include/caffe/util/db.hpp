@@ -19,6 +19,14 @@ class Cursor {
   virtual string key() = 0;
   virtual string value() = 0;
   virtual bool valid() = 0;
+  // Moves to the first item whose key is not less than key. Backends that
+  // cannot seek walk there from the first item.
+  virtual void Seek(const string& key) {
+    for (SeekToFirst(); valid() && this->key() < key; Next()) {}
+  }
+  // Points data at the current value without copying it, valid until the
+  // cursor moves. Returns false if the backend can not, use value() then.
+  virtual bool value_view(const char** data, size_t* size) { return false; }
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
 };
@@ -41,6 +49,15 @@ class DB {
   virtual void Close() = 0;
   virtual Cursor* NewCursor() = 0;
   virtual Transaction* NewTransaction() = 0;
+  // The number of items. Backends that keep no count walk a cursor over them.
+  virtual size_t Count() {
+    shared_ptr<Cursor> cursor(NewCursor());
+    size_t count = 0;
+    for (cursor->SeekToFirst(); cursor->valid(); cursor->Next()) {
+      ++count;
+    }
+    return count;
+  }
 
   DISABLE_COPY_AND_ASSIGN(DB);
 };
@@ -24,6 +24,13 @@ class LevelDBCursor : public Cursor {
   virtual string key() { return iter_->key().ToString(); }
   virtual string value() { return iter_->value().ToString(); }
   virtual bool valid() { return iter_->Valid(); }
+  virtual void Seek(const string& key) { iter_->Seek(key); }
+  virtual bool value_view(const char** data, size_t* size) {
+    const leveldb::Slice value = iter_->value();
+    *data = value.data();
+    *size = value.size();
+    return true;
+  }
 
  private:
   leveldb::Iterator* iter_;
@@ -0,0 +1,72 @@
+#ifndef CAFFE_UTIL_INT8_GEMM_HPP_
+#define CAFFE_UTIL_INT8_GEMM_HPP_
+
+#include <stdint.h>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The gemm of INT8 inference, output = weights * input, where the
+ *        weights (M x K) are quantized once, with one scale per row, and the
+ *        input (K x N) is quantized with the calibrated input scale by every
+ *        Forward. The outputs are dequantized with
+ *        1 / (input_scale * weight_scale) of their row.
+ *
+ * On CPUs with AVX512-VNNI (checked at run time) the products are int8 dot
+ * products with int32 accumulation: the weights are packed by blocks of 8
+ * rows and the input by blocks of 16 columns of 4 consecutive k, so that a
+ * vpdpbusd adds 4 products to each of 16 outputs. The input is offset by 128
+ * to be unsigned, which the row sums of the weights compensate. Elsewhere the
+ * quantized values are multiplied in floating point by caffe_cpu_gemm, with
+ * the same result, and INT8 is no faster than FP32.
+ */
+template <typename Dtype>
+class Int8Gemm {
+ public:
+  /// @brief With use_vnni false, the floating point fallback always runs.
+  explicit Int8Gemm(bool use_vnni = true);
+
+  /// @brief Whether the CPU has AVX512-VNNI and this build can use it.
+  static bool HasVnni();
+  bool use_vnni() const { return use_vnni_; }
+
+  /// @brief Quantizes and packs the weights (M x K).
+  void SetWeights(const int M, const int K, const Dtype* weights,
+      const Dtype input_scale);
+  /**
+   * @brief output (M x N) = weights * input (K x N). With trans, input is
+   *        N x K and output is N x M, as in InnerProduct.
+   */
+  void Forward(const int N, const Dtype* input, Dtype* output,
+      const bool trans = false);
+
+  /// @brief The quantization scales of the weight rows, 127 / max(|row|).
+  const vector<Dtype>& weight_scales() const { return weight_scales_; }
+  /// @brief The dequantization scales of the output rows.
+  const vector<Dtype>& output_scales() const { return output_scales_; }
+
+ private:
+  const bool use_vnni_;
+  int M_;
+  int K_;
+  Dtype input_scale_;
+  vector<Dtype> weight_scales_;
+  vector<Dtype> output_scales_;
+  // VNNI: the weights, M rounded up to 8 rows of K rounded up to 4 int8,
+  // 4 per int; 128 times the row sums; the packed input.
+  vector<int> weights_;
+  vector<int> weight_offsets_;
+  vector<uint8_t> input_;
+  // Fallback: the quantized weights and input, as Dtype.
+  vector<Dtype> weights_q_;
+  vector<Dtype> input_q_;
+
+  DISABLE_COPY_AND_ASSIGN(Int8Gemm);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_INT8_GEMM_HPP_
@@ -142,6 +142,32 @@ DEFINE_CAFFE_CPU_UNARY_FUNC(fabs, y[i] = std::fabs(x[i]))
 template <typename Dtype>
 void caffe_cpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+// Softmax over the channels of x, an outer_num x channels x inner_num array:
+// y = exp(x - max) / sum(exp(x - max)), with the max, exp, sum and
+// normalization done in one pass over each block of locations. y may be x.
+template <typename Dtype>
+void caffe_cpu_softmax(const int outer_num, const int channels,
+    const int inner_num, const Dtype* x, Dtype* y);
+
+// Element-wise sigmoid and tanh, through the vectorized exp of softmax when
+// it is available. y may not be x.
+template <typename Dtype>
+void caffe_cpu_sigmoid(const int n, const Dtype* x, Dtype* y);
+
+template <typename Dtype>
+void caffe_cpu_tanh(const int n, const Dtype* x, Dtype* y);
+
+// Symmetric int8 quantization: y = round(scale * x), saturated to [-127, 127].
+template <typename Dtype>
+void caffe_cpu_quantize(const int n, const Dtype scale, const Dtype* x,
+    int8_t* y);
+
+// Quantizes each row of the M x N matrix x with its own scale,
+// 127 / max(|x_row|), which is returned in scales.
+template <typename Dtype>
+void caffe_cpu_quantize_rows(const int M, const int N, const Dtype* x,
+    int8_t* y, Dtype* scales);
+
 #ifndef CPU_ONLY  // GPU
 
 // Decaf gpu gemm provides an interface that is almost the same as the cpu
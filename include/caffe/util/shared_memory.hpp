@@ -0,0 +1,56 @@
+#ifndef CAFFE_UTIL_SHARED_MEMORY_HPP_
+#define CAFFE_UTIL_SHARED_MEMORY_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A named POSIX shared memory segment mapped into this process.
+ *
+ * The segment outlives the processes that map it, until Remove is called
+ * (or /dev/shm/<name> is deleted). Create builds it as /dev/shm/<name>.new
+ * and Seal links it under name, so Open never sees it partly written.
+ */
+class SharedMemorySegment {
+ public:
+  /// Creates and maps the segment read-write, NULL if it already exists or
+  /// another process is creating it. The segment is in creation until Seal
+  /// is called or the mapping is destroyed, which the process dying does as
+  /// well; it is not published then.
+  static SharedMemorySegment* Create(const string& name, size_t size);
+  /// Maps a published segment read-only, NULL if there is none yet.
+  static SharedMemorySegment* Open(const string& name);
+  /// Whether a live process is creating the segment, so it is worth waiting
+  /// for.
+  static bool InCreation(const string& name);
+  /// Unlinks the segment; mappings stay valid until they are unmapped.
+  static bool Remove(const string& name);
+  ~SharedMemorySegment();
+
+  inline void* data() const { return data_; }
+  inline size_t size() const { return size_; }
+  /// Makes a mapping from Create read-only as well, publishes it under its
+  /// name and ends its creation. False if a segment was published under the
+  /// name meanwhile (after a Remove), this one stays unpublished then.
+  bool Seal();
+
+ private:
+  SharedMemorySegment(const string& name, void* data, size_t size,
+                      int lock_fd)
+      : name_(name), data_(data), size_(size), lock_fd_(lock_fd) {}
+
+  string name_;
+  void* data_;
+  size_t size_;
+  /// From Create, the descriptor holding the creation lock until Seal.
+  int lock_fd_;
+
+  DISABLE_COPY_AND_ASSIGN(SharedMemorySegment);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SHARED_MEMORY_HPP_
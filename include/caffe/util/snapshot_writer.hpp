@@ -0,0 +1,61 @@
+#ifndef CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
+#define CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * Writes binaryproto snapshots on a background thread, so training only pays
+ * for copying the weights into the protos. Each file is written to a temporary
+ * name, synced and renamed once complete, so an interrupted write or a crash
+ * never leaves a truncated snapshot behind. A snapshot that cannot be written
+ * (full disk, missing directory) is logged and dropped instead of stopping
+ * the training.
+ *
+ * One snapshot is written while the next one waits; if another arrives before
+ * the writer gets to it, the waiting one is skipped.
+ */
+class SnapshotWriter : public InternalThread {
+ public:
+  SnapshotWriter();
+  // Writes the pending snapshots before returning.
+  virtual ~SnapshotWriter();
+
+  /**
+   * Queues net_param and state for writing to the given files. The protos
+   * are swapped with the writer's buffers rather than copied, so on return
+   * they hold an older snapshot whose memory the caller can reuse.
+   */
+  void Write(NetParameter* net_param, const string& model_filename,
+             SolverState* state, const string& state_filename);
+
+  // Waits until every queued snapshot is on disk.
+  void Flush();
+
+ protected:
+  virtual void InternalThreadEntry();
+
+  // As in BlockingQueue, keeps boost/thread.hpp out of the header.
+  class sync;
+
+  shared_ptr<sync> sync_;
+  bool pending_;
+  bool writing_;
+  NetParameter pending_net_;
+  SolverState pending_state_;
+  string pending_model_filename_;
+  string pending_state_filename_;
+  NetParameter net_;
+  SolverState state_;
+
+DISABLE_COPY_AND_ASSIGN(SnapshotWriter);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
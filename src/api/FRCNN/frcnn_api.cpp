@@ -1,7 +1,13 @@
 #include "api/FRCNN/frcnn_api.hpp"
 #include "caffe/FRCNN/util/frcnn_gpu_nms.hpp"
 #include "api/util/blowfish.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+#include <unistd.h>
+#include <algorithm>
 #include <cstdio>
+#include <functional>
 
 namespace FRCNN_API{
 
@@ -32,7 +38,63 @@ void Detector::preprocess(const vector<float> &data, const int blob_idx) {
   std::memcpy(blob_data, &data[0], sizeof(float) * data.size());
 }
 
-void Detector::Set_Model(std::string &proto_file, std::string &model_file) {
+// BatchNorm/Scale/ReLU are folded into the convolutions when the net is built,
+// CopyTrainedLayersFrom then folds their trained parameters as well.
+static Net<float>* new_test_net(const std::string &proto_file) {
+  caffe::NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(proto_file, &param);
+  param.mutable_state()->set_phase(caffe::TEST);
+  param.set_fold_inference_layers(FrcnnParam::test_fold_layers);
+  return new Net<float>(param);
+}
+
+// Reads the test net and its weights as Set_Model does, but returns false with
+// the reason in error instead of dying, so that a reload can reject them.
+static bool read_test_net_params(const std::string &proto_file, const std::string &model_file,
+    caffe::NetParameter *param, caffe::NetParameter *weights, std::string *error) {
+  if (access(proto_file.c_str(), R_OK) != 0 || access(model_file.c_str(), R_OK) != 0) {
+    *error = "cannot read " + proto_file + " or " + model_file;
+    return false;
+  }
+  std::string files[2] = {proto_file, model_file};
+  if (FrcnnParam::test_decrypt_model) {
+    const char key[]  = {108, 111, 118, 101};
+    vector<char> v_key(key, key + sizeof(key)/sizeof(char));
+    Blowfish bf(v_key);
+    for (int i = 0; i < 2; i++) {
+      std::string tmp_file = bf.getRandomTmpFile();
+      bf.Decrypt(files[i].c_str(), tmp_file.c_str());
+      files[i] = tmp_file;
+    }
+  }
+  bool ok = true;
+  if (!caffe::ReadProtoFromTextFile(files[0], param)
+      || !caffe::UpgradeNetAsNeeded(files[0], param)) {
+    *error = "cannot parse the net " + proto_file;
+    ok = false;
+  } else if (!caffe::ReadProtoFromBinaryFile(files[1], weights)
+      || !caffe::UpgradeNetAsNeeded(files[1], weights)) {
+    *error = "cannot parse the weights " + model_file + " (HDF5 weights do not reload)";
+    ok = false;
+  }
+  if (FrcnnParam::test_decrypt_model) {
+    remove(files[0].c_str());
+    remove(files[1].c_str());
+  }
+  if (!ok) return false;
+  const vector<std::string> types = caffe::LayerRegistry<float>::LayerTypeList();
+  for (int i = 0; i < param->layer_size(); i++) {
+    if (std::find(types.begin(), types.end(), param->layer(i).type()) == types.end()) {
+      *error = "unknown layer type " + param->layer(i).type() + " in " + proto_file;
+      return false;
+    }
+  }
+  param->mutable_state()->set_phase(caffe::TEST);
+  param->set_fold_inference_layers(FrcnnParam::test_fold_layers);
+  return true;
+}
+
+void Detector::Set_Model(std::string &proto_file, std::string &model_file, const std::string &shm_name) {
   // decypt the model, the key is fixed here. maybe you can place it somewhere else.
   if (FrcnnParam::test_decrypt_model) {
     // the key is love
@@ -41,15 +103,27 @@ void Detector::Set_Model(std::string &proto_file, std::string &model_file) {
     Blowfish bf(v_key);
     std::string tmp_file = bf.getRandomTmpFile();
     bf.Decrypt(proto_file.c_str(), tmp_file.c_str());
-    net_.reset(new Net<float>(tmp_file, caffe::TEST));
+    net_.reset(new_test_net(tmp_file));
     bf.Decrypt(model_file.c_str(), tmp_file.c_str());
-    net_->CopyTrainedLayersFrom(tmp_file);
+    if (shm_name.empty()) {
+      net_->CopyTrainedLayersFrom(tmp_file);
+    } else {
+      net_->ShareTrainedLayersFromShm(tmp_file, shm_name, model_file);
+    }
     // rm the tmp file
     remove(tmp_file.c_str());
   } else {
-    net_.reset(new Net<float>(proto_file, caffe::TEST));
-    net_->CopyTrainedLayersFrom(model_file);
+    net_.reset(new_test_net(proto_file));
+    if (shm_name.empty()) {
+      net_->CopyTrainedLayersFrom(model_file);
+    } else {
+      net_->ShareTrainedLayersFromShm(model_file, shm_name);
+    }
   }
+  find_layers();
+}
+
+void Detector::find_layers() {
   mean_[0] = FrcnnParam::pixel_means[0];
   mean_[1] = FrcnnParam::pixel_means[1];
   mean_[2] = FrcnnParam::pixel_means[2];
@@ -63,12 +137,142 @@ void Detector::Set_Model(std::string &proto_file, std::string &model_file) {
       this->roi_pool_layer = i;
     }
   }
+  this->proposal_layer = -1;
+  if (this->net_->has_blob("rois")) {
+    const Blob<float>* rois = this->net_->blob_by_name("rois").get();
+    const vector<vector<Blob<float>*> >& top_vecs = this->net_->top_vecs();
+    for (size_t i = 0; i < top_vecs.size() && this->proposal_layer < 0; i++) {
+      if (!top_vecs[i].empty() && top_vecs[i][0] == rois) this->proposal_layer = i;
+    }
+  }
   // fyk: this var of roi_pool_layer is only used by predict_iterate,when I use 2 context roi_pool_layer or use R-FCN, I don't use predict_iterate
   //CHECK(this->roi_pool_layer >= 0 && this->roi_pool_layer < layer_names.size());
-  DLOG(INFO) << "SET MODEL DONE, ROI POOLING LAYER : " << layer_names[this->roi_pool_layer];
+  if (this->roi_pool_layer >= 0) DLOG(INFO) << "SET MODEL DONE, ROI POOLING LAYER : " << layer_names[this->roi_pool_layer];
   //caffe::Frcnn::FrcnnParam::print_param();
 }
 
+void Detector::Share_Model(std::string &proto_file, const Detector &other) {
+  if (FrcnnParam::test_decrypt_model) {
+    const char key[]  = {108, 111, 118, 101};
+    vector<char> v_key(key, key + sizeof(key)/sizeof(char));
+    Blowfish bf(v_key);
+    std::string tmp_file = bf.getRandomTmpFile();
+    bf.Decrypt(proto_file.c_str(), tmp_file.c_str());
+    net_.reset(new_test_net(tmp_file));
+    remove(tmp_file.c_str());
+  } else {
+    net_.reset(new_test_net(proto_file));
+  }
+  net_->ShareTrainedLayersWith(other.net_.get());
+  // The replicas may all predict at once: the shared weights are copied to
+  // the device here, not by each replica's first forward at the same time.
+  if (caffe::Caffe::mode() == caffe::Caffe::GPU) {
+    const vector<boost::shared_ptr<caffe::Layer<float> > >& layers = net_->layers();
+    for (size_t i = 0; i < layers.size(); i++) {
+      for (size_t j = 0; j < layers[i]->blobs().size(); j++) {
+        layers[i]->blobs()[j]->gpu_data();
+      }
+    }
+  }
+  std::memcpy(mean_, other.mean_, sizeof(mean_));
+  this->roi_pool_layer = other.roi_pool_layer;
+  this->proposal_layer = other.proposal_layer;
+}
+
+Detector::~Detector() {
+  Wait_Reload();
+}
+
+void Detector::Reload_Model(const std::string &proto_file, const std::string &model_file) {
+  Wait_Reload();
+  // Caffe's mode and device are per thread.
+  int device = 0;
+#ifndef CPU_ONLY
+  if (caffe::Caffe::mode() == caffe::Caffe::GPU) {
+    CUDA_CHECK(cudaGetDevice(&device));
+  }
+#endif
+  reload_thread_.reset(new boost::thread(&Detector::load_model, this,
+      proto_file, model_file, caffe::Caffe::mode(), device));
+}
+
+bool Detector::Wait_Reload() {
+  if (reload_thread_) {
+    reload_thread_->join();
+    reload_thread_.reset();
+  }
+  return reload_ok_;
+}
+
+void Detector::load_model(std::string proto_file, std::string model_file,
+    caffe::Caffe::Brew mode, int device) {
+  caffe::Caffe::set_mode(mode);
+  if (mode == caffe::Caffe::GPU) caffe::Caffe::SetDevice(device);
+  reload_ok_ = false;
+  // Set_Model dies on a file it cannot read or load, which would take the
+  // service down.
+  caffe::NetParameter param, weights;
+  std::string error;
+  if (!read_test_net_params(proto_file, model_file, &param, &weights, &error)) {
+    LOG(ERROR) << "Reload rejected, " << error;
+    return;
+  }
+  boost::shared_ptr<Net<float> > next_net(new Net<float>(param));
+  if (!next_net->CanCopyTrainedLayersFrom(weights, &error)) {
+    LOG(ERROR) << "Reload rejected, " << model_file << " does not fit " << proto_file
+        << ": " << error;
+    return;
+  }
+  next_net->CopyTrainedLayersFrom(weights);
+  boost::shared_ptr<Detector> next(new Detector(next_net));
+  const Net<float>& net = *next->net_;
+  const char* outputs[] = {"rois", "cls_prob", "bbox_pred"};
+  for (int i = 0; i < 3; i++) {
+    if (!net.has_blob(outputs[i])) {
+      LOG(ERROR) << "Reload rejected, " << model_file << " has no " << outputs[i] << " blob";
+      return;
+    }
+  }
+  if (net.input_blobs().size() < 2) {
+    LOG(ERROR) << "Reload rejected, " << proto_file << " should take the image and im_info";
+    return;
+  }
+  if (this->proposal_layer >= 0 && next->proposal_layer < 0) {
+    LOG(ERROR) << "Reload rejected, " << proto_file << " has no layer producing the rois";
+    return;
+  }
+  // The warm-up image is as large as the test images get, so the first
+  // predict does not grow the blobs either.
+  const cv::Mat warm_up(int(FrcnnParam::test_scales[0]), int(FrcnnParam::test_max_size),
+      CV_8UC3, cv::Scalar::all(0));
+  next->prepare(warm_up, 0);
+  vector<std::string> blob_names(outputs, outputs + 3);
+  next->predict(blob_names);
+  const Blob<float>* rois = net.blob_by_name("rois").get();
+  const Blob<float>* cls_prob = net.blob_by_name("cls_prob").get();
+  const Blob<float>* bbox_pred = net.blob_by_name("bbox_pred").get();
+  if (cls_prob->channels() != FrcnnParam::n_classes
+      || bbox_pred->channels() != 4 * FrcnnParam::n_classes
+      || cls_prob->num() != rois->num() || bbox_pred->num() != rois->num()) {
+    LOG(ERROR) << "Reload rejected, " << model_file << " gives rois " << rois->shape_string()
+        << ", cls_prob " << cls_prob->shape_string() << " and bbox_pred "
+        << bbox_pred->shape_string() << " for " << FrcnnParam::n_classes << " classes";
+    return;
+  }
+  boost::atomic_store(&next_, next);
+  reload_ok_ = true;
+  LOG(INFO) << "Reloaded " << model_file << ", swapped in by the next predict";
+}
+
+void Detector::update_model() {
+  boost::shared_ptr<Detector> next = boost::atomic_exchange(&next_, boost::shared_ptr<Detector>());
+  if (!next) return;
+  net_ = next->net_;
+  std::memcpy(mean_, next->mean_, sizeof(mean_));
+  this->roi_pool_layer = next->roi_pool_layer;
+  this->proposal_layer = next->proposal_layer;
+}
+
 vector<boost::shared_ptr<Blob<float> > > Detector::predict(const vector<std::string> blob_names) {
   DLOG(ERROR) << "FORWARD BEGIN";
   float loss;
@@ -82,21 +286,22 @@ vector<boost::shared_ptr<Blob<float> > > Detector::predict(const vector<std::str
 }
 
 void Detector::predict(const cv::Mat &img_in, std::vector<caffe::Frcnn::BBox<float> > &results) {
+  this->update_model();
   CHECK(FrcnnParam::iter_test == -1 || FrcnnParam::iter_test > 1) << "FrcnnParam::iter_test == -1 || FrcnnParam::iter_test > 1";
   if (FrcnnParam::iter_test == -1) {
-    predict_original(img_in, results);
+    if (FrcnnParam::test_tile_size > 0
+        && (img_in.cols > FrcnnParam::test_tile_size || img_in.rows > FrcnnParam::test_tile_size)) {
+      predict_tiled(img_in, results);
+    } else {
+      predict_original(img_in, results);
+    }
   } else {
     predict_iterative(img_in, results);
   }
 }
 
-void Detector::predict_original(const cv::Mat &img_in, std::vector<caffe::Frcnn::BBox<float> > &results) {
-
-  //CHECK(FrcnnParam::test_scales.size() == 1) << "Only single-image batch implemented";
-
-std::vector<std::vector<caffe::Frcnn::BBox<float> > > bboxes_by_class(caffe::Frcnn::FrcnnParam::n_classes);
-for (int test_scale_idx = 0; test_scale_idx < FrcnnParam::test_scales.size(); test_scale_idx++) {
-  float scale_factor = caffe::Frcnn::get_scale_factor(img_in.cols, img_in.rows, FrcnnParam::test_scales[test_scale_idx], FrcnnParam::test_max_size);
+float Detector::prepare(const cv::Mat &img_in, int scale_idx) {
+  float scale_factor = caffe::Frcnn::get_scale_factor(img_in.cols, img_in.rows, FrcnnParam::test_scales[scale_idx], FrcnnParam::test_max_size);
 
   cv::Mat img;
   const int height = img_in.rows;
@@ -139,171 +344,306 @@ for (int test_scale_idx = 0; test_scale_idx < FrcnnParam::test_scales.size(); te
   DLOG(ERROR) << "im_info : " << im_info[0] << ", " << im_info[1] << ", " << im_info[2];
   this->preprocess(img, 0);
   this->preprocess(im_info, 1);
+  return scale_factor;
+}
+
+void Detector::predict_original(const cv::Mat &img_in, std::vector<caffe::Frcnn::BBox<float> > &results) {
+  this->update_model();
+
+  //CHECK(FrcnnParam::test_scales.size() == 1) << "Only single-image batch implemented";
+
+std::vector<std::vector<caffe::Frcnn::BBox<float> > > bboxes_by_class(caffe::Frcnn::FrcnnParam::n_classes);
+for (int test_scale_idx = 0; test_scale_idx < FrcnnParam::test_scales.size(); test_scale_idx++) {
+  const float scale_factor = this->prepare(img_in, test_scale_idx);
 
   vector<std::string> blob_names(3);
   blob_names[0] = "rois";
   blob_names[1] = "cls_prob";
   blob_names[2] = "bbox_pred";
 
-  vector<boost::shared_ptr<Blob<float> > > output = this->predict(blob_names);
-  boost::shared_ptr<Blob<float> > rois(output[0]);
-  boost::shared_ptr<Blob<float> > cls_prob(output[1]);
-  boost::shared_ptr<Blob<float> > bbox_pred(output[2]);
+  this->predict(blob_names);
+  this->decode(scale_factor, img_in.cols, img_in.rows, 0, 0, bboxes_by_class);
+}//scales
+  this->nms(bboxes_by_class, results);
+}
+
+void Detector::decode(float scale_factor, int width, int height, int offset_x, int offset_y,
+    vector<vector<BBox<float> > > &bboxes_by_class) {
+  boost::shared_ptr<Blob<float> > rois = net_->blob_by_name("rois");
+  boost::shared_ptr<Blob<float> > cls_prob = net_->blob_by_name("cls_prob");
+  boost::shared_ptr<Blob<float> > bbox_pred = net_->blob_by_name("bbox_pred");
 
   const int box_num = bbox_pred->num();
   const int cls_num = cls_prob->channels();
   CHECK_EQ(cls_num , caffe::Frcnn::FrcnnParam::n_classes);
-  results.clear();
 
   static float zero_means[] = {0.0, 0.0, 0.0, 0.0};
   static float one_stds[] = {1.0, 1.0, 1.0, 1.0};
   static float* means = FrcnnParam::bbox_normalize_targets ? FrcnnParam::bbox_normalize_means : zero_means;
   static float* stds  = FrcnnParam::bbox_normalize_targets ? FrcnnParam::bbox_normalize_stds : one_stds;
-  for (int cls = 1; cls < cls_num; cls++) { 
-    vector<BBox<float> >& bbox = bboxes_by_class[cls];
-    for (int i = 0; i < box_num; i++) { 
-      float score = cls_prob->cpu_data()[i * cls_num + cls];
+  const float* roi_data = rois->cpu_data();
+  const float* scores = cls_prob->cpu_data();
+  const float* deltas = bbox_pred->cpu_data();
+  const float score_thresh = FrcnnParam::test_score_thresh;
+  // One pass over the rois decodes the boxes of all their classes into
+  // [box_num, cls_num, 4], then they are gathered class by class.
+  boxes_.resize(box_num * cls_num * 4);
+#pragma omp parallel for
+  for (int i = 0; i < box_num; i++) {
+    Point4f<float> roi(roi_data[(i * 5) + 1]/scale_factor,
+                       roi_data[(i * 5) + 2]/scale_factor,
+                       roi_data[(i * 5) + 3]/scale_factor,
+                       roi_data[(i * 5) + 4]/scale_factor);
+    for (int cls = 1; cls < cls_num; cls++) {
       // fyk: speed up
-      if (score < FrcnnParam::test_score_thresh) continue;
-
-      Point4f<float> roi(rois->cpu_data()[(i * 5) + 1]/scale_factor,
-                     rois->cpu_data()[(i * 5) + 2]/scale_factor,
-                     rois->cpu_data()[(i * 5) + 3]/scale_factor,
-                     rois->cpu_data()[(i * 5) + 4]/scale_factor);
-
-      Point4f<float> delta(bbox_pred->cpu_data()[(i * cls_num + cls) * 4 + 0] * stds[0] + means[0],
-                     bbox_pred->cpu_data()[(i * cls_num + cls) * 4 + 1] * stds[1] + means[1],
-                     bbox_pred->cpu_data()[(i * cls_num + cls) * 4 + 2] * stds[2] + means[2],
-                     bbox_pred->cpu_data()[(i * cls_num + cls) * 4 + 3] * stds[3] + means[3]);
+      if (scores[i * cls_num + cls] < score_thresh) continue;
+      const float* delta_data = deltas + (i * cls_num + cls) * 4;
+      Point4f<float> delta(delta_data[0] * stds[0] + means[0],
+                           delta_data[1] * stds[1] + means[1],
+                           delta_data[2] * stds[2] + means[2],
+                           delta_data[3] * stds[3] + means[3]);
 
       Point4f<float> box = caffe::Frcnn::bbox_transform_inv(roi, delta);
       //fyk clip predicted boxes to image
-      box[0] = std::max(0.0f, std::min(box[0], width - 1.f));
-      box[1] = std::max(0.0f, std::min(box[1], height - 1.f));
-      box[2] = std::max(0.0f, std::min(box[2], width - 1.f));
-      box[3] = std::max(0.0f, std::min(box[3], height - 1.f));
-
-      // BBox tmp(box, score, cls);
-      // LOG(ERROR) << "cls: " << tmp.id << " score: " << tmp.confidence;
-      // LOG(ERROR) << "roi: " << roi.to_string();
-      bbox.push_back(BBox<float>(box, score, cls));
+      float* out = &boxes_[(i * cls_num + cls) * 4];
+      out[0] = std::max(0.0f, std::min(box[0], width - 1.f)) + offset_x;
+      out[1] = std::max(0.0f, std::min(box[1], height - 1.f)) + offset_y;
+      out[2] = std::max(0.0f, std::min(box[2], width - 1.f)) + offset_x;
+      out[3] = std::max(0.0f, std::min(box[3], height - 1.f)) + offset_y;
     }
-  } //class
-}//scales
-  int cls_num = caffe::Frcnn::FrcnnParam::n_classes;
-  for (int cls = 1; cls < cls_num; cls++) { 
+  }
+  for (int cls = 1; cls < cls_num; cls++) {
     vector<BBox<float> >& bbox = bboxes_by_class[cls];
-    if (0 == bbox.size()) continue;
-    vector<BBox<float> > bbox_backup = bbox;
-    vector<BBox<float> > bbox_NMS;
-    
-    // Apply NMS
-    // fyk: GPU nms
-#ifndef CPU_ONLY
-    if (caffe::Caffe::mode() == caffe::Caffe::GPU && FrcnnParam::test_use_gpu_nms) {
-      int n_boxes = bbox.size();
-      int box_dim = 5;
-      // sort score if use naive nms
-      if (FrcnnParam::test_soft_nms == 0) {
-        sort(bbox.begin(), bbox.end());
-        box_dim = 4;
-      }
-      std::vector<float> boxes_host(n_boxes * box_dim);
-      for (int i=0; i < n_boxes; i++) {
-        for (int k=0; k < box_dim; k++)
-          boxes_host[i * box_dim + k] = bbox[i][k];
-      }
-      int keep_out[n_boxes];//keeped index of boxes_host
-      int num_out;//how many boxes are keeped
-      // call gpu nms, currently only support naive nms
-      _nms(&keep_out[0], &num_out, &boxes_host[0], n_boxes, box_dim, FrcnnParam::test_nms);
-      //if (FrcnnParam::test_soft_nms == 0) { // naive nms
-      //  _nms(&keep_out[0], &num_out, &boxes_host[0], n_boxes, box_dim, FrcnnParam::test_nms);
-      //} else {
-      //  _soft_nms(&keep_out[0], &num_out, &boxes_host[0], n_boxes, box_dim, FrcnnParam::test_nms, FrcnnParam::test_soft_nms);
-      //}
-      for (int i=0; i < num_out; i++) {
-        bbox_NMS.push_back(bbox[keep_out[i]]);
+    for (int i = 0; i < box_num; i++) {
+      const float score = scores[i * cls_num + cls];
+      if (score < score_thresh) continue;
+      const float* box = &boxes_[(i * cls_num + cls) * 4];
+      bbox.push_back(BBox<float>(box[0], box[1], box[2], box[3], score, cls));
+    }
+  } //class
+}
+
+vector<int> Detector::tile_starts(int length, int tile, int stride) {
+  vector<int> starts(1, 0);
+  while (starts.back() + tile < length) {
+    starts.push_back(std::min(starts.back() + stride, length - tile));
+  }
+  return starts;
+}
+
+float Detector::objectness() const {
+  // bottoms are (rpn_cls_prob_reshape, rpn_bbox_pred) of every level then im_info,
+  // the foreground scores are the second half of the channels.
+  const vector<Blob<float>*>& bottom = net_->bottom_vecs()[this->proposal_layer];
+  float best = 0;
+  for (size_t i = 0; i + 1 < bottom.size(); i += 2) {
+    const int count = bottom[i]->count() / 2;
+    const float* fg_scores = bottom[i]->cpu_data() + count;
+    best = std::max(best, *std::max_element(fg_scores, fg_scores + count));
+  }
+  return best;
+}
+
+void Detector::predict_tiled(const cv::Mat &img_in, std::vector<caffe::Frcnn::BBox<float> > &results) {
+  this->update_model();
+  const int tile = FrcnnParam::test_tile_size;
+  const int stride = FrcnnParam::test_tile_stride > 0 ? FrcnnParam::test_tile_stride : tile - tile / 4;
+  CHECK_GT(tile, 0) << "test_tile_size should be set";
+  CHECK(stride > 0 && stride <= tile) << "Tiles should overlap, stride : " << stride;
+  const bool skip = FrcnnParam::test_tile_objectness > 0;
+  CHECK(!skip || this->proposal_layer > 0) << "test_tile_objectness needs a proposal layer";
+  const vector<int> xs = tile_starts(img_in.cols, tile, stride);
+  const vector<int> ys = tile_starts(img_in.rows, tile, stride);
+
+  vector<std::string> blob_names(3);
+  blob_names[0] = "rois";
+  blob_names[1] = "cls_prob";
+  blob_names[2] = "bbox_pred";
+
+  // Boxes of all tiles in image coordinates, duplicates along the seams are
+  // merged by the per-class NMS (or box voting) as for the test scales.
+  std::vector<std::vector<caffe::Frcnn::BBox<float> > > bboxes_by_class(caffe::Frcnn::FrcnnParam::n_classes);
+  int skipped = 0;
+  for (size_t ty = 0; ty < ys.size(); ty++) {
+    for (size_t tx = 0; tx < xs.size(); tx++) {
+      const cv::Rect rect(xs[tx], ys[ty], std::min(tile, img_in.cols - xs[tx]),
+                          std::min(tile, img_in.rows - ys[ty]));
+      const cv::Mat patch = img_in(rect);
+      for (int test_scale_idx = 0; test_scale_idx < FrcnnParam::test_scales.size(); test_scale_idx++) {
+        const float scale_factor = this->prepare(patch, test_scale_idx);
+        if (skip) {
+          // The rpn is cheap next to the head, stop there on empty tiles.
+          net_->ForwardTo(this->proposal_layer - 1);
+          if (this->objectness() < FrcnnParam::test_tile_objectness) {
+            skipped++;
+            continue;
+          }
+          net_->ForwardFrom(this->proposal_layer);
+        } else {
+          this->predict(blob_names);
+        }
+        this->decode(scale_factor, rect.width, rect.height, rect.x, rect.y, bboxes_by_class);
       }
-    } else { // cpu
+    }
+  }
+  DLOG(INFO) << xs.size() * ys.size() << " tiles, " << skipped << " skipped";
+  this->nms(bboxes_by_class, results);
+}
+
+// NMS (and box voting) of the boxes of one class.
+static vector<BBox<float> > class_nms(vector<BBox<float> > &bbox, bool use_gpu_nms) {
+  vector<BBox<float> > bbox_NMS;
+  if (0 == bbox.size()) return bbox_NMS;
+  vector<BBox<float> > bbox_backup = bbox;
+  
+  // Apply NMS
+  // fyk: GPU nms
+#ifndef CPU_ONLY
+  if (use_gpu_nms) {
+    int n_boxes = bbox.size();
+    int box_dim = 5;
+    // sort score if use naive nms
+    if (FrcnnParam::test_soft_nms == 0) {
+      sort(bbox.begin(), bbox.end());
+      box_dim = 4;
+    }
+    std::vector<float> boxes_host(n_boxes * box_dim);
+    for (int i=0; i < n_boxes; i++) {
+      for (int k=0; k < box_dim; k++)
+        boxes_host[i * box_dim + k] = bbox[i][k];
+    }
+    int keep_out[n_boxes];//keeped index of boxes_host
+    int num_out;//how many boxes are keeped
+    // call gpu nms, currently only support naive nms
+    _nms(&keep_out[0], &num_out, &boxes_host[0], n_boxes, box_dim, FrcnnParam::test_nms);
+    //if (FrcnnParam::test_soft_nms == 0) { // naive nms
+    //  _nms(&keep_out[0], &num_out, &boxes_host[0], n_boxes, box_dim, FrcnnParam::test_nms);
+    //} else {
+    //  _soft_nms(&keep_out[0], &num_out, &boxes_host[0], n_boxes, box_dim, FrcnnParam::test_nms, FrcnnParam::test_soft_nms);
+    //}
+    for (int i=0; i < num_out; i++) {
+      bbox_NMS.push_back(bbox[keep_out[i]]);
+    }
+  } else { // cpu
 #endif
-      if (FrcnnParam::test_soft_nms == 0) { // naive nms
-        sort(bbox.begin(), bbox.end());
-        vector<bool> select(bbox.size(), true);
-        for (int i = 0; i < bbox.size(); i++)
-          if (select[i]) {
-            //if (bbox[i].confidence < FrcnnParam::test_score_thresh) break;
-            for (int j = i + 1; j < bbox.size(); j++) {
-              if (select[j]) {
-                if (get_iou(bbox[i], bbox[j]) > FrcnnParam::test_nms) {
-                  select[j] = false;
-                }
+    if (FrcnnParam::test_soft_nms == 0) { // naive nms
+      sort(bbox.begin(), bbox.end());
+      vector<bool> select(bbox.size(), true);
+      for (int i = 0; i < bbox.size(); i++)
+        if (select[i]) {
+          //if (bbox[i].confidence < FrcnnParam::test_score_thresh) break;
+          for (int j = i + 1; j < bbox.size(); j++) {
+            if (select[j]) {
+              if (get_iou(bbox[i], bbox[j]) > FrcnnParam::test_nms) {
+                select[j] = false;
               }
             }
-            bbox_NMS.push_back(bbox[i]);
           }
-      } else {
-        // soft-nms
-        float sigma = 0.5;
-        float score_thresh = 0.001;
-        int N = bbox.size();
-        for (int cur_box_idx = 0; cur_box_idx < N; cur_box_idx++) {
-          // find max score box
-          float maxscore = bbox[cur_box_idx].confidence;
-          int maxpos = cur_box_idx;
-          for (int i = cur_box_idx + 1; i < N; i++) {
-            if (maxscore < bbox[i].confidence) {
-              maxscore = bbox[i].confidence;
-              maxpos = i;
-            }
-          }
-          //swap
-          BBox<float> tt = bbox[cur_box_idx];
-          bbox[cur_box_idx] = bbox[maxpos];
-          bbox[maxpos] = tt;
-
-          for (int i = cur_box_idx + 1; i < N; i++) {
-            float iou = get_iou(bbox[i], bbox[cur_box_idx]);
-            float weight = 1;
-            if (1 == FrcnnParam::test_soft_nms) { // linear
-              if (iou > FrcnnParam::test_nms) weight = 1 - iou;
-            } else if (2 == FrcnnParam::test_soft_nms) { // gaussian
-              weight = exp(- (iou * iou) / sigma);
-            } else { // original NMS
-              if (iou > FrcnnParam::test_nms) weight = 0;
-            }
-            bbox[i].confidence *= weight;
-            if (bbox[i].confidence < score_thresh) {
-              // discard the box by swapping with last box
-              tt = bbox[i];
-              bbox[i] = bbox[N-1];
-              bbox[N-1] = tt;
-              N -= 1;
-              i -= 1;
-            }
+          bbox_NMS.push_back(bbox[i]);
+        }
+    } else {
+      // soft-nms
+      float sigma = 0.5;
+      float score_thresh = 0.001;
+      int N = bbox.size();
+      for (int cur_box_idx = 0; cur_box_idx < N; cur_box_idx++) {
+        // find max score box
+        float maxscore = bbox[cur_box_idx].confidence;
+        int maxpos = cur_box_idx;
+        for (int i = cur_box_idx + 1; i < N; i++) {
+          if (maxscore < bbox[i].confidence) {
+            maxscore = bbox[i].confidence;
+            maxpos = i;
           }
         }
-        for (int i=0; i < N; i++) {
-          if (bbox[i].confidence >= FrcnnParam::test_score_thresh)
-            bbox_NMS.push_back(bbox[i]);
+        //swap
+        BBox<float> tt = bbox[cur_box_idx];
+        bbox[cur_box_idx] = bbox[maxpos];
+        bbox[maxpos] = tt;
+
+        for (int i = cur_box_idx + 1; i < N; i++) {
+          float iou = get_iou(bbox[i], bbox[cur_box_idx]);
+          float weight = 1;
+          if (1 == FrcnnParam::test_soft_nms) { // linear
+            if (iou > FrcnnParam::test_nms) weight = 1 - iou;
+          } else if (2 == FrcnnParam::test_soft_nms) { // gaussian
+            weight = exp(- (iou * iou) / sigma);
+          } else { // original NMS
+            if (iou > FrcnnParam::test_nms) weight = 0;
+          }
+          bbox[i].confidence *= weight;
+          if (bbox[i].confidence < score_thresh) {
+            // discard the box by swapping with last box
+            tt = bbox[i];
+            bbox[i] = bbox[N-1];
+            bbox[N-1] = tt;
+            N -= 1;
+            i -= 1;
+          }
         }
-      } //nms type switch
+      }
+      for (int i=0; i < N; i++) {
+        if (bbox[i].confidence >= FrcnnParam::test_score_thresh)
+          bbox_NMS.push_back(bbox[i]);
+      }
+    } //nms type switch
 #ifndef CPU_ONLY
-    } //cpu
+  } //cpu
 #endif
-    // box-voting
-    if (FrcnnParam::test_bbox_vote) {
-      // since soft nms will change score of bbox, we use backup
-      bbox_NMS = bbox_vote(bbox_NMS, bbox_backup);
-      //bbox_NMS = bbox_vote(bbox_NMS, bbox_NMS);
-    }
+  // box-voting
+  if (FrcnnParam::test_bbox_vote) {
+    // since soft nms will change score of bbox, we use backup
+    bbox_NMS = bbox_vote(bbox_NMS, bbox_backup);
+    //bbox_NMS = bbox_vote(bbox_NMS, bbox_NMS);
+  }
+
+  return bbox_NMS;
+}
 
-    results.insert(results.end(), bbox_NMS.begin(), bbox_NMS.end());
+void Detector::nms(vector<vector<BBox<float> > > &bboxes_by_class, vector<BBox<float> > &results) {
+  int cls_num = caffe::Frcnn::FrcnnParam::n_classes;
+  // Caffe's mode is per thread, the OpenMP threads would all see CPU. The
+  // GPU NMS stays on this thread, the CPU one runs the classes in parallel.
+  bool use_gpu_nms = false;
+#ifndef CPU_ONLY
+  use_gpu_nms = caffe::Caffe::mode() == caffe::Caffe::GPU && FrcnnParam::test_use_gpu_nms;
+#endif
+  vector<vector<BBox<float> > > kept(cls_num);
+#pragma omp parallel for schedule(dynamic) if (!use_gpu_nms)
+  for (int cls = 1; cls < cls_num; cls++) {
+    kept[cls] = class_nms(bboxes_by_class[cls], use_gpu_nms);
+  }
+  results.clear();
+  for (int cls = 1; cls < cls_num; cls++) {
+    results.insert(results.end(), kept[cls].begin(), kept[cls].end());
   }
 
+  // Keeps the test_max_per_image most confident boxes over all classes, in
+  // the same order; of the boxes tied at the threshold, the first ones.
+  const int max_per_image = FrcnnParam::test_max_per_image;
+  if (max_per_image > 0 && results.size() > size_t(max_per_image)) {
+    vector<float> scores(results.size());
+    for (size_t i = 0; i < results.size(); i++) scores[i] = results[i].confidence;
+    std::nth_element(scores.begin(), scores.begin() + max_per_image - 1, scores.end(),
+                     std::greater<float>());
+    const float image_thresh = scores[max_per_image - 1];
+    int ties = max_per_image;
+    for (int i = 0; i < max_per_image; i++) {
+      if (scores[i] > image_thresh) ties--;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+      if (results[i].confidence > image_thresh
+          || (results[i].confidence == image_thresh && ties-- > 0)) {
+        results[n++] = results[i];
+      }
+    }
+    results.resize(n);
+  }
 }
 
 void Detector::predict_iterative(const cv::Mat &img_in, std::vector<caffe::Frcnn::BBox<float> > &results) {
+  this->update_model();
 
   CHECK(FrcnnParam::test_scales.size() == 1) << "Only single-image batch implemented";
   CHECK(FrcnnParam::iter_test >= 1) << "iter_test should greater and queal than 1";
@@ -6,6 +6,7 @@ namespace FRCNN_API{
 using namespace caffe::Frcnn;
 
 void Detector::predict_cascade(const cv::Mat &img_in, std::vector<std::vector<caffe::Frcnn::BBox<float> > > &results) {
+  this->update_model();
 
   CHECK(FrcnnParam::test_scales.size() == 1) << "Only single-image batch implemented";
 
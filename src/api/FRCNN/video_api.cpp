@@ -0,0 +1,95 @@
+#include "api/FRCNN/video_api.hpp"
+#include "caffe/FRCNN/frcnn_proposal_layer.hpp"
+#include <algorithm>
+
+namespace FRCNN_API{
+
+using namespace caffe::Frcnn;
+
+void VideoDetector::Init() {
+  CHECK_GE(proposal_layer, 0) << "No layer produces the rois";
+  DLOG(INFO) << "PROPOSAL LAYER : " << net_->layer_names()[proposal_layer];
+  LOG_IF(WARNING, !proposal_cap()) << net_->layer_names()[proposal_layer]
+      << " cannot cap its proposals, non-keyframes get all of them";
+  Set_Reuse(5, 0.5, 50);
+  reset();
+}
+
+void VideoDetector::Set_Reuse(int keyframe_interval, float reuse_thresh, int num_proposals) {
+  CHECK_GE(keyframe_interval, 1);
+  CHECK_GE(num_proposals, 0);
+  keyframe_interval_ = keyframe_interval;
+  reuse_thresh_ = reuse_thresh;
+  num_proposals_ = num_proposals;
+}
+
+caffe::Frcnn::ProposalCap* VideoDetector::proposal_cap() const {
+  return dynamic_cast<caffe::Frcnn::ProposalCap*>(net_->layers()[proposal_layer].get());
+}
+
+void VideoDetector::reset() {
+  frames_ = 0;
+  keyframes_ = 0;
+  last_keyframe_ = 0;
+  tracked_.clear();
+}
+
+void VideoDetector::predict(const cv::Mat &img_in, vector<BBox<float> > &results) {
+  CHECK_EQ(FrcnnParam::test_scales.size(), 1) << "VideoDetector needs a single test scale";
+  CHECK_EQ(FrcnnParam::iter_test, -1) << "VideoDetector does not support iter_test";
+  this->predict_original(img_in, results);
+  tracked_.clear();
+  for (size_t i = 0; i < results.size(); i++) {
+    if (results[i].confidence >= reuse_thresh_) tracked_.push_back(results[i]);
+  }
+  frames_++;
+}
+
+vector<boost::shared_ptr<Blob<float> > > VideoDetector::predict(const vector<std::string> blob_names) {
+  // Without proposals the tracked boxes are the only rois, so a frame without
+  // any falls back to a keyframe.
+  if (keyframes_ == 0 || frames_ - last_keyframe_ >= keyframe_interval_
+      || (tracked_.empty() && num_proposals_ == 0)) {
+    keyframes_++;
+    last_keyframe_ = frames_;
+    // The net may be a reloaded one, the cap is set before every forward.
+    caffe::Frcnn::ProposalCap* cap = proposal_cap();
+    if (cap) cap->set_max_proposals(0);
+    return Detector::predict(blob_names);
+  }
+  DLOG(ERROR) << "FORWARD BEGIN, " << tracked_.size() << " tracked rois";
+  if (num_proposals_ > 0) {
+    caffe::Frcnn::ProposalCap* cap = proposal_cap();
+    if (cap) cap->set_max_proposals(num_proposals_);
+    net_->ForwardTo(proposal_layer);
+  } else if (proposal_layer > 0) {
+    net_->ForwardTo(proposal_layer - 1);
+  }
+
+  // Append the tracked boxes, scaled and clipped like the proposals.
+  Blob<float>* rois = net_->blob_by_name("rois").get();
+  const float* im_info = net_->input_blobs()[1]->cpu_data();
+  const float bounds[4] = {im_info[1] - 1, im_info[0] - 1, im_info[1] - 1, im_info[0] - 1};
+  const float scale_factor = im_info[2];
+  const int num_proposals = num_proposals_ > 0 ? rois->num() : 0;
+  vector<float> roi_data(rois->cpu_data(), rois->cpu_data() + num_proposals * 5);
+  for (size_t i = 0; i < tracked_.size(); i++) {
+    roi_data.push_back(0);
+    for (int j = 0; j < 4; j++) {
+      roi_data.push_back(std::max(0.f, std::min(tracked_[i][j] * scale_factor, bounds[j])));
+    }
+  }
+  CHECK_GT(roi_data.size(), 0) << "No rois to detect";
+  rois->Reshape(roi_data.size() / 5, 5, 1, 1);
+  std::copy(roi_data.begin(), roi_data.end(), rois->mutable_cpu_data());
+
+  net_->ForwardFrom(proposal_layer + 1);
+  vector<boost::shared_ptr<Blob<float> > > output;
+  for (size_t i = 0; i < blob_names.size(); ++i) {
+    output.push_back(this->net_->blob_by_name(blob_names[i]));
+  }
+  DLOG(ERROR) << "FORWARD END, " << rois->num() << " rois";
+  return output;
+}
+
+} // FRCNN_API
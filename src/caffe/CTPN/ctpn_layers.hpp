@@ -65,6 +65,7 @@ class LstmLayer : public Layer<Dtype> {
   // intermediate values
   Blob<Dtype> h_to_gate_;
   Blob<Dtype> h_to_h_;
+  Blob<Dtype> weight_h_t_; // hidden-to-hidden weights packed as H x 4H
 };
 
 template <typename Dtype>
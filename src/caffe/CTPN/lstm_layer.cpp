@@ -10,11 +10,6 @@
 
 namespace caffe {
 
-template <typename Dtype>
-inline Dtype sigmoid(Dtype x) {
-  return 1. / (1. + exp(-x));
-}
-
 template <typename Dtype>
 void caffe_bound(const int N, const Dtype* a, const Dtype min, 
     const Dtype max, Dtype* y) {
@@ -23,6 +18,36 @@ void caffe_bound(const int N, const Dtype* a, const Dtype min,
   }
 }
 
+// One time step of one sequence: adds the recurrent contribution to the
+// pre-activations, applies sigmoid to the i, f, o gates and tanh to g, and
+// updates the cell and the hidden state.
+template <typename Dtype>
+void lstm_gates_cpu(const int H, const bool cont, const Dtype* h_to_gate,
+    const Dtype* c_prev, Dtype* pre_gate, Dtype* gate, Dtype* c, Dtype* h) {
+  if (cont) {
+    for (int d = 0; d < 4*H; ++d) {
+      pre_gate[d] += h_to_gate[d];
+    }
+  }
+  caffe_cpu_sigmoid(3*H, pre_gate, gate);
+  caffe_cpu_tanh(H, pre_gate + 3*H, gate + 3*H);
+  if (!cont) {
+    caffe_set(H, Dtype(0.), gate + H);
+  }
+  const Dtype* i = gate;
+  const Dtype* f = gate + H;
+  const Dtype* o = gate + 2*H;
+  const Dtype* g = gate + 3*H;
+  for (int d = 0; d < H; ++d) {
+    // Compute cell : c(t) = f(t)*c(t-1) + i(t)*g(t)
+    c[d] = f[d] * c_prev[d] + i[d] * g[d];
+  }
+  caffe_cpu_tanh(H, c, h);
+  for (int d = 0; d < H; ++d) {
+    h[d] *= o[d];
+  }
+}
+
 template <typename Dtype>
 void LstmLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -90,6 +115,11 @@ void LstmLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   h_T_.Reshape(cell_shape);
   h_to_h_.Reshape(cell_shape);
 
+  vector<int> weight_h_t_shape;
+  weight_h_t_shape.push_back(H_);
+  weight_h_t_shape.push_back(4*H_);
+  weight_h_t_.Reshape(weight_h_t_shape);
+
   vector<int> gate_shape;
   gate_shape.push_back(N_);
   gate_shape.push_back(4);
@@ -156,44 +186,37 @@ void LstmLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   caffe_cpu_gemm(CblasNoTrans, CblasNoTrans, T_*N_, 4*H_, 1, Dtype(1.),
       bias_multiplier_.cpu_data(), bias, Dtype(1.), pre_gate_data);
 
+  // Pack the hidden-to-hidden weights as H x 4H once, so that every time
+  // step runs a plain NoTrans gemm over contiguous rows
+  Dtype* weight_h_t = weight_h_t_.mutable_cpu_data();
+  for (int g = 0; g < 4*H_; ++g) {
+    for (int d = 0; d < H_; ++d) {
+      weight_h_t[d*4*H_ + g] = weight_h[g*H_ + d];
+    }
+  }
+
   // Compute recurrent forward propagation
   for (int t = 0; t < T_; ++t) {
     Dtype* h_t = top_data + top_.offset(t);
     Dtype* c_t = cell_data + cell_.offset(t);
     Dtype* pre_gate_t = pre_gate_data + pre_gate_.offset(t);
     Dtype* gate_t = gate_data + gate_.offset(t);
-    Dtype* h_to_gate_t = h_to_gate;
     const Dtype* clip_t = clip ? clip + bottom[1]->offset(t) : NULL;
     const Dtype* h_t_1 = t > 0 ? (h_t - top_.offset(1)) : h_0_.cpu_data();
     const Dtype* c_t_1 = t > 0 ? (c_t - cell_.offset(1)) : c_0_.cpu_data();
 
     // Hidden-to-hidden propagation
-    caffe_cpu_gemm(CblasNoTrans, CblasTrans, N_, 4*H_, H_, Dtype(1.), 
-        h_t_1, weight_h, Dtype(0.), h_to_gate);
+    caffe_cpu_gemm(CblasNoTrans, CblasNoTrans, N_, 4*H_, H_, Dtype(1.),
+        h_t_1, weight_h_t, Dtype(0.), h_to_gate);
 
+    // The sequences of the batch (the rows of the CTPN feature map) are
+    // independent, so their gates are computed in parallel; the recurrent
+    // add is fused into the branch-free activation loops
+#pragma omp parallel for
     for (int n = 0; n < N_; ++n) {
       const bool cont = clip_t ? clip_t[n] : t > 0;
-      if (cont) {
-        caffe_add(4*H_, pre_gate_t, h_to_gate, pre_gate_t);
-      }
-      for (int d = 0; d < H_; ++d) {
-        // Apply nonlinearity
-        gate_t[d] = sigmoid(pre_gate_t[d]);
-        gate_t[H_ + d] = cont ? sigmoid(pre_gate_t[H_ + d]) : Dtype(0.);
-        gate_t[2*H_ + d] = sigmoid(pre_gate_t[2*H_ + d]);
-        gate_t[3*H_ + d] = tanh(pre_gate_t[3*H_ + d]);
-
-        // Compute cell : c(t) = f(t)*c(t-1) + i(t)*g(t)
-        c_t[d] = gate_t[H_ + d] * c_t_1[d] + gate_t[d] * gate_t[3*H_ + d];
-        h_t[d] = gate_t[2*H_ + d] * tanh(c_t[d]);
-      }
-      
-      h_t += H_;
-      c_t += H_;
-      c_t_1 += H_;
-      pre_gate_t += 4*H_;
-      gate_t += 4*H_;
-      h_to_gate_t += 4*H_;
+      lstm_gates_cpu(H_, cont, h_to_gate + n*4*H_, c_t_1 + n*H_,
+          pre_gate_t + n*4*H_, gate_t + n*4*H_, c_t + n*H_, h_t + n*H_);
     }
   }
   // Preserve cell state and output value for truncated BPTT
@@ -238,8 +261,10 @@ void LstmLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
 
     for (int n = 0; n < N_; ++n) {
       const bool cont = clip_t ? clip_t[n] : t > 0;
+      // tanh(c) goes in the o gate diff, which is overwritten with it.
+      caffe_cpu_tanh(H_, c_t, gate_diff_t + 2*H_);
       for (int d = 0; d < H_; ++d) {
-        const Dtype tanh_c = tanh(c_t[d]);
+        const Dtype tanh_c = gate_diff_t[2*H_ + d];
         gate_diff_t[2*H_ + d] = dh_t[d] * tanh_c;
         dc_t[d] += dh_t[d] * gate_t[2*H_ + d] * (Dtype(1.) - tanh_c * tanh_c);
         dc_t_1[d] = cont ? dc_t[d] * gate_t[H_ + d] : Dtype(0.);
@@ -280,7 +305,7 @@ void LstmLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const bool cont = clip_t ? clip_t[n] : t > 0;
       const Dtype* h_to_h = h_to_h_.cpu_data() + h_to_h_.offset(n);
       if (cont) {
-        caffe_add(H_, dh_t_1, h_to_h, dh_t_1);
+        caffe_add(H_, dh_t_1 + n*H_, h_to_h, dh_t_1 + n*H_);
       }
     }
   }
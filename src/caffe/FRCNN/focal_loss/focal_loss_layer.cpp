@@ -79,16 +79,25 @@ void FocalLossLayer<Dtype>::Reshape(
     top[1]->ReshapeLike(*bottom[0]);
   }
 
-  // log(p_t)
-  log_prob_.ReshapeLike(*bottom[0]);
-  CHECK_EQ(prob_.count(), log_prob_.count());
-  // alpha * (1 - p_t) ^ gamma
-  power_prob_.ReshapeLike(*bottom[0]);
-  CHECK_EQ(prob_.count(), power_prob_.count());
-  // 1
-  ones_.ReshapeLike(*bottom[0]);
-  CHECK_EQ(prob_.count(), ones_.count());
-  caffe_set(prob_.count(), Dtype(1), ones_.mutable_cpu_data());
+  // The CPU path computes these per location as it goes. Forward reshapes
+  // the layer in the mode it then runs in, so they are only kept for the GPU.
+  if (Caffe::mode() == Caffe::GPU) {
+    // log(p_t)
+    log_prob_.ReshapeLike(*bottom[0]);
+    CHECK_EQ(prob_.count(), log_prob_.count());
+    // alpha * (1 - p_t) ^ gamma
+    power_prob_.ReshapeLike(*bottom[0]);
+    CHECK_EQ(prob_.count(), power_prob_.count());
+    // 1
+    ones_.ReshapeLike(*bottom[0]);
+    CHECK_EQ(prob_.count(), ones_.count());
+    caffe_set(prob_.count(), Dtype(1), ones_.mutable_cpu_data());
+  }
+  vector<int> grad_shape(2);
+  grad_shape[0] = outer_num_;
+  grad_shape[1] = inner_num_;
+  focal_grad_.Reshape(grad_shape);
+  scale_.Reshape(vector<int>(1, inner_num_));
 }
 
 template <typename Dtype>
@@ -122,64 +131,49 @@ Dtype FocalLossLayer<Dtype>::get_normalizer(
   return std::max(Dtype(1.0), normalizer);
 }
 
-template <typename Dtype>
-void FocalLossLayer<Dtype>::compute_intermediate_values_of_cpu() {
-  // compute the corresponding variables
-  const int count        = prob_.count();
-  const Dtype* prob_data = prob_.cpu_data();
-  const Dtype* ones_data = ones_.cpu_data();
-  Dtype* log_prob_data   = log_prob_.mutable_cpu_data();
-  Dtype* power_prob_data = power_prob_.mutable_cpu_data();
-
-  /// log(p_t)
-  const Dtype eps        = Dtype(FLT_MIN); // where FLT_MIN = 1.17549e-38, here u can change it
-  // more stable
-  for(int i = 0; i < prob_.count(); i++) {
-    log_prob_data[i] = log(std::max(prob_data[i], eps));
-  }
-  /// caffe_log(count,  prob_data, log_prob_data);
-
-  /// alpha* (1 - p_t) ^ gamma
-  caffe_sub(count,  ones_data, prob_data, power_prob_data);
-  caffe_powx(count, power_prob_.cpu_data(), gamma_, power_prob_data);
-  caffe_scal(count, alpha_, power_prob_data);
-}
-
 template <typename Dtype>
 void FocalLossLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) 
 {
-  // The forward pass computes the softmax prob values.
-  softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
-
-  // compute all needed values
-  compute_intermediate_values_of_cpu();
-  const Dtype* label           = bottom[1]->cpu_data();
-  const Dtype* log_prob_data   = log_prob_.cpu_data();
-  const Dtype* power_prob_data = power_prob_.cpu_data();
-
-  // compute loss
-  int count    = 0;
-  int channels = prob_.shape(softmax_axis_);
-  int dim      = prob_.count() / outer_num_;
-
+  // The shared softmax kernel, then log(p_t), the focal weight and the
+  // gradient w.r.t. log(p_t) in one sweep over the labels.
+  caffe_cpu_softmax(outer_num_, bottom[0]->shape(softmax_axis_), inner_num_,
+      bottom[0]->cpu_data(), prob_.mutable_cpu_data());
+  const Dtype* prob_data   = prob_.cpu_data();
+  const Dtype* label       = bottom[1]->cpu_data();
+  Dtype* grad_data         = focal_grad_.mutable_cpu_data();
+
+  const int channels  = bottom[0]->shape(softmax_axis_);
+  const int dim       = prob_.count() / outer_num_;
+  // log(max(p_t, FLT_MIN)), more stable
+  const Dtype log_eps = log(Dtype(FLT_MIN));
+  const Dtype eps     = 1e-10;
+
+  int count  = 0;
   Dtype loss = 0;
   for (int i = 0; i < outer_num_; ++i) {
-    for (int j = 0; j < inner_num_; j++) {
+    const Dtype* p = prob_data + i * dim;
+    for (int j = 0; j < inner_num_; ++j) {
       const int label_value = static_cast<int>(label[i * inner_num_ + j]);
       if (has_ignore_label_ && label_value == ignore_label_) {
+        grad_data[i * inner_num_ + j] = 0;
         continue;
       }
       DCHECK_GE(label_value, 0);
       DCHECK_LT(label_value, channels);
-      const int index = i * dim + label_value * inner_num_ + j;
+      const Dtype prob_t       = p[label_value * inner_num_ + j];
+      const Dtype log_prob_t   = std::max(Dtype(log(prob_t)), log_eps);
+      // alpha * (1 - p_t) ^ gamma
+      const Dtype power_prob_t = alpha_ * pow(1 - prob_t, gamma_);
       // FL(p_t) = -(1 - p_t) ^ gamma * log(p_t)
-      // loss -= std::max(power_prob_data[index] * log_prob_data[index],
-      //                      Dtype(log(Dtype(FLT_MIN))));
-      loss -= power_prob_data[index] * log_prob_data[index];
+      loss -= power_prob_t * log_prob_t;
+      // the gradient from FL w.r.t p_t, here ignore the `sign`
+      grad_data[i * inner_num_ + j] = power_prob_t - gamma_
+          * (power_prob_t / std::max(1 - prob_t, eps)) * log_prob_t * prob_t;
       ++count;
     }
   }
+  valid_count_ = count;
 
   // prob
   top[0]->mutable_cpu_data()[0] = loss / get_normalizer(normalization_, count);
@@ -198,56 +192,34 @@ void FocalLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
 
   if (propagate_down[0]) {
-    // data
     Dtype* bottom_diff     = bottom[0]->mutable_cpu_diff();
     const Dtype* prob_data = prob_.cpu_data();
     const Dtype* label     = bottom[1]->cpu_data();
-    // intermidiate  
-    const Dtype* log_prob_data   = log_prob_.cpu_data();
-    const Dtype* power_prob_data = power_prob_.cpu_data();
+    const Dtype* grad_data = focal_grad_.cpu_data();
+    Dtype* scale_data      = scale_.mutable_cpu_data();
 
-    int count       = 0;
-    int channels    = bottom[0]->shape(softmax_axis_);
-    int dim         = prob_.count() / outer_num_;
-    const Dtype eps = 1e-10;
+    const int channels = bottom[0]->shape(softmax_axis_);
+    const int dim      = prob_.count() / outer_num_;
+    const Dtype loss_weight = top[0]->cpu_diff()[0]
+        / get_normalizer(normalization_, valid_count_);
 
     for (int i = 0; i < outer_num_; ++i) {
+      // grad * p_j for every channel j, grad * (p_t - 1) for the label
+      caffe_cpu_scale(inner_num_, loss_weight, grad_data + i * inner_num_,
+                      scale_data);
+      for (int c = 0; c < channels; ++c) {
+        const int offset = i * dim + c * inner_num_;
+        caffe_mul(inner_num_, prob_data + offset, scale_data,
+                  bottom_diff + offset);
+      }
       for (int j = 0; j < inner_num_; ++j) {
-        // label
         const int label_value = static_cast<int>(label[i * inner_num_ + j]);
-        
-        // ignore label
         if (has_ignore_label_ && label_value == ignore_label_) {
-          for (int c = 0; c < channels; ++c) {
-            bottom_diff[i * dim + c * inner_num_ + j] = 0;
-          }
           continue;
         }
-
-        // the gradient from FL w.r.t p_t, here ignore the `sign`
-        int ind_i  = i * dim + label_value * inner_num_ + j; // index of ground-truth label
-        Dtype grad = 0 - gamma_ * (power_prob_data[ind_i] / std::max(1 - prob_data[ind_i], eps)) 
-                                * log_prob_data[ind_i] * prob_data[ind_i]
-                       + power_prob_data[ind_i];
-        // the gradient w.r.t input data x
-        for (int c = 0; c < channels; ++c) {
-          int ind_j = i * dim + c * inner_num_ + j;
-          if(c == label_value) {
-            CHECK_EQ(ind_i, ind_j);
-            // if i == j, (here i,j are refered for derivative of softmax)
-            bottom_diff[ind_j] = grad * (prob_data[ind_i] - 1);
-          } else {
-            // if i != j, (here i,j are refered for derivative of softmax)
-            bottom_diff[ind_j] = grad * prob_data[ind_j];
-          }
-        }
-        // count                    
-        ++count;
+        bottom_diff[i * dim + label_value * inner_num_ + j] -= scale_data[j];
       }
     }
-    // Scale gradient
-    Dtype loss_weight = top[0]->cpu_diff()[0] / get_normalizer(normalization_, count);
-    caffe_scal(prob_.count(), loss_weight, bottom_diff);
   }
 }
 
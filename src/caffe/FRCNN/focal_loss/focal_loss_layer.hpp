@@ -44,16 +44,23 @@ class FocalLossLayer : public LossLayer<Dtype> {
   virtual Dtype get_normalizer(
       LossParameter_NormalizationMode normalization_mode, int valid_count);
 
-  void compute_intermediate_values_of_cpu();
   void compute_intermediate_values_of_gpu();
   
   /// The internal SoftmaxLayer used to map predictions to a distribution.
   shared_ptr<Layer<Dtype> > softmax_layer_;
   /// prob stores the output probability predictions from the SoftmaxLayer.
   Blob<Dtype> prob_;        // softmax output p_t
+  /// GPU only, shaped when Reshape runs in GPU mode
   Blob<Dtype> log_prob_;    // log(p_t)
   Blob<Dtype> power_prob_;  // alpha * (1 - p_t) ^ gamma
   Blob<Dtype> ones_;        // 1
+  /// CPU only: d FL / d log(p_t) per location, 0 for ignored labels
+  Blob<Dtype> focal_grad_;
+  /// CPU only: loss_weight * d FL / d log(p_t) of one outer slice, used by
+  /// Backward
+  Blob<Dtype> scale_;
+  /// CPU only: locations that are not ignored in the last forward
+  int valid_count_;
   /// bottom vector holder used in call to the underlying SoftmaxLayer::Forward
   vector<Blob<Dtype>*> softmax_bottom_vec_;
   /// top vector holder used in call to the underlying SoftmaxLayer::Forward
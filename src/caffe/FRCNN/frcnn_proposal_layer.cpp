@@ -17,6 +17,20 @@ namespace Frcnn {
 
 using std::vector;
 
+ProposalCap::~ProposalCap() {}
+
+void ProposalCap::set_max_proposals(int max_proposals) {
+  CHECK_GE(max_proposals, 0);
+  max_proposals_ = max_proposals;
+}
+
+void ProposalCap::cap_top_n(int* pre_nms_top_n, int* post_nms_top_n) const {
+  if (max_proposals_ == 0 || max_proposals_ >= *post_nms_top_n) return;
+  *pre_nms_top_n = std::max(max_proposals_,
+      int(float(*pre_nms_top_n) * max_proposals_ / *post_nms_top_n));
+  *post_nms_top_n = max_proposals_;
+}
+
 template <typename Dtype>
 void FrcnnProposalLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype> *> &bottom,
   const vector<Blob<Dtype> *> &top) {
@@ -74,6 +88,7 @@ void FrcnnProposalLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype> *> &bottom,
     rpn_post_nms_top_n = FrcnnParam::test_rpn_post_nms_top_n;
     rpn_nms_thresh = FrcnnParam::test_rpn_nms_thresh;
     rpn_min_size = FrcnnParam::test_rpn_min_size;
+    this->cap_top_n(&rpn_pre_nms_top_n, &rpn_post_nms_top_n);
   }
   const int config_n_anchors = FrcnnParam::anchors.size() / 4;
   LOG_IF(ERROR, rpn_pre_nms_top_n <= 0 ) << "rpn_pre_nms_top_n : " << rpn_pre_nms_top_n;
@@ -149,6 +149,7 @@ void FrcnnProposalLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype> *> &bottom,
     rpn_post_nms_top_n = FrcnnParam::test_rpn_post_nms_top_n;
     rpn_nms_thresh = FrcnnParam::test_rpn_nms_thresh;
     rpn_min_size = FrcnnParam::test_rpn_min_size;
+    this->cap_top_n(&rpn_pre_nms_top_n, &rpn_post_nms_top_n);
   }
   LOG_IF(ERROR, rpn_pre_nms_top_n <= 0 ) << "rpn_pre_nms_top_n : " << rpn_pre_nms_top_n;
   LOG_IF(ERROR, rpn_post_nms_top_n <= 0 ) << "rpn_post_nms_top_n : " << rpn_post_nms_top_n;
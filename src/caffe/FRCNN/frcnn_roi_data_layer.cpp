@@ -123,6 +123,19 @@ void FrcnnRoiDataLayer<Dtype>::DataLayerSetUp(
   CHECK_GT(lines_.size(), 0) << "No Image In Ground Truth File";
   LOG(INFO) << "number of images: " << lines_.size();
 
+  // Data parallel solvers each train on every solver_count-th image.
+  const int solver_count = this->phase_ == TRAIN ? Caffe::solver_count() : 1;
+  if (solver_count > 1) {
+    vector<int> shard;
+    for (size_t i = Caffe::solver_rank(); i < lines_.size(); i += solver_count) {
+      shard.push_back(lines_[i]);
+    }
+    CHECK_GT(shard.size(), 0) << "Fewer images than solvers";
+    lines_.swap(shard);
+    LOG(INFO) << "solver " << Caffe::solver_rank() << " shard: " << lines_.size()
+              << " images";
+  }
+
   for (map<int, int>::iterator it = label_hist.begin(); it != label_hist.end(); ++it) {
     LOG(INFO) << "class " << it->first << " has " << label_hist[it->first] << " samples";
   }
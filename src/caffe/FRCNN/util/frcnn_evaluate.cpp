@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+#include "caffe/FRCNN/util/frcnn_evaluate.hpp"
+
+namespace caffe {
+
+namespace Frcnn {
+
+// Area under the precision envelope (VOC 2010+), or its mean at the 11
+// recall points 0, 0.1, ..., 1 (VOC 2007).
+static double voc_ap(const vector<double> &rec, const vector<double> &prec,
+    bool use_07_metric) {
+  double ap = 0;
+  if (use_07_metric) {
+    for (int i = 0; i <= 10; i++) {
+      const double t = i * 0.1;
+      double p = 0;
+      for (size_t k = 0; k < rec.size(); k++) {
+        if (rec[k] >= t) p = std::max(p, prec[k]);
+      }
+      ap += p / 11.;
+    }
+    return ap;
+  }
+  vector<double> mrec(1, 0.), mpre(1, 0.);
+  mrec.insert(mrec.end(), rec.begin(), rec.end());
+  mpre.insert(mpre.end(), prec.begin(), prec.end());
+  mrec.push_back(1.);
+  mpre.push_back(0.);
+  for (int i = mpre.size() - 1; i > 0; i--) {
+    mpre[i - 1] = std::max(mpre[i - 1], mpre[i]);
+  }
+  for (size_t i = 0; i + 1 < mrec.size(); i++) {
+    if (mrec[i + 1] != mrec[i]) {
+      ap += (mrec[i + 1] - mrec[i]) * mpre[i + 1];
+    }
+  }
+  return ap;
+}
+
+static float box_area(const Point4f<float> &box) {
+  return (box[2] - box[0] + 1) * (box[3] - box[1] + 1);
+}
+
+DetectionEvaluator::DetectionEvaluator(int num_classes)
+  : num_classes_(num_classes), num_images_(0), gt_boxes_(num_classes),
+    gt_difficult_(num_classes), detections_(num_classes) {
+  CHECK_GT(num_classes, 1) << "At least one class besides the background";
+}
+
+void DetectionEvaluator::AddImage(const vector<BBox<float> > &gts,
+    const vector<int> &difficult, const vector<BBox<float> > &detections) {
+  CHECK_EQ(gts.size(), difficult.size());
+  for (int cls = 0; cls < num_classes_; cls++) {
+    gt_boxes_[cls].push_back(vector<Point4f<float> >());
+    gt_difficult_[cls].push_back(vector<bool>());
+  }
+  for (size_t i = 0; i < gts.size(); i++) {
+    const int cls = gts[i].id;
+    CHECK(cls > 0 && cls < num_classes_) << "illegal label : " << cls;
+    gt_boxes_[cls].back().push_back(gts[i]);
+    gt_difficult_[cls].back().push_back(difficult[i] != 0);
+  }
+  for (size_t i = 0; i < detections.size(); i++) {
+    const int cls = detections[i].id;
+    CHECK(cls >= 0 && cls < num_classes_) << "illegal label : " << cls;
+    Detection detection;
+    detection.confidence = detections[i].confidence;
+    detection.image = num_images_;
+    detection.box = detections[i];
+    detections_[cls].push_back(detection);
+  }
+  num_images_++;
+}
+
+bool DetectionEvaluator::HigherConfidence(const Detection &a,
+    const Detection &b) {
+  return a.confidence > b.confidence;
+}
+
+vector<DetectionEvaluator::Detection> DetectionEvaluator::SortedDetections(
+    int cls, int max_detections) const {
+  vector<Detection> sorted(detections_[cls]);
+  std::stable_sort(sorted.begin(), sorted.end(), HigherConfidence);
+  if (max_detections < INT_MAX) {
+    vector<int> kept(num_images_, 0);
+    size_t n = 0;
+    for (size_t d = 0; d < sorted.size(); d++) {
+      if (kept[sorted[d].image]++ < max_detections) {
+        sorted[n++] = sorted[d];
+      }
+    }
+    sorted.resize(n);
+  }
+  return sorted;
+}
+
+vector<float> DetectionEvaluator::VocAP(float overlap,
+    bool use_07_metric) const {
+  vector<float> ap(num_classes_, -1);
+#pragma omp parallel for schedule(dynamic)
+  for (int cls = 1; cls < num_classes_; cls++) {
+    const vector<vector<Point4f<float> > > &gt_boxes = gt_boxes_[cls];
+    const vector<vector<bool> > &gt_difficult = gt_difficult_[cls];
+    int npos = 0;
+    vector<vector<bool> > matched(num_images_);
+    for (int image = 0; image < num_images_; image++) {
+      matched[image].resize(gt_boxes[image].size(), false);
+      npos += std::count(gt_difficult[image].begin(),
+          gt_difficult[image].end(), false);
+    }
+    if (npos == 0) continue;
+    const vector<Detection> detections = SortedDetections(cls);
+    vector<double> rec, prec;
+    double tp = 0, fp = 0;
+    for (size_t d = 0; d < detections.size(); d++) {
+      const Detection &det = detections[d];
+      const vector<Point4f<float> > &gts = gt_boxes[det.image];
+      float ovmax = -std::numeric_limits<float>::infinity();
+      int jmax = -1;
+      for (size_t g = 0; g < gts.size(); g++) {
+        const float iou = get_iou(det.box, gts[g]);
+        if (iou > ovmax) {
+          ovmax = iou;
+          jmax = g;
+        }
+      }
+      if (ovmax > overlap) {
+        if (!gt_difficult[det.image][jmax]) {
+          if (!matched[det.image][jmax]) {
+            tp += 1;
+            matched[det.image][jmax] = true;
+          } else {
+            fp += 1;
+          }
+        }
+      } else {
+        fp += 1;
+      }
+      rec.push_back(tp / npos);
+      prec.push_back(tp / std::max(tp + fp,
+          double(std::numeric_limits<double>::epsilon())));
+    }
+    ap[cls] = voc_ap(rec, prec, use_07_metric);
+  }
+  return ap;
+}
+
+vector<float> DetectionEvaluator::CocoAP(const vector<float> &overlaps,
+    float min_area, float max_area, int max_detections) const {
+  CHECK_GT(overlaps.size(), 0);
+  CHECK_GT(max_detections, 0);
+  vector<float> ap(num_classes_, -1);
+#pragma omp parallel for schedule(dynamic)
+  for (int cls = 1; cls < num_classes_; cls++) {
+    const vector<vector<Point4f<float> > > &gt_boxes = gt_boxes_[cls];
+    int npos = 0;
+    vector<vector<bool> > ignore(num_images_);
+    for (int image = 0; image < num_images_; image++) {
+      for (size_t g = 0; g < gt_boxes[image].size(); g++) {
+        const float area = box_area(gt_boxes[image][g]);
+        const bool ignored = gt_difficult_[cls][image][g]
+          || area < min_area || area >= max_area;
+        ignore[image].push_back(ignored);
+        npos += !ignored;
+      }
+    }
+    if (npos == 0) continue;
+    const vector<Detection> detections =
+      SortedDetections(cls, max_detections);
+    double sum_ap = 0;
+    for (size_t t = 0; t < overlaps.size(); t++) {
+      vector<vector<bool> > matched(num_images_);
+      for (int image = 0; image < num_images_; image++) {
+        matched[image].resize(gt_boxes[image].size(), false);
+      }
+      vector<double> rec, prec;
+      double tp = 0, fp = 0;
+      for (size_t d = 0; d < detections.size(); d++) {
+        const Detection &det = detections[d];
+        const vector<Point4f<float> > &gts = gt_boxes[det.image];
+        // The best unmatched ground truth, preferring the ones not ignored.
+        int best = -1;
+        for (int pass = 0; pass < 2 && best < 0; pass++) {
+          float best_iou = std::min(overlaps[t], 1.f - 1e-10f);
+          for (size_t g = 0; g < gts.size(); g++) {
+            if (matched[det.image][g] || ignore[det.image][g] != (pass == 1)) {
+              continue;
+            }
+            const float iou = get_iou(det.box, gts[g]);
+            if (iou >= best_iou) {
+              best_iou = iou;
+              best = g;
+            }
+          }
+        }
+        if (best >= 0) {
+          matched[det.image][best] = true;
+          if (ignore[det.image][best]) continue;
+          tp += 1;
+        } else {
+          const float area = box_area(det.box);
+          if (area < min_area || area >= max_area) continue;
+          fp += 1;
+        }
+        rec.push_back(tp / npos);
+        prec.push_back(tp / (tp + fp));
+      }
+      for (int i = static_cast<int>(prec.size()) - 1; i > 0; i--) {
+        prec[i - 1] = std::max(prec[i - 1], prec[i]);
+      }
+      double class_ap = 0;
+      for (int r = 0; r <= 100; r++) {
+        const size_t i = std::lower_bound(rec.begin(), rec.end(), r / 100.)
+          - rec.begin();
+        class_ap += i < prec.size() ? prec[i] : 0;
+      }
+      sum_ap += class_ap / 101;
+    }
+    ap[cls] = sum_ap / overlaps.size();
+  }
+  return ap;
+}
+
+float DetectionEvaluator::MeanAP(const vector<float> &ap) {
+  double sum = 0;
+  int count = 0;
+  for (size_t cls = 0; cls < ap.size(); cls++) {
+    if (ap[cls] >= 0) {
+      sum += ap[cls];
+      count++;
+    }
+  }
+  return count > 0 ? sum / count : -1;
+}
+
+vector<float> DetectionEvaluator::CocoOverlaps() {
+  vector<float> overlaps;
+  for (int i = 0; i < 10; i++) {
+    overlaps.push_back(0.5 + 0.05 * i);
+  }
+  return overlaps;
+}
+
+void DetectionEvaluator::Summarize(float overlap) const {
+  const vector<float> ap07 = VocAP(overlap, true);
+  const vector<float> ap_area = VocAP(overlap, false);
+  const vector<float> coco = CocoAP(CocoOverlaps());
+  const vector<float> coco50 = CocoAP(vector<float>(1, 0.5f));
+  const vector<float> coco75 = CocoAP(vector<float>(1, 0.75f));
+  const vector<float> small = CocoAP(CocoOverlaps(), 0, 32 * 32);
+  const vector<float> medium = CocoAP(CocoOverlaps(), 32 * 32, 96 * 96);
+  const vector<float> large = CocoAP(CocoOverlaps(), 96 * 96);
+  char buff[200];
+  LOG(INFO) << "Evaluated " << num_images_ << " images, overlap " << overlap;
+  LOG(INFO) << "class       [07]    [12]    AP      AP50    AP75    APs     APm     APl";
+  for (int cls = 1; cls < num_classes_; cls++) {
+    snprintf(buff, sizeof(buff),
+        "%-10d %6.2f  %6.2f  %6.2f  %6.2f  %6.2f  %6.2f  %6.2f  %6.2f", cls,
+        ap07[cls] * 100, ap_area[cls] * 100, coco[cls] * 100,
+        coco50[cls] * 100, coco75[cls] * 100, small[cls] * 100,
+        medium[cls] * 100, large[cls] * 100);
+    LOG(INFO) << buff;
+  }
+  snprintf(buff, sizeof(buff),
+      "%-10s %6.2f  %6.2f  %6.2f  %6.2f  %6.2f  %6.2f  %6.2f  %6.2f", "mAP",
+      MeanAP(ap07) * 100, MeanAP(ap_area) * 100, MeanAP(coco) * 100,
+      MeanAP(coco50) * 100, MeanAP(coco75) * 100, MeanAP(small) * 100,
+      MeanAP(medium) * 100, MeanAP(large) * 100);
+  LOG(INFO) << buff;
+}
+
+}  // namespace Frcnn
+
+}  // namespace caffe
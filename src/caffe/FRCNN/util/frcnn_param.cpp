@@ -36,6 +36,11 @@ int FrcnnParam::test_soft_nms;
 bool FrcnnParam::test_use_gpu_nms; 
 bool FrcnnParam::test_bbox_vote; 
 bool FrcnnParam::test_decrypt_model;
+bool FrcnnParam::test_fold_layers;
+int FrcnnParam::test_tile_size;
+int FrcnnParam::test_tile_stride;
+float FrcnnParam::test_tile_objectness;
+int FrcnnParam::test_max_per_image;
 
 // Train bounding-box regressors
 bool FrcnnParam::bbox_reg; // Unuse
@@ -131,6 +136,11 @@ void FrcnnParam::load_param(const std::string default_config_path) {
   FrcnnParam::test_use_gpu_nms = static_cast<bool>(extract_int("test_use_gpu_nms", 0, default_map));
   FrcnnParam::test_bbox_vote = static_cast<bool>(extract_int("test_bbox_vote", 0, default_map));
   FrcnnParam::test_decrypt_model = static_cast<bool>(extract_int("test_decrypt_model", 0, default_map));
+  FrcnnParam::test_fold_layers = static_cast<bool>(extract_int("test_fold_layers", 1, default_map));
+  FrcnnParam::test_tile_size = extract_int("test_tile_size", 0, default_map);
+  FrcnnParam::test_tile_stride = extract_int("test_tile_stride", 0, default_map);
+  FrcnnParam::test_tile_objectness = extract_float("test_tile_objectness", 0, default_map);
+  FrcnnParam::test_max_per_image = extract_int("test_max_per_image", 0, default_map);
 
   FrcnnParam::bbox_reg =
       static_cast<bool>(extract_int("bbox_reg", default_map));
@@ -227,6 +237,11 @@ void FrcnnParam::print_param(){
   LOG(INFO) << "rpn_pre_nms_top_n    : " << FrcnnParam::test_rpn_pre_nms_top_n;
   LOG(INFO) << "rpn_post_nms_top_n   : " << FrcnnParam::test_rpn_post_nms_top_n;
   LOG(INFO) << "test_rpn_min_sizen   : " << FrcnnParam::test_rpn_min_size; 
+  LOG(INFO) << "test_fold_layers     : " << (FrcnnParam::test_fold_layers?"yes":"no");
+  LOG(INFO) << "test_tile_size       : " << FrcnnParam::test_tile_size;
+  LOG(INFO) << "test_tile_stride     : " << FrcnnParam::test_tile_stride;
+  LOG(INFO) << "test_tile_objectness : " << FrcnnParam::test_tile_objectness;
+  LOG(INFO) << "test_max_per_image   : " << FrcnnParam::test_max_per_image;
 
   LOG(INFO) << "== Global Parameters ==";
   LOG(INFO) << "pixel_means[BGR]     : " << FrcnnParam::pixel_means[0] <<  " , " << FrcnnParam::pixel_means[1] << " , " << FrcnnParam::pixel_means[2];
@@ -58,6 +58,13 @@ void ConvolutionDepthwiseLayer<Dtype>::LayerSetUp(
     dilation_h_ = 1;
     dilation_w_ = 1;
   }
+  CHECK(conv_param.depthwise_kernel()
+        != ConvolutionParameter_DepthwiseKernel_DEPTHWISE_SPECIALIZED
+        || (kernel_h_ == 3 && kernel_w_ == 3 && dilation_h_ == 1
+        && dilation_w_ == 1 && stride_h_ == stride_w_
+        && (stride_h_ == 1 || stride_h_ == 2)))
+      << "depthwise_kernel: DEPTHWISE_SPECIALIZED needs a 3x3 kernel of "
+      << "stride 1 or 2 without dilation";
   vector<int> weight_shape(4);
   weight_shape[0] = bottom[0]->channels();
   weight_shape[1] = 1;
@@ -130,6 +137,108 @@ void ConvolutionDepthwiseLayer<Dtype>::Reshape(
   }
 }
 
+// The range [begin, end) of output positions whose input position
+// out * stride + offset lies inside [0, size).
+inline void ConvolutionDepthwiseValidRange(const int offset, const int stride,
+    const int size, const int out_size, int* begin, int* end) {
+  *begin = offset >= 0 ? 0 : (stride - 1 - offset) / stride;
+  *end = offset > size - 1 ? 0 :
+        std::min(out_size, (size - 1 - offset) / stride + 1);
+  *end = std::max(*begin, *end);
+}
+
+template <typename Dtype>
+inline Dtype ConvolutionDepthwiseBorder3x3(const Dtype* const rows[3],
+    const int bottom_width, const Dtype* weight, const Dtype bias,
+    const int w_in) {
+  Dtype value = bias;
+  for (int kh = 0; kh < 3; ++kh) {
+    for (int kw = 0; kw < 3; ++kw) {
+      if (w_in + kw >= 0 && w_in + kw < bottom_width) {
+        value += weight[kh * 3 + kw] * rows[kh][w_in + kw];
+      }
+    }
+  }
+  return value;
+}
+
+// A 3x3 kernel without dilation on one plane. Rows above and below the
+// image read from zero_row, so only the border columns need bounds checks;
+// the interior columns are a straight 9-tap loop the compiler vectorizes
+// for stride 1.
+template <typename Dtype, int kStride>
+void ConvolutionDepthwiseForward3x3(const Dtype* bottom_data,
+    const int bottom_height, const int bottom_width, const Dtype* weight,
+    const Dtype bias, const int pad_h, const int pad_w, const Dtype* zero_row,
+    Dtype* top_data, const int top_height, const int top_width) {
+  int w_begin, w_end;
+  ConvolutionDepthwiseValidRange(-pad_w, kStride, bottom_width - 2,
+        top_width, &w_begin, &w_end);
+  for (int h = 0; h < top_height; ++h) {
+    const Dtype* rows[3];
+    for (int kh = 0; kh < 3; ++kh) {
+      const int h_in = h * kStride - pad_h + kh;
+      rows[kh] = (h_in >= 0 && h_in < bottom_height) ?
+            bottom_data + h_in * bottom_width : zero_row;
+    }
+    const Dtype* r0 = rows[0];
+    const Dtype* r1 = rows[1];
+    const Dtype* r2 = rows[2];
+    Dtype* top_row = top_data + h * top_width;
+    for (int w = w_begin; w < w_end; ++w) {
+      const int w_in = w * kStride - pad_w;
+      top_row[w] = bias
+            + weight[0] * r0[w_in] + weight[1] * r0[w_in + 1]
+            + weight[2] * r0[w_in + 2]
+            + weight[3] * r1[w_in] + weight[4] * r1[w_in + 1]
+            + weight[5] * r1[w_in + 2]
+            + weight[6] * r2[w_in] + weight[7] * r2[w_in + 1]
+            + weight[8] * r2[w_in + 2];
+    }
+    for (int w = 0; w < std::min(w_begin, top_width); ++w) {
+      top_row[w] = ConvolutionDepthwiseBorder3x3(rows, bottom_width, weight,
+            bias, w * kStride - pad_w);
+    }
+    for (int w = w_end; w < top_width; ++w) {
+      top_row[w] = ConvolutionDepthwiseBorder3x3(rows, bottom_width, weight,
+            bias, w * kStride - pad_w);
+    }
+  }
+}
+
+// Any kernel, stride and dilation on one plane: each tap is accumulated over
+// the output rows and columns that read inside the image.
+template <typename Dtype>
+void ConvolutionDepthwiseForwardGeneric(const Dtype* bottom_data,
+    const int bottom_height, const int bottom_width, const Dtype* weight,
+    const Dtype bias, const int kernel_h, const int kernel_w,
+    const int stride_h, const int stride_w, const int pad_h, const int pad_w,
+    const int dilation_h, const int dilation_w, Dtype* top_data,
+    const int top_height, const int top_width) {
+  caffe_set(top_height * top_width, bias, top_data);
+  for (int kh = 0; kh < kernel_h; ++kh) {
+    int h_begin, h_end;
+    ConvolutionDepthwiseValidRange(kh * dilation_h - pad_h, stride_h,
+          bottom_height, top_height, &h_begin, &h_end);
+    for (int kw = 0; kw < kernel_w; ++kw) {
+      const int offset_w = kw * dilation_w - pad_w;
+      int w_begin, w_end;
+      ConvolutionDepthwiseValidRange(offset_w, stride_w, bottom_width,
+            top_width, &w_begin, &w_end);
+      const Dtype value = weight[kh * kernel_w + kw];
+      for (int h = h_begin; h < h_end; ++h) {
+        const Dtype* bottom_row = bottom_data
+              + (h * stride_h + kh * dilation_h - pad_h) * bottom_width
+              + offset_w;
+        Dtype* top_row = top_data + h * top_width;
+        for (int w = w_begin; w < w_end; ++w) {
+          top_row[w] += value * bottom_row[w * stride_w];
+        }
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void ConvolutionDepthwiseLayer<Dtype>::Forward_cpu(
       const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
@@ -139,47 +248,45 @@ void ConvolutionDepthwiseLayer<Dtype>::Forward_cpu(
   const int top_width = top[0]->width();
   const int bottom_height = bottom[0]->height();
   const int bottom_width = bottom[0]->width();
+  const int kernel_h = kernel_h_, kernel_w = kernel_w_;
+  const int stride_h = stride_h_, stride_w = stride_w_;
+  const int pad_h = pad_h_, pad_w = pad_w_;
+  const int dilation_h = dilation_h_, dilation_w = dilation_w_;
   const Dtype* bottom_data = bottom[0]->cpu_data();
-  const Dtype* weight_data_base = this->blobs_[0]->cpu_data();
+  const Dtype* weight_data = this->blobs_[0]->cpu_data();
+  const Dtype* bias_data =
+        this->layer_param_.convolution_param().bias_term() ?
+        this->blobs_[1]->cpu_data() : NULL;
   Dtype* top_data = top[0]->mutable_cpu_data();
-  for (int n = 0; n < num; ++n) {
-    for (int c = 0; c < channels; ++c) {
-      for (int h = 0; h < top_height; ++h) {
-        for (int w = 0; w < top_width; ++w) {
-          const Dtype* weight_data = weight_data_base
-                + c * kernel_h_ * kernel_w_;
-          Dtype value = 0;
-          for (int kh = 0; kh < kernel_h_; ++kh) {
-            for (int kw = 0; kw < kernel_w_; ++kw) {
-              int h_in = -pad_h_ + h * stride_h_ + kh * dilation_h_;
-              int w_in = -pad_w_ + w * stride_w_ + kw * dilation_w_;
-              if ((h_in >= 0) && (h_in < bottom_height)
-                    && (w_in >= 0) && (w_in < bottom_width)) {
-                int offset = ((n * channels + c) * bottom_height + h_in)
-                      * bottom_width + w_in;
-                value += (*weight_data) * bottom_data[offset];
-              }
-              ++weight_data;
-            }
-          }
-          *top_data++ = value;
-        }
-      }
-    }
-  }
-  if (this->layer_param_.convolution_param().bias_term()) {
-    top_data = top[0]->mutable_cpu_data();
-    for (int n = 0; n < num; ++n) {
-      const Dtype* bias_data = this->blobs_[1]->cpu_data();
-      for (int c = 0; c < channels; ++c) {
-        for (int h = 0; h < top_height; ++h) {
-          for (int w = 0; w < top_width; ++w) {
-            *top_data += *bias_data;
-            ++top_data;
-          }
-        }
-        ++bias_data;
-      }
+  const bool is_3x3 =
+        this->layer_param_.convolution_param().depthwise_kernel()
+        != ConvolutionParameter_DepthwiseKernel_DEPTHWISE_GENERIC
+        && kernel_h == 3 && kernel_w == 3 && dilation_h == 1
+        && dilation_w == 1 && stride_h == stride_w
+        && (stride_h == 1 || stride_h == 2);
+  const vector<Dtype> zero_row(bottom_width, Dtype(0));
+  const int bottom_dim = bottom_height * bottom_width;
+  const int top_dim = top_height * top_width;
+#pragma omp parallel for
+  for (int index = 0; index < num * channels; ++index) {
+    const int c = index % channels;
+    const Dtype* bottom_plane = bottom_data + index * bottom_dim;
+    const Dtype* weight = weight_data + c * kernel_h * kernel_w;
+    const Dtype bias = bias_data ? bias_data[c] : Dtype(0);
+    Dtype* top_plane = top_data + index * top_dim;
+    if (is_3x3 && stride_h == 1) {
+      ConvolutionDepthwiseForward3x3<Dtype, 1>(bottom_plane, bottom_height,
+            bottom_width, weight, bias, pad_h, pad_w, &zero_row[0],
+            top_plane, top_height, top_width);
+    } else if (is_3x3) {
+      ConvolutionDepthwiseForward3x3<Dtype, 2>(bottom_plane, bottom_height,
+            bottom_width, weight, bias, pad_h, pad_w, &zero_row[0],
+            top_plane, top_height, top_width);
+    } else {
+      ConvolutionDepthwiseForwardGeneric(bottom_plane, bottom_height,
+            bottom_width, weight, bias, kernel_h, kernel_w, stride_h,
+            stride_w, pad_h, pad_w, dilation_h, dilation_w, top_plane,
+            top_height, top_width);
     }
   }
 }
@@ -194,75 +301,74 @@ void ConvolutionDepthwiseLayer<Dtype>::Backward_cpu(
   const int top_width = top[0]->width();
   const int bottom_height = bottom[0]->height();
   const int bottom_width = bottom[0]->width();
-  caffe_set(bottom[0]->count(), Dtype(0), bottom[0]->mutable_cpu_diff());
-  if (this->layer_param_.convolution_param().bias_term()
-        && this->param_propagate_down_[1]) {
-    const Dtype* top_diff = top[0]->cpu_diff();
+  const int kernel_h = kernel_h_, kernel_w = kernel_w_;
+  const int stride_h = stride_h_, stride_w = stride_w_;
+  const int pad_h = pad_h_, pad_w = pad_w_;
+  const int dilation_h = dilation_h_, dilation_w = dilation_w_;
+  const bool bias_propagate_down =
+        this->layer_param_.convolution_param().bias_term()
+        && this->param_propagate_down_[1];
+  const bool weight_propagate_down = this->param_propagate_down_[0];
+  const bool data_propagate_down = propagate_down[0];
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* weight_data = this->blobs_[0]->cpu_data();
+  Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  Dtype* bias_diff =
+        bias_propagate_down ? this->blobs_[1]->mutable_cpu_diff() : NULL;
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
+  const int bottom_dim = bottom_height * bottom_width;
+  const int top_dim = top_height * top_width;
+  // Each channel owns its weights, its bias and its bottom planes, so the
+  // channels run in parallel without any reduction across threads.
+#pragma omp parallel for
+  for (int c = 0; c < channels; ++c) {
     for (int n = 0; n < num; ++n) {
-      Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
-      for (int c = 0; c < channels; ++c) {
-        for (int h = 0; h < top_height; ++h) {
-          for (int w = 0; w < top_width; ++w) {
-            *bias_diff += *top_diff;
-            ++top_diff;
-          }
+      const int index = n * channels + c;
+      const Dtype* top_plane = top_diff + index * top_dim;
+      const Dtype* bottom_plane = bottom_data + index * bottom_dim;
+      Dtype* bottom_diff_plane = bottom_diff + index * bottom_dim;
+      if (bias_propagate_down) {
+        Dtype sum = 0;
+        for (int i = 0; i < top_dim; ++i) {
+          sum += top_plane[i];
         }
-        ++bias_diff;
+        bias_diff[c] += sum;
       }
-    }
-  }
-  if (this->param_propagate_down_[0]) {
-    const Dtype* top_diff = top[0]->cpu_diff();
-    const Dtype* bottom_data = bottom[0]->cpu_data();
-    Dtype* weight_diff_base = this->blobs_[0]->mutable_cpu_diff();
-    for (int n = 0; n < num; ++n) {
-      for (int c = 0; c < channels; ++c) {
-        for (int h = 0; h < top_height; ++h) {
-          for (int w = 0; w < top_width; ++w) {
-            Dtype* weight_diff = weight_diff_base + c * kernel_h_ * kernel_w_;
-            for (int kh = 0; kh < kernel_h_; ++kh) {
-              for (int kw = 0; kw < kernel_w_; ++kw) {
-                int h_in = -pad_h_ + h * stride_h_ + kh * dilation_h_;
-                int w_in = -pad_w_ + w * stride_w_ + kw * dilation_w_;
-                if ((h_in >= 0) && (h_in < bottom_height)
-                      && (w_in >= 0) && (w_in < bottom_width)) {
-                  int offset = ((n * channels + c) * bottom_height + h_in)
-                        * bottom_width + w_in;
-                  *weight_diff += bottom_data[offset] * (*top_diff);
-                }
-                ++weight_diff;
+      if (!weight_propagate_down && !data_propagate_down) { continue; }
+      for (int kh = 0; kh < kernel_h; ++kh) {
+        int h_begin, h_end;
+        ConvolutionDepthwiseValidRange(kh * dilation_h - pad_h, stride_h,
+              bottom_height, top_height, &h_begin, &h_end);
+        for (int kw = 0; kw < kernel_w; ++kw) {
+          const int offset_w = kw * dilation_w - pad_w;
+          int w_begin, w_end;
+          ConvolutionDepthwiseValidRange(offset_w, stride_w, bottom_width,
+                top_width, &w_begin, &w_end);
+          const int k = c * kernel_h * kernel_w + kh * kernel_w + kw;
+          const Dtype weight = weight_data[k];
+          Dtype weight_sum = 0;
+          for (int h = h_begin; h < h_end; ++h) {
+            const int bottom_offset =
+                  (h * stride_h + kh * dilation_h - pad_h) * bottom_width
+                  + offset_w;
+            const Dtype* top_row = top_plane + h * top_width;
+            const Dtype* bottom_row = bottom_plane + bottom_offset;
+            Dtype* bottom_diff_row = bottom_diff_plane + bottom_offset;
+            if (weight_propagate_down) {
+              for (int w = w_begin; w < w_end; ++w) {
+                weight_sum += top_row[w] * bottom_row[w * stride_w];
               }
             }
-            ++top_diff;
-          }
-        }
-      }
-    }
-  }
-  if (propagate_down[0]) {
-    const Dtype* top_diff = top[0]->cpu_diff();
-    const Dtype* weight_data_base = this->blobs_[0]->cpu_data();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    for (int n = 0; n < num; ++n) {
-      for (int c = 0; c < channels; ++c) {
-        for (int h = 0; h < top_height; ++h) {
-          for (int w = 0; w < top_width; ++w) {
-            const Dtype* weight_data = weight_data_base
-                  + c * kernel_h_ * kernel_w_;
-            for (int kh = 0; kh < kernel_h_; ++kh) {
-              for (int kw = 0; kw < kernel_w_; ++kw) {
-                int h_in = -pad_h_ + h * stride_h_ + kh * dilation_h_;
-                int w_in = -pad_w_ + w * stride_w_ + kw * dilation_w_;
-                if ((h_in >= 0) && (h_in < bottom_height)
-                      && (w_in >= 0) && (w_in < bottom_width)) {
-                  int offset = ((n * channels + c) * bottom_height + h_in)
-                  * bottom_width + w_in;
-                  bottom_diff[offset] += (*weight_data) * (*top_diff);
-                }
-                ++weight_data;
+            if (data_propagate_down) {
+              for (int w = w_begin; w < w_end; ++w) {
+                bottom_diff_row[w * stride_w] += weight * top_row[w];
               }
             }
-            ++top_diff;
+          }
+          if (weight_propagate_down) {
+            weight_diff[k] += weight_sum;
           }
         }
       }
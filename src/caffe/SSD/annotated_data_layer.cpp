@@ -105,6 +105,13 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
       this->prefetch_[i].label_.Reshape(label_shape);
     }
   }
+  fused_ = transform_param.fused_augmentation();
+  if (fused_ && !(this->data_transformer_->CanFuse() &&
+                  this->output_labels_ && has_anno_type_)) {
+    LOG(WARNING) << "fused_augmentation needs bbox labels, a WARP "
+        << "resize_param, no crop and no mean_file; augmenting step by step.";
+    fused_ = false;
+  }
 }
 
 // This function is called on prefetch thread
@@ -112,6 +119,8 @@ template<typename Dtype>
 void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CPUTimer batch_timer;
   batch_timer.Start();
+  // items already read when the batch starts, see DataReader::queue_depth
+  const size_t queue_depth = reader_.queue_depth();
   double read_time = 0;
   double trans_time = 0;
   CPUTimer timer;
@@ -150,6 +159,28 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     AnnotatedDatum& anno_datum = *(reader_.full().pop("Waiting for data"));
     read_time += timer.MicroSeconds();
     timer.Start();
+    if (fused_ && anno_datum.datum().encoded()) {
+      // Distort, expand, sample, mirror and resize in one pass.
+      CHECK(anno_datum.has_type()) << "Some datum misses AnnotationType.";
+      if (anno_data_param.has_anno_type()) {
+        anno_datum.set_type(anno_type_);
+      } else {
+        CHECK_EQ(anno_type_, anno_datum.type()) << "Different AnnotationType.";
+      }
+      this->transformed_data_.set_cpu_data(
+          top_data + batch->data_.offset(item_id));
+      vector<AnnotationGroup> transformed_anno_vec;
+      this->data_transformer_->FusedTransform(anno_datum, batch_samplers_,
+                                              &(this->transformed_data_),
+                                              &transformed_anno_vec);
+      for (int g = 0; g < transformed_anno_vec.size(); ++g) {
+        num_bboxes += transformed_anno_vec[g].annotation_size();
+      }
+      all_anno[item_id] = transformed_anno_vec;
+      trans_time += timer.MicroSeconds();
+      reader_.free().push(const_cast<AnnotatedDatum*>(&anno_datum));
+      continue;
+    }
     AnnotatedDatum distort_datum;
     AnnotatedDatum* expand_datum = NULL;
     if (transform_param.has_distort_param()) {
@@ -191,7 +222,6 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       sampled_datum = expand_datum;
     }
     CHECK(sampled_datum != NULL);
-    timer.Start();
     vector<int> shape =
         this->data_transformer_->InferBlobShape(sampled_datum->datum());
     if (transform_param.has_resize_param()) {
@@ -305,6 +335,11 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  LOG_EVERY_N(INFO, 1000) << "Transform time: "
+      << trans_time / 1000 / batch_size << " ms per item"
+      << (fused_ ? " (fused)." : ".");
+  LOG_EVERY_N(INFO, 1000) << "Queue depth: " << queue_depth << " / "
+      << reader_.queue_capacity();
 }
 
 INSTANTIATE_CLASS(AnnotatedDataLayer);
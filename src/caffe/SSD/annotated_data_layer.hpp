@@ -36,6 +36,8 @@ class AnnotatedDataLayer : public SSDBasePrefetchingDataLayer<Dtype> {
   AnnotatedDatum_AnnotationType anno_type_;
   vector<BatchSampler> batch_samplers_;
   string label_map_file_;
+  // transform_param.fused_augmentation, if the transformer supports it
+  bool fused_;
 };
 
 }  // namespace caffe
@@ -109,6 +109,8 @@ void AnnotatedRDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
 	//LOG(INFO) << "Load Batch:";
   CPUTimer batch_timer;
   batch_timer.Start();
+  // items already read when the batch starts, see DataReader::queue_depth
+  const size_t queue_depth = reader_.queue_depth();
   double read_time = 0;
   double trans_time = 0;
   CPUTimer timer;
@@ -230,6 +232,8 @@ void AnnotatedRDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  LOG_EVERY_N(INFO, 1000) << "Queue depth: " << queue_depth << " / "
+      << reader_.queue_capacity();
 }
 
 INSTANTIATE_CLASS(AnnotatedRDataLayer);
@@ -1,4 +1,7 @@
 #include <boost/thread.hpp>
+#include <stdint.h>
+
+#include <algorithm>
 #include <map>
 #include <string>
 #include <vector>
@@ -33,8 +36,9 @@ static boost::mutex bodies_mutex_;
 
 template <typename T>
 DataReader<T>::DataReader(const LayerParameter& param)
-    : queue_pair_(new QueuePair(  //
-        param.data_param().prefetch() * param.data_param().batch_size())) {
+    : queue_capacity_(
+        param.data_param().prefetch() * param.data_param().batch_size()),
+      queue_pair_(new QueuePair(queue_capacity_)) {
   // Get or create a body
   boost::mutex::scoped_lock lock(bodies_mutex_);
   string key = source_key(param);
@@ -76,10 +80,66 @@ DataReader<T>::QueuePair::~QueuePair() {
   }
 }
 
+// Parses the current value of the cursor into t. Backends that can expose the
+// value in place are parsed without the intermediate string copy, and t keeps
+// the allocations of its previous contents.
+template <typename T>
+static void parse_value(db::Cursor* cursor, T* t) {
+  const char* data;
+  size_t size;
+  if (cursor->value_view(&data, &size)) {
+    t->ParseFromArray(data, size);
+  } else {
+    t->ParseFromString(cursor->value());
+  }
+}
+
+template <typename T>
+DataReader<T>::Reader::Reader(db::Cursor* cursor, int begin, int end,
+    const string& begin_key, int queue_size)
+    : qp_(queue_size), cursor_(cursor), begin_(begin), end_(end),
+      begin_key_(begin_key) {
+  seek_begin();
+  StartInternalThread();
+}
+
+template <typename T>
+DataReader<T>::Reader::~Reader() {
+  StopInternalThread();
+}
+
+template <typename T>
+void DataReader<T>::Reader::seek_begin() {
+  cursor_->Seek(begin_key_);
+  CHECK(cursor_->valid() && cursor_->key() == begin_key_)
+      << "Item " << begin_ << " is gone from the database";
+}
+
+template <typename T>
+void DataReader<T>::Reader::InternalThreadEntry() {
+  try {
+    int index = begin_;
+    while (!must_stop()) {
+      T* t = qp_.free_.pop();
+      parse_value(cursor_.get(), t);
+      qp_.full_.push(t);
+      if (++index == end_) {
+        index = begin_;
+        seek_begin();
+      } else {
+        cursor_->Next();
+      }
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
 template <typename T>
 DataReader<T>::Body::Body(const LayerParameter& param)
     : param_(param),
-      new_queue_pairs_() {
+      new_queue_pairs_(),
+      next_reader_(0) {
   StartInternalThread();
 }
 
@@ -94,6 +154,36 @@ void DataReader<T>::Body::InternalThreadEntry() {
   db->Open(param_.data_param().source(), db::READ);
   shared_ptr<db::Cursor> cursor(db->NewCursor());
   vector<shared_ptr<QueuePair> > qps;
+  const int reader_threads = param_.data_param().reader_threads();
+  if (reader_threads > 1) {
+    const int count = static_cast<int>(db->Count());
+    CHECK_GT(count, 0) << "Empty database " << param_.data_param().source();
+    const int num_readers = std::min(reader_threads, count);
+    const int queue_size =
+        param_.data_param().prefetch() * param_.data_param().batch_size();
+    // The first key of every range, so that the readers seek back to it at
+    // each epoch instead of stepping over the ranges before theirs.
+    vector<int> begins(num_readers + 1);
+    for (int r = 0; r <= num_readers; ++r) {
+      begins[r] = int64_t(count) * r / num_readers;
+    }
+    vector<string> begin_keys;
+    cursor->SeekToFirst();
+    for (int index = 0; begin_keys.size() < begins.size() - 1; ++index) {
+      if (index == begins[begin_keys.size()]) {
+        begin_keys.push_back(cursor->key());
+      }
+      cursor->Next();
+    }
+    for (int r = 0; r < num_readers; ++r) {
+      // Cursors are opened here, one at a time, then moved to their reader.
+      readers_.push_back(shared_ptr<Reader>(new Reader(db->NewCursor(),
+          begins[r], begins[r + 1], begin_keys[r], queue_size)));
+    }
+    handed_.resize(num_readers, 0);
+    LOG_IF(INFO, Caffe::root_solver()) << num_readers << " readers over "
+        << count << " items of " << param_.data_param().source();
+  }
   try {
     int solver_count = param_.phase() == TRAIN ? Caffe::solver_count() : 1;
 
@@ -102,13 +192,21 @@ void DataReader<T>::Body::InternalThreadEntry() {
     // so read one item, then wait for the next solver.
     for (int i = 0; i < solver_count; ++i) {
       shared_ptr<QueuePair> qp(new_queue_pairs_.pop());
-      read_one(cursor.get(), qp.get());
+      if (readers_.empty()) {
+        read_one(cursor.get(), qp.get());
+      } else {
+        hand_one(qp.get());
+      }
       qps.push_back(qp);
     }
     // Main loop
     while (!must_stop()) {
       for (int i = 0; i < solver_count; ++i) {
-        read_one(cursor.get(), qps[i].get());
+        if (readers_.empty()) {
+          read_one(cursor.get(), qps[i].get());
+        } else {
+          hand_one(qps[i].get());
+        }
       }
       // Check no additional readers have been created. This can happen if
       // more than one net is trained at a time per process, whether single
@@ -119,13 +217,16 @@ void DataReader<T>::Body::InternalThreadEntry() {
   } catch (boost::thread_interrupted&) {
     // Interrupted exception is expected on shutdown
   }
+  // Stop the readers before their cursors and the db go away. Joining them
+  // must not throw on the interruption that stopped this thread.
+  boost::this_thread::disable_interruption no_interruption;
+  readers_.clear();
 }
 
 template <typename T>
 void DataReader<T>::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
   T* t = qp->free_.pop();
-  // TODO deserialize in-place instead of copy?
-  t->ParseFromString(cursor->value());
+  parse_value(cursor, t);
   qp->full_.push(t);
 
   // go to the next iter
@@ -136,6 +237,27 @@ void DataReader<T>::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
   }
 }
 
+template <typename T>
+void DataReader<T>::Body::hand_one(QueuePair* qp) {
+  // Skip the readers done with their range, once all are start a new epoch.
+  int skipped = 0;
+  while (handed_[next_reader_] == readers_[next_reader_]->size()) {
+    next_reader_ = (next_reader_ + 1) % readers_.size();
+    if (++skipped == readers_.size()) {
+      std::fill(handed_.begin(), handed_.end(), 0);
+      next_reader_ = 0;
+    }
+  }
+  Reader* reader = readers_[next_reader_].get();
+  handed_[next_reader_]++;
+  next_reader_ = (next_reader_ + 1) % readers_.size();
+  T* parsed = reader->qp_.full_.pop();
+  T* t = qp->free_.pop();
+  t->Swap(parsed);
+  reader->qp_.free_.push(parsed);
+  qp->full_.push(t);
+}
+
 // Instance class
 template class DataReader<Datum>;
 template class DataReader<AnnotatedDatum>;
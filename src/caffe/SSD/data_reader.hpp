@@ -19,6 +19,11 @@ namespace caffe {
  * databases are read sequentially, and that each solver accesses a different
  * subset of the database. Data is distributed to solvers in a round-robin
  * way to keep parallel training deterministic.
+ *
+ * With data_param.reader_threads > 1 the database is split in as many
+ * contiguous ranges, each parsed by its own thread into recycled objects.
+ * The body hands out one item of each range in turn (Swap, no copy), so the
+ * order is still deterministic, but interleaves the ranges.
  */
 template <typename T>
 class DataReader {
@@ -32,6 +37,14 @@ class DataReader {
   inline BlockingQueue<T*>& full() const {
     return queue_pair_->full_;
   }
+  // Items read ahead and waiting for the layer: near 0 when the solver waits
+  // on I/O, near queue_capacity() when it is bound by compute.
+  inline size_t queue_depth() const {
+    return queue_pair_->full_.size();
+  }
+  inline size_t queue_capacity() const {
+    return queue_capacity_;
+  }
 
  protected:
   // Queue pairs are shared between a body and its readers
@@ -46,6 +59,30 @@ class DataReader {
   DISABLE_COPY_AND_ASSIGN(QueuePair);
   };
 
+  // Parses the items [begin, end) of the database, cycling over them
+  class Reader : public InternalThread {
+   public:
+    Reader(db::Cursor* cursor, int begin, int end, const string& begin_key,
+        int queue_size);
+    virtual ~Reader();
+
+    inline int size() const { return end_ - begin_; }
+
+    QueuePair qp_;
+
+   protected:
+    void InternalThreadEntry();
+    void seek_begin();
+
+    shared_ptr<db::Cursor> cursor_;
+    const int begin_;
+    const int end_;
+    // the key of item begin_, where each epoch of the range starts
+    const string begin_key_;
+
+  DISABLE_COPY_AND_ASSIGN(Reader);
+  };
+
   // A single body is created per source
   class Body : public InternalThread {
    public:
@@ -55,9 +92,17 @@ class DataReader {
    protected:
     void InternalThreadEntry();
     void read_one(db::Cursor* cursor, QueuePair* qp);
+    // Moves the next parsed item of the readers, in turn, to qp. Readers
+    // done with their range wait for the others, so that every item is
+    // handed out once per epoch.
+    void hand_one(QueuePair* qp);
 
     const LayerParameter param_;
     BlockingQueue<shared_ptr<QueuePair> > new_queue_pairs_;
+    vector<shared_ptr<Reader> > readers_;
+    // items handed out of each reader in this epoch
+    vector<int> handed_;
+    int next_reader_;
 
     friend class DataReader;
 
@@ -70,6 +115,7 @@ class DataReader {
     return param.name() + ":" + param.data_param().source();
   }
 
+  const size_t queue_capacity_;
   const shared_ptr<QueuePair> queue_pair_;
   shared_ptr<Body> body_;
 
@@ -2,12 +2,14 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
 #include "ssd_data_transformer.hpp"
 #include "util/bbox_util.hpp"
 #include "util/im_transforms.hpp"
+#include "util/sampler.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
@@ -568,6 +570,19 @@ void SSDDataTransformer<Dtype>::DistortImage(const Datum& datum,
   }
 }
 
+template<typename Dtype>
+bool SSDDataTransformer<Dtype>::CanFuse() const {
+#ifdef USE_OPENCV
+  return param_.has_resize_param() &&
+      param_.resize_param().resize_mode() ==
+          ResizeParameter_Resize_mode_WARP &&
+      param_.crop_size() == 0 && param_.crop_h() == 0 &&
+      param_.crop_w() == 0 && !param_.has_mean_file();
+#else
+  return false;
+#endif  // USE_OPENCV
+}
+
 #ifdef USE_OPENCV
 template<typename Dtype>
 void SSDDataTransformer<Dtype>::Transform(const vector<cv::Mat> & mat_vector,
@@ -885,6 +900,289 @@ void SSDDataTransformer<Dtype>::ExpandImage(const cv::Mat& img,
   img.copyTo((*expand_img)(bbox_roi));
 }
 
+// Draws one distortion of ApplyDistort the way the Random* functions do,
+// returns whether it applies.
+static bool RandomDistortion(const float prob, const float lower,
+                             const float upper, float* delta) {
+  float p;
+  caffe_rng_uniform(1, 0.f, 1.f, &p);
+  if (p >= prob) {
+    return false;
+  }
+  CHECK_GE(upper, lower);
+  caffe_rng_uniform(1, lower, upper, delta);
+  return true;
+}
+
+template<typename Dtype>
+void SSDDataTransformer<Dtype>::FusedTransform(
+    const AnnotatedDatum& anno_datum,
+    const vector<BatchSampler>& batch_samplers,
+    Blob<Dtype>* transformed_blob,
+    vector<AnnotationGroup>* transformed_anno_vec) {
+  CHECK(CanFuse()) << "transform_param does not support fused augmentation";
+  const Datum& datum = anno_datum.datum();
+  CHECK(datum.encoded()) << "Fused augmentation needs an encoded datum";
+  CHECK(!(param_.force_color() && param_.force_gray()))
+      << "cannot set both force_color and force_gray";
+  cv::Mat cv_img;
+  if (param_.force_color() || param_.force_gray()) {
+    // If force_color then decode in color otherwise decode in gray.
+    cv_img = DecodeDatumToCVMat(datum, param_.force_color());
+  } else {
+    cv_img = DecodeDatumToCVMatNative(datum);
+  }
+  const int img_height = cv_img.rows;
+  const int img_width = cv_img.cols;
+  const int img_channels = cv_img.channels();
+  const int channels = transformed_blob->channels();
+  const int height = transformed_blob->height();
+  const int width = transformed_blob->width();
+  CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
+  CHECK_EQ(channels, img_channels);
+  CHECK_EQ(height, param_.resize_param().height());
+  CHECK_EQ(width, param_.resize_param().width());
+  const bool has_mean_values = mean_values_.size() > 0;
+  if (has_mean_values) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == img_channels) <<
+        "Specify either 1 mean_value or as many as channels: " << img_channels;
+    if (img_channels > 1 && mean_values_.size() == 1) {
+      // Replicate the mean_value for simplicity
+      for (int c = 1; c < img_channels; ++c) {
+        mean_values_.push_back(mean_values_[0]);
+      }
+    }
+  }
+
+  // By default the decoded image is distorted as DistortImage does, only
+  // without re-encoding it. With fused_distort_warped the distortion is drawn
+  // the same way, but saturation and hue change the warped image and
+  // brightness, contrast and the channel order the final write.
+  float brightness = 0, contrast = 1, saturation = 1, hue = 0;
+  bool do_brightness = false, do_contrast = false;
+  bool do_saturation = false, do_hue = false;
+  vector<int> channel_order(img_channels);
+  for (int c = 0; c < img_channels; ++c) {
+    channel_order[c] = c;
+  }
+  if (param_.has_distort_param() && !param_.fused_distort_warped()) {
+    cv_img = ApplyDistort(cv_img, param_.distort_param());
+  } else if (param_.has_distort_param()) {
+    const DistortionParameter& distort = param_.distort_param();
+    float prob;
+    caffe_rng_uniform(1, 0.f, 1.f, &prob);
+    do_brightness = RandomDistortion(distort.brightness_prob(),
+        -distort.brightness_delta(), distort.brightness_delta(), &brightness);
+    if (prob > 0.5) {
+      do_contrast = RandomDistortion(distort.contrast_prob(),
+          distort.contrast_lower(), distort.contrast_upper(), &contrast);
+      do_saturation = RandomDistortion(distort.saturation_prob(),
+          distort.saturation_lower(), distort.saturation_upper(), &saturation);
+      do_hue = RandomDistortion(distort.hue_prob(), -distort.hue_delta(),
+                                distort.hue_delta(), &hue);
+    } else {
+      do_saturation = RandomDistortion(distort.saturation_prob(),
+          distort.saturation_lower(), distort.saturation_upper(), &saturation);
+      do_hue = RandomDistortion(distort.hue_prob(), -distort.hue_delta(),
+                                distort.hue_delta(), &hue);
+      do_contrast = RandomDistortion(distort.contrast_prob(),
+          distort.contrast_lower(), distort.contrast_upper(), &contrast);
+    }
+    caffe_rng_uniform(1, 0.f, 1.f, &prob);
+    if (prob < distort.random_order_prob()) {
+      CHECK_EQ(img_channels, 3);
+      // As RandomOrderChannels, which does not draw from the caffe rng.
+      std::random_shuffle(channel_order.begin(), channel_order.end());
+    }
+  }
+
+  // Expand as ExpandImage does, the canvas only exists in the warp.
+  AnnotatedDatum expand_datum;
+  expand_datum.set_type(anno_datum.type());
+  int canvas_height = img_height;
+  int canvas_width = img_width;
+  float h_off = 0, w_off = 0;
+  bool do_expand = false;
+  if (param_.has_expand_param()) {
+    const ExpansionParameter& expand_param = param_.expand_param();
+    const float max_expand_ratio = expand_param.max_expand_ratio();
+    float prob;
+    caffe_rng_uniform(1, 0.f, 1.f, &prob);
+    if (prob <= expand_param.prob() && fabs(max_expand_ratio - 1.) >= 1e-2) {
+      float expand_ratio;
+      caffe_rng_uniform(1, 1.f, max_expand_ratio, &expand_ratio);
+      canvas_height = static_cast<int>(img_height * expand_ratio);
+      canvas_width = static_cast<int>(img_width * expand_ratio);
+      caffe_rng_uniform(1, 0.f, static_cast<float>(canvas_height - img_height),
+                        &h_off);
+      caffe_rng_uniform(1, 0.f, static_cast<float>(canvas_width - img_width),
+                        &w_off);
+      h_off = floor(h_off);
+      w_off = floor(w_off);
+      NormalizedBBox expand_bbox;
+      expand_bbox.set_xmin(-w_off/img_width);
+      expand_bbox.set_ymin(-h_off/img_height);
+      expand_bbox.set_xmax((canvas_width - w_off)/img_width);
+      expand_bbox.set_ymax((canvas_height - h_off)/img_height);
+      TransformAnnotation(anno_datum, false, expand_bbox, false,
+                          expand_datum.mutable_annotation_group());
+      do_expand = true;
+    }
+  }
+  if (!do_expand) {
+    expand_datum.mutable_annotation_group()->CopyFrom(
+        anno_datum.annotation_group());
+  }
+
+  // Sample and crop as AnnotatedDataLayer and CropImage do.
+  AnnotatedDatum crop_datum;
+  crop_datum.set_type(anno_datum.type());
+  NormalizedBBox crop_bbox;
+  crop_bbox.set_xmin(0);
+  crop_bbox.set_ymin(0);
+  crop_bbox.set_xmax(1);
+  crop_bbox.set_ymax(1);
+  bool has_sampled = false;
+  if (batch_samplers.size() > 0) {
+    vector<NormalizedBBox> sampled_bboxes;
+    GenerateBatchSamples(expand_datum, batch_samplers, &sampled_bboxes);
+    if (sampled_bboxes.size() > 0) {
+      int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
+      ClipBBox(sampled_bboxes[rand_idx], &crop_bbox);
+      TransformAnnotation(expand_datum, false, crop_bbox, false,
+                          crop_datum.mutable_annotation_group());
+      has_sampled = true;
+    }
+  }
+  if (!has_sampled) {
+    crop_datum.mutable_annotation_group()->CopyFrom(
+        expand_datum.annotation_group());
+  }
+  NormalizedBBox scaled_bbox;
+  ScaleBBox(crop_bbox, canvas_height, canvas_width, &scaled_bbox);
+  const int crop_x = static_cast<int>(scaled_bbox.xmin());
+  const int crop_y = static_cast<int>(scaled_bbox.ymin());
+  const int crop_width =
+      static_cast<int>(scaled_bbox.xmax() - scaled_bbox.xmin());
+  const int crop_height =
+      static_cast<int>(scaled_bbox.ymax() - scaled_bbox.ymin());
+  CHECK_GT(crop_width, 0);
+  CHECK_GT(crop_height, 0);
+
+  const bool do_mirror = param_.mirror() && Rand(2);
+  int interp_mode = RandomInterpMode(param_.resize_param());
+
+  // The output pixel (u, v) samples the crop where cv::resize would,
+  // x = (u + 0.5) * crop_width / width - 0.5, with u -> width - 1 - u when
+  // mirrored, and the crop is at (crop_x - w_off, crop_y - h_off) of the
+  // decoded image.
+  const double scale_x = static_cast<double>(crop_width) / width;
+  const double scale_y = static_cast<double>(crop_height) / height;
+  double ax = scale_x;
+  double bx = 0.5 * scale_x - 0.5 + crop_x - w_off;
+  if (do_mirror) {
+    ax = -scale_x;
+    bx = (width - 0.5) * scale_x - 0.5 + crop_x - w_off;
+  }
+  double ay = scale_y;
+  double by = 0.5 * scale_y - 0.5 + crop_y - h_off;
+  cv::Mat src_img = cv_img;
+  if (interp_mode == cv::INTER_AREA) {
+    // warpAffine has no area filter. When shrinking by 2 or more, shrink the
+    // part of the image under the crop with cv::resize first and warp that.
+    const int x0 = std::max(0, static_cast<int>(crop_x - w_off) - 1);
+    const int y0 = std::max(0, static_cast<int>(crop_y - h_off) - 1);
+    const int x1 = std::min(img_width,
+                            static_cast<int>(crop_x - w_off) + crop_width + 1);
+    const int y1 = std::min(img_height,
+                            static_cast<int>(crop_y - h_off) + crop_height + 1);
+    if ((scale_x >= 2 || scale_y >= 2) && x1 > x0 && y1 > y0) {
+      const int roi_width = x1 - x0;
+      const int roi_height = y1 - y0;
+      const int shrunk_width = std::max(1,
+          cvRound(roi_width / std::max(1., scale_x)));
+      const int shrunk_height = std::max(1,
+          cvRound(roi_height / std::max(1., scale_y)));
+      cv::resize(cv_img(cv::Rect(x0, y0, roi_width, roi_height)), src_img,
+                 cv::Size(shrunk_width, shrunk_height), 0, 0, cv::INTER_AREA);
+      const double kx = static_cast<double>(roi_width) / shrunk_width;
+      const double ky = static_cast<double>(roi_height) / shrunk_height;
+      ax /= kx;
+      bx = (bx - x0 + 0.5) / kx - 0.5;
+      ay /= ky;
+      by = (by - y0 + 0.5) / ky - 0.5;
+    }
+    interp_mode = cv::INTER_LINEAR;
+  }
+  cv::Mat warp_mat = (cv::Mat_<double>(2, 3) << ax, 0, bx, 0, ay, by);
+  // The expanded canvas is filled with the mean, as in ExpandImage.
+  cv::Scalar fill(0, 0, 0);
+  if (has_mean_values) {
+    for (int c = 0; c < std::min(img_channels, 4); ++c) {
+      fill[c] = mean_values_[c];
+    }
+  }
+  cv::Mat cv_warped_image;
+  cv::warpAffine(src_img, cv_warped_image, warp_mat, cv::Size(width, height),
+                 interp_mode | cv::WARP_INVERSE_MAP,
+                 do_expand ? cv::BORDER_CONSTANT : cv::BORDER_REPLICATE, fill);
+
+  if (param_.has_noise_param()) {
+    cv_warped_image = ApplyNoise(cv_warped_image, param_.noise_param());
+  }
+  if (do_saturation) {
+    AdjustSaturation(cv_warped_image, saturation, &cv_warped_image);
+  }
+  if (do_hue) {
+    AdjustHue(cv_warped_image, hue, &cv_warped_image);
+  }
+  CHECK(cv_warped_image.depth() == CV_8U);
+  CHECK_EQ(cv_warped_image.channels(), channels);
+
+  // One table per channel for brightness, contrast, mean and scale, each
+  // saturated to uchar like AdjustBrightness and AdjustContrast.
+  const Dtype scale = param_.scale();
+  vector<Dtype> lut(channels * 256);
+  for (int v = 0; v < 256; ++v) {
+    int pixel = v;
+    if (do_brightness && fabs(brightness) > 0) {
+      pixel = cv::saturate_cast<uchar>(pixel + brightness);
+    }
+    if (do_contrast && fabs(contrast - 1.f) > 1e-3) {
+      pixel = cv::saturate_cast<uchar>(pixel * contrast);
+    }
+    for (int c = 0; c < channels; ++c) {
+      lut[c * 256 + v] = has_mean_values ?
+          (pixel - mean_values_[c]) * scale : pixel * scale;
+    }
+  }
+  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
+  for (int h = 0; h < height; ++h) {
+    const uchar* ptr = cv_warped_image.ptr<uchar>(h);
+    for (int w = 0; w < width; ++w) {
+      for (int c = 0; c < channels; ++c) {
+        transformed_data[(c * height + h) * width + w] =
+            lut[c * 256 + ptr[w * channels + channel_order[c]]];
+      }
+    }
+  }
+
+  // Resize and mirror the annotations as Transform does.
+  crop_datum.mutable_datum()->set_height(crop_height);
+  crop_datum.mutable_datum()->set_width(crop_width);
+  NormalizedBBox unit_bbox;
+  unit_bbox.set_xmin(0);
+  unit_bbox.set_ymin(0);
+  unit_bbox.set_xmax(1);
+  unit_bbox.set_ymax(1);
+  RepeatedPtrField<AnnotationGroup> transformed_anno_group_all;
+  TransformAnnotation(crop_datum, true, unit_bbox, do_mirror,
+                      &transformed_anno_group_all);
+  for (int g = 0; g < transformed_anno_group_all.size(); ++g) {
+    transformed_anno_vec->push_back(transformed_anno_group_all.Get(g));
+  }
+}
+
 #endif  // USE_OPENCV
 
 template<typename Dtype>
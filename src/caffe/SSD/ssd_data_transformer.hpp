@@ -130,6 +130,12 @@ class SSDDataTransformer {
    */
   void DistortImage(const Datum& datum, Datum* distort_datum);
 
+  /**
+   * @brief Whether FusedTransform supports the transform_param: it needs a
+   *    WARP resize_param, no crop and no mean_file.
+   */
+  bool CanFuse() const;
+
 #ifdef USE_OPENCV
   /**
    * @brief Applies the transformation defined in the data layer's
@@ -170,6 +176,20 @@ class SSDDataTransformer {
   void ExpandImage(const cv::Mat& img, const float expand_ratio,
                    NormalizedBBox* expand_bbox, cv::Mat* expand_img);
 
+  /**
+   * @brief Distorts, expands, samples with batch_samplers, mirrors and
+   *    resizes an encoded anno_datum like the separate steps of
+   *    AnnotatedDataLayer do, but decodes it once and warps it once: the
+   *    geometric steps are a single affine map of the decoded image, and
+   *    the annotations are only projected. With fused_distort_warped,
+   *    saturation and hue distort the warped image, and brightness, contrast
+   *    and channel order are applied while writing transformed_blob.
+   */
+  void FusedTransform(const AnnotatedDatum& anno_datum,
+                      const vector<BatchSampler>& batch_samplers,
+                      Blob<Dtype>* transformed_blob,
+                      vector<AnnotationGroup>* transformed_anno_vec);
+
   void TransformInv(const Blob<Dtype>* blob, vector<cv::Mat>* cv_imgs);
   void TransformInv(const Dtype* data, cv::Mat* cv_img, const int height,
                     const int width, const int channels);
@@ -336,27 +336,7 @@ void constantNoise(const int n, const vector<uchar>& val, cv::Mat* image) {
   }
 }
 
-cv::Mat ApplyResize(const cv::Mat& in_img, const ResizeParameter& param) {
-  cv::Mat out_img;
-
-  // Reading parameters
-  const int new_height = param.height();
-  const int new_width = param.width();
-
-  int pad_mode = cv::BORDER_CONSTANT;
-  switch (param.pad_mode()) {
-    case ResizeParameter_Pad_mode_CONSTANT:
-      break;
-    case ResizeParameter_Pad_mode_MIRRORED:
-      pad_mode = cv::BORDER_REFLECT101;
-      break;
-    case ResizeParameter_Pad_mode_REPEAT_NEAREST:
-      pad_mode = cv::BORDER_REPLICATE;
-      break;
-    default:
-      LOG(FATAL) << "Unknown pad mode.";
-  }
-
+int RandomInterpMode(const ResizeParameter& param) {
   int interp_mode = cv::INTER_LINEAR;
   int num_interp_mode = param.interp_mode_size();
   if (num_interp_mode > 0) {
@@ -382,6 +362,31 @@ cv::Mat ApplyResize(const cv::Mat& in_img, const ResizeParameter& param) {
         LOG(FATAL) << "Unknown interp mode.";
     }
   }
+  return interp_mode;
+}
+
+cv::Mat ApplyResize(const cv::Mat& in_img, const ResizeParameter& param) {
+  cv::Mat out_img;
+
+  // Reading parameters
+  const int new_height = param.height();
+  const int new_width = param.width();
+
+  int pad_mode = cv::BORDER_CONSTANT;
+  switch (param.pad_mode()) {
+    case ResizeParameter_Pad_mode_CONSTANT:
+      break;
+    case ResizeParameter_Pad_mode_MIRRORED:
+      pad_mode = cv::BORDER_REFLECT101;
+      break;
+    case ResizeParameter_Pad_mode_REPEAT_NEAREST:
+      pad_mode = cv::BORDER_REPLICATE;
+      break;
+    default:
+      LOG(FATAL) << "Unknown pad mode.";
+  }
+
+  const int interp_mode = RandomInterpMode(param);
 
   cv::Scalar pad_val = cv::Scalar(0, 0, 0);
   const int img_channels = in_img.channels();
@@ -51,6 +51,9 @@ cv::Mat AspectKeepingResizeBySmall(const cv::Mat& in_img,
 
 void constantNoise(const int n, const vector<uchar>& val, cv::Mat* image);
 
+// Pick one of the interp_mode of param at random, cv::INTER_LINEAR if none.
+int RandomInterpMode(const ResizeParameter& param);
+
 cv::Mat ApplyResize(const cv::Mat& in_img, const ResizeParameter& param);
 
 cv::Mat ApplyNoise(const cv::Mat& in_img, const NoiseParameter& param);
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <climits>
 #include <vector>
 
@@ -164,6 +165,58 @@ void Blob<Dtype>::ShareDiff(const Blob& other) {
   diff_ = other.diff();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ShareDataView(const Blob& other, const int offset) {
+  CHECK(other.data());
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  data_.reset(new SyncedMemory(other.data(), offset * sizeof(Dtype),
+      count_ * sizeof(Dtype)));
+  // Growing must leave the view.
+  capacity_ = count_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDiffView(const Blob& other, const int offset) {
+  CHECK(other.diff());
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  diff_.reset(new SyncedMemory(other.diff(), offset * sizeof(Dtype),
+      count_ * sizeof(Dtype)));
+  capacity_ = count_;
+}
+
+template <typename Dtype>
+bool Blob<Dtype>::IsDataViewOf(const Blob& other, const int offset) const {
+  return data_ && data_->is_view_of(other.data().get(),
+      offset * sizeof(Dtype));
+}
+
+template <typename Dtype>
+bool Blob<Dtype>::IsDiffViewOf(const Blob& other, const int offset) const {
+  return diff_ && diff_->is_view_of(other.diff().get(),
+      offset * sizeof(Dtype));
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ReleaseViews() {
+  const size_t size = count_ * sizeof(Dtype);
+  if (data_ && data_->is_view()) {
+    shared_ptr<SyncedMemory> data(new SyncedMemory(size));
+    caffe_copy(count_, cpu_data(),
+        static_cast<Dtype*>(data->mutable_cpu_data()));
+    data_ = data;
+    capacity_ = count_;
+  }
+  if (diff_ && diff_->is_view()) {
+    shared_ptr<SyncedMemory> diff(new SyncedMemory(size));
+    caffe_copy(count_, cpu_diff(),
+        static_cast<Dtype*>(diff->mutable_cpu_data()));
+    diff_ = diff;
+    capacity_ = count_;
+  }
+}
+
 // The "update" method is used for parameter blobs in a Net, which are stored
 // as Blob<float> or Blob<double> -- hence we do not define it for
 // Blob<int> or Blob<unsigned int>.
@@ -521,15 +574,16 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_double_data();
   proto->clear_double_diff();
+  // One copy, into the capacity a reused proto (e.g. snapshots) already has
   const double* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_double_data(data_vec[i]);
-  }
+  proto->mutable_double_data()->Resize(count_, 0);
+  std::copy(data_vec, data_vec + count_,
+            proto->mutable_double_data()->mutable_data());
   if (write_diff) {
     const double* diff_vec = cpu_diff();
-    for (int i = 0; i < count_; ++i) {
-      proto->add_double_diff(diff_vec[i]);
-    }
+    proto->mutable_double_diff()->Resize(count_, 0);
+    std::copy(diff_vec, diff_vec + count_,
+              proto->mutable_double_diff()->mutable_data());
   }
 }
 
@@ -541,15 +595,16 @@ void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_data();
   proto->clear_diff();
+  // One copy, into the capacity a reused proto (e.g. snapshots) already has
   const float* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_data(data_vec[i]);
-  }
+  proto->mutable_data()->Resize(count_, 0);
+  std::copy(data_vec, data_vec + count_,
+            proto->mutable_data()->mutable_data());
   if (write_diff) {
     const float* diff_vec = cpu_diff();
-    for (int i = 0; i < count_; ++i) {
-      proto->add_diff(diff_vec[i]);
-    }
+    proto->mutable_diff()->Resize(count_, 0);
+    std::copy(diff_vec, diff_vec + count_,
+              proto->mutable_diff()->mutable_data());
   }
 }
 
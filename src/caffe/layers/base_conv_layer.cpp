@@ -1,8 +1,12 @@
 #include <algorithm>
+#include <map>
+#include <sstream>
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/base_conv_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/cpu_conv.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -139,6 +143,19 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     weight_shape.push_back(kernel_shape_data[i]);
   }
   bias_term_ = this->layer_param_.convolution_param().bias_term();
+  cpu_engine_by_size_.clear();
+  winograd_weights_version_ = 0;
+  fused_relu_ = conv_param.has_fused_relu_param();
+  relu_negative_slope_ = conv_param.fused_relu_param().negative_slope();
+  const QuantizationParameter& quant_param =
+      this->layer_param_.quantization_param();
+  int8_ = this->phase_ == TEST && !reverse_dimensions() &&
+      quant_param.precision() == QuantizationParameter_Precision_INT8;
+  if (int8_) {
+    CHECK_GT(quant_param.bottom_max(), 0)
+        << "INT8 quantization requires the calibrated bottom_max.";
+    int8_input_scale_ = Dtype(127) / quant_param.bottom_max();
+  }
   vector<int> bias_shape(bias_term_, num_output_);
   if (this->blobs_.size() > 0) {
     CHECK_EQ(1 + bias_term_, this->blobs_.size())
@@ -178,6 +195,11 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
   kernel_dim_ = this->blobs_[0]->count(1);
   weight_offset_ = conv_out_channels_ * kernel_dim_ / group_;
+  int8_gemm_.clear();
+  int8_weight_version_ = 0;
+  for (int g = 0; int8_ && g < group_; ++g) {
+    int8_gemm_.push_back(shared_ptr<Int8Gemm<Dtype> >(new Int8Gemm<Dtype>()));
+  }
   // Propagate gradients to the parameters (as directed by backward pass).
   this->param_propagate_down_.resize(this->blobs_.size(), true);
 }
@@ -251,6 +273,14 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     caffe_set(bias_multiplier_.count(), Dtype(1),
         bias_multiplier_.mutable_cpu_data());
   }
+  // Get the weights of the CPU forward pass ready.
+  if (Caffe::mode() == Caffe::CPU && !reverse_dimensions()) {
+    if (int8_) {
+      quantize_weights_cpu();
+    } else {
+      select_cpu_engine(bottom[0]->cpu_data(), top[0]->mutable_cpu_data());
+    }
+  }
 }
 
 template <typename Dtype>
@@ -271,6 +301,181 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::quantize_weights_cpu() {
+  const uint64_t version = this->blobs_[0]->data()->version();
+  if (version == int8_weight_version_) { return; }
+  const Dtype* weights = this->blobs_[0]->cpu_data();
+  for (int g = 0; g < group_; ++g) {
+    int8_gemm_[g]->SetWeights(conv_out_channels_ / group_, kernel_dim_,
+        weights + weight_offset_ * g, int8_input_scale_);
+  }
+  int8_weight_version_ = version;
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_int8(const Dtype* input,
+    Dtype* output) {
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+    col_buff = col_buffer_.cpu_data();
+  }
+  for (int g = 0; g < group_; ++g) {
+    int8_gemm_[g]->Forward(conv_out_spatial_dim_, col_buff + col_offset_ * g,
+        output + output_offset_ * g);
+  }
+}
+
+template <typename Dtype>
+bool BaseConvolutionLayer<Dtype>::cpu_engine_applicable(
+    const ConvolutionParameter_CPUEngine engine) {
+  if (engine == ConvolutionParameter_CPUEngine_IM2COL) { return true; }
+  if (reverse_dimensions() || num_spatial_axes_ != 2) { return false; }
+  if (engine == ConvolutionParameter_CPUEngine_DIRECT) { return true; }
+  const int* kernel_shape_data = kernel_shape_.cpu_data();
+  const int* stride_data = stride_.cpu_data();
+  const int* dilation_data = dilation_.cpu_data();
+  for (int i = 0; i < 2; ++i) {
+    if (kernel_shape_data[i] != 3 || stride_data[i] != 1 ||
+        dilation_data[i] != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::select_cpu_engine(const Dtype* input,
+    Dtype* output) {
+  const ConvolutionParameter_CPUEngine engine =
+      this->layer_param_.convolution_param().cpu_engine();
+  if (engine != ConvolutionParameter_CPUEngine_AUTO) {
+    CHECK(cpu_engine_applicable(engine))
+        << ConvolutionParameter_CPUEngine_Name(engine)
+        << " does not apply to layer " << this->layer_param_.name();
+    cpu_engine_ = engine;
+  } else if (this->phase_ == TRAIN) {
+    cpu_engine_ = ConvolutionParameter_CPUEngine_IM2COL;
+  } else {
+    int size_bucket = 0;
+    for (int size = conv_out_spatial_dim_; size > 1; size /= 2) {
+      ++size_bucket;
+    }
+    if (!cpu_engine_by_size_.count(size_bucket)) {
+      cpu_engine_by_size_[size_bucket] = benchmark_cpu_engine(input, output);
+    }
+    cpu_engine_ = cpu_engine_by_size_[size_bucket];
+  }
+  prepare_cpu_engine();
+}
+
+template <typename Dtype>
+ConvolutionParameter_CPUEngine
+BaseConvolutionLayer<Dtype>::benchmark_cpu_engine(const Dtype* input,
+    Dtype* output) {
+  // Time every applicable engine on the first image, keeping the best of two
+  // runs.
+  const Dtype* weights = this->blobs_[0]->cpu_data();
+  ConvolutionParameter_CPUEngine best_engine =
+      ConvolutionParameter_CPUEngine_IM2COL;
+  float best_time = 0;
+  std::ostringstream times;
+  CPUTimer timer;
+  for (int i = ConvolutionParameter_CPUEngine_IM2COL;
+       i <= ConvolutionParameter_CPUEngine_CPUEngine_MAX; ++i) {
+    cpu_engine_ = static_cast<ConvolutionParameter_CPUEngine>(i);
+    if (!cpu_engine_applicable(cpu_engine_)) { continue; }
+    prepare_cpu_engine();
+    float engine_time = 0;
+    for (int run = 0; run < 2; ++run) {
+      timer.Start();
+      forward_cpu_engine(input, weights, output);
+      timer.Stop();
+      if (run == 0 || timer.MicroSeconds() < engine_time) {
+        engine_time = timer.MicroSeconds();
+      }
+    }
+    times << " " << ConvolutionParameter_CPUEngine_Name(cpu_engine_) << " "
+        << engine_time / 1000 << " ms";
+    if (i == ConvolutionParameter_CPUEngine_IM2COL ||
+        engine_time < best_time) {
+      best_engine = cpu_engine_;
+      best_time = engine_time;
+    }
+  }
+  LOG(INFO) << "Layer " << this->layer_param_.name() << " uses CPU engine "
+      << ConvolutionParameter_CPUEngine_Name(best_engine) << ":"
+      << times.str();
+  return best_engine;
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::prepare_cpu_engine() {
+  if (cpu_engine_ != ConvolutionParameter_CPUEngine_WINOGRAD_2X2 &&
+      cpu_engine_ != ConvolutionParameter_CPUEngine_WINOGRAD_4X4) {
+    return;
+  }
+  const int tile = winograd_tile();
+  const int alpha2 = (tile + 2) * (tile + 2);
+  const int num_tiles = winograd_num_tiles(tile, output_shape_[0],
+      output_shape_[1]);
+  const int channels = conv_in_channels_ / group_;
+  const int num_output = conv_out_channels_ / group_;
+  winograd_data_.Reshape(vector<int>(1, alpha2 * channels * num_tiles));
+  winograd_output_.Reshape(vector<int>(1, alpha2 * num_output * num_tiles));
+  const uint64_t version = this->blobs_[0]->data()->version();
+  if (version == winograd_weights_version_ &&
+      winograd_weights_.count() == alpha2 * conv_out_channels_ * channels) {
+    return;
+  }
+  winograd_weights_.Reshape(
+      vector<int>(1, alpha2 * conv_out_channels_ * channels));
+  const Dtype* weights = this->blobs_[0]->cpu_data();
+  for (int g = 0; g < group_; ++g) {
+    winograd_transform_weights_cpu(tile, weights + weight_offset_ * g,
+        num_output, channels,
+        winograd_weights_.mutable_cpu_data() + alpha2 * num_output * channels
+        * g);
+  }
+  winograd_weights_version_ = version;
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_engine(const Dtype* input,
+    const Dtype* weights, Dtype* output) {
+  if (cpu_engine_ == ConvolutionParameter_CPUEngine_IM2COL) {
+    forward_cpu_gemm(input, weights, output);
+    return;
+  }
+  const int* kernel_shape_data = kernel_shape_.cpu_data();
+  const int* pad_data = pad_.cpu_data();
+  const int* stride_data = stride_.cpu_data();
+  const int* dilation_data = dilation_.cpu_data();
+  const int height = conv_input_shape_.cpu_data()[1];
+  const int width = conv_input_shape_.cpu_data()[2];
+  const int channels = conv_in_channels_ / group_;
+  const int num_output = conv_out_channels_ / group_;
+  const int input_offset = channels * height * width;
+  for (int g = 0; g < group_; ++g) {
+    if (cpu_engine_ == ConvolutionParameter_CPUEngine_DIRECT) {
+      direct_conv_cpu(input + input_offset * g, channels, height, width,
+          weights + weight_offset_ * g, num_output, kernel_shape_data[0],
+          kernel_shape_data[1], pad_data[0], pad_data[1], stride_data[0],
+          stride_data[1], dilation_data[0], dilation_data[1],
+          output + output_offset_ * g, output_shape_[0], output_shape_[1]);
+    } else {
+      const int tile = winograd_tile();
+      winograd_conv_cpu(tile, input + input_offset * g, channels, height,
+          width, pad_data[0], pad_data[1], winograd_weights_.cpu_data()
+          + (tile + 2) * (tile + 2) * num_output * channels * g, num_output,
+          output + output_offset_ * g, output_shape_[0], output_shape_[1],
+          winograd_data_.mutable_cpu_data(),
+          winograd_output_.mutable_cpu_data());
+    }
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
@@ -279,6 +484,29 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
       (Dtype)1., output);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_bias_relu(Dtype* output,
+    const Dtype* bias) {
+  for (int c = 0; c < num_output_; ++c) {
+    const Dtype bias_c = bias ? bias[c] : Dtype(0);
+    Dtype* output_c = output + c * out_spatial_dim_;
+    for (int i = 0; i < out_spatial_dim_; ++i) {
+      const Dtype value = output_c[i] + bias_c;
+      output_c[i] = std::max(value, Dtype(0))
+          + relu_negative_slope_ * std::min(value, Dtype(0));
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_relu(const Dtype* output,
+    Dtype* output_diff, const int count) {
+  for (int i = 0; i < count; ++i) {
+    output_diff[i] *= ((output[i] > 0)
+        + relu_negative_slope_ * (output[i] <= 0));
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
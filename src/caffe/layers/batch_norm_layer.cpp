@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/batch_norm_layer.hpp"
@@ -19,10 +20,15 @@ void BatchNormLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   else
     channels_ = bottom[0]->shape(1);
   eps_ = param.eps();
+  scale_bias_term_ = param.scale_bias_term();
+  fused_relu_ = param.has_fused_relu_param();
+  relu_negative_slope_ = param.fused_relu_param().negative_slope();
+  CHECK(use_global_stats_ || !(scale_bias_term_ || fused_relu_))
+      << "scale_bias_term and fused_relu_param need use_global_stats.";
   if (this->blobs_.size() > 0) {
     LOG(INFO) << "Skipping parameter initialization";
   } else {
-    this->blobs_.resize(3);
+    this->blobs_.resize(scale_bias_term_ ? 5 : 3);
     vector<int> sz;
     sz.push_back(channels_);
     this->blobs_[0].reset(new Blob<Dtype>(sz));
@@ -33,6 +39,14 @@ void BatchNormLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       caffe_set(this->blobs_[i]->count(), Dtype(0),
                 this->blobs_[i]->mutable_cpu_data());
     }
+    if (scale_bias_term_) {
+      // Scale and bias, initialized to the identity.
+      sz[0] = channels_;
+      this->blobs_[3].reset(new Blob<Dtype>(sz));
+      this->blobs_[4].reset(new Blob<Dtype>(sz));
+      caffe_set(channels_, Dtype(1), this->blobs_[3]->mutable_cpu_data());
+      caffe_set(channels_, Dtype(0), this->blobs_[4]->mutable_cpu_data());
+    }
   }
   // Mask statistics from optimization by setting local learning rates
   // for mean, variance, and the bias correction to zero.
@@ -59,8 +73,13 @@ void BatchNormLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   sz.push_back(channels_);
   mean_.Reshape(sz);
   variance_.Reshape(sz);
-  temp_.ReshapeLike(*bottom[0]);
-  x_norm_.ReshapeLike(*bottom[0]);
+  if (use_global_stats_) {
+    inference_scale_.Reshape(sz);
+    inference_shift_.Reshape(sz);
+  } else {
+    temp_.ReshapeLike(*bottom[0]);
+    x_norm_.ReshapeLike(*bottom[0]);
+  }
   sz[0] = bottom[0]->shape(0);
   batch_sum_multiplier_.Reshape(sz);
 
@@ -83,6 +102,26 @@ void BatchNormLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void BatchNormLayer<Dtype>::compute_inference_affine() {
+  // The statistics can change after Reshape (loaded or shared weights), so
+  // this runs on every forward; it is only O(channels).
+  const Dtype scale_factor = this->blobs_[2]->cpu_data()[0] == 0 ?
+      0 : 1 / this->blobs_[2]->cpu_data()[0];
+  const Dtype* mean = this->blobs_[0]->cpu_data();
+  const Dtype* variance = this->blobs_[1]->cpu_data();
+  const Dtype* scale = scale_bias_term_ ? this->blobs_[3]->cpu_data() : NULL;
+  const Dtype* bias = scale_bias_term_ ? this->blobs_[4]->cpu_data() : NULL;
+  Dtype* scale_data = inference_scale_.mutable_cpu_data();
+  Dtype* shift_data = inference_shift_.mutable_cpu_data();
+  for (int c = 0; c < channels_; ++c) {
+    const Dtype inv_std = 1 / std::sqrt(variance[c] * scale_factor + eps_);
+    scale_data[c] = (scale ? scale[c] : Dtype(1)) * inv_std;
+    shift_data[c] = (bias ? bias[c] : Dtype(0))
+        - scale_data[c] * mean[c] * scale_factor;
+  }
+}
+
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
@@ -91,28 +130,44 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   int num = bottom[0]->shape(0);
   int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
 
+  if (use_global_stats_) {
+    // use the stored mean/variance estimates, in a single pass.
+    compute_inference_affine();
+    const Dtype* scale_data = inference_scale_.cpu_data();
+    const Dtype* shift_data = inference_shift_.cpu_data();
+#pragma omp parallel for
+    for (int i = 0; i < num * channels_; ++i) {
+      const Dtype scale = scale_data[i % channels_];
+      const Dtype shift = shift_data[i % channels_];
+      const Dtype* x = bottom_data + i * spatial_dim;
+      Dtype* y = top_data + i * spatial_dim;
+      if (fused_relu_) {
+        for (int j = 0; j < spatial_dim; ++j) {
+          const Dtype value = scale * x[j] + shift;
+          y[j] = std::max(value, Dtype(0))
+              + relu_negative_slope_ * std::min(value, Dtype(0));
+        }
+      } else {
+        for (int j = 0; j < spatial_dim; ++j) {
+          y[j] = scale * x[j] + shift;
+        }
+      }
+    }
+    return;
+  }
+
   if (bottom[0] != top[0]) {
     caffe_copy(bottom[0]->count(), bottom_data, top_data);
   }
 
-  if (use_global_stats_) {
-    // use the stored mean/variance estimates.
-    const Dtype scale_factor = this->blobs_[2]->cpu_data()[0] == 0 ?
-        0 : 1 / this->blobs_[2]->cpu_data()[0];
-    caffe_cpu_scale(variance_.count(), scale_factor,
-        this->blobs_[0]->cpu_data(), mean_.mutable_cpu_data());
-    caffe_cpu_scale(variance_.count(), scale_factor,
-        this->blobs_[1]->cpu_data(), variance_.mutable_cpu_data());
-  } else {
-    // compute mean
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), bottom_data,
-        spatial_sum_multiplier_.cpu_data(), 0.,
-        num_by_chans_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-        mean_.mutable_cpu_data());
-  }
+  // compute mean
+  caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
+      1. / (num * spatial_dim), bottom_data,
+      spatial_sum_multiplier_.cpu_data(), 0.,
+      num_by_chans_.mutable_cpu_data());
+  caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
+      num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
+      mean_.mutable_cpu_data());
 
   // subtract mean
   caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
@@ -122,29 +177,27 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       spatial_dim, 1, -1, num_by_chans_.cpu_data(),
       spatial_sum_multiplier_.cpu_data(), 1., top_data);
 
-  if (!use_global_stats_) {
-    // compute variance using var(X) = E((X-EX)^2)
-    caffe_powx(top[0]->count(), top_data, Dtype(2),
-        temp_.mutable_cpu_data());  // (X-EX)^2
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), temp_.cpu_data(),
-        spatial_sum_multiplier_.cpu_data(), 0.,
-        num_by_chans_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-        variance_.mutable_cpu_data());  // E((X_EX)^2)
-
-    // compute and save moving average
-    this->blobs_[2]->mutable_cpu_data()[0] *= moving_average_fraction_;
-    this->blobs_[2]->mutable_cpu_data()[0] += 1;
-    caffe_cpu_axpby(mean_.count(), Dtype(1), mean_.cpu_data(),
-        moving_average_fraction_, this->blobs_[0]->mutable_cpu_data());
-    int m = bottom[0]->count()/channels_;
-    Dtype bias_correction_factor = m > 1 ? Dtype(m)/(m-1) : 1;
-    caffe_cpu_axpby(variance_.count(), bias_correction_factor,
-        variance_.cpu_data(), moving_average_fraction_,
-        this->blobs_[1]->mutable_cpu_data());
-  }
+  // compute variance using var(X) = E((X-EX)^2)
+  caffe_powx(top[0]->count(), top_data, Dtype(2),
+      temp_.mutable_cpu_data());  // (X-EX)^2
+  caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
+      1. / (num * spatial_dim), temp_.cpu_data(),
+      spatial_sum_multiplier_.cpu_data(), 0.,
+      num_by_chans_.mutable_cpu_data());
+  caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
+      num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
+      variance_.mutable_cpu_data());  // E((X_EX)^2)
+
+  // compute and save moving average
+  this->blobs_[2]->mutable_cpu_data()[0] *= moving_average_fraction_;
+  this->blobs_[2]->mutable_cpu_data()[0] += 1;
+  caffe_cpu_axpby(mean_.count(), Dtype(1), mean_.cpu_data(),
+      moving_average_fraction_, this->blobs_[0]->mutable_cpu_data());
+  int m = bottom[0]->count()/channels_;
+  Dtype bias_correction_factor = m > 1 ? Dtype(m)/(m-1) : 1;
+  caffe_cpu_axpby(variance_.count(), bias_correction_factor,
+      variance_.cpu_data(), moving_average_fraction_,
+      this->blobs_[1]->mutable_cpu_data());
 
   // normalize variance
   caffe_add_scalar(variance_.count(), eps_, variance_.mutable_cpu_data());
@@ -169,6 +222,25 @@ template <typename Dtype>
 void BatchNormLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  int num = bottom[0]->shape()[0];
+  int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
+  if (use_global_stats_) {
+    // Elementwise, so in-place is safe: scale by inference_scale_, after the
+    // fused ReLU.
+    const Dtype* top_diff = top[0]->cpu_diff();
+    const Dtype* top_data = top[0]->cpu_data();
+    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    const Dtype* scale_data = inference_scale_.cpu_data();
+    for (int i = 0; i < num * channels_; ++i) {
+      const Dtype scale = scale_data[i % channels_];
+      for (int j = i * spatial_dim; j < (i + 1) * spatial_dim; ++j) {
+        bottom_diff[j] = top_diff[j] * scale * (fused_relu_ ?
+            (top_data[j] > 0) + relu_negative_slope_ * (top_data[j] <= 0) :
+            Dtype(1));
+      }
+    }
+    return;
+  }
   const Dtype* top_diff;
   if (bottom[0] != top[0]) {
     top_diff = top[0]->cpu_diff();
@@ -177,13 +249,7 @@ void BatchNormLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     top_diff = x_norm_.cpu_diff();
   }
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  if (use_global_stats_) {
-    caffe_div(temp_.count(), top_diff, temp_.cpu_data(), bottom_diff);
-    return;
-  }
   const Dtype* top_data = x_norm_.cpu_data();
-  int num = bottom[0]->shape()[0];
-  int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
   // if Y = (X-mean(X))/(sqrt(var(X)+eps)), then
   //
   // dE(Y)/dX =
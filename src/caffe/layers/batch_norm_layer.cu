@@ -6,6 +6,47 @@
 
 namespace caffe {
 
+// compute_inference_affine on the device, so that the forward does not copy
+// the statistics to the host and back.
+template <typename Dtype>
+__global__ void BatchNormInferenceAffine(const int channels,
+    const Dtype* mean, const Dtype* variance, const Dtype* moving_factor,
+    const Dtype* scale, const Dtype* bias, const Dtype eps,
+    Dtype* scale_data, Dtype* shift_data) {
+  CUDA_KERNEL_LOOP(c, channels) {
+    const Dtype scale_factor =
+        moving_factor[0] == 0 ? Dtype(0) : 1 / moving_factor[0];
+    const Dtype inv_std = 1 / sqrt(variance[c] * scale_factor + eps);
+    scale_data[c] = (scale ? scale[c] : Dtype(1)) * inv_std;
+    shift_data[c] = (bias ? bias[c] : Dtype(0))
+        - scale_data[c] * mean[c] * scale_factor;
+  }
+}
+
+template <typename Dtype>
+__global__ void BatchNormInferenceForward(const int n, const int channels,
+    const int spatial_dim, const Dtype* scale, const Dtype* shift,
+    const bool relu, const Dtype negative_slope, const Dtype* in,
+    Dtype* out) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const int c = (index / spatial_dim) % channels;
+    const Dtype value = scale[c] * in[index] + shift[c];
+    out[index] = (relu && value <= 0) ? value * negative_slope : value;
+  }
+}
+
+template <typename Dtype>
+__global__ void BatchNormInferenceBackward(const int n, const int channels,
+    const int spatial_dim, const Dtype* scale, const bool relu,
+    const Dtype negative_slope, const Dtype* out, const Dtype* out_diff,
+    Dtype* in_diff) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const int c = (index / spatial_dim) % channels;
+    in_diff[index] = out_diff[index] * scale[c]
+        * ((relu && out[index] <= 0) ? negative_slope : Dtype(1));
+  }
+}
+
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
@@ -14,29 +55,39 @@ void BatchNormLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   int num = bottom[0]->shape(0);
   int spatial_dim = bottom[0]->count()/(channels_*bottom[0]->shape(0));
 
+  if (use_global_stats_) {
+    // use the stored mean/variance estimates, in a single pass.
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    BatchNormInferenceAffine<Dtype><<<CAFFE_GET_BLOCKS(channels_),
+        CAFFE_CUDA_NUM_THREADS>>>(channels_, this->blobs_[0]->gpu_data(),
+        this->blobs_[1]->gpu_data(), this->blobs_[2]->gpu_data(),
+        scale_bias_term_ ? this->blobs_[3]->gpu_data() : NULL,
+        scale_bias_term_ ? this->blobs_[4]->gpu_data() : NULL, eps_,
+        inference_scale_.mutable_gpu_data(),
+        inference_shift_.mutable_gpu_data());
+    CUDA_POST_KERNEL_CHECK;
+    const int count = bottom[0]->count();
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    BatchNormInferenceForward<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, channels_, spatial_dim,
+        inference_scale_.gpu_data(), inference_shift_.gpu_data(),
+        fused_relu_, relu_negative_slope_, bottom_data, top_data);
+    CUDA_POST_KERNEL_CHECK;
+    return;
+  }
+
   if (bottom[0] != top[0]) {
     caffe_copy(bottom[0]->count(), bottom_data, top_data);
   }
 
-
-  if (use_global_stats_) {
-    // use the stored mean/variance estimates.
-    const Dtype scale_factor = this->blobs_[2]->cpu_data()[0] == 0 ?
-        0 : 1 / this->blobs_[2]->cpu_data()[0];
-    caffe_gpu_scale(variance_.count(), scale_factor,
-        this->blobs_[0]->gpu_data(), mean_.mutable_gpu_data());
-    caffe_gpu_scale(variance_.count(), scale_factor,
-        this->blobs_[1]->gpu_data(), variance_.mutable_gpu_data());
-  } else {
-    // compute mean
-    caffe_gpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), bottom_data,
-        spatial_sum_multiplier_.gpu_data(), 0.,
-        num_by_chans_.mutable_gpu_data());
-    caffe_gpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.gpu_data(), batch_sum_multiplier_.gpu_data(), 0.,
-        mean_.mutable_gpu_data());
-  }
+  // compute mean
+  caffe_gpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
+      1. / (num * spatial_dim), bottom_data,
+      spatial_sum_multiplier_.gpu_data(), 0.,
+      num_by_chans_.mutable_gpu_data());
+  caffe_gpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
+      num_by_chans_.gpu_data(), batch_sum_multiplier_.gpu_data(), 0.,
+      mean_.mutable_gpu_data());
 
   // subtract mean
   caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
@@ -46,29 +97,27 @@ void BatchNormLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       spatial_dim, 1, -1, num_by_chans_.gpu_data(),
       spatial_sum_multiplier_.gpu_data(), 1., top_data);
 
-  if (!use_global_stats_) {
-    // compute variance using var(X) = E((X-EX)^2)
-    caffe_gpu_powx(top[0]->count(), top_data, Dtype(2),
-        temp_.mutable_gpu_data());  // (X-EX)^2
-    caffe_gpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), temp_.gpu_data(),
-        spatial_sum_multiplier_.gpu_data(), 0.,
-        num_by_chans_.mutable_gpu_data());
-    caffe_gpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.gpu_data(), batch_sum_multiplier_.gpu_data(), 0.,
-        variance_.mutable_gpu_data());  // E((X_EX)^2)
-
-    // compute and save moving average
-    this->blobs_[2]->mutable_cpu_data()[0] *= moving_average_fraction_;
-    this->blobs_[2]->mutable_cpu_data()[0] += 1;
-    caffe_gpu_axpby(mean_.count(), Dtype(1), mean_.gpu_data(),
-        moving_average_fraction_, this->blobs_[0]->mutable_gpu_data());
-    int m = bottom[0]->count()/channels_;
-    Dtype bias_correction_factor = m > 1 ? Dtype(m)/(m-1) : 1;
-    caffe_gpu_axpby(variance_.count(), bias_correction_factor,
-        variance_.gpu_data(), moving_average_fraction_,
-        this->blobs_[1]->mutable_gpu_data());
-  }
+  // compute variance using var(X) = E((X-EX)^2)
+  caffe_gpu_powx(top[0]->count(), top_data, Dtype(2),
+      temp_.mutable_gpu_data());  // (X-EX)^2
+  caffe_gpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
+      1. / (num * spatial_dim), temp_.gpu_data(),
+      spatial_sum_multiplier_.gpu_data(), 0.,
+      num_by_chans_.mutable_gpu_data());
+  caffe_gpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
+      num_by_chans_.gpu_data(), batch_sum_multiplier_.gpu_data(), 0.,
+      variance_.mutable_gpu_data());  // E((X_EX)^2)
+
+  // compute and save moving average
+  this->blobs_[2]->mutable_cpu_data()[0] *= moving_average_fraction_;
+  this->blobs_[2]->mutable_cpu_data()[0] += 1;
+  caffe_gpu_axpby(mean_.count(), Dtype(1), mean_.gpu_data(),
+      moving_average_fraction_, this->blobs_[0]->mutable_gpu_data());
+  int m = bottom[0]->count()/channels_;
+  Dtype bias_correction_factor = m > 1 ? Dtype(m)/(m-1) : 1;
+  caffe_gpu_axpby(variance_.count(), bias_correction_factor,
+      variance_.gpu_data(), moving_average_fraction_,
+      this->blobs_[1]->mutable_gpu_data());
 
   // normalize variance
   caffe_gpu_add_scalar(variance_.count(), eps_, variance_.mutable_gpu_data());
@@ -93,6 +142,18 @@ template <typename Dtype>
 void BatchNormLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  int num = bottom[0]->shape()[0];
+  int spatial_dim = bottom[0]->count()/(channels_*bottom[0]->shape(0));
+  if (use_global_stats_) {
+    const int count = bottom[0]->count();
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    BatchNormInferenceBackward<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, channels_, spatial_dim,
+        inference_scale_.gpu_data(), fused_relu_, relu_negative_slope_,
+        top[0]->gpu_data(), top[0]->gpu_diff(), bottom[0]->mutable_gpu_diff());
+    CUDA_POST_KERNEL_CHECK;
+    return;
+  }
   const Dtype* top_diff;
   if (bottom[0] != top[0]) {
     top_diff = top[0]->gpu_diff();
@@ -101,13 +162,7 @@ void BatchNormLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
     top_diff = x_norm_.gpu_diff();
   }
   Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
-  if (use_global_stats_) {
-    caffe_gpu_div(temp_.count(), top_diff, temp_.gpu_data(), bottom_diff);
-    return;
-  }
   const Dtype* top_data = x_norm_.gpu_data();
-  int num = bottom[0]->shape()[0];
-  int spatial_dim = bottom[0]->count()/(channels_*bottom[0]->shape(0));
   // if Y = (X-mean(X))/(sqrt(var(X)+eps)), then
   //
   // dE(Y)/dX =
@@ -53,10 +53,64 @@ void ConcatLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+bool ConcatLayer<Dtype>::ShareTopViews(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& roots, Blob<Dtype>* top) {
+  CHECK_EQ(bottom.size(), roots.size());
+  if (bottom.size() == 1 || num_concats_ != 1) { return false; }
+  int offset = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const int count = bottom[i]->count();
+    CHECK_EQ(count, roots[i]->count());
+    // Keep whatever the producers have computed so far.
+    if (roots[i]->data()->head() != SyncedMemory::UNINITIALIZED) {
+      caffe_copy(count, roots[i]->cpu_data(), top->mutable_cpu_data() + offset);
+    }
+    if (bottom[i]->diff()->head() != SyncedMemory::UNINITIALIZED) {
+      caffe_copy(count, bottom[i]->cpu_diff(),
+          top->mutable_cpu_diff() + offset);
+    }
+    roots[i]->ShareDataView(*top, offset);
+    roots[i]->ShareDiffView(*top, offset);
+    if (bottom[i] != roots[i]) {
+      bottom[i]->ShareDataView(*top, offset);
+      bottom[i]->ShareDiffView(*top, offset);
+    }
+    offset += count;
+  }
+  view_roots_ = roots;
+  return true;
+}
+
+template <typename Dtype>
+bool ConcatLayer<Dtype>::CheckTopViews(const vector<Blob<Dtype>*>& bottom,
+      const Blob<Dtype>* top) {
+  if (view_roots_.empty()) { return false; }
+  bool shared = num_concats_ == 1;
+  int offset = 0;
+  for (int i = 0; i < bottom.size() && shared; ++i) {
+    shared = bottom[i]->IsDataViewOf(*top, offset) &&
+        bottom[i]->IsDiffViewOf(*top, offset);
+    offset += bottom[i]->count();
+  }
+  if (!shared) {
+    // A shape changed: views left at the old offsets could overlap the new
+    // ranges of the others.
+    LOG(INFO) << "Concat " << this->layer_param_.name()
+        << " copies its bottoms again";
+    for (int i = 0; i < bottom.size(); ++i) {
+      view_roots_[i]->ReleaseViews();
+      bottom[i]->ReleaseViews();
+    }
+    view_roots_.clear();
+  }
+  return shared;
+}
+
 template <typename Dtype>
 void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  if (bottom.size() == 1) { return; }
+  if (bottom.size() == 1 || CheckTopViews(bottom, top[0])) { return; }
   Dtype* top_data = top[0]->mutable_cpu_data();
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
@@ -79,7 +133,8 @@ void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void ConcatLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  if (bottom.size() == 1) { return; }
+  // The bottom diffs are views of the top diff.
+  if (bottom.size() == 1 || !view_roots_.empty()) { return; }
   const Dtype* top_diff = top[0]->cpu_diff();
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
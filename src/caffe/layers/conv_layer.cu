@@ -4,6 +4,41 @@
 
 namespace caffe {
 
+template <typename Dtype>
+__global__ void FusedReLUForward(const int n, Dtype* out,
+    Dtype negative_slope) {
+  CUDA_KERNEL_LOOP(index, n) {
+    out[index] = out[index] > 0 ? out[index] : out[index] * negative_slope;
+  }
+}
+
+template <typename Dtype>
+__global__ void FusedReLUBackward(const int n, const Dtype* out,
+    Dtype* out_diff, Dtype negative_slope) {
+  CUDA_KERNEL_LOOP(index, n) {
+    out_diff[index] *= ((out[index] > 0)
+        + (out[index] <= 0) * negative_slope);
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_gpu_relu(Dtype* output,
+    const int count) {
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  FusedReLUForward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, output, this->relu_negative_slope_);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::backward_gpu_relu(const Dtype* output,
+    Dtype* output_diff, const int count) {
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  FusedReLUBackward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, output, output_diff, this->relu_negative_slope_);
+  CUDA_POST_KERNEL_CHECK;
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -19,6 +54,9 @@ void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
         this->forward_gpu_bias(top_data + n * this->top_dim_, bias);
       }
     }
+    if (this->fused_relu_) {
+      this->forward_gpu_relu(top_data, top[i]->count());
+    }
   }
 }
 
@@ -28,6 +66,10 @@ void ConvolutionLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   const Dtype* weight = this->blobs_[0]->gpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_gpu_diff();
   for (int i = 0; i < top.size(); ++i) {
+    if (this->fused_relu_) {
+      this->backward_gpu_relu(top[i]->gpu_data(), top[i]->mutable_gpu_diff(),
+          top[i]->count());
+    }
     const Dtype* top_diff = top[i]->gpu_diff();
     // Bias gradient, if necessary.
     if (this->bias_term_ && this->param_propagate_down_[1]) {
@@ -42,6 +42,9 @@ void CuDNNConvolutionLayer<Dtype>::Forward_gpu(
     // stream, by launching an empty kernel into the default (null) stream.
     // NOLINT_NEXT_LINE(whitespace/operators)
     sync_conv_groups<<<1, 1>>>();
+    if (this->fused_relu_) {
+      this->forward_gpu_relu(top_data, top[i]->count());
+    }
   }
 }
 
@@ -59,6 +62,10 @@ void CuDNNConvolutionLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
     bias_diff = this->blobs_[1]->mutable_gpu_diff();
   }
   for (int i = 0; i < top.size(); ++i) {
+    if (this->fused_relu_) {
+      this->backward_gpu_relu(top[i]->gpu_data(), top[i]->mutable_gpu_diff(),
+          top[i]->count());
+    }
     const Dtype* top_diff = top[i]->gpu_diff();
     // Backward through cuDNN in parallel over groups and gradients.
     for (int g = 0; g < this->group_; g++) {
@@ -12,6 +12,16 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int num_output = this->layer_param_.inner_product_param().num_output();
   bias_term_ = this->layer_param_.inner_product_param().bias_term();
   transpose_ = this->layer_param_.inner_product_param().transpose();
+  const QuantizationParameter& quant_param =
+      this->layer_param_.quantization_param();
+  int8_ = this->phase_ == TEST &&
+      quant_param.precision() == QuantizationParameter_Precision_INT8;
+  if (int8_) {
+    CHECK(!transpose_) << "INT8 quantization does not support transpose.";
+    CHECK_GT(quant_param.bottom_max(), 0)
+        << "INT8 quantization requires the calibrated bottom_max.";
+    int8_input_scale_ = Dtype(127) / quant_param.bottom_max();
+  }
   N_ = num_output;
   const int axis = bottom[0]->CanonicalAxisIndex(
       this->layer_param_.inner_product_param().axis());
@@ -51,6 +61,7 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       bias_filler->Fill(this->blobs_[1].get());
     }
   }  // parameter initialization
+  int8_weight_version_ = 0;
   this->param_propagate_down_.resize(this->blobs_.size(), true);
 }
 
@@ -72,6 +83,14 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   top_shape.resize(axis + 1);
   top_shape[axis] = N_;
   top[0]->Reshape(top_shape);
+  if (int8_ && Caffe::mode() == Caffe::CPU) {
+    const uint64_t version = this->blobs_[0]->data()->version();
+    if (version != int8_weight_version_) {
+      int8_gemm_.SetWeights(N_, K_, this->blobs_[0]->cpu_data(),
+          int8_input_scale_);
+      int8_weight_version_ = version;
+    }
+  }
   // Set up the bias multiplier
   if (bias_term_) {
     vector<int> bias_shape(1, M_);
@@ -86,9 +105,13 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  if (int8_) {
+    int8_gemm_.Forward(M_, bottom_data, top_data, true);
+  } else {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
+        M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
@@ -10,6 +10,171 @@ namespace caffe {
 using std::min;
 using std::max;
 
+// The shape of one pooled plane.
+struct PoolingShape {
+  int height, width;
+  int kernel_h, kernel_w;
+  int stride_h, stride_w;
+  int pad_h, pad_w;
+  int pooled_height, pooled_width;
+};
+
+static PoolingShape pooling_shape(const int height, const int width,
+    const int kernel_h, const int kernel_w, const int stride_h,
+    const int stride_w, const int pad_h, const int pad_w,
+    const int pooled_height, const int pooled_width) {
+  PoolingShape shape;
+  shape.height = height;
+  shape.width = width;
+  shape.kernel_h = kernel_h;
+  shape.kernel_w = kernel_w;
+  shape.stride_h = stride_h;
+  shape.stride_w = stride_w;
+  shape.pad_h = pad_h;
+  shape.pad_w = pad_w;
+  shape.pooled_height = pooled_height;
+  shape.pooled_width = pooled_width;
+  return shape;
+}
+
+// The outputs [*begin, *end) whose window lies inside [0, size), unclipped.
+static void interior_range(const int size, const int kernel, const int stride,
+    const int pad, const int pooled, int* begin, int* end) {
+  *begin = min((pad + stride - 1) / stride, pooled);
+  *end = size + pad >= kernel ?
+      min((size + pad - kernel) / stride + 1, pooled) : 0;
+  *end = max(*end, *begin);
+}
+
+// Pools the window of (ph, pw), clipped to the image, as the masked loops do.
+template <typename Dtype, bool kMax>
+static Dtype pool_window(const PoolingShape& s, const Dtype* bottom_data,
+    const int ph, const int pw) {
+  int hstart = ph * s.stride_h - s.pad_h;
+  int wstart = pw * s.stride_w - s.pad_w;
+  int hend = min(hstart + s.kernel_h, s.height + (kMax ? 0 : s.pad_h));
+  int wend = min(wstart + s.kernel_w, s.width + (kMax ? 0 : s.pad_w));
+  const int pool_size = (hend - hstart) * (wend - wstart);
+  hstart = max(hstart, 0);
+  wstart = max(wstart, 0);
+  hend = min(hend, s.height);
+  wend = min(wend, s.width);
+  Dtype value = kMax ? Dtype(-FLT_MAX) : Dtype(0);
+  for (int h = hstart; h < hend; ++h) {
+    for (int w = wstart; w < wend; ++w) {
+      const Dtype x = bottom_data[h * s.width + w];
+      if (kMax) {
+        if (x > value) { value = x; }
+      } else {
+        value += x;
+      }
+    }
+  }
+  return kMax ? value : value / pool_size;
+}
+
+// MAX or AVE pooling of one plane without a mask. On the output rows whose
+// windows lie inside the image, the kernel_h input rows are first reduced
+// into row over contiguous memory, then each window of row is reduced, with
+// fixed-size loops for 2x2 and 3x3 windows at stride 2. Windows over the
+// padding are clipped one at a time.
+template <typename Dtype, bool kMax>
+static void pool_plane(const PoolingShape& s, const Dtype* bottom_data,
+    Dtype* top_data, Dtype* row) {
+  int ph_begin, ph_end, pw_begin, pw_end;
+  interior_range(s.height, s.kernel_h, s.stride_h, s.pad_h, s.pooled_height,
+      &ph_begin, &ph_end);
+  interior_range(s.width, s.kernel_w, s.stride_w, s.pad_w, s.pooled_width,
+      &pw_begin, &pw_end);
+  const int x_begin = pw_begin * s.stride_w - s.pad_w;
+  const int x_end = (pw_end - 1) * s.stride_w - s.pad_w + s.kernel_w;
+  const int n = pw_end - pw_begin;
+  const Dtype interior_size = s.kernel_h * s.kernel_w;
+  for (int ph = 0; ph < s.pooled_height; ++ph) {
+    Dtype* top_row = top_data + ph * s.pooled_width;
+    const bool interior = ph >= ph_begin && ph < ph_end && n > 0;
+    if (interior) {
+      const Dtype* bottom_row =
+          bottom_data + (ph * s.stride_h - s.pad_h) * s.width;
+      for (int x = x_begin; x < x_end; ++x) {
+        row[x] = bottom_row[x];
+      }
+      for (int h = 1; h < s.kernel_h; ++h) {
+        const Dtype* next_row = bottom_row + h * s.width;
+        for (int x = x_begin; x < x_end; ++x) {
+          row[x] = kMax ? max(row[x], next_row[x]) : row[x] + next_row[x];
+        }
+      }
+      const Dtype* r = row + x_begin;
+      Dtype* t = top_row + pw_begin;
+      if (s.kernel_w == 2 && s.stride_w == 2) {
+        for (int i = 0; i < n; ++i) {
+          t[i] = kMax ? max(r[2 * i], r[2 * i + 1]) : r[2 * i] + r[2 * i + 1];
+        }
+      } else if (s.kernel_w == 3 && s.stride_w == 2) {
+        for (int i = 0; i < n; ++i) {
+          t[i] = kMax ? max(max(r[2 * i], r[2 * i + 1]), r[2 * i + 2])
+              : r[2 * i] + r[2 * i + 1] + r[2 * i + 2];
+        }
+      } else {
+        for (int i = 0; i < n; ++i) {
+          const Dtype* window = r + i * s.stride_w;
+          Dtype value = window[0];
+          for (int w = 1; w < s.kernel_w; ++w) {
+            value = kMax ? max(value, window[w]) : value + window[w];
+          }
+          t[i] = value;
+        }
+      }
+      if (!kMax) {
+        for (int i = 0; i < n; ++i) {
+          t[i] /= interior_size;
+        }
+      }
+    }
+    for (int pw = 0; pw < s.pooled_width; ++pw) {
+      if (interior && pw == pw_begin) {
+        pw = pw_end - 1;
+        continue;
+      }
+      top_row[pw] = pool_window<Dtype, kMax>(s, bottom_data, ph, pw);
+    }
+  }
+}
+
+// MAX pooling of one plane that also records the argmax in mask; with a NULL
+// top_data, only the argmax.
+template <typename Dtype, typename MaskType>
+static void max_pool_plane_with_mask(const PoolingShape& s,
+    const Dtype* bottom_data, Dtype* top_data, MaskType* mask) {
+  for (int ph = 0; ph < s.pooled_height; ++ph) {
+    for (int pw = 0; pw < s.pooled_width; ++pw) {
+      int hstart = ph * s.stride_h - s.pad_h;
+      int wstart = pw * s.stride_w - s.pad_w;
+      int hend = min(hstart + s.kernel_h, s.height);
+      int wend = min(wstart + s.kernel_w, s.width);
+      hstart = max(hstart, 0);
+      wstart = max(wstart, 0);
+      const int pool_index = ph * s.pooled_width + pw;
+      Dtype value = Dtype(-FLT_MAX);
+      int max_index = -1;
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          const int index = h * s.width + w;
+          if (bottom_data[index] > value) {
+            value = bottom_data[index];
+            max_index = index;
+          }
+        }
+      }
+      if (top_data) {
+        top_data[pool_index] = value;
+      }
+      mask[pool_index] = static_cast<MaskType>(max_index);
+    }
+  }
+}
+
 template <typename Dtype>
 void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -35,6 +200,7 @@ void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       || (!pool_param.has_stride_h() && !pool_param.has_stride_w()))
       << "Stride is stride OR stride_h and stride_w are required.";
   global_pooling_ = pool_param.global_pooling();
+  max_idx_valid_ = false;
   if (global_pooling_) {
     kernel_h_ = bottom[0]->height();
     kernel_w_ = bottom[0]->width();
@@ -153,87 +319,54 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const bool use_top_mask = top.size() > 1;
   int* mask = NULL;  // suppress warnings about uninitalized variables
   Dtype* top_mask = NULL;
+  const PoolingShape shape = pooling_shape(height_, width_,
+      kernel_h_, kernel_w_, stride_h_, stride_w_, pad_h_, pad_w_,
+      pooled_height_, pooled_width_);
+  const int num_planes = bottom[0]->num() * channels_;
+  const int bottom_dim = height_ * width_;
+  const int top_dim = pooled_height_ * pooled_width_;
   // Different pooling methods. We explicitly do the switch outside the for
   // loop to save time, although this results in more code.
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // Initialize
     if (use_top_mask) {
       top_mask = top[1]->mutable_cpu_data();
-      caffe_set(top_count, Dtype(-1), top_mask);
-    } else {
+#pragma omp parallel for
+      for (int index = 0; index < num_planes; ++index) {
+        max_pool_plane_with_mask(shape, bottom_data + index * bottom_dim,
+            top_data + index * top_dim, top_mask + index * top_dim);
+      }
+    } else if (this->phase_ == TRAIN) {
       mask = max_idx_.mutable_cpu_data();
-      caffe_set(top_count, -1, mask);
-    }
-    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
+#pragma omp parallel for
+      for (int index = 0; index < num_planes; ++index) {
+        max_pool_plane_with_mask(shape, bottom_data + index * bottom_dim,
+            top_data + index * top_dim, mask + index * top_dim);
+      }
+      max_idx_valid_ = true;
+    } else {
+      // A TEST net does not normally run backward, so the argmax is left for
+      // Backward_cpu to find if it does.
+#pragma omp parallel
+      {
+        vector<Dtype> row(width_);
+#pragma omp for
+        for (int index = 0; index < num_planes; ++index) {
+          pool_plane<Dtype, true>(shape, bottom_data + index * bottom_dim,
+              top_data + index * top_dim, &row[0]);
         }
       }
+      max_idx_valid_ = false;
     }
     break;
   case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
-    }
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
-            }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
+#pragma omp parallel
+    {
+      vector<Dtype> row(width_);
+#pragma omp for
+      for (int index = 0; index < num_planes; ++index) {
+        pool_plane<Dtype, false>(shape, bottom_data + index * bottom_dim,
+            top_data + index * top_dim, &row[0]);
       }
     }
     break;
@@ -344,6 +477,22 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     if (use_top_mask) {
       top_mask = top[1]->cpu_data();
     } else {
+      if (!max_idx_valid_) {
+        // Forward_cpu skipped the argmax; find it without touching the top.
+        const PoolingShape shape = pooling_shape(height_, width_,
+            kernel_h_, kernel_w_, stride_h_, stride_w_, pad_h_, pad_w_,
+            pooled_height_, pooled_width_);
+        const int bottom_dim = height_ * width_;
+        const int top_dim = pooled_height_ * pooled_width_;
+        const Dtype* bottom_data = bottom[0]->cpu_data();
+        int* recomputed_mask = max_idx_.mutable_cpu_data();
+#pragma omp parallel for
+        for (int index = 0; index < top[0]->num() * channels_; ++index) {
+          max_pool_plane_with_mask(shape, bottom_data + index * bottom_dim,
+              static_cast<Dtype*>(NULL), recomputed_mask + index * top_dim);
+        }
+        max_idx_valid_ = true;
+      }
       mask = max_idx_.cpu_data();
     }
     for (int n = 0; n < top[0]->num(); ++n) {
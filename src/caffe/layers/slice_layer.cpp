@@ -72,10 +72,48 @@ void SliceLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+bool SliceLayer<Dtype>::ShareBottomViews(Blob<Dtype>* bottom,
+      const vector<Blob<Dtype>*>& top) {
+  if (top.size() == 1 || num_slices_ != 1) { return false; }
+  int offset = 0;
+  for (int i = 0; i < top.size(); ++i) {
+    top[i]->ShareDataView(*bottom, offset);
+    top[i]->ShareDiffView(*bottom, offset);
+    offset += top[i]->count();
+  }
+  shares_views_ = true;
+  return true;
+}
+
+template <typename Dtype>
+bool SliceLayer<Dtype>::CheckBottomViews(const Blob<Dtype>* bottom,
+      const vector<Blob<Dtype>*>& top) {
+  if (!shares_views_) { return false; }
+  bool shared = num_slices_ == 1;
+  int offset = 0;
+  for (int i = 0; i < top.size() && shared; ++i) {
+    shared = top[i]->IsDataViewOf(*bottom, offset) &&
+        top[i]->IsDiffViewOf(*bottom, offset);
+    offset += top[i]->count();
+  }
+  if (!shared) {
+    // A shape changed: views left at the old offsets could overlap the new
+    // ranges of the others.
+    LOG(INFO) << "Slice " << this->layer_param_.name()
+        << " copies its tops again";
+    for (int i = 0; i < top.size(); ++i) {
+      top[i]->ReleaseViews();
+    }
+    shares_views_ = false;
+  }
+  return shared;
+}
+
 template <typename Dtype>
 void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  if (top.size() == 1) { return; }
+  if (top.size() == 1 || CheckBottomViews(bottom[0], top)) { return; }
   int offset_slice_axis = 0;
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
@@ -96,7 +134,8 @@ void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void SliceLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  if (!propagate_down[0] || top.size() == 1) { return; }
+  // With shares_views_ the top diffs are views of the bottom diff.
+  if (!propagate_down[0] || top.size() == 1 || shares_views_) { return; }
   int offset_slice_axis = 0;
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
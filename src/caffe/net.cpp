@@ -1,4 +1,9 @@
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <algorithm>
+#include <fstream>
 #include <map>
 #include <set>
 #include <string>
@@ -8,7 +13,10 @@
 #include "hdf5.h"
 
 #include "caffe/common.hpp"
+#include "caffe/filler.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/layers/concat_layer.hpp"
+#include "caffe/layers/slice_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
@@ -48,6 +56,13 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   // the current NetState.
   NetParameter filtered_param;
   FilterNet(in_param, &filtered_param);
+  folded_layers_.clear();
+  folded_params_.clear();
+  if (phase_ == TEST && filtered_param.fold_inference_layers()) {
+    NetParameter folded_param;
+    FoldInferenceLayers(filtered_param, &folded_param, &folded_layers_);
+    filtered_param.CopyFrom(folded_param);
+  }
   LOG_IF(INFO, Caffe::root_solver())
       << "Initializing net from parameters: " << std::endl
       << "	**prototxt parameters** encrypted." << std::endl;
@@ -252,6 +267,8 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  InitFoldedParams();
+  ShareBlobViews();
   debug_info_ = param.debug_info();
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
@@ -352,6 +369,336 @@ bool Net<Dtype>::StateMeetsRule(const NetState& state,
   return true;
 }
 
+// Helpers for FoldInferenceLayers.
+namespace {
+
+bool SharesParams(const LayerParameter& layer_param) {
+  for (int i = 0; i < layer_param.param_size(); ++i) {
+    if (layer_param.param(i).name().size()) { return true; }
+  }
+  return false;
+}
+
+bool IsFoldableConvolution(const LayerParameter& layer_param) {
+  if (layer_param.type() != "Convolution" ||
+      layer_param.bottom_size() != 1 || layer_param.top_size() != 1) {
+    return false;
+  }
+  const ConvolutionParameter& conv_param = layer_param.convolution_param();
+  if (conv_param.axis() != 1 || conv_param.has_fused_relu_param()) {
+    return false;
+  }
+  // Folding rewrites the weights, which must not be visible to other layers.
+  return !SharesParams(layer_param);
+}
+
+bool IsFoldableLayer(const LayerParameter& layer_param) {
+  if (layer_param.bottom_size() != 1 || layer_param.top_size() != 1) {
+    return false;
+  }
+  if (layer_param.type() == "BatchNorm") {
+    // Only the stored statistics can be folded, not the batch statistics,
+    // and only once.
+    const BatchNormParameter& bn_param = layer_param.batch_norm_param();
+    return (!bn_param.has_use_global_stats() || bn_param.use_global_stats())
+        && !bn_param.scale_bias_term() && !bn_param.has_fused_relu_param();
+  } else if (layer_param.type() == "Scale") {
+    return layer_param.scale_param().axis() == 1 &&
+        layer_param.scale_param().num_axes() == 1;
+  }
+  return layer_param.type() == "ReLU";
+}
+
+// A BatchNorm that can take over the Scale and ReLU following it, which adds
+// blobs to it.
+bool IsFoldableBatchNorm(const LayerParameter& layer_param) {
+  return layer_param.type() == "BatchNorm" && IsFoldableLayer(layer_param) &&
+      !SharesParams(layer_param);
+}
+
+// Index of the first layer after 'start' that reads blob_name, or -1.
+int NextConsumer(const vector<LayerParameter>& layers, const int start,
+    const string& blob_name) {
+  for (int i = start + 1; i < layers.size(); ++i) {
+    for (int j = 0; j < layers[i].bottom_size(); ++j) {
+      if (layers[i].bottom(j) == blob_name) { return i; }
+    }
+  }
+  return -1;
+}
+
+}  // namespace
+
+template <typename Dtype>
+void Net<Dtype>::FoldInferenceLayers(const NetParameter& param,
+    NetParameter* param_folded,
+    map<string, vector<LayerParameter> >* folded_layers) {
+  // The order in which layers may follow a convolution to be folded into it.
+  // A BatchNorm that is not folded into a convolution takes the ones after it.
+  const char* kFoldableTypes[] = { "BatchNorm", "Scale", "ReLU" };
+  const int kNumFoldableTypes = 3;
+  vector<LayerParameter> layers(param.layer().begin(), param.layer().end());
+  vector<bool> folded(layers.size(), false);
+  folded_layers->clear();
+  for (int target_id = 0; target_id < layers.size(); ++target_id) {
+    const bool is_batch_norm = !folded[target_id] &&
+        IsFoldableBatchNorm(layers[target_id]);
+    if (!is_batch_norm && !IsFoldableConvolution(layers[target_id])) {
+      continue;
+    }
+    LayerParameter& target_param = layers[target_id];
+    vector<int> chain;
+    string blob_name = target_param.top(0);
+    int type_id = is_batch_norm ? 1 : 0;
+    while (type_id < kNumFoldableTypes) {
+      const int next_id = NextConsumer(layers, chain.size() ?
+          chain.back() : target_id, blob_name);
+      if (next_id < 0) { break; }
+      const LayerParameter& next_param = layers[next_id];
+      while (type_id < kNumFoldableTypes &&
+             next_param.type() != kFoldableTypes[type_id]) {
+        ++type_id;
+      }
+      if (type_id == kNumFoldableTypes || !IsFoldableLayer(next_param)) {
+        break;
+      }
+      // Unless it is computed in-place, the input of the folded layer stops
+      // existing, so nothing else may read it.
+      if (next_param.top(0) != blob_name &&
+          NextConsumer(layers, next_id, blob_name) >= 0) {
+        break;
+      }
+      chain.push_back(next_id);
+      blob_name = next_param.top(0);
+      ++type_id;
+    }
+    if (chain.empty()) { continue; }
+    vector<LayerParameter>& absorbed = (*folded_layers)[target_param.name()];
+    string folded_names;
+    for (int i = 0; i < chain.size(); ++i) {
+      const LayerParameter& layer_param = layers[chain[i]];
+      folded[chain[i]] = true;
+      folded_names += (i ? ", " : "") + layer_param.name();
+      if (is_batch_norm) {
+        if (layer_param.type() == "ReLU") {
+          target_param.mutable_batch_norm_param()->mutable_fused_relu_param()
+              ->CopyFrom(layer_param.relu_param());
+        } else {
+          absorbed.push_back(layer_param);
+          target_param.mutable_batch_norm_param()->set_scale_bias_term(true);
+        }
+      } else if (layer_param.type() == "ReLU") {
+        target_param.mutable_convolution_param()->mutable_fused_relu_param()
+            ->CopyFrom(layer_param.relu_param());
+      } else {
+        absorbed.push_back(layer_param);
+        target_param.mutable_convolution_param()->set_bias_term(true);
+      }
+    }
+    if (absorbed.empty()) { folded_layers->erase(target_param.name()); }
+    target_param.set_top(0, blob_name);
+    LOG_IF(INFO, Caffe::root_solver()) << "Folding " << folded_names
+        << " into layer " << target_param.name();
+  }
+  param_folded->CopyFrom(param);
+  param_folded->clear_layer();
+  for (int i = 0; i < layers.size(); ++i) {
+    if (!folded[i]) { param_folded->add_layer()->CopyFrom(layers[i]); }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitFoldedParams() {
+  set<string> conv_names, folded_names;
+  for (typename map<string, vector<LayerParameter> >::const_iterator it =
+       folded_layers_.begin(); it != folded_layers_.end(); ++it) {
+    conv_names.insert(it->first);
+    const int conv_id = layer_names_index_[it->first];
+    const vector<int> shape(1, layers_[conv_id]->blobs()[0]->shape(0));
+    for (int i = 0; i < it->second.size(); ++i) {
+      const LayerParameter& layer_param = it->second[i];
+      vector<shared_ptr<Blob<Dtype> > >& blobs =
+          folded_params_[layer_param.name()];
+      folded_names.insert(layer_param.name());
+      if (layer_param.type() == "BatchNorm") {
+        // Mean, variance and moving average factor, as in BatchNormLayer.
+        blobs.resize(3);
+        blobs[0].reset(new Blob<Dtype>(shape));
+        blobs[1].reset(new Blob<Dtype>(shape));
+        blobs[2].reset(new Blob<Dtype>(vector<int>(1, 1)));
+        for (int j = 0; j < blobs.size(); ++j) {
+          caffe_set(blobs[j]->count(), Dtype(0), blobs[j]->mutable_cpu_data());
+        }
+      } else {
+        // Scale and optional bias, as in ScaleLayer.
+        const ScaleParameter& scale_param = layer_param.scale_param();
+        FillerParameter filler_param(scale_param.filler());
+        if (!scale_param.has_filler()) {
+          filler_param.set_type("constant");
+          filler_param.set_value(1);
+        }
+        blobs.resize(scale_param.bias_term() ? 2 : 1);
+        blobs[0].reset(new Blob<Dtype>(shape));
+        shared_ptr<Filler<Dtype> > filler(GetFiller<Dtype>(filler_param));
+        filler->Fill(blobs[0].get());
+        if (scale_param.bias_term()) {
+          blobs[1].reset(new Blob<Dtype>(shape));
+          filler.reset(GetFiller<Dtype>(scale_param.bias_filler()));
+          filler->Fill(blobs[1].get());
+        }
+      }
+    }
+  }
+  FoldParams(conv_names, folded_names);
+}
+
+template <typename Dtype>
+void Net<Dtype>::FoldParams(const set<string>& conv_names,
+    const set<string>& loaded_folded_layers) {
+  for (typename map<string, vector<LayerParameter> >::const_iterator it =
+       folded_layers_.begin(); it != folded_layers_.end(); ++it) {
+    int num_loaded = 0;
+    for (int i = 0; i < it->second.size(); ++i) {
+      num_loaded += loaded_folded_layers.count(it->second[i].name());
+    }
+    if (!conv_names.count(it->first)) {
+      // Folding overwrites the convolution weights, so they can only be
+      // updated together with the layers folded into them.
+      CHECK_EQ(num_loaded, 0) << "Layers folded into layer " << it->first
+          << " cannot be loaded without it.";
+      continue;
+    }
+    if (num_loaded == 0) {
+      // Weights saved by a folded net already include the folded layers.
+      LOG(INFO) << "Layer " << it->first << " is already folded";
+      continue;
+    }
+    CHECK_EQ(num_loaded, it->second.size()) << "Not all layers folded into "
+        << "layer " << it->first << " were loaded.";
+    Layer<Dtype>* target_layer = layers_[layer_names_index_[it->first]].get();
+    const int channels = target_layer->blobs()[0]->shape(0);
+    // The folded layers compute alpha * x + beta per channel.
+    vector<Dtype> alpha(channels, Dtype(1));
+    vector<Dtype> beta(channels, Dtype(0));
+    for (int i = 0; i < it->second.size(); ++i) {
+      const LayerParameter& layer_param = it->second[i];
+      const vector<shared_ptr<Blob<Dtype> > >& blobs =
+          folded_params_[layer_param.name()];
+      for (int j = 0; j < blobs.size(); ++j) {
+        CHECK_EQ(blobs[j]->count(), j == 2 ? 1 : channels)
+            << "Cannot fold layer " << layer_param.name() << " into layer "
+            << it->first << "; shape mismatch.";
+      }
+      if (layer_param.type() == "BatchNorm") {
+        const Dtype scale_factor = blobs[2]->cpu_data()[0] == 0 ?
+            0 : 1 / blobs[2]->cpu_data()[0];
+        const Dtype eps = layer_param.batch_norm_param().eps();
+        const Dtype* mean = blobs[0]->cpu_data();
+        const Dtype* variance = blobs[1]->cpu_data();
+        for (int c = 0; c < channels; ++c) {
+          const Dtype inv_std =
+              1 / std::sqrt(variance[c] * scale_factor + eps);
+          alpha[c] *= inv_std;
+          beta[c] = (beta[c] - mean[c] * scale_factor) * inv_std;
+        }
+      } else {
+        const Dtype* scale = blobs[0]->cpu_data();
+        const Dtype* shift = blobs.size() > 1 ? blobs[1]->cpu_data() : NULL;
+        for (int c = 0; c < channels; ++c) {
+          alpha[c] *= scale[c];
+          beta[c] = beta[c] * scale[c] + (shift ? shift[c] : Dtype(0));
+        }
+      }
+    }
+    if (string(target_layer->type()) == "BatchNorm") {
+      // A BatchNorm applies them after normalizing (scale_bias_term).
+      caffe_copy(channels, &alpha[0],
+          target_layer->blobs()[3]->mutable_cpu_data());
+      caffe_copy(channels, &beta[0],
+          target_layer->blobs()[4]->mutable_cpu_data());
+      continue;
+    }
+    Blob<Dtype>* weight = target_layer->blobs()[0].get();
+    const int kernel_dim = weight->count(1);
+    Dtype* weight_data = weight->mutable_cpu_data();
+    Dtype* bias_data = target_layer->blobs()[1]->mutable_cpu_data();
+    for (int c = 0; c < channels; ++c) {
+      caffe_scal(kernel_dim, alpha[c], weight_data + c * kernel_dim);
+      bias_data[c] = alpha[c] * bias_data[c] + beta[c];
+    }
+  }
+}
+
+// Helper for Net::Init: make Concat and Slice blobs views of each other.
+template <typename Dtype>
+void Net<Dtype>::ShareBlobViews() {
+  // The first and the last layer writing each blob: any but the first
+  // computes it in place.
+  vector<int> producer(blobs_.size(), -1);
+  vector<int> last_writer(blobs_.size(), -1);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      const int blob_id = top_id_vecs_[layer_id][top_id];
+      if (producer[blob_id] < 0) {
+        producer[blob_id] = layer_id;
+      }
+      last_writer[blob_id] = layer_id;
+    }
+  }
+  // Once shared, whatever is computed in place on one blob after the
+  // Concat or Slice overwrites the other too, which the backward pass of the
+  // layer producing it may still need. Going backwards, a Concat feeding
+  // another one has already become a view when its bottoms are made views of
+  // it.
+  for (int layer_id = layers_.size() - 1; layer_id >= 0; --layer_id) {
+    const string type = layers_[layer_id]->type();
+    if (type == "Concat") {
+      if (last_writer[top_id_vecs_[layer_id][0]] != layer_id) { continue; }
+      vector<Blob<Dtype>*> roots;
+      for (int bottom_id = 0; bottom_id < bottom_id_vecs_[layer_id].size();
+           ++bottom_id) {
+        int blob_id = bottom_id_vecs_[layer_id][bottom_id];
+        bool shareable = last_writer[blob_id] < layer_id;
+        while (shareable && producer[blob_id] >= 0 &&
+            (string(layers_[producer[blob_id]]->type()) == "Flatten" ||
+             string(layers_[producer[blob_id]]->type()) == "Reshape")) {
+          blob_id = bottom_id_vecs_[producer[blob_id]][0];
+          shareable = last_writer[blob_id] < layer_id;
+        }
+        // Net inputs are set from outside, Split and Slice tops share their
+        // bottom.
+        if (!shareable || producer[blob_id] < 0 ||
+            string(layers_[producer[blob_id]]->type()) == "Split" ||
+            string(layers_[producer[blob_id]]->type()) == "Slice") {
+          break;
+        }
+        roots.push_back(blobs_[blob_id].get());
+      }
+      if (roots.size() < bottom_vecs_[layer_id].size()) { continue; }
+      ConcatLayer<Dtype>* concat =
+          static_cast<ConcatLayer<Dtype>*>(layers_[layer_id].get());
+      if (concat->ShareTopViews(bottom_vecs_[layer_id], roots,
+          top_vecs_[layer_id][0])) {
+        LOG_IF(INFO, Caffe::root_solver()) << layer_names_[layer_id]
+            << " concatenates in place";
+      }
+    } else if (type == "Slice") {
+      bool shareable =
+          last_writer[bottom_id_vecs_[layer_id][0]] < layer_id;
+      for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+        shareable &= last_writer[top_id_vecs_[layer_id][top_id]] == layer_id;
+      }
+      SliceLayer<Dtype>* slice =
+          static_cast<SliceLayer<Dtype>*>(layers_[layer_id].get());
+      if (shareable && slice->ShareBottomViews(bottom_vecs_[layer_id][0],
+          top_vecs_[layer_id])) {
+        LOG_IF(INFO, Caffe::root_solver()) << layer_names_[layer_id]
+            << " slices in place";
+      }
+    }
+  }
+}
+
 // Helper for Net::Init: add a new top blob to the net.
 template <typename Dtype>
 void Net<Dtype>::AppendTop(const NetParameter& param, const int layer_id,
@@ -662,8 +1009,21 @@ void Net<Dtype>::UpdateDebugInfo(const int param_id) {
   }
 }
 
+// Whether the same layers, in the same order, were folded into a layer.
+static bool same_folded_layers(const vector<LayerParameter>& a,
+    const vector<LayerParameter>& b) {
+  if (a.size() != b.size()) { return false; }
+  for (int i = 0; i < a.size(); ++i) {
+    if (a[i].name() != b[i].name() || a[i].type() != b[i].type()) {
+      return false;
+    }
+  }
+  return true;
+}
+
 template <typename Dtype>
 void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
+  set<string> folded_convs, folded_sources;
   int num_source_layers = other->layers().size();
   for (int i = 0; i < num_source_layers; ++i) {
     Layer<Dtype>* source_layer = other->layers()[i].get();
@@ -674,24 +1034,75 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
       ++target_layer_id;
     }
     if (target_layer_id == layer_names_.size()) {
+      if (folded_params_.count(source_layer_name)) {
+        vector<shared_ptr<Blob<Dtype> > >& folded_blobs =
+            folded_params_[source_layer_name];
+        CHECK_EQ(folded_blobs.size(), source_layer->blobs().size())
+            << "Incompatible number of blobs for layer " << source_layer_name;
+        for (int j = 0; j < folded_blobs.size(); ++j) {
+          folded_blobs[j]->CopyFrom(*source_layer->blobs()[j], false, true);
+        }
+        folded_sources.insert(source_layer_name);
+        continue;
+      }
       LOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
     DLOG(INFO) << "Copying source layer " << source_layer_name;
     vector<shared_ptr<Blob<Dtype> > >& target_blobs =
         layers_[target_layer_id]->blobs();
-    CHECK_EQ(target_blobs.size(), source_layer->blobs().size())
-        << "Incompatible number of blobs for layer " << source_layer_name;
-    for (int j = 0; j < target_blobs.size(); ++j) {
+    // Folded weights differ from those of an unfolded source, so they are
+    // copied and folded again, not shared. A source folded the same way
+    // holds the folded weights already.
+    bool folded = folded_layers_.count(source_layer_name) > 0;
+    if (folded && other->folded_layers_.count(source_layer_name) &&
+        same_folded_layers(folded_layers_[source_layer_name],
+            other->folded_layers_.find(source_layer_name)->second)) {
+      folded = false;
+      const vector<LayerParameter>& absorbed =
+          folded_layers_[source_layer_name];
+      for (int i = 0; i < absorbed.size(); ++i) {
+        const vector<shared_ptr<Blob<Dtype> > >& source_blobs =
+            other->folded_params_.find(absorbed[i].name())->second;
+        vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+            folded_params_[absorbed[i].name()];
+        for (int j = 0; j < target_blobs.size(); ++j) {
+          target_blobs[j]->ShareData(*source_blobs[j]);
+        }
+      }
+    }
+    const int num_source_blobs = source_layer->blobs().size();
+    if (folded) {
+      folded_convs.insert(source_layer_name);
+      if (num_source_blobs + 1 == target_blobs.size()) {
+        // The bias term was added by FoldInferenceLayers.
+        caffe_set(target_blobs[1]->count(), Dtype(0),
+            target_blobs[1]->mutable_cpu_data());
+      } else {
+        CHECK_EQ(target_blobs.size(), num_source_blobs)
+            << "Incompatible number of blobs for layer " << source_layer_name;
+      }
+    } else {
+      CHECK_EQ(target_blobs.size(), num_source_blobs)
+          << "Incompatible number of blobs for layer " << source_layer_name;
+    }
+    for (int j = 0; j < num_source_blobs; ++j) {
       Blob<Dtype>* source_blob = source_layer->blobs()[j].get();
       CHECK(target_blobs[j]->shape() == source_blob->shape())
           << "Cannot share param " << j << " weights from layer '"
           << source_layer_name << "'; shape mismatch.  Source param shape is "
           << source_blob->shape_string() << "; target param shape is "
           << target_blobs[j]->shape_string();
-      target_blobs[j]->ShareData(*source_blob);
+      if (folded) {
+        target_blobs[j]->CopyFrom(*source_blob);
+      } else {
+        target_blobs[j]->ShareData(*source_blob);
+      }
     }
   }
+  FoldParams(folded_convs, folded_sources);
+  // The shared blobs may point into other's mapping
+  shared_weights_ = other->shared_weights_;
 }
 
 template <typename Dtype>
@@ -732,6 +1143,7 @@ void Net<Dtype>::Reshape() {
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
+  set<string> folded_convs, folded_sources;
   int num_source_layers = param.layer_size();
   for (int i = 0; i < num_source_layers; ++i) {
     const LayerParameter& source_layer = param.layer(i);
@@ -742,15 +1154,40 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
       ++target_layer_id;
     }
     if (target_layer_id == layer_names_.size()) {
+      if (folded_params_.count(source_layer_name)) {
+        vector<shared_ptr<Blob<Dtype> > >& folded_blobs =
+            folded_params_[source_layer_name];
+        CHECK_EQ(folded_blobs.size(), source_layer.blobs_size())
+            << "Incompatible number of blobs for layer " << source_layer_name;
+        for (int j = 0; j < folded_blobs.size(); ++j) {
+          folded_blobs[j]->FromProto(source_layer.blobs(j), true);
+        }
+        folded_sources.insert(source_layer_name);
+        continue;
+      }
       LOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
     DLOG(INFO) << "Copying source layer " << source_layer_name;
     vector<shared_ptr<Blob<Dtype> > >& target_blobs =
         layers_[target_layer_id]->blobs();
-    CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
-        << "Incompatible number of blobs for layer " << source_layer_name;
-    for (int j = 0; j < target_blobs.size(); ++j) {
+    const int num_source_blobs = source_layer.blobs_size();
+    if (folded_layers_.count(source_layer_name)) {
+      folded_convs.insert(source_layer_name);
+    }
+    if (folded_layers_.count(source_layer_name) &&
+        num_source_blobs < target_blobs.size()) {
+      // The bias term of a Convolution, or the scale and bias of a
+      // BatchNorm, were added by FoldInferenceLayers.
+      for (int j = num_source_blobs; j < target_blobs.size(); ++j) {
+        caffe_set(target_blobs[j]->count(), Dtype(0),
+            target_blobs[j]->mutable_cpu_data());
+      }
+    } else {
+      CHECK_EQ(target_blobs.size(), num_source_blobs)
+          << "Incompatible number of blobs for layer " << source_layer_name;
+    }
+    for (int j = 0; j < num_source_blobs; ++j) {
       if (!target_blobs[j]->ShapeEquals(source_layer.blobs(j))) {
         Blob<Dtype> source_blob;
         const bool kReshape = true;
@@ -766,6 +1203,77 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
       target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
     }
   }
+  FoldParams(folded_convs, folded_sources);
+}
+
+// The shape of a blob as BlobProto stores it, legacy or not.
+static vector<int> proto_shape(const BlobProto& proto) {
+  vector<int> shape;
+  if (!proto.has_shape()) {
+    shape.push_back(proto.num());
+    shape.push_back(proto.channels());
+    shape.push_back(proto.height());
+    shape.push_back(proto.width());
+  }
+  for (int i = 0; i < proto.shape().dim_size(); ++i) {
+    shape.push_back(proto.shape().dim(i));
+  }
+  return shape;
+}
+
+template <typename Dtype>
+bool Net<Dtype>::CanCopyTrainedLayersFrom(const NetParameter& param,
+    string* error) const {
+  std::ostringstream stream;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& source_layer = param.layer(i);
+    const string& source_layer_name = source_layer.name();
+    const int num_source_blobs = source_layer.blobs_size();
+    if (!layer_names_index_.count(source_layer_name)) {
+      typename map<string, vector<shared_ptr<Blob<Dtype> > > >::const_iterator
+          folded = folded_params_.find(source_layer_name);
+      if (folded == folded_params_.end()) continue;
+      // Reshaped when loaded, only their sizes matter to FoldParams.
+      if (folded->second.size() != num_source_blobs) {
+        stream << "Incompatible number of blobs for layer "
+            << source_layer_name;
+        *error = stream.str();
+        return false;
+      }
+      for (int j = 0; j < num_source_blobs; ++j) {
+        const Blob<Dtype> source_blob(proto_shape(source_layer.blobs(j)));
+        if (folded->second[j]->count() != source_blob.count()) {
+          stream << "Cannot copy param " << j << " weights from layer '"
+              << source_layer_name << "'; " << source_blob.count()
+              << " weights instead of " << folded->second[j]->count();
+          *error = stream.str();
+          return false;
+        }
+      }
+      continue;
+    }
+    const vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[layer_names_index_.find(source_layer_name)->second]->blobs();
+    if (folded_layers_.count(source_layer_name) ?
+        num_source_blobs > target_blobs.size() :
+        num_source_blobs != target_blobs.size()) {
+      stream << "Incompatible number of blobs for layer " << source_layer_name;
+      *error = stream.str();
+      return false;
+    }
+    for (int j = 0; j < num_source_blobs; ++j) {
+      if (!target_blobs[j]->ShapeEquals(source_layer.blobs(j))) {
+        const Blob<Dtype> source_blob(proto_shape(source_layer.blobs(j)));
+        stream << "Cannot copy param " << j << " weights from layer '"
+            << source_layer_name << "'; shape mismatch.  Source param shape is "
+            << source_blob.shape_string() << "; target param shape is "
+            << target_blobs[j]->shape_string();
+        *error = stream.str();
+        return false;
+      }
+    }
+  }
+  return true;
 }
 
 template <typename Dtype>
@@ -792,14 +1300,36 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   CHECK_GE(file_hid, 0) << "Couldn't open " << trained_filename;
   hid_t data_hid = H5Gopen2(file_hid, "data", H5P_DEFAULT);
   CHECK_GE(data_hid, 0) << "Error reading weights from " << trained_filename;
+  set<string> folded_convs, folded_sources;
   int num_layers = hdf5_get_num_links(data_hid);
   for (int i = 0; i < num_layers; ++i) {
     string source_layer_name = hdf5_get_name_by_idx(data_hid, i);
     if (!layer_names_index_.count(source_layer_name)) {
+      if (folded_params_.count(source_layer_name)) {
+        vector<shared_ptr<Blob<Dtype> > >& folded_blobs =
+            folded_params_[source_layer_name];
+        hid_t layer_hid = H5Gopen2(data_hid, source_layer_name.c_str(),
+            H5P_DEFAULT);
+        CHECK_GE(layer_hid, 0)
+            << "Error reading weights from " << trained_filename;
+        CHECK_EQ(hdf5_get_num_links(layer_hid), folded_blobs.size())
+            << "Incompatible number of blobs for layer " << source_layer_name;
+        for (int j = 0; j < folded_blobs.size(); ++j) {
+          ostringstream dataset_name;
+          dataset_name << j;
+          hdf5_load_nd_dataset(layer_hid, dataset_name.str().c_str(), 0,
+              kMaxBlobAxes, folded_blobs[j].get());
+        }
+        H5Gclose(layer_hid);
+        folded_sources.insert(source_layer_name);
+        continue;
+      }
       LOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
     int target_layer_id = layer_names_index_[source_layer_name];
+    const bool folded = folded_layers_.count(source_layer_name) > 0;
+    if (folded) { folded_convs.insert(source_layer_name); }
     DLOG(INFO) << "Copying source layer " << source_layer_name;
     vector<shared_ptr<Blob<Dtype> > >& target_blobs =
         layers_[target_layer_id]->blobs();
@@ -821,6 +1351,11 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
         if (param_owners_[target_net_param_id] != -1) {
           // ...but it's weight-shared in target, so that's fine.
           continue;
+        } else if (folded && j == 1) {
+          // ...but it's the bias term added by FoldInferenceLayers.
+          caffe_set(target_blobs[j]->count(), Dtype(0),
+              target_blobs[j]->mutable_cpu_data());
+          continue;
         } else {
           LOG(FATAL) << "Incompatible number of blobs for layer "
               << source_layer_name;
@@ -833,6 +1368,147 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   }
   H5Gclose(data_hid);
   H5Fclose(file_hid);
+  FoldParams(folded_convs, folded_sources);
+}
+
+// A segment of ShareTrainedLayersFromShm starts with this header and the
+// count of each parameter blob, then their data, each on its own cache line.
+struct SharedWeightsHeader {
+  uint32_t magic;
+  uint32_t dtype_size;
+  uint32_t num_blobs;
+  uint32_t reserved;
+  uint64_t size;
+  // The file identifying the weights: its device, inode, size and
+  // modification time, read with a stat; the path is for the logs.
+  uint64_t source_dev;
+  uint64_t source_ino;
+  uint64_t source_size;
+  int64_t source_mtime_sec;
+  int64_t source_mtime_nsec;
+  char source[256];
+};
+static const uint32_t kSharedWeightsMagic = 0x43414645;
+// Seconds to wait for another process to publish the weights.
+static const int kSharedWeightsTimeout = 120;
+
+static size_t align_cache_line(size_t bytes) {
+  return (bytes + 63) / 64 * 64;
+}
+
+static void stat_source(const string& filename, SharedWeightsHeader* header) {
+  struct stat st;
+  CHECK_EQ(stat(filename.c_str(), &st), 0) << "Cannot stat " << filename;
+  header->source_dev = st.st_dev;
+  header->source_ino = st.st_ino;
+  header->source_size = st.st_size;
+  header->source_mtime_sec = st.st_mtim.tv_sec;
+  header->source_mtime_nsec = st.st_mtim.tv_nsec;
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareTrainedLayersFromShm(const string trained_filename,
+    const string& shm_name, const string& source_filename) {
+  CHECK_EQ(phase_, TEST) << "Weights in shared memory are read-only";
+  // Each parameter once, shared parameters have the same SyncedMemory.
+  vector<Blob<Dtype>*> blobs;
+  set<const SyncedMemory*> seen;
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < layers_[i]->blobs().size(); ++j) {
+      Blob<Dtype>* blob = layers_[i]->blobs()[j].get();
+      if (seen.insert(blob->data().get()).second) {
+        blobs.push_back(blob);
+      }
+    }
+  }
+  vector<size_t> offsets;
+  size_t size = align_cache_line(sizeof(SharedWeightsHeader) +
+                                 blobs.size() * sizeof(uint64_t));
+  for (int i = 0; i < blobs.size(); ++i) {
+    offsets.push_back(size);
+    size += align_cache_line(blobs[i]->count() * sizeof(Dtype));
+  }
+  const string& source =
+      source_filename.empty() ? trained_filename : source_filename;
+  SharedWeightsHeader source_stat = SharedWeightsHeader();
+  stat_source(source, &source_stat);
+
+  shared_ptr<SharedMemorySegment> segment;
+  for (int waited = 0; ; waited += 10) {
+    // A segment is only there once it is complete.
+    segment.reset(SharedMemorySegment::Open(shm_name));
+    if (segment) { break; }
+    segment.reset(SharedMemorySegment::Create(shm_name, size));
+    if (segment) {
+      LOG(INFO) << "Publishing " << trained_filename << " to shared memory "
+                << shm_name << " (" << size << " bytes)";
+      CopyTrainedLayersFrom(trained_filename);
+      char* base = static_cast<char*>(segment->data());
+      SharedWeightsHeader* header =
+          reinterpret_cast<SharedWeightsHeader*>(base);
+      uint64_t* counts = reinterpret_cast<uint64_t*>(header + 1);
+      *header = source_stat;
+      header->magic = kSharedWeightsMagic;
+      header->dtype_size = sizeof(Dtype);
+      header->num_blobs = blobs.size();
+      header->size = size;
+      strncpy(header->source, source.c_str(), sizeof(header->source) - 1);
+      for (int i = 0; i < blobs.size(); ++i) {
+        counts[i] = blobs[i]->count();
+        caffe_copy(blobs[i]->count(), blobs[i]->cpu_data(),
+                   reinterpret_cast<Dtype*>(base + offsets[i]));
+      }
+      if (segment->Seal()) { break; }
+      segment.reset();
+      continue;
+    }
+    // Published or abandoned meanwhile: look again right away.
+    if (!SharedMemorySegment::InCreation(shm_name)) { continue; }
+    if (waited >= kSharedWeightsTimeout * 1000) {
+      LOG(WARNING) << "Shared memory " << shm_name << " not published after "
+          << kSharedWeightsTimeout << "s. Loading " << trained_filename
+          << " into this process only.";
+      CopyTrainedLayersFrom(trained_filename);
+      return;
+    }
+    usleep(10000);
+  }
+  const SharedWeightsHeader* header =
+      static_cast<const SharedWeightsHeader*>(segment->data());
+  const uint64_t* counts = reinterpret_cast<const uint64_t*>(header + 1);
+  CHECK_EQ(header->magic, kSharedWeightsMagic)
+      << shm_name << " does not hold shared weights";
+  if (header->source_dev != source_stat.source_dev ||
+      header->source_ino != source_stat.source_ino ||
+      header->source_size != source_stat.source_size ||
+      header->source_mtime_sec != source_stat.source_mtime_sec ||
+      header->source_mtime_nsec != source_stat.source_mtime_nsec) {
+    LOG(WARNING) << "Shared memory " << shm_name << " holds the weights of "
+        << string(header->source, strnlen(header->source,
+                                          sizeof(header->source)))
+        << ", not those of " << source << " (remove it with "
+        << "SharedMemorySegment::Remove). Loading " << trained_filename
+        << " into this process only.";
+    CopyTrainedLayersFrom(trained_filename);
+    return;
+  }
+  CHECK_EQ(header->dtype_size, sizeof(Dtype))
+      << shm_name << " holds weights of another precision";
+  CHECK_EQ(header->num_blobs, blobs.size())
+      << shm_name << " holds the weights of another net";
+  CHECK_EQ(header->size, size) << shm_name
+      << " holds the weights of another net";
+  CHECK_EQ(segment->size(), size);
+  for (int i = 0; i < blobs.size(); ++i) {
+    CHECK_EQ(counts[i], blobs[i]->count())
+        << shm_name << " holds the weights of another net";
+  }
+  LOG(INFO) << "Attached to the weights in shared memory " << shm_name;
+  const char* base = static_cast<const char*>(segment->data());
+  for (int i = 0; i < blobs.size(); ++i) {
+    blobs[i]->data()->set_read_only_cpu_data(base + offsets[i]);
+  }
+  shared_weights_ = segment;
 }
 
 template <typename Dtype>
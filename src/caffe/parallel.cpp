@@ -1,8 +1,10 @@
 #ifdef USE_NCCL
-
 #include <cuda_runtime.h>
+#endif
 #include <glog/logging.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -72,6 +74,174 @@ Params<Dtype>::Params(shared_ptr<Solver<Dtype> > root_solver)
     diff_() {
 }
 
+// On a cache line boundary, so that the slices of slice_begin are whole
+// lines.
+template<typename Dtype>
+static Dtype* cache_aligned_buffer(size_t size) {
+  void* buffer = NULL;
+  CHECK_EQ(posix_memalign(&buffer, 64, std::max<size_t>(size, 1)
+      * sizeof(Dtype)), 0) << "host allocation of " << size
+      << " parameters failed";
+  return static_cast<Dtype*>(buffer);
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::CPUParams(shared_ptr<Solver<Dtype> > root_solver)
+  : Params<Dtype>(root_solver) {
+  data_ = cache_aligned_buffer<Dtype>(size_);
+  const vector<Blob<Dtype>*>& net =
+    root_solver->net()->learnable_params();
+  apply_buffers(net, data_, size_, copy);
+  diff_ = cache_aligned_buffer<Dtype>(size_);
+  caffe_set(size_, Dtype(0), diff_);
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::~CPUParams() {
+  free(data_);
+  free(diff_);
+}
+
+template<typename Dtype>
+void CPUParams<Dtype>::Configure(Solver<Dtype>* solver) const {
+  const vector<Blob<Dtype>*>& net =
+    solver->net()->learnable_params();
+  apply_buffers(net, data_, size_, replace_cpu);
+  apply_buffers(net, diff_, size_, replace_cpu_diff);
+}
+
+template<typename Dtype>
+CPUSync<Dtype>::CPUSync(shared_ptr<Solver<Dtype> > solver)
+  : CPUParams<Dtype>(solver),
+    solver_(solver), barrier_(), syncs_(), stopped_(false) {
+  this->Configure(solver.get());
+}
+
+// Start of the slice of a buffer of size elements that rank reduces. Slices
+// are whole cache lines of the aligned buffers, so replicas never write the
+// same line.
+template<typename Dtype>
+static size_t slice_begin(size_t size, int rank, int count) {
+  const size_t line = 64 / sizeof(Dtype);
+  const size_t lines = (size + line - 1) / line;
+  return std::min(size, lines * rank / count * line);
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::on_gradients_ready() {
+  const int count = static_cast<int>(syncs_->size());
+  const int rank = Caffe::solver_rank();
+  // Wait for the gradients of all the replicas
+  barrier_->wait();
+  if ((*syncs_)[0]->solver_->requested_early_exit()) {
+    // Rank 0 stopped and this was its final wait in Run, the replica stops
+    // after this iteration without reducing.
+    stopped_ = true;
+    return;
+  }
+  const size_t begin = slice_begin<Dtype>(size_, rank, count);
+  const int n = static_cast<int>(
+      slice_begin<Dtype>(size_, rank + 1, count) - begin);
+  Dtype* sum = diff_ + begin;
+  for (int i = 0; i < count; ++i) {
+    if (i != rank) {
+      caffe_axpy(n, Dtype(1), (*syncs_)[i]->diff_ + begin, sum);
+    }
+  }
+  caffe_scal(n, Dtype(1) / count, sum);
+  for (int i = 0; i < count; ++i) {
+    if (i != rank) {
+      caffe_copy(n, sum, (*syncs_)[i]->diff_ + begin);
+    }
+  }
+  // Wait for all the slices before the solvers update
+  barrier_->wait();
+}
+
+template<typename Dtype>
+class CPUWorker : public InternalThread {
+ public:
+  CPUWorker(shared_ptr<Solver<Dtype> > rank0, shared_ptr<Solver<Dtype> > solver,
+            const CPUSync<Dtype>* sync, boost::barrier* barrier)
+    : rank0_(rank0), solver_(solver), sync_(sync), barrier_(barrier) {
+    solver_->SetActionFunction(boost::bind(&CPUWorker::CheckForSignals, this));
+  }
+  virtual ~CPUWorker() {}
+
+ protected:
+  SolverAction::Enum CheckForSignals() const {
+    if (rank0_->requested_early_exit() || sync_->stopped()) {
+      return SolverAction::STOP;
+    }
+    return SolverAction::NONE;
+  }
+
+  void InternalThreadEntry() {
+    solver_->Step(solver_->param().max_iter() - solver_->iter());
+    if (!sync_->stopped()) {
+      barrier_->wait();
+    }
+  }
+
+  shared_ptr<Solver<Dtype> > rank0_;
+  shared_ptr<Solver<Dtype> > solver_;
+  const CPUSync<Dtype>* sync_;
+  boost::barrier* barrier_;
+};
+
+template<typename Dtype>
+void CPUSync<Dtype>::Run(int count, const char* restore) {
+  CHECK_EQ(Caffe::mode(), Caffe::CPU);
+  CHECK_EQ(Caffe::solver_count(), count);
+  boost::barrier barrier(count);
+  vector<CPUSync<Dtype>*> syncs(count);
+  vector<shared_ptr<CPUSync<Dtype> > > worker_syncs(count);
+  vector<shared_ptr<CPUWorker<Dtype> > > workers(count);
+  // The replicas are created here rather than in their threads, the layers
+  // of a net are not all safe to set up concurrently.
+  for (int i = 1; i < count; ++i) {
+    Caffe::set_solver_rank(i);
+    SolverParameter param(solver_->param());
+    param.set_type(solver_->type());
+    shared_ptr<Solver<Dtype> > s(SolverRegistry<Dtype>::CreateSolver(param));
+    CHECK_EQ(s->type(), solver_->type());
+    if (restore) {
+      s->Restore(restore);
+    }
+    worker_syncs[i].reset(new CPUSync<Dtype>(s));
+    // Start from the weights of rank 0
+    caffe_copy(size_, data_, worker_syncs[i]->data_);
+    s->add_callback(worker_syncs[i].get());
+    syncs[i] = worker_syncs[i].get();
+  }
+  Caffe::set_solver_rank(0);
+  syncs[0] = this;
+  for (int i = 0; i < count; ++i) {
+    syncs[i]->barrier_ = &barrier;
+    syncs[i]->syncs_ = &syncs;
+  }
+  for (int i = 1; i < count; ++i) {
+    Caffe::set_solver_rank(i);
+    workers[i].reset(new CPUWorker<Dtype>(solver_, worker_syncs[i]->solver_,
+                                          worker_syncs[i].get(), &barrier));
+    workers[i]->StartInternalThread();
+  }
+  Caffe::set_solver_rank(0);
+  solver_->add_callback(this);
+  solver_->Solve();
+  // Wait for the replicas to finish
+  barrier.wait();
+  for (int i = 1; i < count; ++i) {
+    workers[i]->StopInternalThread();
+  }
+}
+
+INSTANTIATE_CLASS(Params);
+INSTANTIATE_CLASS(CPUParams);
+INSTANTIATE_CLASS(CPUSync);
+
+#ifdef USE_NCCL
+
 template<typename Dtype>
 GPUParams<Dtype>::GPUParams(shared_ptr<Solver<Dtype> > root_solver, int device)
   : Params<Dtype>(root_solver) {
@@ -373,11 +543,10 @@ void NCCL<Dtype>::Run(const vector<int>& gpus, const char* restore) {
   // better method by @cypof see #pull/5825
 }
 
-INSTANTIATE_CLASS(Params);
 INSTANTIATE_CLASS(GPUParams);
 INSTANTIATE_CLASS(Worker);
 INSTANTIATE_CLASS(NCCL);
 
-}  // namespace caffe
-
 #endif  // USE_NCCL
+
+}  // namespace caffe
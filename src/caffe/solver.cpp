@@ -310,6 +310,9 @@ void Solver<Dtype>::Solve(const char* resume_file) {
       && (!param_.snapshot() || iter_ % param_.snapshot() != 0)) {
     Snapshot();
   }
+  if (snapshot_writer_) {
+    snapshot_writer_->Flush();
+  }
   if (requested_early_exit_) {
     LOG(INFO) << "Optimization stopped early.";
     return;
@@ -422,6 +425,15 @@ void Solver<Dtype>::Test(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  if (param_.async_snapshot()) {
+    if (param_.snapshot_format() ==
+        caffe::SolverParameter_SnapshotFormat_BINARYPROTO) {
+      SnapshotAsync();
+      return;
+    }
+    LOG_FIRST_N(WARNING, 1) << "async_snapshot needs the BINARYPROTO format, "
+        << "snapshotting synchronously";
+  }
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -437,6 +449,20 @@ void Solver<Dtype>::Snapshot() {
   SnapshotSolverState(model_filename);
 }
 
+template <typename Dtype>
+void Solver<Dtype>::SnapshotAsync() {
+  if (!snapshot_writer_) {
+    snapshot_writer_.reset(new SnapshotWriter());
+  }
+  const string model_filename = SnapshotFilename(".caffemodel");
+  LOG(INFO) << "Snapshotting to binary proto file " << model_filename
+            << " in the background";
+  net_->ToProto(&snapshot_net_, param_.snapshot_diff());
+  SnapshotSolverStateToProto(model_filename, &snapshot_state_);
+  snapshot_writer_->Write(&snapshot_net_, model_filename, &snapshot_state_,
+                          SnapshotFilename(".solverstate"));
+}
+
 template <typename Dtype>
 void Solver<Dtype>::CheckSnapshotWritePermissions() {
   if (Caffe::root_solver() && param_.snapshot()) {
@@ -1,11 +1,18 @@
+#include <boost/atomic.hpp>
+
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
+
+// The last version given to any SyncedMemory.
+static boost::atomic<uint64_t> last_version(0);
+
 SyncedMemory::SyncedMemory()
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    read_only_(false), offset_(0), version_(++last_version) {
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -15,7 +22,23 @@ SyncedMemory::SyncedMemory()
 
 SyncedMemory::SyncedMemory(size_t size)
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    read_only_(false), offset_(0), version_(++last_version) {
+#ifndef CPU_ONLY
+#ifdef DEBUG
+  CUDA_CHECK(cudaGetDevice(&device_));
+#endif
+#endif
+}
+
+SyncedMemory::SyncedMemory(const shared_ptr<SyncedMemory>& parent,
+    size_t offset, size_t size)
+  : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    read_only_(false), parent_(parent), offset_(offset),
+    version_(++last_version) {
+  CHECK(parent_);
+  CHECK_LE(offset + size, parent_->size());
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -36,6 +59,10 @@ SyncedMemory::~SyncedMemory() {
 #endif  // CPU_ONLY
 }
 
+inline void SyncedMemory::bump_version() {
+  version_ = ++last_version;
+}
+
 inline void SyncedMemory::to_cpu() {
   check_device();
   switch (head_) {
@@ -92,6 +119,9 @@ inline void SyncedMemory::to_gpu() {
 
 const void* SyncedMemory::cpu_data() {
   check_device();
+  if (parent_) {
+    return static_cast<const char*>(parent_->cpu_data()) + offset_;
+  }
   to_cpu();
   return (const void*)cpu_ptr_;
 }
@@ -99,17 +129,28 @@ const void* SyncedMemory::cpu_data() {
 void SyncedMemory::set_cpu_data(void* data) {
   check_device();
   CHECK(data);
+  parent_.reset();
   if (own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
   }
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  read_only_ = false;
+  bump_version();
+}
+
+void SyncedMemory::set_read_only_cpu_data(const void* data) {
+  set_cpu_data(const_cast<void*>(data));
+  read_only_ = true;
 }
 
 const void* SyncedMemory::gpu_data() {
   check_device();
 #ifndef CPU_ONLY
+  if (parent_) {
+    return static_cast<const char*>(parent_->gpu_data()) + offset_;
+  }
   to_gpu();
   return (const void*)gpu_ptr_;
 #else
@@ -122,12 +163,19 @@ void SyncedMemory::set_gpu_data(void* data) {
   check_device();
 #ifndef CPU_ONLY
   CHECK(data);
+  parent_.reset();
   if (own_gpu_data_) {
     CUDA_CHECK(cudaFree(gpu_ptr_));
   }
   gpu_ptr_ = data;
   head_ = HEAD_AT_GPU;
   own_gpu_data_ = false;
+  if (read_only_) {
+    // Syncing back to the host must not write the read-only data.
+    cpu_ptr_ = NULL;
+    read_only_ = false;
+  }
+  bump_version();
 #else
   NO_GPU;
 #endif
@@ -135,16 +183,26 @@ void SyncedMemory::set_gpu_data(void* data) {
 
 void* SyncedMemory::mutable_cpu_data() {
   check_device();
+  if (parent_) {
+    return static_cast<char*>(parent_->mutable_cpu_data()) + offset_;
+  }
+  CHECK(!read_only_) << "The data is read-only";
   to_cpu();
   head_ = HEAD_AT_CPU;
+  bump_version();
   return cpu_ptr_;
 }
 
 void* SyncedMemory::mutable_gpu_data() {
   check_device();
 #ifndef CPU_ONLY
+  if (parent_) {
+    return static_cast<char*>(parent_->mutable_gpu_data()) + offset_;
+  }
+  CHECK(!read_only_) << "The data is read-only";
   to_gpu();
   head_ = HEAD_AT_GPU;
+  bump_version();
   return gpu_ptr_;
 #else
   NO_GPU;
@@ -155,6 +213,10 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
 void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
   check_device();
+  if (parent_) {
+    parent_->async_gpu_push(stream);
+    return;
+  }
   CHECK(head_ == HEAD_AT_CPU);
   if (gpu_ptr_ == NULL) {
     CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
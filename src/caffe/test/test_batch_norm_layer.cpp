@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <vector>
 
@@ -130,4 +131,89 @@ namespace caffe {
         this->blob_top_vec_);
   }
 
+  TYPED_TEST(BatchNormLayerTest, TestForwardGlobalStatsScaleBiasReLU) {
+    typedef typename TypeParam::Dtype Dtype;
+    LayerParameter layer_param;
+    BatchNormParameter* bn_param = layer_param.mutable_batch_norm_param();
+    bn_param->set_use_global_stats(true);
+    bn_param->set_scale_bias_term(true);
+    bn_param->mutable_fused_relu_param()->set_negative_slope(0.1);
+
+    BatchNormLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    ASSERT_EQ(5, layer.blobs().size());
+    FillerParameter filler_param;
+    filler_param.set_min(0.5);
+    filler_param.set_max(2);
+    GaussianFiller<Dtype> gaussian_filler(filler_param);
+    UniformFiller<Dtype> uniform_filler(filler_param);
+    gaussian_filler.Fill(layer.blobs()[0].get());
+    uniform_filler.Fill(layer.blobs()[1].get());
+    layer.blobs()[2]->mutable_cpu_data()[0] = 2;
+    gaussian_filler.Fill(layer.blobs()[3].get());
+    gaussian_filler.Fill(layer.blobs()[4].get());
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+    const Dtype* mean = layer.blobs()[0]->cpu_data();
+    const Dtype* variance = layer.blobs()[1]->cpu_data();
+    const Dtype* scale = layer.blobs()[3]->cpu_data();
+    const Dtype* bias = layer.blobs()[4]->cpu_data();
+    for (int i = 0; i < this->blob_bottom_->num(); ++i) {
+      for (int j = 0; j < this->blob_bottom_->channels(); ++j) {
+        for (int k = 0; k < this->blob_bottom_->height(); ++k) {
+          for (int l = 0; l < this->blob_bottom_->width(); ++l) {
+            Dtype value = (this->blob_bottom_->data_at(i, j, k, l)
+                - mean[j] / 2) / sqrt(variance[j] / 2 + 1e-5);
+            value = scale[j] * value + bias[j];
+            value = value > 0 ? value : Dtype(0.1) * value;
+            EXPECT_NEAR(value, this->blob_top_->data_at(i, j, k, l), 1e-4);
+          }
+        }
+      }
+    }
+  }
+
+  TYPED_TEST(BatchNormLayerTest, TestBackwardGlobalStatsScaleBias) {
+    typedef typename TypeParam::Dtype Dtype;
+    LayerParameter layer_param;
+    layer_param.mutable_batch_norm_param()->set_use_global_stats(true);
+    layer_param.mutable_batch_norm_param()->set_scale_bias_term(true);
+
+    BatchNormLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    FillerParameter filler_param;
+    filler_param.set_min(0.5);
+    filler_param.set_max(2);
+    UniformFiller<Dtype> filler(filler_param);
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      filler.Fill(layer.blobs()[i].get());
+    }
+    // The statistics, scale and bias have no gradient, so this checks the
+    // bottom diff only: the layer is x * scale / sqrt(var + eps) + const.
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    GaussianFiller<Dtype> gaussian_filler(filler_param);
+    Blob<Dtype> top_diff;
+    top_diff.ReshapeLike(*this->blob_top_);
+    gaussian_filler.Fill(&top_diff);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+        this->blob_bottom_vec_);
+    const Dtype scale_factor = 1 / layer.blobs()[2]->cpu_data()[0];
+    const Dtype* variance = layer.blobs()[1]->cpu_data();
+    const Dtype* scale = layer.blobs()[3]->cpu_data();
+    for (int i = 0; i < this->blob_bottom_->num(); ++i) {
+      for (int j = 0; j < this->blob_bottom_->channels(); ++j) {
+        const Dtype factor =
+            scale[j] / sqrt(variance[j] * scale_factor + 1e-5);
+        for (int k = 0; k < this->blob_bottom_->height(); ++k) {
+          for (int l = 0; l < this->blob_bottom_->width(); ++l) {
+            EXPECT_NEAR(top_diff.data_at(i, j, k, l) * factor,
+                this->blob_bottom_->diff_at(i, j, k, l), 1e-4);
+          }
+        }
+      }
+    }
+  }
+
 }  // namespace caffe
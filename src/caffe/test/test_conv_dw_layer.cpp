@@ -0,0 +1,173 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/conv_layer.hpp"
+#include "caffe/PR/conv_dw_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class ConvolutionDepthwiseLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  ConvolutionDepthwiseLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 9, 8)),
+        blob_top_(new Blob<Dtype>()),
+        ref_blob_bottom_(new Blob<Dtype>()),
+        ref_blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    FillerParameter filler_param;
+    filler_param.set_value(1.);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+
+  virtual ~ConvolutionDepthwiseLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete ref_blob_bottom_;
+    delete ref_blob_top_;
+  }
+
+  // Checks the forward and backward passes against a ConvolutionLayer with
+  // one group per channel sharing the same weights and bias.
+  void CheckAgainstGroupConvolution(const int kernel, const int stride,
+      const int pad, const int dilation,
+      const ConvolutionParameter_DepthwiseKernel depthwise_kernel =
+      ConvolutionParameter_DepthwiseKernel_DEPTHWISE_AUTO) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(kernel);
+    convolution_param->add_stride(stride);
+    convolution_param->add_pad(pad);
+    convolution_param->add_dilation(dilation);
+    convolution_param->set_num_output(this->blob_bottom_->channels());
+    convolution_param->set_group(this->blob_bottom_->channels());
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    ConvolutionLayer<Dtype> ref_layer(layer_param);
+    convolution_param->set_depthwise_kernel(depthwise_kernel);
+    ConvolutionDepthwiseLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    vector<Blob<Dtype>*> ref_bottom_vec(1, this->ref_blob_bottom_);
+    vector<Blob<Dtype>*> ref_top_vec(1, this->ref_blob_top_);
+    this->ref_blob_bottom_->CopyFrom(*this->blob_bottom_, false, true);
+    ref_layer.SetUp(ref_bottom_vec, ref_top_vec);
+    for (int i = 0; i < 2; ++i) {
+      ref_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+    }
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    ref_layer.Forward(ref_bottom_vec, ref_top_vec);
+    ASSERT_EQ(this->ref_blob_top_->shape(), this->blob_top_->shape());
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+    }
+    FillerParameter filler_param;
+    filler_param.set_value(1.);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_top_);
+    caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    this->ref_blob_top_->CopyFrom(*this->blob_top_, true);
+    vector<bool> propagate_down(1, true);
+    layer.Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+    ref_layer.Backward(ref_top_vec, propagate_down, ref_bottom_vec);
+    const Dtype* bottom_diff = this->blob_bottom_->cpu_diff();
+    const Dtype* ref_bottom_diff = this->ref_blob_bottom_->cpu_diff();
+    for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+      EXPECT_NEAR(bottom_diff[i], ref_bottom_diff[i], 1e-4);
+    }
+    for (int i = 0; i < 2; ++i) {
+      const Dtype* param_diff = layer.blobs()[i]->cpu_diff();
+      const Dtype* ref_param_diff = ref_layer.blobs()[i]->cpu_diff();
+      for (int j = 0; j < layer.blobs()[i]->count(); ++j) {
+        EXPECT_NEAR(param_diff[j], ref_param_diff[j], 1e-4);
+      }
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const ref_blob_bottom_;
+  Blob<Dtype>* const ref_blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ConvolutionDepthwiseLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(ConvolutionDepthwiseLayerTest, Test3x3Stride1) {
+  this->CheckAgainstGroupConvolution(3, 1, 1, 1);
+}
+
+TYPED_TEST(ConvolutionDepthwiseLayerTest, Test3x3Stride2) {
+  this->CheckAgainstGroupConvolution(3, 2, 1, 1);
+}
+
+TYPED_TEST(ConvolutionDepthwiseLayerTest, Test3x3Stride1Generic) {
+  this->CheckAgainstGroupConvolution(3, 1, 1, 1,
+      ConvolutionParameter_DepthwiseKernel_DEPTHWISE_GENERIC);
+}
+
+TYPED_TEST(ConvolutionDepthwiseLayerTest, Test3x3Stride2Generic) {
+  this->CheckAgainstGroupConvolution(3, 2, 1, 1,
+      ConvolutionParameter_DepthwiseKernel_DEPTHWISE_GENERIC);
+}
+
+TYPED_TEST(ConvolutionDepthwiseLayerTest, Test3x3Stride1Specialized) {
+  this->CheckAgainstGroupConvolution(3, 1, 1, 1,
+      ConvolutionParameter_DepthwiseKernel_DEPTHWISE_SPECIALIZED);
+}
+
+TYPED_TEST(ConvolutionDepthwiseLayerTest, Test3x3Stride2Specialized) {
+  this->CheckAgainstGroupConvolution(3, 2, 1, 1,
+      ConvolutionParameter_DepthwiseKernel_DEPTHWISE_SPECIALIZED);
+}
+
+TYPED_TEST(ConvolutionDepthwiseLayerTest, Test3x3Stride2NoPad) {
+  this->CheckAgainstGroupConvolution(3, 2, 0, 1);
+}
+
+TYPED_TEST(ConvolutionDepthwiseLayerTest, Test3x3LargePad) {
+  this->CheckAgainstGroupConvolution(3, 1, 3, 1);
+}
+
+TYPED_TEST(ConvolutionDepthwiseLayerTest, TestDilated5x5) {
+  this->CheckAgainstGroupConvolution(5, 1, 4, 2);
+}
+
+TYPED_TEST(ConvolutionDepthwiseLayerTest, TestStride3) {
+  this->CheckAgainstGroupConvolution(3, 3, 2, 1);
+}
+
+TYPED_TEST(ConvolutionDepthwiseLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(1);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionDepthwiseLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
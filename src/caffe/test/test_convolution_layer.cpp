@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -495,6 +496,159 @@ TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolutionGroup) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestInt8ConvolutionGroup) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  Dtype bottom_max = 0;
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    bottom_max = std::max(bottom_max, std::abs(bottom_data[i]));
+  }
+  QuantizationParameter* quantization_param =
+      layer_param.mutable_quantization_param();
+  quantization_param->set_precision(QuantizationParameter_Precision_INT8);
+  quantization_param->set_bottom_max(bottom_max);
+  shared_ptr<Layer<Dtype> > layer(
+      new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Check against reference convolution of the quantized input and weights,
+  // brought back to their range, which only the rounding separates.
+  Blob<Dtype> bottom_q(this->blob_bottom_->shape());
+  const Dtype input_scale = Dtype(127) / bottom_max;
+  for (int i = 0; i < bottom_q.count(); ++i) {
+    int8_t q;
+    caffe_cpu_quantize(1, input_scale, bottom_data + i, &q);
+    bottom_q.mutable_cpu_data()[i] = q / input_scale;
+  }
+  vector<shared_ptr<Blob<Dtype> > > weights_q(2);
+  weights_q[0].reset(new Blob<Dtype>(layer->blobs()[0]->shape()));
+  weights_q[1] = layer->blobs()[1];
+  const int kernel_dim = layer->blobs()[0]->count(1);
+  vector<int8_t> q(layer->blobs()[0]->count());
+  vector<Dtype> weight_scales(6);
+  caffe_cpu_quantize_rows(6, kernel_dim, layer->blobs()[0]->cpu_data(),
+      q.data(), weight_scales.data());
+  for (int i = 0; i < q.size(); ++i) {
+    weights_q[0]->mutable_cpu_data()[i] = q[i] / weight_scales[i / kernel_dim];
+  }
+  caffe_conv(&bottom_q, convolution_param, weights_q,
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+  // New weights are quantized again, and twice the weights give twice the
+  // output before the bias.
+  vector<Dtype> top_before(top_data, top_data + this->blob_top_->count());
+  caffe_scal(layer->blobs()[0]->count(), Dtype(2),
+      layer->blobs()[0]->mutable_cpu_data());
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  top_data = this->blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], 2 * top_before[i] - 0.1, 1e-4);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestCPUEngines) {
+  typedef typename TypeParam::Dtype Dtype;
+  const ConvolutionParameter_CPUEngine engines[] = {
+    ConvolutionParameter_CPUEngine_DIRECT,
+    ConvolutionParameter_CPUEngine_WINOGRAD_2X2,
+    ConvolutionParameter_CPUEngine_WINOGRAD_4X4,
+    ConvolutionParameter_CPUEngine_AUTO
+  };
+  for (int i = 0; i < 4; ++i) {
+    LayerParameter layer_param;
+    layer_param.set_phase(TEST);
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(3);
+    convolution_param->add_pad(1);
+    convolution_param->set_num_output(6);
+    convolution_param->set_group(3);
+    convolution_param->set_cpu_engine(engines[i]);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("constant");
+    convolution_param->mutable_bias_filler()->set_value(0.1);
+    shared_ptr<Layer<Dtype> > layer(
+        new ConvolutionLayer<Dtype>(layer_param));
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    // Check against reference convolution.
+    caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int j = 0; j < this->blob_top_->count(); ++j) {
+      EXPECT_NEAR(top_data[j], ref_top_data[j], 1e-4);
+    }
+    // New weights and a new input shape are picked up.
+    caffe_scal(layer->blobs()[0]->count(), Dtype(2),
+        layer->blobs()[0]->mutable_cpu_data());
+    this->blob_bottom_->Reshape(2, 3, 9, 5);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    top_data = this->blob_top_->cpu_data();
+    ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int j = 0; j < this->blob_top_->count(); ++j) {
+      EXPECT_NEAR(top_data[j], ref_top_data[j], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestDirectDilatedConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> bottom_shape;
+  bottom_shape.push_back(2);
+  bottom_shape.push_back(3);
+  bottom_shape.push_back(8);
+  bottom_shape.push_back(7);
+  this->blob_bottom_->Reshape(bottom_shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(2);
+  convolution_param->add_dilation(2);
+  convolution_param->set_num_output(5);
+  convolution_param->set_cpu_engine(ConvolutionParameter_CPUEngine_DIRECT);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<Layer<Dtype> > layer(
+      new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Check against reference convolution.
+  caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestSobelConvolution) {
   // Test separable convolution by computing the Sobel operator
   // as a single filter then comparing the result
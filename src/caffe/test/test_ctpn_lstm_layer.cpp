@@ -0,0 +1,102 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/CTPN/ctpn_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class CTPNLstmLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  CTPNLstmLayerTest()
+      : blob_bottom_(new Blob<Dtype>()),
+        blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    vector<int> shape;
+    shape.push_back(4);  // T
+    shape.push_back(3);  // N
+    shape.push_back(5);  // I
+    blob_bottom_->Reshape(shape);
+    FillerParameter filler_param;
+    filler_param.set_std(0.5);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+    LstmParameter* lstm_param = layer_param_.mutable_lstm_param();
+    lstm_param->set_num_output(3);
+    lstm_param->mutable_weight_filler()->set_type("gaussian");
+    lstm_param->mutable_weight_filler()->set_std(0.5);
+    lstm_param->mutable_bias_filler()->set_type("gaussian");
+    lstm_param->mutable_bias_filler()->set_std(0.5);
+  }
+
+  virtual ~CTPNLstmLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  LayerParameter layer_param_;
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(CTPNLstmLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(CTPNLstmLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LstmLayer<Dtype> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int T = 4, N = 3, I = 5, H = 3;
+  const Dtype* x = this->blob_bottom_->cpu_data();
+  const Dtype* w_i = layer.blobs()[0]->cpu_data();
+  const Dtype* w_h = layer.blobs()[1]->cpu_data();
+  const Dtype* b = layer.blobs()[2]->cpu_data();
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  // Every sequence of the batch evolves independently from a zero state.
+  for (int n = 0; n < N; ++n) {
+    vector<Dtype> h(H, 0), c(H, 0);
+    for (int t = 0; t < T; ++t) {
+      vector<Dtype> gate(4*H);
+      for (int g = 0; g < 4*H; ++g) {
+        Dtype sum = b[g];
+        for (int i = 0; i < I; ++i) {
+          sum += w_i[g*I + i] * x[(t*N + n)*I + i];
+        }
+        for (int d = 0; d < H; ++d) {
+          sum += w_h[g*H + d] * h[d];
+        }
+        gate[g] = g < 3*H ? 1. / (1. + std::exp(-sum)) : std::tanh(sum);
+      }
+      for (int d = 0; d < H; ++d) {
+        const Dtype f = t > 0 ? gate[H + d] : Dtype(0);
+        c[d] = f * c[d] + gate[d] * gate[3*H + d];
+        h[d] = gate[2*H + d] * std::tanh(c[d]);
+        EXPECT_NEAR(h[d], top_data[(t*N + n)*H + d], 1e-5);
+      }
+    }
+  }
+}
+
+TYPED_TEST(CTPNLstmLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LstmLayer<Dtype> layer(this->layer_param_);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
@@ -0,0 +1,140 @@
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/FRCNN/focal_loss/focal_loss_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class FocalLossLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  FocalLossLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(10, 5, 2, 3)),
+        blob_bottom_label_(new Blob<Dtype>(10, 1, 2, 3)),
+        blob_top_loss_(new Blob<Dtype>()) {
+    // fill the values
+    FillerParameter filler_param;
+    filler_param.set_std(3);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    for (int i = 0; i < blob_bottom_label_->count(); ++i) {
+      blob_bottom_label_->mutable_cpu_data()[i] = caffe_rng_rand() % 5;
+    }
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+  }
+  virtual ~FocalLossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_loss_;
+  }
+
+  // Sum of -alpha * (1 - p_t) ^ gamma * log(p_t) over the labels that are
+  // not ignore_label, with the softmax taken channel by channel.
+  Dtype ReferenceLoss(Dtype alpha, Dtype gamma, int ignore_label,
+                      int* valid_count) {
+    const int num = blob_bottom_data_->num();
+    const int channels = blob_bottom_data_->channels();
+    const int spatial_dim = blob_bottom_data_->count(2);
+    const Dtype* data = blob_bottom_data_->cpu_data();
+    const Dtype* label = blob_bottom_label_->cpu_data();
+    Dtype loss = 0;
+    *valid_count = 0;
+    for (int n = 0; n < num; ++n) {
+      for (int s = 0; s < spatial_dim; ++s) {
+        const int label_value = static_cast<int>(label[n * spatial_dim + s]);
+        if (label_value == ignore_label) {
+          continue;
+        }
+        Dtype max_value = -FLT_MAX;
+        for (int c = 0; c < channels; ++c) {
+          max_value = std::max(max_value,
+              data[(n * channels + c) * spatial_dim + s]);
+        }
+        Dtype sum = 0;
+        for (int c = 0; c < channels; ++c) {
+          sum += exp(data[(n * channels + c) * spatial_dim + s] - max_value);
+        }
+        const Dtype prob = exp(data[(n * channels + label_value) * spatial_dim
+            + s] - max_value) / sum;
+        loss -= alpha * pow(1 - prob, gamma) * log(std::max(prob,
+            Dtype(FLT_MIN)));
+        ++(*valid_count);
+      }
+    }
+    return loss;
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(FocalLossLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(FocalLossLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_loss_param()->set_normalize(false);
+  FocalLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  int valid_count;
+  const Dtype loss = this->ReferenceLoss(0.25, 2, -1, &valid_count);
+  // BATCH_SIZE normalization: divided by the num
+  EXPECT_NEAR(this->blob_top_loss_->cpu_data()[0], loss / 10, 1e-4);
+}
+
+TYPED_TEST(FocalLossLayerTest, TestForwardIgnoreLabel) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_loss_param()->set_ignore_label(1);
+  layer_param.mutable_loss_param()->set_normalization(
+      LossParameter_NormalizationMode_VALID);
+  layer_param.mutable_focal_loss_param()->set_alpha(0.5);
+  layer_param.mutable_focal_loss_param()->set_gamma(1);
+  FocalLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  int valid_count;
+  const Dtype loss = this->ReferenceLoss(0.5, 1, 1, &valid_count);
+  EXPECT_NEAR(this->blob_top_loss_->cpu_data()[0], loss / valid_count, 1e-4);
+}
+
+TYPED_TEST(FocalLossLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.add_loss_weight(3);
+  FocalLossLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(FocalLossLayerTest, TestGradientIgnoreLabel) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  // labels are in {0, ..., 4}, so we'll ignore about a fifth of them
+  layer_param.mutable_loss_param()->set_ignore_label(0);
+  layer_param.mutable_focal_loss_param()->set_gamma(0.5);
+  FocalLossLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+}  // namespace caffe
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/FRCNN/util/frcnn_helper.hpp"
+#include "caffe/FRCNN/util/frcnn_param.hpp"
+#include "caffe/FRCNN/util/frcnn_utils.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using Frcnn::FrcnnParam;
+using Frcnn::Point4f;
+
+// FPNProposal lives in the "modules" library, which the layer factory opens
+// from CAFFE_LAYER_PATH or the build directory.
+class FPNProposalLayerTest : public ::testing::Test {
+ protected:
+  // Levels P2 .. P6 of a 128 x 128 image with 3 anchors per position, 4092
+  // in all, and scores in steps of 1/32 so that many of them tie.
+  FPNProposalLayerTest()
+      : num_levels_(5), blob_bottom_im_info_(new Blob<float>(1, 3, 1, 1)) {
+    Caffe::set_mode(Caffe::CPU);
+    FrcnnParam::test_rpn_pre_nms_top_n = 300;
+    FrcnnParam::test_rpn_post_nms_top_n = 120;
+    FrcnnParam::test_rpn_nms_thresh = 0.7;
+    FrcnnParam::test_rpn_min_size = 4;
+    // sqrt(w * h) < 16 goes to P2, [16, 32) to P3, [32, 64) to P4 and
+    // larger rois to P5.
+    FrcnnParam::roi_canonical_scale = 32;
+    FrcnnParam::roi_canonical_level = 4;
+    FillerParameter filler_param;
+    filler_param.set_std(0.3);
+    GaussianFiller<float> filler(filler_param);
+    for (int level = 0; level < num_levels_; ++level) {
+      const int size = 32 >> level;
+      Blob<float>* score = new Blob<float>(1, 6, size, size);
+      float* score_data = score->mutable_cpu_data();
+      for (int i = 0; i < score->count(); ++i) {
+        score_data[i] = (caffe_rng_rand() % 33) / 32.f;
+      }
+      Blob<float>* bbox = new Blob<float>(1, 12, size, size);
+      filler.Fill(bbox);
+      blob_bottom_vec_.push_back(score);
+      blob_bottom_vec_.push_back(bbox);
+    }
+    float* im_info = blob_bottom_im_info_->mutable_cpu_data();
+    im_info[0] = im_info[1] = 128;
+    im_info[2] = 1;
+    blob_bottom_vec_.push_back(blob_bottom_im_info_);
+  }
+  virtual ~FPNProposalLayerTest() {
+    for (int i = 0; i < blob_bottom_vec_.size(); ++i) {
+      delete blob_bottom_vec_[i];
+    }
+    for (int i = 0; i < blob_top_vec_.size(); ++i) {
+      delete blob_top_vec_[i];
+    }
+  }
+
+  // The previous Forward_cpu: one scan of every level in (j, i, k) order, a
+  // full sort of the boxes by score, the serial NMS and, with the per-level
+  // tops, the rois grouped by level with a zero roi for each empty level.
+  void PreviousForward(const bool split, vector<vector<float> >* rois,
+      vector<float>* scores) {
+    const float bounds[4] = {127, 127, 127, 127};
+    typedef std::pair<float, int> sort_pair;
+    vector<sort_pair> sort_vector;
+    vector<Point4f<float> > boxes;
+    for (int level = 0; level < num_levels_; ++level) {
+      const Blob<float>* score = blob_bottom_vec_[level * 2];
+      const Blob<float>* bbox = blob_bottom_vec_[level * 2 + 1];
+      const int height = bbox->height();
+      const int width = bbox->width();
+      const int plane = height * width;
+      const int stride = 4 << level;
+      // generate_anchors(stride, {0.5, 1, 2}, {8}).
+      const float ratios[3] = {0.5, 1, 2};
+      float anchors[3][4];
+      for (int k = 0; k < 3; ++k) {
+        const float center = 0.5 * (stride - 1);
+        const int w = sqrt(stride * 8 * stride * 8 / ratios[k]);
+        const int h = w * ratios[k];
+        anchors[k][0] = static_cast<int>(center - 0.5 * (w - 1));
+        anchors[k][1] = static_cast<int>(center - 0.5 * (h - 1));
+        anchors[k][2] = static_cast<int>(center + 0.5 * (w - 1));
+        anchors[k][3] = static_cast<int>(center + 0.5 * (h - 1));
+      }
+      for (int j = 0; j < height; ++j) {
+        for (int i = 0; i < width; ++i) {
+          for (int k = 0; k < 3; ++k) {
+            Point4f<float> anchor(anchors[k][0] + i * stride,
+                anchors[k][1] + j * stride, anchors[k][2] + i * stride,
+                anchors[k][3] + j * stride);
+            const float* delta = bbox->cpu_data() + j * width + i;
+            Point4f<float> box_delta(delta[(k * 4) * plane],
+                delta[(k * 4 + 1) * plane], delta[(k * 4 + 2) * plane],
+                delta[(k * 4 + 3) * plane]);
+            Point4f<float> box = Frcnn::bbox_transform_inv(anchor, box_delta);
+            for (int q = 0; q < 4; ++q) {
+              box.Point[q] = std::max(0.f, std::min(box[q], bounds[q]));
+            }
+            if (box[2] - box[0] + 1 >= 4 && box[3] - box[1] + 1 >= 4) {
+              sort_vector.push_back(sort_pair(score->cpu_data()[
+                  (3 + k) * plane + j * width + i], boxes.size()));
+              boxes.push_back(box);
+            }
+          }
+        }
+      }
+    }
+    std::sort(sort_vector.begin(), sort_vector.end(),
+        std::greater<sort_pair>());
+    const int n_boxes = std::min(static_cast<int>(sort_vector.size()),
+        FrcnnParam::test_rpn_pre_nms_top_n);
+    vector<bool> select(n_boxes, true);
+    vector<Point4f<float> > box_final;
+    vector<float> score_final;
+    for (int i = 0; i < n_boxes
+        && box_final.size() < FrcnnParam::test_rpn_post_nms_top_n; ++i) {
+      if (select[i]) {
+        const Point4f<float>& box = boxes[sort_vector[i].second];
+        for (int j = i + 1; j < n_boxes; ++j) {
+          if (select[j] && Frcnn::get_iou(box, boxes[sort_vector[j].second])
+              > FrcnnParam::test_rpn_nms_thresh) {
+            select[j] = false;
+          }
+        }
+        box_final.push_back(box);
+        score_final.push_back(sort_vector[i].first);
+      }
+    }
+    // rois->at(0) holds all the rois, rois->at(1 + l) those of level l.
+    rois->assign(split ? 5 : 1, vector<float>());
+    scores->clear();
+    for (int l = 0; l < (split ? 4 : 1); ++l) {
+      const int before = scores->size();
+      for (int i = 0; i < box_final.size(); ++i) {
+        const float w = box_final[i][2] - box_final[i][0];
+        const float h = box_final[i][3] - box_final[i][1];
+        const int level = std::min(5, std::max(2, static_cast<int>(
+            FrcnnParam::roi_canonical_level + std::log2(std::sqrt(w * h)
+            / FrcnnParam::roi_canonical_scale + 1e-6)))) - 2;
+        if (split && level != l) {
+          continue;
+        }
+        for (int r = 0; r < (split ? 2 : 1); ++r) {
+          vector<float>& top = (*rois)[r == 0 ? 0 : 1 + l];
+          top.push_back(0);
+          for (int q = 0; q < 4; ++q) {
+            top.push_back(box_final[i][q]);
+          }
+        }
+        scores->push_back(score_final[i]);
+      }
+      if (split && scores->size() == before) {
+        (*rois)[0].resize((*rois)[0].size() + 5, 0);
+        (*rois)[1 + l].resize(5, 0);
+        scores->push_back(0);
+      }
+    }
+  }
+
+  void TestForward(const bool split) {
+    LayerParameter layer_param;
+    layer_param.set_phase(TEST);
+    layer_param.set_type("Module");
+    ModuleParameter* module_param = layer_param.mutable_module_param();
+    module_param->set_module("modules");
+    module_param->set_type("FPNProposal");
+    module_param->set_param_str("{'feat_strides': [4, 8, 16, 32, 64], "
+        "'anchor_scales': [8], 'anchor_ratios': [0.5, 1, 2]}");
+    // rois, the rois of P2 .. P5 when split, and the scores.
+    const int num_tops = split ? 6 : 2;
+    for (int i = 0; i < num_tops; ++i) {
+      blob_top_vec_.push_back(new Blob<float>());
+    }
+    shared_ptr<Layer<float> > layer =
+        LayerRegistry<float>::CreateLayer(layer_param);
+    layer->SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer->Forward(blob_bottom_vec_, blob_top_vec_);
+
+    vector<vector<float> > rois;
+    vector<float> scores;
+    PreviousForward(split, &rois, &scores);
+    for (int t = 0; t < rois.size(); ++t) {
+      const Blob<float>* top = blob_top_vec_[t];
+      ASSERT_EQ(top->count(), rois[t].size()) << "top " << t;
+      EXPECT_EQ(top->channels(), 5);
+      for (int i = 0; i < top->count(); ++i) {
+        EXPECT_EQ(top->cpu_data()[i], rois[t][i]) << "top " << t << " " << i;
+      }
+    }
+    const Blob<float>* top_scores = blob_top_vec_.back();
+    ASSERT_EQ(top_scores->count(), scores.size());
+    for (int i = 0; i < top_scores->count(); ++i) {
+      EXPECT_EQ(top_scores->cpu_data()[i], scores[i]) << "score " << i;
+    }
+  }
+
+  const int num_levels_;
+  Blob<float>* const blob_bottom_im_info_;
+  vector<Blob<float>*> blob_bottom_vec_;
+  vector<Blob<float>*> blob_top_vec_;
+};
+
+TEST_F(FPNProposalLayerTest, TestForward) {
+  this->TestForward(false);
+}
+
+TEST_F(FPNProposalLayerTest, TestForwardLevels) {
+  this->TestForward(true);
+}
+
+TEST_F(FPNProposalLayerTest, TestForwardEmptyLevels) {
+  // Every roi goes to P5, P2 .. P4 get a zero roi each.
+  FrcnnParam::roi_canonical_scale = 1;
+  this->TestForward(true);
+}
+
+}  // namespace caffe
@@ -0,0 +1,370 @@
+#ifdef USE_OPENCV
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/thread.hpp"
+#include "gtest/gtest.h"
+
+#include "api/FRCNN/frcnn_api.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using FRCNN_API::Detector;
+using Frcnn::BBox;
+using Frcnn::FrcnnParam;
+
+// Exposes the postprocess of predict.
+class PostprocessDetector : public Detector {
+ public:
+  PostprocessDetector(string& proto_file, string& model_file)
+    : Detector(proto_file, model_file) {}
+  using Detector::nms;
+  using Detector::tile_starts;
+};
+
+class DetectorTest : public ::testing::Test {
+ protected:
+  DetectorTest() : stop_(false), calls_(0), failures_(0), label_(0) {}
+
+  virtual void SetUp() {
+    Caffe::set_mode(Caffe::CPU);
+    FrcnnParam::n_classes = 3;
+    FrcnnParam::test_scales = vector<float>(1, 8);
+    FrcnnParam::test_max_size = 16;
+    FrcnnParam::test_score_thresh = 0.5;
+    FrcnnParam::test_nms = 0.3;
+    FrcnnParam::iter_test = -1;
+    FrcnnParam::test_tile_size = 0;
+    FrcnnParam::test_tile_stride = 0;
+    FrcnnParam::test_tile_objectness = 0;
+    FrcnnParam::test_soft_nms = 0;
+    FrcnnParam::test_bbox_vote = false;
+    FrcnnParam::test_decrypt_model = false;
+    FrcnnParam::test_fold_layers = false;
+    FrcnnParam::bbox_normalize_targets = false;
+    FrcnnParam::im_size_align = 0;
+    FrcnnParam::test_max_per_image = 0;
+    for (int i = 0; i < 3; i++) FrcnnParam::pixel_means[i] = 0;
+    MakeTempFilename(&proto_file_);
+    WriteProto(proto_file_, 3);
+    // The weights of the models do not fit its classifier.
+    MakeTempFilename(&bad_proto_file_);
+    WriteProto(bad_proto_file_, 4);
+    MakeTempFilename(&corrupt_model_file_);
+    std::ofstream(corrupt_model_file_.c_str()) << "not a model";
+    // Model l detects a single box of class l.
+    for (int l = 1; l <= 2; l++) {
+      string model_file;
+      MakeTempFilename(&model_file);
+      WriteModel(model_file, l);
+      model_files_.push_back(model_file);
+    }
+  }
+
+  virtual void TearDown() {
+    StopPredicting();
+    remove(proto_file_.c_str());
+    remove(bad_proto_file_.c_str());
+    remove(corrupt_model_file_.c_str());
+    for (int i = 0; i < model_files_.size(); i++) {
+      remove(model_files_[i].c_str());
+    }
+  }
+
+  // A single fixed roi classified from the mean color of the image, after
+  // a convolution that absorbs a BatchNorm when test_fold_layers is set.
+  void WriteProto(const string& filename, int cls_num) {
+    std::ostringstream proto;
+    proto <<
+        "name: 'TinyDetector' "
+        "input: 'data' "
+        "input_shape { dim: 1 dim: 3 dim: 8 dim: 8 } "
+        "input: 'im_info' "
+        "input_shape { dim: 1 dim: 3 } "
+        "layer { name: 'rois' type: 'DummyData' top: 'rois' "
+        "  dummy_data_param { shape { dim: 1 dim: 5 } } } "
+        "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+        "  convolution_param { num_output: 3 kernel_size: 1 } } "
+        "layer { name: 'bn' type: 'BatchNorm' bottom: 'conv' top: 'conv' } "
+        "layer { name: 'pool' type: 'Pooling' bottom: 'conv' top: 'pool' "
+        "  pooling_param { pool: AVE global_pooling: true } } "
+        "layer { name: 'cls_score' type: 'InnerProduct' "
+        "  bottom: 'pool' top: 'cls_score' "
+        "  inner_product_param { num_output: " << cls_num << " } } "
+        "layer { name: 'cls_prob' type: 'Softmax' bottom: 'cls_score' "
+        "  top: 'cls_prob' } "
+        "layer { name: 'bbox_pred' type: 'InnerProduct' "
+        "  bottom: 'pool' top: 'bbox_pred' "
+        "  inner_product_param { num_output: " << 4 * cls_num << " } } ";
+    std::ofstream file(filename.c_str());
+    file << proto.str();
+  }
+
+  void WriteModel(const string& filename, int label) {
+    NetParameter param;
+    ReadNetParamsFromTextFileOrDie(proto_file_, &param);
+    param.mutable_state()->set_phase(TEST);
+    Net<float> net(param);
+    Blob<float>* bias = net.layer_by_name("cls_score")->blobs()[1].get();
+    bias->mutable_cpu_data()[label] = 10;
+    NetParameter weights;
+    net.ToProto(&weights);
+    WriteProtoToBinaryFile(weights, filename);
+  }
+
+  // Predicts until stop_, counting the calls and the labels.
+  void Predict(Detector* detector) {
+    const cv::Mat img(8, 8, CV_8UC3, cv::Scalar::all(100));
+    vector<BBox<float> > results;
+    while (true) {
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        if (stop_) break;
+      }
+      detector->predict(img, results);
+      boost::mutex::scoped_lock lock(mutex_);
+      calls_++;
+      if (results.size() == 1 && (results[0].id == 1 || results[0].id == 2)) {
+        label_ = results[0].id;
+      } else {
+        failures_++;
+      }
+    }
+  }
+
+  void StartPredicting(Detector* detector) {
+    predictor_.reset(new boost::thread(&DetectorTest::Predict, this,
+        detector));
+  }
+
+  void StopPredicting() {
+    if (!predictor_) return;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stop_ = true;
+    }
+    predictor_->join();
+    predictor_.reset();
+  }
+
+  // Waits for calls more predictions, the last of which detects label.
+  bool WaitForPredictions(int calls, int label) {
+    const boost::posix_time::ptime deadline =
+        boost::posix_time::microsec_clock::local_time()
+        + boost::posix_time::seconds(60);
+    int start;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      start = calls_;
+    }
+    while (boost::posix_time::microsec_clock::local_time() < deadline) {
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        if (calls_ >= start + calls && label_ == label) return true;
+      }
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+    return false;
+  }
+
+  string proto_file_;
+  string bad_proto_file_;
+  string corrupt_model_file_;
+  vector<string> model_files_;
+  shared_ptr<boost::thread> predictor_;
+  boost::mutex mutex_;
+  bool stop_;
+  int calls_;
+  int failures_;
+  int label_;
+};
+
+TEST_F(DetectorTest, TestReloadWhilePredicting) {
+  // Reading the net from a pipe holds a reload until it is written.
+  string fifo;
+  MakeTempFilename(&fifo);
+  remove(fifo.c_str());
+  ASSERT_EQ(mkfifo(fifo.c_str(), 0600), 0);
+  Detector detector(proto_file_, model_files_[0]);
+  boost::weak_ptr<Net<float> > first_net = detector.Get_Net();
+  StartPredicting(&detector);
+  EXPECT_TRUE(WaitForPredictions(1, 1));
+
+  // The predictions go on with the first model while the second one loads.
+  detector.Reload_Model(fifo, model_files_[1]);
+  EXPECT_TRUE(WaitForPredictions(20, 1));
+  {
+    std::ifstream proto(proto_file_.c_str());
+    std::ofstream pipe(fifo.c_str());
+    pipe << proto.rdbuf();
+  }
+  EXPECT_TRUE(detector.Wait_Reload());
+  EXPECT_TRUE(WaitForPredictions(1, 2));
+  EXPECT_TRUE(first_net.expired());
+  remove(fifo.c_str());
+
+  // Back and forth while predicting.
+  for (int i = 0; i < 4; i++) {
+    detector.Reload_Model(proto_file_, model_files_[i % 2]);
+    EXPECT_TRUE(detector.Wait_Reload());
+    EXPECT_TRUE(WaitForPredictions(1, 1 + i % 2));
+  }
+
+  // Models that cannot be read, cannot be parsed or do not fit the net are
+  // rejected without dying, the current one stays.
+  detector.Reload_Model(proto_file_, fifo);
+  EXPECT_FALSE(detector.Wait_Reload());
+  detector.Reload_Model(proto_file_, corrupt_model_file_);
+  EXPECT_FALSE(detector.Wait_Reload());
+  detector.Reload_Model(corrupt_model_file_, model_files_[0]);
+  EXPECT_FALSE(detector.Wait_Reload());
+  detector.Reload_Model(bad_proto_file_, model_files_[0]);
+  EXPECT_FALSE(detector.Wait_Reload());
+  EXPECT_TRUE(WaitForPredictions(5, 2));
+
+  StopPredicting();
+  EXPECT_EQ(failures_, 0);
+}
+
+TEST_F(DetectorTest, TestShareModel) {
+  FrcnnParam::test_fold_layers = true;
+  Detector detector(proto_file_, model_files_[0]);
+  Detector replica(proto_file_, detector);
+  const Net<float>& net = *detector.Get_Net();
+  const Net<float>& replica_net = *replica.Get_Net();
+  EXPECT_FALSE(replica_net.has_layer("bn"));
+  ASSERT_EQ(net.layers().size(), replica_net.layers().size());
+  int num_params = 0;
+  for (int i = 0; i < net.layers().size(); i++) {
+    const vector<shared_ptr<Blob<float> > >& blobs = net.layers()[i]->blobs();
+    const vector<shared_ptr<Blob<float> > >& replica_blobs =
+        replica_net.layers()[i]->blobs();
+    ASSERT_EQ(blobs.size(), replica_blobs.size());
+    for (int j = 0; j < blobs.size(); j++) {
+      EXPECT_EQ(blobs[j]->data().get(), replica_blobs[j]->data().get())
+          << net.layer_names()[i] << " param " << j;
+      num_params++;
+    }
+  }
+  // conv (with the bias added by folding), cls_score and bbox_pred
+  EXPECT_EQ(num_params, 6);
+  const cv::Mat img(8, 8, CV_8UC3, cv::Scalar::all(100));
+  vector<BBox<float> > results;
+  replica.predict(img, results);
+  ASSERT_EQ(results.size(), 1);
+  EXPECT_EQ(results[0].id, 1);
+}
+
+TEST_F(DetectorTest, TestTileStarts) {
+  // An image smaller than a tile.
+  vector<int> starts = PostprocessDetector::tile_starts(5, 8, 6);
+  ASSERT_EQ(starts.size(), 1);
+  EXPECT_EQ(starts[0], 0);
+  starts = PostprocessDetector::tile_starts(8, 8, 6);
+  ASSERT_EQ(starts.size(), 1);
+  EXPECT_EQ(starts[0], 0);
+  // Exact multiples of the stride.
+  starts = PostprocessDetector::tile_starts(24, 8, 8);
+  ASSERT_EQ(starts.size(), 3);
+  EXPECT_EQ(starts[1], 8);
+  EXPECT_EQ(starts[2], 16);
+  starts = PostprocessDetector::tile_starts(20, 8, 6);
+  ASSERT_EQ(starts.size(), 3);
+  EXPECT_EQ(starts[1], 6);
+  EXPECT_EQ(starts[2], 12);
+  // A remainder: the last tile is moved back to end at the border.
+  starts = PostprocessDetector::tile_starts(22, 8, 6);
+  ASSERT_EQ(starts.size(), 4);
+  EXPECT_EQ(starts[2], 12);
+  EXPECT_EQ(starts[3], 14);
+  starts = PostprocessDetector::tile_starts(9, 8, 6);
+  ASSERT_EQ(starts.size(), 2);
+  EXPECT_EQ(starts[1], 1);
+}
+
+TEST_F(DetectorTest, TestTiledMerge) {
+  // The roi at the origin of a tile grows to a 5.5 x 5.5 box of class 1 (after
+  // clipping), so the two tiles of a 9 x 8 image, at x = 0 and 1, both detect
+  // a box in their overlap.
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(proto_file_, &param);
+  param.mutable_state()->set_phase(TEST);
+  Net<float> net(param);
+  net.layer_by_name("cls_score")->blobs()[1]->mutable_cpu_data()[1] = 10;
+  float* deltas = net.layer_by_name("bbox_pred")->blobs()[1]->mutable_cpu_data();
+  deltas[4 + 2] = deltas[4 + 3] = log(8.f);
+  NetParameter weights;
+  net.ToProto(&weights);
+  string model_file;
+  MakeTempFilename(&model_file);
+  WriteProtoToBinaryFile(weights, model_file);
+  model_files_.push_back(model_file);
+
+  FrcnnParam::test_tile_size = 8;
+  FrcnnParam::test_tile_stride = 6;
+  FrcnnParam::test_tile_objectness = 0;
+  Detector detector(proto_file_, model_file);
+  const cv::Mat img(8, 9, CV_8UC3, cv::Scalar::all(100));
+  vector<BBox<float> > results;
+  FrcnnParam::test_nms = 1;
+  detector.predict_tiled(img, results);
+  ASSERT_EQ(results.size(), 2);
+  EXPECT_EQ(results[0][0] + results[1][0], 1);
+
+  // The NMS across the tiles keeps one of them.
+  FrcnnParam::test_nms = 0.3;
+  detector.predict_tiled(img, results);
+  ASSERT_EQ(results.size(), 1);
+  EXPECT_EQ(results[0].id, 1);
+  EXPECT_EQ(results[0][1], 0);
+  EXPECT_NEAR(results[0][3], 4.5, 1e-4);
+}
+
+TEST_F(DetectorTest, TestNmsMaxPerImage) {
+  PostprocessDetector detector(proto_file_, model_files_[0]);
+  vector<vector<BBox<float> > > bboxes_by_class(3);
+  bboxes_by_class[1].push_back(BBox<float>(50, 50, 60, 60, 0.6, 1));
+  bboxes_by_class[1].push_back(BBox<float>(1, 1, 10, 10, 0.8, 1));
+  bboxes_by_class[1].push_back(BBox<float>(0, 0, 10, 10, 0.9, 1));
+  bboxes_by_class[2].push_back(BBox<float>(100, 100, 110, 110, 0.6, 2));
+  bboxes_by_class[2].push_back(BBox<float>(0, 0, 10, 10, 0.7, 2));
+  vector<vector<BBox<float> > > copy = bboxes_by_class;
+  vector<BBox<float> > results;
+  detector.nms(copy, results);
+  // Per class by decreasing confidence, the 0.8 box of class 1 is suppressed.
+  const float expected[] = {0.9, 0.6, 0.7, 0.6};
+  ASSERT_EQ(results.size(), 4);
+  for (int i = 0; i < 4; i++) {
+    EXPECT_EQ(results[i].confidence, expected[i]);
+    EXPECT_EQ(results[i].id, i < 2 ? 1 : 2);
+  }
+  // Of the two boxes tied at the threshold, the first one is kept.
+  FrcnnParam::test_max_per_image = 3;
+  copy = bboxes_by_class;
+  detector.nms(copy, results);
+  ASSERT_EQ(results.size(), 3);
+  EXPECT_EQ(results[0].confidence, expected[0]);
+  EXPECT_EQ(results[1].confidence, expected[1]);
+  EXPECT_EQ(results[1].id, 1);
+  EXPECT_EQ(results[2].confidence, expected[2]);
+  FrcnnParam::test_max_per_image = 1;
+  copy = bboxes_by_class;
+  detector.nms(copy, results);
+  ASSERT_EQ(results.size(), 1);
+  EXPECT_EQ(results[0].confidence, expected[0]);
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -0,0 +1,98 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/FRCNN/util/frcnn_evaluate.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using Frcnn::BBox;
+using Frcnn::DetectionEvaluator;
+
+class DetectionEvaluatorTest : public ::testing::Test {
+ protected:
+  // Two images with one 100 x 100 box of class 1 each. Detections, by
+  // decreasing confidence: a hit on image 0, a miss on image 0 and a hit on
+  // image 1, so precision goes 1, 1/2, 2/3 while recall goes 1/2, 1/2, 1.
+  void AddTwoImages(DetectionEvaluator* evaluator) {
+    vector<BBox<float> > gts(1, BBox<float>(0, 0, 99, 99, 1, 1));
+    vector<int> difficult(1, 0);
+    vector<BBox<float> > dets;
+    dets.push_back(BBox<float>(0, 0, 99, 99, 0.9, 1));
+    dets.push_back(BBox<float>(200, 200, 299, 299, 0.8, 1));
+    evaluator->AddImage(gts, difficult, dets);
+    gts[0] = BBox<float>(50, 50, 149, 149, 1, 1);
+    dets.clear();
+    dets.push_back(BBox<float>(50, 50, 149, 149, 0.7, 1));
+    evaluator->AddImage(gts, difficult, dets);
+  }
+};
+
+TEST_F(DetectionEvaluatorTest, TestVocAP) {
+  DetectionEvaluator evaluator(3);
+  AddTwoImages(&evaluator);
+  EXPECT_EQ(evaluator.num_images(), 2);
+  const vector<float> ap_area = evaluator.VocAP(0.5, false);
+  EXPECT_NEAR(ap_area[1], 0.5 + 0.5 * 2. / 3, 1e-6);
+  // Recall 0 to 0.5 at precision 1, recall 0.6 to 1 at precision 2/3.
+  const vector<float> ap07 = evaluator.VocAP(0.5, true);
+  EXPECT_NEAR(ap07[1], (6 + 5 * 2. / 3) / 11, 1e-6);
+  // Class 2 has no ground truth and is not part of the mean.
+  EXPECT_EQ(ap_area[2], -1);
+  EXPECT_NEAR(DetectionEvaluator::MeanAP(ap_area), ap_area[1], 1e-6);
+}
+
+TEST_F(DetectionEvaluatorTest, TestCocoAP) {
+  DetectionEvaluator evaluator(2);
+  AddTwoImages(&evaluator);
+  const vector<float> ap50 = evaluator.CocoAP(vector<float>(1, 0.5));
+  EXPECT_NEAR(ap50[1], (51 + 50 * 2. / 3) / 101, 1e-6);
+  // The hits are exact, so every threshold gives the same AP.
+  const vector<float> ap = evaluator.CocoAP(DetectionEvaluator::CocoOverlaps());
+  EXPECT_NEAR(ap[1], ap50[1], 1e-6);
+  // All boxes are 100 x 100, which is large: there is no small or medium
+  // ground truth, and the large AP keeps the miss as a false positive.
+  const vector<float> small = evaluator.CocoAP(
+      DetectionEvaluator::CocoOverlaps(), 0, 32 * 32);
+  EXPECT_EQ(small[1], -1);
+  const vector<float> medium = evaluator.CocoAP(
+      DetectionEvaluator::CocoOverlaps(), 32 * 32, 96 * 96);
+  EXPECT_EQ(medium[1], -1);
+  const vector<float> large = evaluator.CocoAP(
+      DetectionEvaluator::CocoOverlaps(), 96 * 96);
+  EXPECT_NEAR(large[1], ap50[1], 1e-6);
+  // With one detection per image, the miss of image 0 is dropped.
+  const vector<float> capped = evaluator.CocoAP(vector<float>(1, 0.5), 0,
+      FLT_MAX, 1);
+  EXPECT_NEAR(capped[1], 1, 1e-6);
+}
+
+TEST_F(DetectionEvaluatorTest, TestDifficultAndDuplicates) {
+  DetectionEvaluator evaluator(2);
+  vector<BBox<float> > gts;
+  gts.push_back(BBox<float>(0, 0, 99, 99, 1, 1));
+  gts.push_back(BBox<float>(300, 300, 399, 399, 1, 1));
+  vector<int> difficult(2, 0);
+  difficult[1] = 1;
+  vector<BBox<float> > dets;
+  dets.push_back(BBox<float>(0, 0, 99, 99, 0.9, 1));
+  // Matches the difficult box: neither true nor false positive.
+  dets.push_back(BBox<float>(300, 300, 399, 399, 0.8, 1));
+  // Duplicate of the first hit: false positive.
+  dets.push_back(BBox<float>(2, 2, 99, 99, 0.7, 1));
+  evaluator.AddImage(gts, difficult, dets);
+  const vector<float> ap = evaluator.VocAP(0.5, false);
+  EXPECT_NEAR(ap[1], 1, 1e-6);
+  const vector<float> coco = evaluator.CocoAP(vector<float>(1, 0.5));
+  EXPECT_NEAR(coco[1], 1, 1e-6);
+  // Below the overlap threshold the only detection is a false positive.
+  dets.resize(1);
+  dets[0] = BBox<float>(60, 60, 159, 159, 0.9, 1);
+  DetectionEvaluator missed(2);
+  missed.AddImage(gts, difficult, dets);
+  EXPECT_NEAR(missed.VocAP(0.5, false)[1], 0, 1e-6);
+}
+
+}  // namespace caffe
@@ -0,0 +1,107 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/FRCNN/frcnn_proposal_layer.hpp"
+#include "caffe/FRCNN/util/frcnn_param.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using Frcnn::FrcnnParam;
+using Frcnn::FrcnnProposalLayer;
+
+class FrcnnProposalLayerTest : public ::testing::Test {
+ protected:
+  // A 4 x 4 map with one 16 x 16 anchor per cell, so that the boxes do not
+  // overlap, and scores decreasing in raster order.
+  FrcnnProposalLayerTest()
+      : blob_bottom_score_(new Blob<float>(1, 2, 4, 4)),
+        blob_bottom_bbox_(new Blob<float>(1, 4, 4, 4)),
+        blob_bottom_im_info_(new Blob<float>(1, 3, 1, 1)),
+        blob_top_rois_(new Blob<float>()) {
+    Caffe::set_mode(Caffe::CPU);
+    FrcnnParam::anchors = vector<float>(4, 0);
+    FrcnnParam::anchors[2] = FrcnnParam::anchors[3] = 15;
+    FrcnnParam::feat_stride = 16;
+    FrcnnParam::test_rpn_pre_nms_top_n = 16;
+    FrcnnParam::test_rpn_post_nms_top_n = 16;
+    FrcnnParam::test_rpn_nms_thresh = 0.7;
+    FrcnnParam::test_rpn_min_size = 0;
+    FrcnnParam::test_rpn_score_thresh = 0;
+    FrcnnParam::test_soft_nms = 0;
+    FrcnnParam::test_use_gpu_nms = false;
+    float* score = blob_bottom_score_->mutable_cpu_data();
+    for (int i = 0; i < 16; i++) {
+      score[i] = float(i) / 16;
+      score[16 + i] = 1 - score[i];
+    }
+    caffe_set(blob_bottom_bbox_->count(), 0.f,
+        blob_bottom_bbox_->mutable_cpu_data());
+    float* im_info = blob_bottom_im_info_->mutable_cpu_data();
+    im_info[0] = im_info[1] = 64;
+    im_info[2] = 1;
+    blob_bottom_vec_.push_back(blob_bottom_score_);
+    blob_bottom_vec_.push_back(blob_bottom_bbox_);
+    blob_bottom_vec_.push_back(blob_bottom_im_info_);
+    blob_top_vec_.push_back(blob_top_rois_);
+  }
+  virtual ~FrcnnProposalLayerTest() {
+    delete blob_bottom_score_;
+    delete blob_bottom_bbox_;
+    delete blob_bottom_im_info_;
+    delete blob_top_rois_;
+  }
+
+  Blob<float>* const blob_bottom_score_;
+  Blob<float>* const blob_bottom_bbox_;
+  Blob<float>* const blob_bottom_im_info_;
+  Blob<float>* const blob_top_rois_;
+  vector<Blob<float>*> blob_bottom_vec_;
+  vector<Blob<float>*> blob_top_vec_;
+};
+
+TEST_F(FrcnnProposalLayerTest, TestMaxProposals) {
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  FrcnnProposalLayer<float> layer(layer_param);
+  layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+  layer.Forward(blob_bottom_vec_, blob_top_vec_);
+  ASSERT_EQ(blob_top_rois_->num(), 16);
+  const vector<float> all(blob_top_rois_->cpu_data(),
+      blob_top_rois_->cpu_data() + blob_top_rois_->count());
+  // The first proposals are the cells with the highest scores, in order.
+  for (int i = 0; i < 16; i++) {
+    EXPECT_EQ(all[i * 5 + 1], (i % 4) * 16);
+    EXPECT_EQ(all[i * 5 + 2], (i / 4) * 16);
+  }
+
+  // Capped, the top proposals come out in the same order.
+  layer.set_max_proposals(4);
+  layer.Forward(blob_bottom_vec_, blob_top_vec_);
+  ASSERT_EQ(blob_top_rois_->num(), 4);
+  for (int i = 0; i < blob_top_rois_->count(); i++) {
+    EXPECT_EQ(blob_top_rois_->cpu_data()[i], all[i]);
+  }
+  EXPECT_EQ(FrcnnParam::test_rpn_pre_nms_top_n, 16);
+  EXPECT_EQ(FrcnnParam::test_rpn_post_nms_top_n, 16);
+
+  // Another layer, e.g. in another net, is not capped.
+  FrcnnProposalLayer<float> other_layer(layer_param);
+  other_layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+  other_layer.Forward(blob_bottom_vec_, blob_top_vec_);
+  EXPECT_EQ(blob_top_rois_->num(), 16);
+
+  // A cap above test_rpn_post_nms_top_n, or 0, changes nothing.
+  layer.set_max_proposals(20);
+  layer.Forward(blob_bottom_vec_, blob_top_vec_);
+  EXPECT_EQ(blob_top_rois_->num(), 16);
+  layer.set_max_proposals(0);
+  layer.Forward(blob_bottom_vec_, blob_top_vec_);
+  EXPECT_EQ(blob_top_rois_->num(), 16);
+}
+
+}  // namespace caffe
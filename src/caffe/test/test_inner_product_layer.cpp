@@ -135,6 +135,51 @@ TYPED_TEST(InnerProductLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardInt8) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("constant");
+  inner_product_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<InnerProductLayer<Dtype> > layer(
+      new InnerProductLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> ref_top;
+  ref_top.CopyFrom(*this->blob_top_, false, true);
+  // The bottom is uniform in [0, 1].
+  QuantizationParameter* quantization_param =
+      layer_param.mutable_quantization_param();
+  quantization_param->set_precision(QuantizationParameter_Precision_INT8);
+  quantization_param->set_bottom_max(1);
+  shared_ptr<InnerProductLayer<Dtype> > int8_layer(
+      new InnerProductLayer<Dtype>(layer_param));
+  int8_layer->blobs().push_back(layer->blobs()[0]);
+  int8_layer->blobs().push_back(layer->blobs()[1]);
+  int8_layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  int8_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* data = this->blob_top_->cpu_data();
+  const Dtype* ref_data = ref_top.cpu_data();
+  for (int i = 0; i < ref_top.count(); ++i) {
+    EXPECT_NEAR(data[i], ref_data[i], 0.1);
+  }
+  // New weights are quantized again, and twice the weights give twice the
+  // output before the bias.
+  vector<Dtype> top_before(data, data + this->blob_top_->count());
+  caffe_scal(layer->blobs()[0]->count(), Dtype(2),
+      layer->blobs()[0]->mutable_cpu_data());
+  int8_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  data = this->blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(data[i], 2 * top_before[i] - 0.1, 1e-4);
+  }
+}
+
 /**
  * @brief Init. an IP layer without transpose + random weights,
  * run Forward, save the result.
@@ -0,0 +1,106 @@
+#include <stdint.h>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/int8_gemm.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class Int8GemmTest : public ::testing::Test {
+ protected:
+  // Sizes that are not multiples of the VNNI blocks, 8 rows, 16 columns
+  // and 4 k, and an odd number of column blocks.
+  Int8GemmTest() : M_(11), N_(37), K_(13), input_scale_(0.5) {
+    weights_.resize(M_ * K_);
+    caffe_rng_gaussian<Dtype>(weights_.size(), Dtype(0), Dtype(1),
+        weights_.data());
+    // Multiples of 1 / input_scale_, where the rounding of the halves
+    // matters, and beyond 127 / input_scale_, where the input saturates.
+    input_.resize(K_ * N_);
+    for (int i = 0; i < input_.size(); ++i) {
+      input_[i] = Dtype(static_cast<int>(caffe_rng_rand() % 601) - 300);
+    }
+  }
+
+  // The output of the quantized values, multiplied exactly.
+  void Reference(vector<Dtype>* output) {
+    vector<int8_t> weights_int8(M_ * K_);
+    vector<Dtype> weight_scales(M_);
+    caffe_cpu_quantize_rows(M_, K_, weights_.data(), weights_int8.data(),
+        weight_scales.data());
+    vector<int8_t> input_int8(K_ * N_);
+    caffe_cpu_quantize(K_ * N_, input_scale_, input_.data(),
+        input_int8.data());
+    output->resize(M_ * N_);
+    for (int m = 0; m < M_; ++m) {
+      for (int n = 0; n < N_; ++n) {
+        int sum = 0;
+        for (int k = 0; k < K_; ++k) {
+          sum += weights_int8[m * K_ + k] * input_int8[k * N_ + n];
+        }
+        (*output)[m * N_ + n] =
+            Dtype(1) / (input_scale_ * weight_scales[m]) * sum;
+      }
+    }
+  }
+
+  void TestForward(const bool use_vnni) {
+    Int8Gemm<Dtype> gemm(use_vnni);
+    EXPECT_EQ(use_vnni && Int8Gemm<Dtype>::HasVnni(), gemm.use_vnni());
+    gemm.SetWeights(M_, K_, weights_.data(), input_scale_);
+    for (int m = 0; m < M_; ++m) {
+      EXPECT_EQ(gemm.output_scales()[m],
+          Dtype(1) / (input_scale_ * gemm.weight_scales()[m]));
+    }
+    vector<Dtype> expected;
+    Reference(&expected);
+    vector<Dtype> output(M_ * N_);
+    gemm.Forward(N_, input_.data(), output.data());
+    for (int i = 0; i < output.size(); ++i) {
+      EXPECT_NEAR(output[i], expected[i], 1e-5 * std::abs(expected[i]));
+    }
+    // Transposed, as in InnerProduct.
+    vector<Dtype> input_t(N_ * K_);
+    for (int k = 0; k < K_; ++k) {
+      for (int n = 0; n < N_; ++n) {
+        input_t[n * K_ + k] = input_[k * N_ + n];
+      }
+    }
+    vector<Dtype> output_t(N_ * M_);
+    gemm.Forward(N_, input_t.data(), output_t.data(), true);
+    for (int m = 0; m < M_; ++m) {
+      for (int n = 0; n < N_; ++n) {
+        EXPECT_NEAR(output_t[n * M_ + m], expected[m * N_ + n],
+            1e-5 * std::abs(expected[m * N_ + n]));
+      }
+    }
+  }
+
+  const int M_;
+  const int N_;
+  const int K_;
+  const Dtype input_scale_;
+  vector<Dtype> weights_;
+  vector<Dtype> input_;
+};
+
+TYPED_TEST_CASE(Int8GemmTest, TestDtypes);
+
+TYPED_TEST(Int8GemmTest, TestForward) {
+  if (!Int8Gemm<TypeParam>::HasVnni()) {
+    LOG(ERROR) << "Skipping the VNNI test, the CPU lacks AVX512-VNNI.";
+  }
+  this->TestForward(true);
+}
+
+TYPED_TEST(Int8GemmTest, TestForwardFallback) {
+  this->TestForward(false);
+}
+
+}  // namespace caffe
@@ -1,6 +1,8 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
+#include <algorithm>
 #include <cmath>  // for std::fabs
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -109,6 +111,73 @@ TYPED_TEST(CPUMathFunctionsTest, TestScale) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestQuantizeRows) {
+  const int M = 17;
+  const int N = this->blob_bottom_->count() / M;
+  const TypeParam* x = this->blob_bottom_->cpu_data();
+  vector<int8_t> y(M * N);
+  vector<TypeParam> scales(M);
+  caffe_cpu_quantize_rows<TypeParam>(M, N, x, y.data(), scales.data());
+  for (int m = 0; m < M; ++m) {
+    int max_abs = 0;
+    for (int n = 0; n < N; ++n) {
+      const int i = m * N + n;
+      EXPECT_NEAR(y[i], x[i] * scales[m], 0.5 + 1e-4);
+      max_abs = std::max(max_abs, std::abs(static_cast<int>(y[i])));
+    }
+    EXPECT_EQ(127, max_abs);
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestSoftmax) {
+  // Both layouts: channels last (inner 1), and 17 channels over 19 * 23
+  // locations, which is more than one block. The spread of 100 makes some
+  // exps underflow.
+  const int n = this->blob_bottom_->count();
+  TypeParam* x = this->blob_bottom_->mutable_cpu_data();
+  caffe_scal<TypeParam>(n, TypeParam(100), x);
+  TypeParam* y = this->blob_bottom_->mutable_cpu_diff();
+  const int shapes[2][3] = {{11 * 17 * 19, 23, 1}, {11, 17, 19 * 23}};
+  for (int s = 0; s < 2; ++s) {
+    const int outer = shapes[s][0], channels = shapes[s][1];
+    const int inner = shapes[s][2];
+    caffe_cpu_softmax<TypeParam>(outer, channels, inner, x, y);
+    for (int i = 0; i < outer; ++i) {
+      for (int k = 0; k < inner; ++k) {
+        const int offset = i * channels * inner + k;
+        double max_value = x[offset];
+        for (int c = 1; c < channels; ++c) {
+          max_value = std::max(max_value, double(x[offset + c * inner]));
+        }
+        double sum = 0;
+        for (int c = 0; c < channels; ++c) {
+          sum += std::exp(x[offset + c * inner] - max_value);
+        }
+        for (int c = 0; c < channels; ++c) {
+          EXPECT_NEAR(y[offset + c * inner],
+              std::exp(x[offset + c * inner] - max_value) / sum, 1e-6);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestSigmoidTanh) {
+  // A spread of 100 saturates some of them.
+  const int n = this->blob_bottom_->count();
+  TypeParam* x = this->blob_bottom_->mutable_cpu_data();
+  caffe_scal<TypeParam>(n, TypeParam(100), x);
+  TypeParam* y = this->blob_bottom_->mutable_cpu_diff();
+  caffe_cpu_sigmoid<TypeParam>(n, x, y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(y[i], 1 / (1 + std::exp(-double(x[i]))), 1e-6);
+  }
+  caffe_cpu_tanh<TypeParam>(n, x, y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(y[i], std::tanh(double(x[i])), 1e-6);
+  }
+}
+
 TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   const int n = this->blob_bottom_->count();
   const TypeParam* bottom_data = this->blob_bottom_->cpu_data();
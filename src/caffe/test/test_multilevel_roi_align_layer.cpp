@@ -0,0 +1,194 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/FRCNN/util/frcnn_param.hpp"
+#include "caffe/util/format.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+using Frcnn::FrcnnParam;
+
+// MultiLevelROIAlign lives in the "modules" library, which the layer factory
+// opens from CAFFE_LAYER_PATH or the build directory.
+template <typename TypeParam>
+class MultiLevelROIAlignLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  // Levels P2 .. P5 of a 128 x 128 image, batch of 2, and rois in an order
+  // that mixes the levels, none of them on P3.
+  MultiLevelROIAlignLayerTest()
+      : blob_bottom_rois_(new Blob<Dtype>(7, 5, 1, 1)),
+        blob_top_(new Blob<Dtype>()) {
+    // sqrt(w * h) < 16 goes to P2, [16, 32) to P3, [32, 64) to P4 and
+    // larger rois to P5.
+    FrcnnParam::roi_canonical_scale = 32;
+    FrcnnParam::roi_canonical_level = 4;
+    FillerParameter filler_param;
+    filler_param.set_std(1);
+    GaussianFiller<Dtype> filler(filler_param);
+    for (int level = 0; level < 4; ++level) {
+      const int size = 32 >> level;
+      blob_bottom_levels_.push_back(new Blob<Dtype>(2, 3, size, size));
+      filler.Fill(blob_bottom_levels_[level]);
+      blob_bottom_vec_.push_back(blob_bottom_levels_[level]);
+    }
+    const Dtype rois[7][5] = {
+      {0, 40, 30, 120, 110},  // P5
+      {1, 4, 8, 14, 18},      // P2
+      {0, 10, 20, 50, 60},    // P4
+      {1, 60, 50, 100, 90},   // P4
+      {0, 100, 100, 108, 108},  // P2
+      {1, 0, 0, 127, 127},    // P5
+      {0, 33.5, 17.25, 41.5, 29.75},  // P2
+    };
+    Dtype* roi_data = blob_bottom_rois_->mutable_cpu_data();
+    for (int n = 0; n < 7; ++n) {
+      for (int i = 0; i < 5; ++i) {
+        roi_data[n * 5 + i] = rois[n][i];
+      }
+    }
+    roi_levels_.push_back(3);
+    roi_levels_.push_back(0);
+    roi_levels_.push_back(2);
+    roi_levels_.push_back(2);
+    roi_levels_.push_back(0);
+    roi_levels_.push_back(3);
+    roi_levels_.push_back(0);
+    blob_bottom_vec_.push_back(blob_bottom_rois_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~MultiLevelROIAlignLayerTest() {
+    for (int level = 0; level < blob_bottom_levels_.size(); ++level) {
+      delete blob_bottom_levels_[level];
+    }
+    delete blob_bottom_rois_;
+    delete blob_top_;
+  }
+
+  LayerParameter MultiLevelParam(const int bi_type) {
+    LayerParameter layer_param;
+    layer_param.set_type("Module");
+    ModuleParameter* module_param = layer_param.mutable_module_param();
+    module_param->set_module("modules");
+    module_param->set_type("MultiLevelROIAlign");
+    module_param->set_param_str("{'spatial_scales': "
+        "[0.25, 0.125, 0.0625, 0.03125], 'pooled_h': 3, 'pooled_w': 4, "
+        "'bi_type': " + format_int(bi_type) + "}");
+    return layer_param;
+  }
+
+  // ROIAlign of the rois of every level on its own, then a concat, as the
+  // per-level path of the FPN nets does; levels without rois are skipped.
+  void TestForward(const int bi_type) {
+    shared_ptr<Layer<Dtype> > layer =
+        LayerRegistry<Dtype>::CreateLayer(MultiLevelParam(bi_type));
+    layer->SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer->Forward(blob_bottom_vec_, blob_top_vec_);
+    ASSERT_EQ(blob_top_->num(), 7);
+    EXPECT_EQ(blob_top_->channels(), 3);
+    EXPECT_EQ(blob_top_->height(), 3);
+    EXPECT_EQ(blob_top_->width(), 4);
+
+    const Dtype* roi_data = blob_bottom_rois_->cpu_data();
+    vector<shared_ptr<Blob<Dtype> > > level_rois, level_tops;
+    vector<Blob<Dtype>*> concat_bottom;
+    vector<int> order;
+    for (int level = 0; level < 4; ++level) {
+      vector<int> rois;
+      for (int n = 0; n < roi_levels_.size(); ++n) {
+        if (roi_levels_[n] == level) {
+          rois.push_back(n);
+        }
+      }
+      if (rois.empty()) {
+        continue;
+      }
+      level_rois.push_back(shared_ptr<Blob<Dtype> >(
+          new Blob<Dtype>(rois.size(), 5, 1, 1)));
+      for (int i = 0; i < rois.size(); ++i) {
+        caffe_copy(5, roi_data + rois[i] * 5,
+            level_rois.back()->mutable_cpu_data() + i * 5);
+        order.push_back(rois[i]);
+      }
+      LayerParameter align_param;
+      align_param.set_type("ROIAlign");
+      ROIPoolingParameter* roi_pooling_param =
+          align_param.mutable_roi_pooling_param();
+      roi_pooling_param->set_pooled_h(3);
+      roi_pooling_param->set_pooled_w(4);
+      roi_pooling_param->set_spatial_scale(0.25 / (1 << level));
+      roi_pooling_param->set_bi_type(bi_type);
+      shared_ptr<Layer<Dtype> > align =
+          LayerRegistry<Dtype>::CreateLayer(align_param);
+      vector<Blob<Dtype>*> align_bottom;
+      align_bottom.push_back(blob_bottom_levels_[level]);
+      align_bottom.push_back(level_rois.back().get());
+      level_tops.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      vector<Blob<Dtype>*> align_top(1, level_tops.back().get());
+      align->SetUp(align_bottom, align_top);
+      align->Forward(align_bottom, align_top);
+      concat_bottom.push_back(level_tops.back().get());
+    }
+    EXPECT_EQ(concat_bottom.size(), 3);
+    LayerParameter concat_param;
+    concat_param.set_type("Concat");
+    concat_param.mutable_concat_param()->set_axis(0);
+    shared_ptr<Layer<Dtype> > concat =
+        LayerRegistry<Dtype>::CreateLayer(concat_param);
+    Blob<Dtype> concat_top;
+    vector<Blob<Dtype>*> concat_top_vec(1, &concat_top);
+    concat->SetUp(concat_bottom, concat_top_vec);
+    concat->Forward(concat_bottom, concat_top_vec);
+    ASSERT_EQ(concat_top.num(), 7);
+
+    // Row i of the concat is roi order[i], row order[i] of the layer.
+    const int dim = blob_top_->count(1);
+    for (int i = 0; i < order.size(); ++i) {
+      const Dtype* expected = concat_top.cpu_data() + i * dim;
+      const Dtype* actual = blob_top_->cpu_data() + order[i] * dim;
+      for (int j = 0; j < dim; ++j) {
+        EXPECT_NEAR(actual[j], expected[j], 1e-5) << "roi " << order[i];
+      }
+    }
+  }
+
+  vector<Blob<Dtype>*> blob_bottom_levels_;
+  Blob<Dtype>* const blob_bottom_rois_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  vector<int> roi_levels_;
+};
+
+TYPED_TEST_CASE(MultiLevelROIAlignLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(MultiLevelROIAlignLayerTest, TestForwardBicubic) {
+  this->TestForward(1);
+}
+
+TYPED_TEST(MultiLevelROIAlignLayerTest, TestForwardBilinear) {
+  this->TestForward(0);
+}
+
+TYPED_TEST(MultiLevelROIAlignLayerTest, TestGradientBilinear) {
+  typedef typename TypeParam::Dtype Dtype;
+  shared_ptr<Layer<Dtype> > layer =
+      LayerRegistry<Dtype>::CreateLayer(this->MultiLevelParam(0));
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  // The P3 gradient is checked too, and stays zero.
+  for (int level = 0; level < 4; ++level) {
+    checker.CheckGradient(layer.get(), this->blob_bottom_vec_,
+        this->blob_top_vec_, level);
+  }
+}
+
+}  // namespace caffe
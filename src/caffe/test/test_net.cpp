@@ -1,3 +1,6 @@
+#include <unistd.h>
+#include <algorithm>
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -11,6 +14,7 @@
 #include "caffe/net.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/shared_memory.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -2601,4 +2605,628 @@ TYPED_TEST(NetTest, TestAllInOneNetDeploy) {
   ASSERT_TRUE(found_data);
 }
 
+TYPED_TEST(NetTest, TestFoldInferenceLayers) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "state: { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape: { dim: 2 dim: 3 dim: 5 dim: 5 } } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 4 "
+      "    kernel_size: 3 "
+      "    pad: 1 "
+      "    bias_term: false "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'bn1' "
+      "  type: 'BatchNorm' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'scale1' "
+      "  type: 'Scale' "
+      "  bottom: 'conv1' "
+      "  top: 'scale1' "
+      "  scale_param { "
+      "    filler { type: 'gaussian' } "
+      "    bias_term: true "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'scale1' "
+      "  top: 'scale1' "
+      "  relu_param { negative_slope: 0.1 } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> net(param);
+  // Give the BatchNorm layer non-trivial statistics.
+  const vector<shared_ptr<Blob<Dtype> > >& bn_blobs =
+      net.layer_by_name("bn1")->blobs();
+  FillerParameter filler_param;
+  filler_param.set_min(0.5);
+  filler_param.set_max(2);
+  UniformFiller<Dtype> uniform_filler(filler_param);
+  GaussianFiller<Dtype> gaussian_filler(filler_param);
+  gaussian_filler.Fill(bn_blobs[0].get());
+  uniform_filler.Fill(bn_blobs[1].get());
+  bn_blobs[2]->mutable_cpu_data()[0] = 2;
+  Blob<Dtype> data(2, 3, 5, 5);
+  gaussian_filler.Fill(&data);
+  net.input_blobs()[0]->CopyFrom(data);
+  net.Forward();
+  NetParameter weights;
+  net.ToProto(&weights);
+
+  param.set_fold_inference_layers(true);
+  Net<Dtype> folded_net(param);
+  ASSERT_EQ(2, folded_net.layers().size());
+  EXPECT_EQ(2, folded_net.layer_by_name("conv1")->blobs().size());
+  folded_net.CopyTrainedLayersFrom(weights);
+  folded_net.input_blobs()[0]->CopyFrom(data);
+  folded_net.Forward();
+  const Blob<Dtype>* expected = net.blob_by_name("scale1").get();
+  const Blob<Dtype>* actual = folded_net.blob_by_name("scale1").get();
+  ASSERT_EQ(expected->shape(), actual->shape());
+  for (int i = 0; i < expected->count(); ++i) {
+    EXPECT_NEAR(expected->cpu_data()[i], actual->cpu_data()[i], 1e-4);
+  }
+  // Weights saved from the folded net load as already folded.
+  NetParameter folded_weights;
+  folded_net.ToProto(&folded_weights);
+  Net<Dtype> refolded_net(param);
+  refolded_net.CopyTrainedLayersFrom(folded_weights);
+  refolded_net.input_blobs()[0]->CopyFrom(data);
+  refolded_net.Forward();
+  const Blob<Dtype>* reloaded = refolded_net.blob_by_name("scale1").get();
+  for (int i = 0; i < expected->count(); ++i) {
+    EXPECT_NEAR(expected->cpu_data()[i], reloaded->cpu_data()[i], 1e-4);
+  }
+}
+
+TYPED_TEST(NetTest, TestCanCopyTrainedLayersFrom) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "state: { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape: { dim: 2 dim: 3 dim: 5 dim: 5 } } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 4 "
+      "    kernel_size: 3 "
+      "    bias_term: false "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'bn1' "
+      "  type: 'BatchNorm' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> net(param);
+  NetParameter weights;
+  net.ToProto(&weights);
+  param.set_fold_inference_layers(true);
+  Net<Dtype> folded_net(param);
+  string error;
+  EXPECT_TRUE(net.CanCopyTrainedLayersFrom(weights, &error));
+  EXPECT_TRUE(folded_net.CanCopyTrainedLayersFrom(weights, &error));
+
+  // A convolution with more outputs.
+  NetParameter mismatched = weights;
+  mismatched.mutable_layer(1)->mutable_blobs(0)->mutable_shape()->set_dim(0, 5);
+  EXPECT_FALSE(net.CanCopyTrainedLayersFrom(mismatched, &error));
+  EXPECT_NE(error.find("conv1"), string::npos) << error;
+  EXPECT_FALSE(folded_net.CanCopyTrainedLayersFrom(mismatched, &error));
+
+  // Statistics of a folded BatchNorm for a different number of channels.
+  mismatched = weights;
+  mismatched.mutable_layer(2)->mutable_blobs(0)->mutable_shape()->set_dim(0, 5);
+  error.clear();
+  EXPECT_FALSE(folded_net.CanCopyTrainedLayersFrom(mismatched, &error));
+  EXPECT_NE(error.find("bn1"), string::npos) << error;
+
+  // A missing blob.
+  mismatched = weights;
+  mismatched.mutable_layer(2)->mutable_blobs()->RemoveLast();
+  EXPECT_FALSE(net.CanCopyTrainedLayersFrom(mismatched, &error));
+  EXPECT_FALSE(folded_net.CanCopyTrainedLayersFrom(mismatched, &error));
+}
+
+TYPED_TEST(NetTest, TestShareTrainedLayersWithFolded) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "state: { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape: { dim: 2 dim: 3 dim: 5 dim: 5 } } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 4 "
+      "    kernel_size: 3 "
+      "    pad: 1 "
+      "    bias_term: false "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'bn1' "
+      "  type: 'BatchNorm' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'scale1' "
+      "  type: 'Scale' "
+      "  bottom: 'conv1' "
+      "  top: 'scale1' "
+      "  scale_param { "
+      "    filler { type: 'gaussian' } "
+      "    bias_term: true "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'scale1' "
+      "  top: 'scale1' "
+      "  relu_param { negative_slope: 0.1 } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> net(param);
+  const vector<shared_ptr<Blob<Dtype> > >& bn_blobs =
+      net.layer_by_name("bn1")->blobs();
+  FillerParameter filler_param;
+  filler_param.set_min(0.5);
+  filler_param.set_max(2);
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(bn_blobs[0].get());
+  filler.Fill(bn_blobs[1].get());
+  bn_blobs[2]->mutable_cpu_data()[0] = 2;
+  param.set_fold_inference_layers(true);
+  Net<Dtype> folded_net(param);
+  folded_net.ShareTrainedLayersWith(&net);
+  // A source folded the same way shares its folded weights.
+  Net<Dtype> replica(param);
+  replica.ShareTrainedLayersWith(&folded_net);
+  const vector<shared_ptr<Blob<Dtype> > >& folded_blobs =
+      folded_net.layer_by_name("conv1")->blobs();
+  const vector<shared_ptr<Blob<Dtype> > >& replica_blobs =
+      replica.layer_by_name("conv1")->blobs();
+  ASSERT_EQ(2, replica_blobs.size());
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(folded_blobs[i]->cpu_data(), replica_blobs[i]->cpu_data());
+  }
+  // An unfolded source is copied and folded.
+  EXPECT_NE(net.layer_by_name("conv1")->blobs()[0]->cpu_data(),
+            folded_blobs[0]->cpu_data());
+  Blob<Dtype> data(2, 3, 5, 5);
+  GaussianFiller<Dtype> data_filler(filler_param);
+  data_filler.Fill(&data);
+  Net<Dtype>* nets[3] = {&net, &folded_net, &replica};
+  for (int i = 0; i < 3; ++i) {
+    nets[i]->input_blobs()[0]->CopyFrom(data);
+    nets[i]->Forward();
+  }
+  const Blob<Dtype>* expected = net.blob_by_name("scale1").get();
+  for (int i = 1; i < 3; ++i) {
+    const Blob<Dtype>* actual = nets[i]->blob_by_name("scale1").get();
+    for (int j = 0; j < expected->count(); ++j) {
+      EXPECT_NEAR(expected->cpu_data()[j], actual->cpu_data()[j], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestShareTrainedLayersFromShm) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "state: { phase: TEST } "
+      "fold_inference_layers: true "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape: { dim: 2 dim: 3 dim: 5 dim: 5 } } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 4 "
+      "    kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'bn1' "
+      "  type: 'BatchNorm' "
+      "  bottom: 'conv1' "
+      "  top: 'conv1' "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'conv1' "
+      "  top: 'ip' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  param.set_fold_inference_layers(false);
+  Net<Dtype> trained(param);
+  const vector<shared_ptr<Blob<Dtype> > >& bn_blobs =
+      trained.layer_by_name("bn1")->blobs();
+  FillerParameter filler_param;
+  filler_param.set_min(0.5);
+  filler_param.set_max(2);
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(bn_blobs[0].get());
+  filler.Fill(bn_blobs[1].get());
+  bn_blobs[2]->mutable_cpu_data()[0] = 2;
+  NetParameter weights;
+  trained.ToProto(&weights);
+  string weights_file;
+  MakeTempFilename(&weights_file);
+  WriteProtoToBinaryFile(weights, weights_file);
+
+  param.set_fold_inference_layers(true);
+  Net<Dtype> reference(param), published(param), attached(param);
+  reference.CopyTrainedLayersFrom(weights_file);
+  std::ostringstream shm_name;
+  shm_name << "caffe_test_net_" << getpid() << "_" << sizeof(Dtype);
+  SharedMemorySegment::Remove(shm_name.str());
+  published.ShareTrainedLayersFromShm(weights_file, shm_name.str());
+  attached.ShareTrainedLayersFromShm(weights_file, shm_name.str());
+  EXPECT_TRUE(SharedMemorySegment::Remove(shm_name.str()));
+  // Two read-only mappings of the same weights.
+  const Blob<Dtype>* conv_weights =
+      attached.layer_by_name("conv1")->blobs()[0].get();
+  EXPECT_NE(published.layer_by_name("conv1")->blobs()[0]->cpu_data(),
+            conv_weights->cpu_data());
+  EXPECT_EQ(0, reinterpret_cast<size_t>(conv_weights->cpu_data()) % 64);
+  Blob<Dtype> data(2, 3, 5, 5);
+  GaussianFiller<Dtype> data_filler(filler_param);
+  data_filler.Fill(&data);
+  Net<Dtype>* nets[3] = {&reference, &published, &attached};
+  for (int i = 0; i < 3; ++i) {
+    nets[i]->input_blobs()[0]->CopyFrom(data);
+    nets[i]->Forward();
+  }
+  const Blob<Dtype>* expected = reference.blob_by_name("ip").get();
+  for (int i = 1; i < 3; ++i) {
+    const Blob<Dtype>* actual = nets[i]->blob_by_name("ip").get();
+    for (int j = 0; j < expected->count(); ++j) {
+      EXPECT_EQ(expected->cpu_data()[j], actual->cpu_data()[j]);
+    }
+  }
+  EXPECT_TRUE(conv_weights->data()->read_only());
+  EXPECT_FALSE(reference.layer_by_name("conv1")->blobs()[0]->data()
+               ->read_only());
+
+  // A segment in creation is not seen under its name, nor created twice.
+  // One whose publisher stopped before it was complete is published again,
+  // instead of waited for.
+  SharedMemorySegment* abandoned =
+      SharedMemorySegment::Create(shm_name.str(), 64);
+  ASSERT_TRUE(abandoned != NULL);
+  EXPECT_TRUE(SharedMemorySegment::InCreation(shm_name.str()));
+  EXPECT_TRUE(SharedMemorySegment::Open(shm_name.str()) == NULL);
+  EXPECT_TRUE(SharedMemorySegment::Create(shm_name.str(), 64) == NULL);
+  delete abandoned;
+  EXPECT_FALSE(SharedMemorySegment::InCreation(shm_name.str()));
+  Net<Dtype> republished(param);
+  republished.ShareTrainedLayersFromShm(weights_file, shm_name.str());
+  EXPECT_TRUE(republished.layer_by_name("conv1")->blobs()[0]->data()
+              ->read_only());
+
+  // Nets of other weights do not attach to it.
+  filler.Fill(bn_blobs[1].get());
+  trained.ToProto(&weights);
+  string other_weights_file;
+  MakeTempFilename(&other_weights_file);
+  WriteProtoToBinaryFile(weights, other_weights_file);
+  Net<Dtype> other(param);
+  other.ShareTrainedLayersFromShm(other_weights_file, shm_name.str());
+  EXPECT_TRUE(SharedMemorySegment::Remove(shm_name.str()));
+  EXPECT_FALSE(other.layer_by_name("conv1")->blobs()[0]->data()->read_only());
+  EXPECT_NE(republished.layer_by_name("conv1")->blobs()[0]->cpu_data()[0],
+            other.layer_by_name("conv1")->blobs()[0]->cpu_data()[0]);
+}
+
+TYPED_TEST(NetTest, TestFoldInferenceLayersIntoBatchNorm) {
+  typedef typename TypeParam::Dtype Dtype;
+  // No convolution to fold into: the BatchNorm takes the Scale and ReLU.
+  const string& proto =
+      "state: { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape: { dim: 2 dim: 3 dim: 5 dim: 5 } } "
+      "} "
+      "layer { "
+      "  name: 'bn1' "
+      "  type: 'BatchNorm' "
+      "  bottom: 'data' "
+      "  top: 'bn1' "
+      "} "
+      "layer { "
+      "  name: 'scale1' "
+      "  type: 'Scale' "
+      "  bottom: 'bn1' "
+      "  top: 'bn1' "
+      "  scale_param { "
+      "    filler { type: 'gaussian' } "
+      "    bias_term: true "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu1' "
+      "  type: 'ReLU' "
+      "  bottom: 'bn1' "
+      "  top: 'bn1' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> net(param);
+  const vector<shared_ptr<Blob<Dtype> > >& bn_blobs =
+      net.layer_by_name("bn1")->blobs();
+  FillerParameter filler_param;
+  filler_param.set_min(0.5);
+  filler_param.set_max(2);
+  UniformFiller<Dtype> uniform_filler(filler_param);
+  GaussianFiller<Dtype> gaussian_filler(filler_param);
+  gaussian_filler.Fill(bn_blobs[0].get());
+  uniform_filler.Fill(bn_blobs[1].get());
+  bn_blobs[2]->mutable_cpu_data()[0] = 2;
+  Blob<Dtype> data(2, 3, 5, 5);
+  gaussian_filler.Fill(&data);
+  net.input_blobs()[0]->CopyFrom(data);
+  net.Forward();
+  NetParameter weights;
+  net.ToProto(&weights);
+
+  param.set_fold_inference_layers(true);
+  Net<Dtype> folded_net(param);
+  ASSERT_EQ(2, folded_net.layers().size());
+  EXPECT_EQ(5, folded_net.layer_by_name("bn1")->blobs().size());
+  folded_net.CopyTrainedLayersFrom(weights);
+  folded_net.input_blobs()[0]->CopyFrom(data);
+  folded_net.Forward();
+  const Blob<Dtype>* expected = net.blob_by_name("bn1").get();
+  const Blob<Dtype>* actual = folded_net.blob_by_name("bn1").get();
+  ASSERT_EQ(expected->shape(), actual->shape());
+  for (int i = 0; i < expected->count(); ++i) {
+    EXPECT_NEAR(expected->cpu_data()[i], actual->cpu_data()[i], 1e-4);
+  }
+  // Weights saved from the folded net load as already folded.
+  NetParameter folded_weights;
+  folded_net.ToProto(&folded_weights);
+  Net<Dtype> refolded_net(param);
+  refolded_net.CopyTrainedLayersFrom(folded_weights);
+  refolded_net.input_blobs()[0]->CopyFrom(data);
+  refolded_net.Forward();
+  const Blob<Dtype>* reloaded = refolded_net.blob_by_name("bn1").get();
+  for (int i = 0; i < expected->count(); ++i) {
+    EXPECT_NEAR(expected->cpu_data()[i], reloaded->cpu_data()[i], 1e-4);
+  }
+}
+
+TYPED_TEST(NetTest, TestConcatSliceViews) {
+  typedef typename TypeParam::Dtype Dtype;
+  // c = [2x, x + 1] along the channels, sliced into 1 + 3 channels and
+  // squared: loss = sum(4x^2) + sum((x + 1)^2), d loss / dx = 10x + 2.
+  const string& proto =
+      "force_backward: true "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape: { dim: 1 dim: 2 dim: 3 dim: 4 } } "
+      "} "
+      "layer { "
+      "  name: 'a' "
+      "  type: 'Power' "
+      "  bottom: 'data' "
+      "  top: 'a' "
+      "  power_param { scale: 2 } "
+      "} "
+      "layer { "
+      "  name: 'b' "
+      "  type: 'Power' "
+      "  bottom: 'data' "
+      "  top: 'b' "
+      "  power_param { shift: 1 } "
+      "} "
+      "layer { "
+      "  name: 'c' "
+      "  type: 'Concat' "
+      "  bottom: 'a' "
+      "  bottom: 'b' "
+      "  top: 'c' "
+      "} "
+      "layer { "
+      "  name: 's' "
+      "  type: 'Slice' "
+      "  bottom: 'c' "
+      "  top: 's1' "
+      "  top: 's2' "
+      "  slice_param { slice_point: 1 } "
+      "} "
+      "layer { "
+      "  name: 'p1' "
+      "  type: 'Power' "
+      "  bottom: 's1' "
+      "  top: 'p1' "
+      "  power_param { power: 2 } "
+      "} "
+      "layer { "
+      "  name: 'p2' "
+      "  type: 'Power' "
+      "  bottom: 's2' "
+      "  top: 'p2' "
+      "  power_param { power: 2 } "
+      "} "
+      "layer { "
+      "  name: 'loss1' "
+      "  type: 'Reduction' "
+      "  bottom: 'p1' "
+      "  top: 'loss1' "
+      "  loss_weight: 1 "
+      "} "
+      "layer { "
+      "  name: 'loss2' "
+      "  type: 'Reduction' "
+      "  bottom: 'p2' "
+      "  top: 'loss2' "
+      "  loss_weight: 1 "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  Net<Dtype>* net = this->net_.get();
+  const Blob<Dtype>* c = net->blob_by_name("c").get();
+  Blob<Dtype>* data = net->input_blobs()[0];
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int pass = 0; pass < 2; ++pass) {
+    // The second pass has two images: each bottom is no longer one range
+    // of the top, and the layers go back to copying.
+    if (pass == 1) {
+      data->Reshape(2, 2, 3, 4);
+      net->Reshape();
+    }
+    filler.Fill(data);
+    const Dtype loss = net->ForwardBackward();
+    const bool views = pass == 0;
+    EXPECT_EQ(views, net->blob_by_name("a")->cpu_data() == c->cpu_data());
+    EXPECT_EQ(views, net->blob_by_name("b")->cpu_data() ==
+        c->cpu_data() + c->count() / 2);
+    EXPECT_EQ(views, net->blob_by_name("s2")->cpu_diff() ==
+        c->cpu_diff() + c->count() / 4);
+    const Dtype* x = data->cpu_data();
+    Dtype expected_loss = 0;
+    for (int i = 0; i < data->count(); ++i) {
+      expected_loss += 4 * x[i] * x[i] + (x[i] + 1) * (x[i] + 1);
+      EXPECT_NEAR(10 * x[i] + 2, data->cpu_diff()[i], 1e-4);
+    }
+    EXPECT_NEAR(expected_loss, loss, 1e-3);
+  }
+}
+
+TYPED_TEST(NetTest, TestConcatViewsThroughFlatten) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The layout of the SSD heads: each bottom is shared through a Flatten.
+  const string& proto =
+      "state: { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape: { dim: 1 dim: 2 dim: 3 dim: 4 } } "
+      "} "
+      "layer { "
+      "  name: 'a' "
+      "  type: 'Power' "
+      "  bottom: 'data' "
+      "  top: 'a' "
+      "  power_param { scale: 2 } "
+      "} "
+      "layer { "
+      "  name: 'a_flat' "
+      "  type: 'Flatten' "
+      "  bottom: 'a' "
+      "  top: 'a_flat' "
+      "} "
+      "layer { "
+      "  name: 'b' "
+      "  type: 'Power' "
+      "  bottom: 'data' "
+      "  top: 'b' "
+      "  power_param { shift: 1 } "
+      "} "
+      "layer { "
+      "  name: 'b_flat' "
+      "  type: 'Flatten' "
+      "  bottom: 'b' "
+      "  top: 'b_flat' "
+      "} "
+      "layer { "
+      "  name: 'c' "
+      "  type: 'Concat' "
+      "  bottom: 'a_flat' "
+      "  bottom: 'b_flat' "
+      "  top: 'c' "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'c' "
+      "  top: 'c' "
+      "} ";
+  // First without, then with a ReLU on 'c', which must not reach 'b'.
+  for (int relu = 0; relu < 2; ++relu) {
+    this->InitNetFromProtoString(relu ? proto :
+        proto.substr(0, proto.rfind("layer {")));
+    Net<Dtype>* net = this->net_.get();
+    Blob<Dtype>* data = net->input_blobs()[0];
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(data);
+    net->Forward();
+    const Blob<Dtype>* b = net->blob_by_name("b").get();
+    const Blob<Dtype>* c = net->blob_by_name("c").get();
+    EXPECT_EQ(!relu, net->blob_by_name("a")->cpu_data() == c->cpu_data());
+    EXPECT_EQ(!relu, b->cpu_data() == c->cpu_data() + 24);
+    const Dtype* x = data->cpu_data();
+    for (int i = 0; i < 24; ++i) {
+      const Dtype a_i = 2 * x[i], b_i = x[i] + 1;
+      EXPECT_NEAR(b_i, b->cpu_data()[i], 1e-5);
+      EXPECT_NEAR(relu ? std::max(a_i, Dtype(0)) : a_i, c->cpu_data()[i],
+          1e-5);
+      EXPECT_NEAR(relu ? std::max(b_i, Dtype(0)) : b_i,
+          c->cpu_data()[24 + i], 1e-5);
+    }
+  }
+}
+
 }  // namespace caffe
@@ -609,6 +609,58 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestMaxTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The TEST phase pools without the argmax, through the 2x2 and 3x3
+  // stride 2 kernels and the clipped border; backward then finds the argmax.
+  this->blob_bottom_->Reshape(2, 3, 11, 13);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  Blob<Dtype> train_top, train_bottom_diff;
+  vector<Blob<Dtype>*> train_top_vec(1, &train_top);
+  for (int kernel = 2; kernel <= 4; ++kernel) {
+    for (int pad = 0; pad < kernel && pad <= 1; ++pad) {
+      LayerParameter layer_param;
+      PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+      pooling_param->set_kernel_size(kernel);
+      pooling_param->set_stride(2);
+      pooling_param->set_pad(pad);
+      pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+      PoolingLayer<Dtype> train_layer(layer_param);
+      train_layer.SetUp(this->blob_bottom_vec_, train_top_vec);
+      train_layer.Forward(this->blob_bottom_vec_, train_top_vec);
+      filler.Fill(&train_top);
+      caffe_copy(train_top.count(), train_top.cpu_data(),
+                 train_top.mutable_cpu_diff());
+      train_layer.Forward(this->blob_bottom_vec_, train_top_vec);
+      train_layer.Backward(train_top_vec, vector<bool>(1, true),
+                           this->blob_bottom_vec_);
+      train_bottom_diff.CopyFrom(*this->blob_bottom_, true, true);
+
+      layer_param.set_phase(TEST);
+      PoolingLayer<Dtype> test_layer(layer_param);
+      test_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      test_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      ASSERT_EQ(this->blob_top_->count(), train_top.count());
+      for (int i = 0; i < train_top.count(); ++i) {
+        EXPECT_EQ(this->blob_top_->cpu_data()[i], train_top.cpu_data()[i]);
+      }
+      caffe_copy(train_top.count(), train_top.cpu_diff(),
+                 this->blob_top_->mutable_cpu_diff());
+      // Finding the argmax does not write the top.
+      const uint64_t top_version = this->blob_top_->data()->version();
+      test_layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+                          this->blob_bottom_vec_);
+      EXPECT_EQ(top_version, this->blob_top_->data()->version());
+      for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+        EXPECT_EQ(this->blob_bottom_->cpu_diff()[i],
+                  train_bottom_diff.cpu_diff()[i]);
+      }
+    }
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
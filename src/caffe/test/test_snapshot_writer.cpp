@@ -0,0 +1,64 @@
+#include <boost/filesystem.hpp>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/snapshot_writer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class SnapshotWriterTest : public ::testing::Test {};
+
+TEST_F(SnapshotWriterTest, TestWrite) {
+  string dirname;
+  MakeTempDir(&dirname);
+  const string model_filename = dirname + "/iter_1.caffemodel";
+  const string state_filename = dirname + "/iter_1.solverstate";
+  NetParameter net_param;
+  net_param.set_name("snapshot");
+  SolverState state;
+  state.set_iter(1);
+  state.set_learned_net(model_filename);
+  {
+    SnapshotWriter writer;
+    writer.Write(&net_param, model_filename, &state, state_filename);
+  }
+  NetParameter read_net_param;
+  ASSERT_TRUE(ReadProtoFromBinaryFile(model_filename, &read_net_param));
+  EXPECT_EQ(read_net_param.name(), "snapshot");
+  SolverState read_state;
+  ASSERT_TRUE(ReadProtoFromBinaryFile(state_filename, &read_state));
+  EXPECT_EQ(read_state.iter(), 1);
+  EXPECT_FALSE(boost::filesystem::exists(model_filename + ".tmp"));
+  EXPECT_FALSE(boost::filesystem::exists(state_filename + ".tmp"));
+  boost::filesystem::remove_all(dirname);
+}
+
+TEST_F(SnapshotWriterTest, TestWriteFailureDrops) {
+  string dirname;
+  MakeTempDir(&dirname);
+  const string missing = dirname + "/missing";
+  SnapshotWriter writer;
+  NetParameter net_param;
+  SolverState state;
+  // Cannot be written, the writer logs it and carries on.
+  writer.Write(&net_param, missing + "/iter_1.caffemodel", &state,
+               missing + "/iter_1.solverstate");
+  writer.Flush();
+  EXPECT_FALSE(boost::filesystem::exists(missing));
+  const string model_filename = dirname + "/iter_2.caffemodel";
+  const string state_filename = dirname + "/iter_2.solverstate";
+  state.set_iter(2);
+  writer.Write(&net_param, model_filename, &state, state_filename);
+  writer.Flush();
+  SolverState read_state;
+  ASSERT_TRUE(ReadProtoFromBinaryFile(state_filename, &read_state));
+  EXPECT_EQ(read_state.iter(), 2);
+  boost::filesystem::remove_all(dirname);
+}
+
+}  // namespace caffe
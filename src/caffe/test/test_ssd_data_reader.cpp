@@ -0,0 +1,110 @@
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/SSD/data_reader.hpp"
+#include "caffe/util/db.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using boost::scoped_ptr;
+
+class SSDDataReaderTest : public ::testing::Test {
+ protected:
+  SSDDataReaderTest() : num_items_(10) {}
+
+  virtual void SetUp() {
+    MakeTempDir(&filename_);
+    filename_ += "/db";
+  }
+
+  // Item i has label i, and the keys keep that order.
+  void Fill(DataParameter_DB backend) {
+    backend_ = backend;
+    scoped_ptr<db::DB> db(db::GetDB(backend));
+    db->Open(filename_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = 0; i < num_items_; ++i) {
+      Datum datum;
+      datum.set_label(i);
+      string out;
+      CHECK(datum.SerializeToString(&out));
+      txn->Put(format_int(i, 8), out);
+    }
+    txn->Commit();
+    db->Close();
+  }
+
+  // The readers split the items in contiguous ranges and the body takes one
+  // item of each range in turn, skipping the ranges already done, so that
+  // every epoch holds each item once, in the same order.
+  void TestReaders(const int reader_threads) {
+    LayerParameter param;
+    param.set_name("reader_threads_" + format_int(reader_threads));
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(2);
+    data_param->set_prefetch(2);
+    data_param->set_source(filename_);
+    data_param->set_backend(backend_);
+    data_param->set_reader_threads(reader_threads);
+
+    vector<int> epoch;
+    for (int i = 0; i < num_items_; ++i) {
+      for (int r = 0; r < reader_threads; ++r) {
+        const int begin = num_items_ * r / reader_threads;
+        const int end = num_items_ * (r + 1) / reader_threads;
+        if (begin + i < end) {
+          epoch.push_back(begin + i);
+        }
+      }
+    }
+    ASSERT_EQ(epoch.size(), num_items_);
+
+    DataReader<Datum> reader(param);
+    for (int e = 0; e < 3; ++e) {
+      vector<int> count(num_items_, 0);
+      for (int i = 0; i < num_items_; ++i) {
+        Datum* datum = reader.full().pop();
+        EXPECT_EQ(datum->label(), epoch[i]) << "epoch " << e << " item " << i;
+        count[datum->label()]++;
+        reader.free().push(datum);
+      }
+      for (int i = 0; i < num_items_; ++i) {
+        EXPECT_EQ(count[i], 1) << "epoch " << e << " label " << i;
+      }
+    }
+  }
+
+  const int num_items_;
+  string filename_;
+  DataParameter_DB backend_;
+};
+
+#ifdef USE_LEVELDB
+TEST_F(SSDDataReaderTest, TestReadersLevelDB) {
+  this->Fill(DataParameter_DB_LEVELDB);
+  this->TestReaders(1);
+  this->TestReaders(3);
+  this->TestReaders(4);
+}
+#endif  // USE_LEVELDB
+
+#ifdef USE_LMDB
+TEST_F(SSDDataReaderTest, TestReadersLMDB) {
+  this->Fill(DataParameter_DB_LMDB);
+  this->TestReaders(1);
+  this->TestReaders(3);
+  this->TestReaders(4);
+}
+#endif  // USE_LMDB
+
+}  // namespace caffe
@@ -0,0 +1,168 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/SSD/ssd_data_transformer.hpp"
+#include "caffe/SSD/util/sampler.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class SSDDataTransformerTest : public ::testing::Test {
+ protected:
+  // A smooth 80 x 60 color image, encoded without loss, with two boxes.
+  SSDDataTransformerTest() : num_iter_(8) {
+    cv::Mat cv_img(60, 80, CV_8UC3);
+    for (int h = 0; h < cv_img.rows; ++h) {
+      for (int w = 0; w < cv_img.cols; ++w) {
+        cv_img.at<cv::Vec3b>(h, w) = cv::Vec3b(30 + h + w, 60 + 2 * h, 200 - w);
+      }
+    }
+    EncodeCVMatToDatum(cv_img, "png", anno_datum_.mutable_datum());
+    anno_datum_.set_type(AnnotatedDatum_AnnotationType_BBOX);
+    AnnotationGroup* group = anno_datum_.add_annotation_group();
+    group->set_group_label(1);
+    const float boxes[2][4] = {{0.1, 0.2, 0.5, 0.6}, {0.4, 0.3, 0.9, 0.8}};
+    for (int i = 0; i < 2; ++i) {
+      Annotation* annotation = group->add_annotation();
+      annotation->set_instance_id(i);
+      NormalizedBBox* bbox = annotation->mutable_bbox();
+      bbox->set_xmin(boxes[i][0]);
+      bbox->set_ymin(boxes[i][1]);
+      bbox->set_xmax(boxes[i][2]);
+      bbox->set_ymax(boxes[i][3]);
+    }
+
+    transform_param_.set_mirror(true);
+    transform_param_.add_mean_value(104);
+    transform_param_.add_mean_value(117);
+    transform_param_.add_mean_value(123);
+    ResizeParameter* resize_param = transform_param_.mutable_resize_param();
+    resize_param->set_resize_mode(ResizeParameter_Resize_mode_WARP);
+    resize_param->set_height(32);
+    resize_param->set_width(32);
+    ExpansionParameter* expand_param = transform_param_.mutable_expand_param();
+    expand_param->set_prob(0.5);
+    expand_param->set_max_expand_ratio(2);
+    // Always one crop of half the size, somewhere.
+    BatchSampler batch_sampler;
+    batch_sampler.mutable_sampler()->set_min_scale(0.5);
+    batch_sampler.mutable_sampler()->set_max_scale(0.5);
+    batch_sampler.set_max_sample(1);
+    batch_sampler.set_max_trials(1);
+    batch_samplers_.push_back(batch_sampler);
+  }
+
+  // What AnnotatedDataLayer does step by step, re-encoding in between.
+  void TransformSteps(SSDDataTransformer<Dtype>* transformer,
+      Blob<Dtype>* blob, vector<AnnotationGroup>* anno_vec) {
+    AnnotatedDatum distort_datum(anno_datum_);
+    if (transform_param_.has_distort_param()) {
+      transformer->DistortImage(anno_datum_.datum(),
+                                distort_datum.mutable_datum());
+    }
+    AnnotatedDatum expand_datum;
+    transformer->ExpandImage(distort_datum, &expand_datum);
+    vector<NormalizedBBox> sampled_bboxes;
+    GenerateBatchSamples(expand_datum, batch_samplers_, &sampled_bboxes);
+    ASSERT_EQ(sampled_bboxes.size(), 1);
+    const int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
+    AnnotatedDatum sampled_datum;
+    transformer->CropImage(expand_datum, sampled_bboxes[rand_idx],
+                           &sampled_datum);
+    transformer->Transform(sampled_datum, blob, anno_vec);
+  }
+
+  // Runs both paths from the same seeds: the boxes must match and the
+  // pixels differ by the jpg re-encoding and the interpolation only.
+  void TestFusedMatchesSteps(const Dtype max_mean_diff) {
+    SSDDataTransformer<Dtype> transformer(transform_param_, TRAIN);
+    for (int iter = 0; iter < num_iter_; ++iter) {
+      Blob<Dtype> steps_blob(1, 3, 32, 32);
+      vector<AnnotationGroup> steps_anno;
+      Caffe::set_random_seed(1701 + iter);
+      transformer.InitRand();
+      TransformSteps(&transformer, &steps_blob, &steps_anno);
+
+      Blob<Dtype> fused_blob(1, 3, 32, 32);
+      vector<AnnotationGroup> fused_anno;
+      Caffe::set_random_seed(1701 + iter);
+      transformer.InitRand();
+      transformer.FusedTransform(anno_datum_, batch_samplers_, &fused_blob,
+                                 &fused_anno);
+
+      ASSERT_EQ(fused_anno.size(), steps_anno.size());
+      for (int g = 0; g < fused_anno.size(); ++g) {
+        ASSERT_EQ(fused_anno[g].annotation_size(),
+                  steps_anno[g].annotation_size());
+        for (int i = 0; i < fused_anno[g].annotation_size(); ++i) {
+          const NormalizedBBox& fused = fused_anno[g].annotation(i).bbox();
+          const NormalizedBBox& steps = steps_anno[g].annotation(i).bbox();
+          EXPECT_NEAR(fused.xmin(), steps.xmin(), 1e-5);
+          EXPECT_NEAR(fused.ymin(), steps.ymin(), 1e-5);
+          EXPECT_NEAR(fused.xmax(), steps.xmax(), 1e-5);
+          EXPECT_NEAR(fused.ymax(), steps.ymax(), 1e-5);
+        }
+      }
+      Dtype diff = 0;
+      for (int i = 0; i < fused_blob.count(); ++i) {
+        diff += std::abs(fused_blob.cpu_data()[i] - steps_blob.cpu_data()[i]);
+      }
+      EXPECT_LT(diff / fused_blob.count(), max_mean_diff) << "iter " << iter;
+    }
+  }
+
+  const int num_iter_;
+  AnnotatedDatum anno_datum_;
+  TransformationParameter transform_param_;
+  vector<BatchSampler> batch_samplers_;
+};
+
+TYPED_TEST_CASE(SSDDataTransformerTest, TestDtypes);
+
+TYPED_TEST(SSDDataTransformerTest, TestFusedMatchesSteps) {
+  this->TestFusedMatchesSteps(3);
+}
+
+TYPED_TEST(SSDDataTransformerTest, TestFusedMatchesStepsDistort) {
+  DistortionParameter* distort_param =
+      this->transform_param_.mutable_distort_param();
+  distort_param->set_brightness_prob(1);
+  distort_param->set_brightness_delta(32);
+  distort_param->set_contrast_prob(1);
+  distort_param->set_contrast_lower(0.5);
+  distort_param->set_contrast_upper(1.5);
+  distort_param->set_saturation_prob(1);
+  distort_param->set_saturation_lower(0.5);
+  distort_param->set_saturation_upper(1.5);
+  distort_param->set_hue_prob(1);
+  distort_param->set_hue_delta(18);
+  this->TestFusedMatchesSteps(4);
+}
+
+TYPED_TEST(SSDDataTransformerTest, TestFusedDistortWarpedBoxes) {
+  // Distorting the warped image changes the pixels, not the geometry: the
+  // draws stay in the order of the step-by-step path.
+  DistortionParameter* distort_param =
+      this->transform_param_.mutable_distort_param();
+  distort_param->set_brightness_prob(1);
+  distort_param->set_brightness_delta(32);
+  distort_param->set_saturation_prob(1);
+  distort_param->set_saturation_lower(0.5);
+  distort_param->set_saturation_upper(1.5);
+  this->transform_param_.set_fused_distort_warped(true);
+  this->TestFusedMatchesSteps(255);
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -67,6 +67,48 @@ TEST_F(SyncedMemoryTest, TestCPUWrite) {
   }
 }
 
+TEST_F(SyncedMemoryTest, TestView) {
+  shared_ptr<SyncedMemory> mem(new SyncedMemory(10));
+  SyncedMemory view(mem, 4, 6);
+  EXPECT_TRUE(view.is_view_of(mem.get(), 4));
+  EXPECT_EQ(view.size(), 6);
+  caffe_memset(6, 2, view.mutable_cpu_data());
+  EXPECT_EQ(mem->head(), SyncedMemory::HEAD_AT_CPU);
+  EXPECT_EQ(view.cpu_data(), static_cast<const char*>(mem->cpu_data()) + 4);
+  for (int i = 0; i < mem->size(); ++i) {
+    EXPECT_EQ((static_cast<const char*>(mem->cpu_data()))[i], i < 4 ? 0 : 2);
+  }
+  // Setting the data detaches the view.
+  char data[6];
+  view.set_cpu_data(data);
+  EXPECT_FALSE(view.is_view());
+  EXPECT_EQ(view.cpu_data(), data);
+}
+
+TEST_F(SyncedMemoryTest, TestVersion) {
+  shared_ptr<SyncedMemory> mem(new SyncedMemory(10));
+  SyncedMemory other(10);
+  EXPECT_NE(mem->version(), other.version());
+  // Reads keep the version, writes change it.
+  uint64_t version = mem->version();
+  mem->cpu_data();
+  EXPECT_EQ(mem->version(), version);
+  mem->mutable_cpu_data();
+  EXPECT_NE(mem->version(), version);
+  EXPECT_NE(mem->version(), other.version());
+  version = mem->version();
+  char data[10];
+  mem->set_cpu_data(data);
+  EXPECT_NE(mem->version(), version);
+  // A view has the version of its parent, and writes to either change it.
+  SyncedMemory view(mem, 4, 6);
+  EXPECT_EQ(view.version(), mem->version());
+  version = mem->version();
+  view.mutable_cpu_data();
+  EXPECT_NE(mem->version(), version);
+  EXPECT_EQ(view.version(), mem->version());
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestGPURead) {
@@ -0,0 +1,146 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/util/format.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+// Upsample lives in the "modules" library, which the layer factory opens
+// from CAFFE_LAYER_PATH or the build directory.
+template <typename TypeParam>
+class UpsampleLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  UpsampleLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 3, 4)),
+        blob_bottom_lateral_(new Blob<Dtype>()),
+        blob_top_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~UpsampleLayerTest() {
+    delete blob_bottom_;
+    delete blob_bottom_lateral_;
+    delete blob_top_;
+  }
+
+  // With lateral, the second bottom of the upsampled shape is added.
+  shared_ptr<Layer<Dtype> > MakeLayer(const int scale, const bool lateral) {
+    LayerParameter layer_param;
+    layer_param.set_type("Module");
+    ModuleParameter* module_param = layer_param.mutable_module_param();
+    module_param->set_module("modules");
+    module_param->set_type("Upsample");
+    module_param->set_param_str("{'scale': " + format_int(scale) + "}");
+    if (lateral) {
+      blob_bottom_lateral_->Reshape(2, 3, 3 * scale, 4 * scale);
+      FillerParameter filler_param;
+      GaussianFiller<Dtype> filler(filler_param);
+      filler.Fill(blob_bottom_lateral_);
+      blob_bottom_vec_.push_back(blob_bottom_lateral_);
+    }
+    return LayerRegistry<Dtype>::CreateLayer(layer_param);
+  }
+
+  // Every top value is the nearest bottom value, plus the lateral one.
+  void TestForward(const int scale, const bool lateral) {
+    shared_ptr<Layer<Dtype> > layer = MakeLayer(scale, lateral);
+    layer->SetUp(blob_bottom_vec_, blob_top_vec_);
+    ASSERT_EQ(blob_top_->num(), 2);
+    ASSERT_EQ(blob_top_->channels(), 3);
+    ASSERT_EQ(blob_top_->height(), 3 * scale);
+    ASSERT_EQ(blob_top_->width(), 4 * scale);
+    layer->Forward(blob_bottom_vec_, blob_top_vec_);
+    for (int n = 0; n < 2; ++n) {
+      for (int c = 0; c < 3; ++c) {
+        for (int h = 0; h < 3 * scale; ++h) {
+          for (int w = 0; w < 4 * scale; ++w) {
+            Dtype expected = blob_bottom_->data_at(n, c, h / scale, w / scale);
+            if (lateral) {
+              expected += blob_bottom_lateral_->data_at(n, c, h, w);
+            }
+            EXPECT_EQ(blob_top_->data_at(n, c, h, w), expected)
+                << "scale " << scale << " at " << n << ", " << c << ", " << h
+                << ", " << w;
+          }
+        }
+      }
+    }
+  }
+
+  void TestGradient(const int scale, const bool lateral) {
+    shared_ptr<Layer<Dtype> > layer = MakeLayer(scale, lateral);
+    GradientChecker<Dtype> checker(1e-2, 1e-2);
+    checker.CheckGradient(layer.get(), blob_bottom_vec_, blob_top_vec_);
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_bottom_lateral_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(UpsampleLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(UpsampleLayerTest, TestForwardScale1) {
+  this->TestForward(1, false);
+}
+
+TYPED_TEST(UpsampleLayerTest, TestForwardScale2) {
+  this->TestForward(2, false);
+}
+
+TYPED_TEST(UpsampleLayerTest, TestForwardScale3) {
+  this->TestForward(3, false);
+}
+
+TYPED_TEST(UpsampleLayerTest, TestForwardScale1Lateral) {
+  this->TestForward(1, true);
+}
+
+TYPED_TEST(UpsampleLayerTest, TestForwardScale2Lateral) {
+  this->TestForward(2, true);
+}
+
+TYPED_TEST(UpsampleLayerTest, TestForwardScale3Lateral) {
+  this->TestForward(3, true);
+}
+
+TYPED_TEST(UpsampleLayerTest, TestGradientScale1) {
+  this->TestGradient(1, false);
+}
+
+TYPED_TEST(UpsampleLayerTest, TestGradientScale2) {
+  this->TestGradient(2, false);
+}
+
+TYPED_TEST(UpsampleLayerTest, TestGradientScale3) {
+  this->TestGradient(3, false);
+}
+
+TYPED_TEST(UpsampleLayerTest, TestGradientScale1Lateral) {
+  this->TestGradient(1, true);
+}
+
+TYPED_TEST(UpsampleLayerTest, TestGradientScale2Lateral) {
+  this->TestGradient(2, true);
+}
+
+TYPED_TEST(UpsampleLayerTest, TestGradientScale3Lateral) {
+  this->TestGradient(3, true);
+}
+
+}  // namespace caffe
@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/cpu_conv.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void direct_conv_cpu(const Dtype* data, const int channels,
+    const int height, const int width, const Dtype* weights,
+    const int num_output, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, Dtype* output,
+    const int height_out, const int width_out) {
+  const int kBlock = 4;
+  const int output_size = height_out * width_out;
+  const int kernel_size = kernel_h * kernel_w;
+  const int num_blocks = (num_output + kBlock - 1) / kBlock;
+#pragma omp parallel for
+  for (int block = 0; block < num_blocks; ++block) {
+    const int block_begin = block * kBlock;
+    const int block_size = std::min(kBlock, num_output - block_begin);
+    const Dtype* weights_block = weights + block_begin * channels * kernel_size;
+    Dtype* output_block = output + block_begin * output_size;
+    caffe_set(block_size * output_size, Dtype(0), output_block);
+    // A partial block repeats its last channel into scratch rows so that the
+    // inner loop always updates kBlock rows.
+    std::vector<Dtype> scratch((kBlock - 1) * width_out);
+    for (int oh = 0; oh < height_out; ++oh) {
+      Dtype* rows[kBlock];
+      for (int b = 0; b < kBlock; ++b) {
+        rows[b] = b < block_size ? output_block + b * output_size
+            + oh * width_out : &scratch[(b - 1) * width_out];
+      }
+      Dtype* out0 = rows[0];
+      Dtype* out1 = rows[1];
+      Dtype* out2 = rows[2];
+      Dtype* out3 = rows[3];
+      for (int c = 0; c < channels; ++c) {
+        const Dtype* data_c = data + c * height * width;
+        for (int kh = 0; kh < kernel_h; ++kh) {
+          const int ih = oh * stride_h + kh * dilation_h - pad_h;
+          if (ih < 0 || ih >= height) { continue; }
+          const Dtype* data_row = data_c + ih * width;
+          for (int kw = 0; kw < kernel_w; ++kw) {
+            Dtype w[kBlock];
+            for (int b = 0; b < kBlock; ++b) {
+              w[b] = weights_block[(std::min(b, block_size - 1) * channels + c)
+                  * kernel_size + kh * kernel_w + kw];
+            }
+            // The output columns whose input column lies inside the image.
+            const int offset_w = kw * dilation_w - pad_w;
+            const int ow_begin =
+                offset_w >= 0 ? 0 : (stride_w - 1 - offset_w) / stride_w;
+            const int ow_end = offset_w > width - 1 ? 0 :
+                std::min(width_out, (width - 1 - offset_w) / stride_w + 1);
+            const Dtype* in = data_row + offset_w;
+            if (stride_w == 1) {
+              for (int ow = ow_begin; ow < ow_end; ++ow) {
+                const Dtype x = in[ow];
+                out0[ow] += w[0] * x;
+                out1[ow] += w[1] * x;
+                out2[ow] += w[2] * x;
+                out3[ow] += w[3] * x;
+              }
+            } else {
+              for (int ow = ow_begin; ow < ow_end; ++ow) {
+                const Dtype x = in[ow * stride_w];
+                out0[ow] += w[0] * x;
+                out1[ow] += w[1] * x;
+                out2[ow] += w[2] * x;
+                out3[ow] += w[3] * x;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Explicit instantiation
+template void direct_conv_cpu<float>(const float* data, const int channels,
+    const int height, const int width, const float* weights,
+    const int num_output, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, float* output,
+    const int height_out, const int width_out);
+template void direct_conv_cpu<double>(const double* data, const int channels,
+    const int height, const int width, const double* weights,
+    const int num_output, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, double* output,
+    const int height_out, const int width_out);
+
+// The Winograd transforms: B^T for the input tiles, G for the kernels and
+// A^T for the output tiles (Lavin & Gray, Fast Algorithms for Convolutional
+// Neural Networks, 2015).
+static const float kWinogradBt2[4 * 4] = {
+  1,  0, -1,  0,
+  0,  1,  1,  0,
+  0, -1,  1,  0,
+  0,  1,  0, -1
+};
+static const float kWinogradG2[4 * 3] = {
+  1,    0,   0,
+  0.5,  0.5, 0.5,
+  0.5, -0.5, 0.5,
+  0,    0,   1
+};
+static const float kWinogradAt2[2 * 4] = {
+  1, 1,  1,  0,
+  0, 1, -1, -1
+};
+static const float kWinogradBt4[6 * 6] = {
+  4,  0, -5,  0, 1, 0,
+  0, -4, -4,  1, 1, 0,
+  0,  4, -4, -1, 1, 0,
+  0, -2, -1,  2, 1, 0,
+  0,  2, -1, -2, 1, 0,
+  0,  4,  0, -5, 0, 1
+};
+static const float kWinogradG4[6 * 3] = {
+  1.f / 4,        0,       0,
+  -1.f / 6, -1.f / 6, -1.f / 6,
+  -1.f / 6,  1.f / 6, -1.f / 6,
+  1.f / 24, 1.f / 12,  1.f / 6,
+  1.f / 24, -1.f / 12, 1.f / 6,
+  0,               0,       1
+};
+static const float kWinogradAt4[4 * 6] = {
+  1, 1,  1, 1,  1, 0,
+  0, 1, -1, 2, -2, 0,
+  0, 1,  1, 4,  4, 0,
+  0, 1, -1, 8, -8, 1
+};
+
+static void winograd_transforms(const int tile, const float** Bt,
+    const float** G, const float** At) {
+  CHECK(tile == 2 || tile == 4) << "Winograd tile must be 2 or 4.";
+  *Bt = tile == 2 ? kWinogradBt2 : kWinogradBt4;
+  *G = tile == 2 ? kWinogradG2 : kWinogradG4;
+  *At = tile == 2 ? kWinogradAt2 : kWinogradAt4;
+}
+
+// y (m x m) = T * x * T^T, where T is m x n and x is n x n.
+template <typename Dtype>
+inline void winograd_transform_tile(const int m, const int n, const float* T,
+    const Dtype* x, Dtype* y) {
+  Dtype tmp[6 * 6];
+  for (int i = 0; i < m; ++i) {
+    for (int j = 0; j < n; ++j) {
+      Dtype sum = 0;
+      for (int k = 0; k < n; ++k) {
+        sum += T[i * n + k] * x[k * n + j];
+      }
+      tmp[i * n + j] = sum;
+    }
+  }
+  for (int i = 0; i < m; ++i) {
+    for (int j = 0; j < m; ++j) {
+      Dtype sum = 0;
+      for (int k = 0; k < n; ++k) {
+        sum += tmp[i * n + k] * T[j * n + k];
+      }
+      y[i * m + j] = sum;
+    }
+  }
+}
+
+template <typename Dtype>
+void winograd_transform_weights_cpu(const int tile, const Dtype* weights,
+    const int num_output, const int channels, Dtype* weights_t) {
+  const float *Bt, *G, *At;
+  winograd_transforms(tile, &Bt, &G, &At);
+  const int alpha = tile + 2;
+  const int stride = num_output * channels;
+  for (int k = 0; k < num_output; ++k) {
+    for (int c = 0; c < channels; ++c) {
+      Dtype u[6 * 6];
+      winograd_transform_tile(alpha, 3, G, weights + (k * channels + c) * 9,
+          u);
+      for (int xi = 0; xi < alpha * alpha; ++xi) {
+        weights_t[xi * stride + k * channels + c] = u[xi];
+      }
+    }
+  }
+}
+
+template void winograd_transform_weights_cpu<float>(const int tile,
+    const float* weights, const int num_output, const int channels,
+    float* weights_t);
+template void winograd_transform_weights_cpu<double>(const int tile,
+    const double* weights, const int num_output, const int channels,
+    double* weights_t);
+
+template <typename Dtype>
+void winograd_conv_cpu(const int tile, const Dtype* data, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const Dtype* weights_t, const int num_output, Dtype* output,
+    const int height_out, const int width_out, Dtype* data_t,
+    Dtype* output_t) {
+  const float *Bt, *G, *At;
+  winograd_transforms(tile, &Bt, &G, &At);
+  const int alpha = tile + 2;
+  const int tiles_w = (width_out + tile - 1) / tile;
+  const int num_tiles = winograd_num_tiles(tile, height_out, width_out);
+  // Input transform: data_t[xi][c][p] = (B^T d B)[xi] of tile p.
+#pragma omp parallel for
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* data_c = data + c * height * width;
+    for (int p = 0; p < num_tiles; ++p) {
+      const int h0 = (p / tiles_w) * tile - pad_h;
+      const int w0 = (p % tiles_w) * tile - pad_w;
+      Dtype d[6 * 6], v[6 * 6];
+      for (int i = 0; i < alpha; ++i) {
+        for (int j = 0; j < alpha; ++j) {
+          const int h = h0 + i, w = w0 + j;
+          d[i * alpha + j] = (h >= 0 && h < height && w >= 0 && w < width) ?
+              data_c[h * width + w] : Dtype(0);
+        }
+      }
+      winograd_transform_tile(alpha, alpha, Bt, d, v);
+      for (int xi = 0; xi < alpha * alpha; ++xi) {
+        data_t[(xi * channels + c) * num_tiles + p] = v[xi];
+      }
+    }
+  }
+  // Sum the element-wise products over the channels.
+  for (int xi = 0; xi < alpha * alpha; ++xi) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output, num_tiles,
+        channels, (Dtype)1., weights_t + xi * num_output * channels,
+        data_t + xi * channels * num_tiles, (Dtype)0.,
+        output_t + xi * num_output * num_tiles);
+  }
+  // Output transform: y = A^T m A, cropped at the borders of the output.
+#pragma omp parallel for
+  for (int k = 0; k < num_output; ++k) {
+    Dtype* output_k = output + k * height_out * width_out;
+    for (int p = 0; p < num_tiles; ++p) {
+      const int h0 = (p / tiles_w) * tile;
+      const int w0 = (p % tiles_w) * tile;
+      Dtype m[6 * 6], y[4 * 4];
+      for (int xi = 0; xi < alpha * alpha; ++xi) {
+        m[xi] = output_t[(xi * num_output + k) * num_tiles + p];
+      }
+      winograd_transform_tile(tile, alpha, At, m, y);
+      for (int i = 0; i < tile && h0 + i < height_out; ++i) {
+        for (int j = 0; j < tile && w0 + j < width_out; ++j) {
+          output_k[(h0 + i) * width_out + w0 + j] = y[i * tile + j];
+        }
+      }
+    }
+  }
+}
+
+template void winograd_conv_cpu<float>(const int tile, const float* data,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, const float* weights_t, const int num_output,
+    float* output, const int height_out, const int width_out, float* data_t,
+    float* output_t);
+template void winograd_conv_cpu<double>(const int tile, const double* data,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, const double* weights_t, const int num_output,
+    double* output, const int height_out, const int width_out,
+    double* data_t, double* output_t);
+
+}  // namespace caffe
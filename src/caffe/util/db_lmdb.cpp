@@ -44,6 +44,13 @@ LMDBCursor* LMDB::NewCursor() {
   return new LMDBCursor(mdb_txn, mdb_cursor);
 }
 
+size_t LMDB::Count() {
+  // From the header of the main database, without reading the items.
+  MDB_stat mdb_stat;
+  MDB_CHECK(mdb_env_stat(mdb_env_, &mdb_stat));
+  return mdb_stat.ms_entries;
+}
+
 LMDBTransaction* LMDB::NewTransaction() {
   return new LMDBTransaction(mdb_env_);
 }
@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "caffe/util/int8_gemm.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (__GNUC__ >= 8 || defined(__clang__))
+#include <immintrin.h>
+#define CAFFE_VNNI
+// The VNNI code is compiled for AVX512-VNNI whatever the flags of the build,
+// and only runs after HasVnni.
+#define CAFFE_VNNI_TARGET __attribute__((target("avx512f,avx512bw,avx512vnni")))
+#endif
+
+namespace caffe {
+
+// Rounds half away from zero and saturates to [-127, 127], as
+// caffe_cpu_quantize.
+template <typename Dtype>
+inline int quantize(const Dtype v) {
+  const Dtype c = std::min(std::max(v, Dtype(-127)), Dtype(127));
+  return static_cast<int>(c < 0 ? c - Dtype(0.5) : c + Dtype(0.5));
+}
+
+// The VNNI layout: k is padded to a multiple of 4, the input columns to a
+// multiple of 16, and the input is stored as [N / 16][K / 4][16][4].
+inline int k_blocks(const int K) { return (K + 3) / 4; }
+inline int n_blocks(const int N) { return (N + 15) / 16; }
+inline int m_padded(const int M) { return (M + 7) / 8 * 8; }
+
+template <typename Dtype>
+Int8Gemm<Dtype>::Int8Gemm(bool use_vnni)
+    : use_vnni_(use_vnni && HasVnni()), M_(0), K_(0), input_scale_(0) {}
+
+template <typename Dtype>
+bool Int8Gemm<Dtype>::HasVnni() {
+#ifdef CAFFE_VNNI
+  static const bool has_vnni = __builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512vnni");
+  return has_vnni;
+#else
+  return false;
+#endif
+}
+
+template <typename Dtype>
+void Int8Gemm<Dtype>::SetWeights(const int M, const int K,
+    const Dtype* weights, const Dtype input_scale) {
+  M_ = M;
+  K_ = K;
+  input_scale_ = input_scale;
+  weight_scales_.resize(M);
+  output_scales_.resize(M);
+  vector<int8_t> weights_int8(M * K);
+  caffe_cpu_quantize_rows(M, K, weights, weights_int8.data(),
+      weight_scales_.data());
+  for (int m = 0; m < M; ++m) {
+    output_scales_[m] = Dtype(1) / (input_scale * weight_scales_[m]);
+  }
+  if (use_vnni_) {
+    const int K4 = k_blocks(K);
+    weights_.assign(m_padded(M) * K4, 0);
+    weight_offsets_.resize(M);
+    for (int m = 0; m < M; ++m) {
+      const int8_t* row = weights_int8.data() + m * K;
+      std::memcpy(weights_.data() + m * K4, row, K);
+      int sum = 0;
+      for (int k = 0; k < K; ++k) {
+        sum += row[k];
+      }
+      weight_offsets_[m] = 128 * sum;
+    }
+  } else {
+    weights_q_.assign(weights_int8.begin(), weights_int8.end());
+  }
+}
+
+#ifdef CAFFE_VNNI
+
+template <typename Dtype>
+static void vnni_pack_input(const int K, const int N, const Dtype* x,
+    const Dtype scale, const bool trans, uint8_t* packed) {
+  const int K4 = k_blocks(K);
+#pragma omp parallel for
+  for (int n = 0; n < N; ++n) {
+    uint8_t* packed_n = packed + (n / 16) * K4 * 64 + (n % 16) * 4;
+    for (int k = 0; k < K; ++k) {
+      const Dtype v = trans ? x[n * K + k] : x[k * N + n];
+      packed_n[(k / 4) * 64 + k % 4] =
+          static_cast<uint8_t>(quantize(scale * v) + 128);
+    }
+  }
+}
+
+// Quantizes 4 rows of 16 columns at a time, then interleaves their bytes.
+template <>
+CAFFE_VNNI_TARGET
+void vnni_pack_input<float>(const int K, const int N, const float* x,
+    const float scale, const bool trans, uint8_t* packed) {
+  const int K4 = k_blocks(K);
+  const int NB = n_blocks(N);
+  if (trans) {
+#pragma omp parallel for
+    for (int n = 0; n < N; ++n) {
+      uint8_t* packed_n = packed + (n / 16) * K4 * 64 + (n % 16) * 4;
+      const float* x_n = x + n * K;
+      for (int k = 0; k < K; ++k) {
+        packed_n[(k / 4) * 64 + k % 4] =
+            static_cast<uint8_t>(quantize(scale * x_n[k]) + 128);
+      }
+    }
+    return;
+  }
+  const __m512 scale_v = _mm512_set1_ps(scale);
+  const __m512 low = _mm512_set1_ps(-127);
+  const __m512 high = _mm512_set1_ps(127);
+  const __m512i sign = _mm512_set1_epi32(0x80000000);
+  const __m512i half = _mm512_castps_si512(_mm512_set1_ps(0.5f));
+  const __m512i offset = _mm512_set1_epi32(128);
+#pragma omp parallel for
+  for (int nb = 0; nb < NB; ++nb) {
+    const int n0 = nb * 16;
+    const __mmask16 mask = N - n0 >= 16 ? 0xFFFF : (1 << (N - n0)) - 1;
+    for (int k4 = 0; k4 < K4; ++k4) {
+      __m128i q[4];
+      for (int r = 0; r < 4; ++r) {
+        const int k = k4 * 4 + r;
+        __m512 v = k < K ?
+            _mm512_maskz_loadu_ps(mask, x + k * N + n0) : _mm512_setzero_ps();
+        v = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(v, scale_v), low),
+            high);
+        const __m512 h = _mm512_castsi512_ps(_mm512_or_si512(
+            _mm512_and_si512(_mm512_castps_si512(v), sign), half));
+        q[r] = _mm512_cvtepi32_epi8(_mm512_add_epi32(
+            _mm512_cvttps_epi32(_mm512_add_ps(v, h)), offset));
+      }
+      const __m128i q01_low = _mm_unpacklo_epi8(q[0], q[1]);
+      const __m128i q01_high = _mm_unpackhi_epi8(q[0], q[1]);
+      const __m128i q23_low = _mm_unpacklo_epi8(q[2], q[3]);
+      const __m128i q23_high = _mm_unpackhi_epi8(q[2], q[3]);
+      __m128i* out = reinterpret_cast<__m128i*>(packed + (nb * K4 + k4) * 64);
+      _mm_storeu_si128(out, _mm_unpacklo_epi16(q01_low, q23_low));
+      _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(q01_low, q23_low));
+      _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(q01_high, q23_high));
+      _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(q01_high, q23_high));
+    }
+  }
+}
+
+// Dequantizes the count outputs of acc to output, stride apart.
+template <typename Dtype>
+CAFFE_VNNI_TARGET
+inline void vnni_store(const __m512i acc, const int count, const Dtype scale,
+    Dtype* output, const int stride) {
+  int v[16];
+  _mm512_storeu_si512(v, acc);
+  for (int i = 0; i < count; ++i) {
+    output[i * stride] = scale * v[i];
+  }
+}
+
+template <>
+CAFFE_VNNI_TARGET
+inline void vnni_store<float>(const __m512i acc, const int count,
+    const float scale, float* output, const int stride) {
+  if (stride == 1) {
+    const __mmask16 mask = count >= 16 ? 0xFFFF : (1 << count) - 1;
+    _mm512_mask_storeu_ps(output, mask,
+        _mm512_mul_ps(_mm512_cvtepi32_ps(acc), _mm512_set1_ps(scale)));
+  } else {
+    float v[16];
+    _mm512_storeu_ps(v,
+        _mm512_mul_ps(_mm512_cvtepi32_ps(acc), _mm512_set1_ps(scale)));
+    for (int i = 0; i < count; ++i) {
+      output[i * stride] = v[i];
+    }
+  }
+}
+
+// Blocks of 8 rows x 32 columns, 16 accumulators, with the 32 columns of
+// the input in cache while all the rows go through.
+template <typename Dtype>
+CAFFE_VNNI_TARGET
+static void vnni_gemm(const int M, const int N, const int K,
+    const int* weights, const int* offsets, const Dtype* scales,
+    const uint8_t* input, Dtype* output, const bool trans) {
+  const int K4 = k_blocks(K);
+  const int NB = n_blocks(N);
+#pragma omp parallel for
+  for (int nb = 0; nb < NB; nb += 2) {
+    const uint8_t* input_0 = input + nb * K4 * 64;
+    const uint8_t* input_1 = nb + 1 < NB ? input_0 + K4 * 64 : input_0;
+    for (int m0 = 0; m0 < M; m0 += 8) {
+      __m512i acc[8][2];
+      for (int i = 0; i < 8; ++i) {
+        acc[i][0] = _mm512_setzero_si512();
+        acc[i][1] = _mm512_setzero_si512();
+      }
+      const int* w = weights + m0 * K4;
+      for (int k4 = 0; k4 < K4; ++k4) {
+        const __m512i x0 = _mm512_loadu_si512(input_0 + k4 * 64);
+        const __m512i x1 = _mm512_loadu_si512(input_1 + k4 * 64);
+        for (int i = 0; i < 8; ++i) {
+          const __m512i w_i = _mm512_set1_epi32(w[i * K4 + k4]);
+          acc[i][0] = _mm512_dpbusd_epi32(acc[i][0], x0, w_i);
+          acc[i][1] = _mm512_dpbusd_epi32(acc[i][1], x1, w_i);
+        }
+      }
+      for (int i = 0; i < std::min(8, M - m0); ++i) {
+        const int m = m0 + i;
+        for (int j = 0; j < 2 && nb + j < NB; ++j) {
+          const int n = (nb + j) * 16;
+          const __m512i acc_ij =
+              _mm512_sub_epi32(acc[i][j], _mm512_set1_epi32(offsets[m]));
+          if (trans) {
+            vnni_store(acc_ij, std::min(16, N - n), scales[m],
+                output + n * M + m, M);
+          } else {
+            vnni_store(acc_ij, std::min(16, N - n), scales[m],
+                output + m * N + n, 1);
+          }
+        }
+      }
+    }
+  }
+}
+
+#endif  // CAFFE_VNNI
+
+template <typename Dtype>
+void Int8Gemm<Dtype>::Forward(const int N, const Dtype* input, Dtype* output,
+    const bool trans) {
+  CHECK_GT(M_, 0) << "SetWeights must come first.";
+#ifdef CAFFE_VNNI
+  if (use_vnni_) {
+    input_.resize(n_blocks(N) * k_blocks(K_) * 64);
+    vnni_pack_input(K_, N, input, input_scale_, trans, input_.data());
+    vnni_gemm(M_, N, K_, weights_.data(), weight_offsets_.data(),
+        output_scales_.data(), input_.data(), output, trans);
+    return;
+  }
+#endif
+  input_q_.resize(K_ * N);
+  for (int i = 0; i < K_ * N; ++i) {
+    input_q_[i] = quantize(input_scale_ * input[i]);
+  }
+  if (trans) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, M_, K_, Dtype(1),
+        input_q_.data(), weights_q_.data(), Dtype(0), output);
+    for (int n = 0; n < N; ++n) {
+      for (int m = 0; m < M_; ++m) {
+        output[n * M_ + m] *= output_scales_[m];
+      }
+    }
+  } else {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N, K_, Dtype(1),
+        weights_q_.data(), input_q_.data(), Dtype(0), output);
+    for (int m = 0; m < M_; ++m) {
+      caffe_scal(N, output_scales_[m], output + m * N);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(Int8Gemm);
+
+}  // namespace caffe
@@ -1,6 +1,9 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <limits>
 
 #include "caffe/common.hpp"
@@ -373,4 +376,204 @@ void caffe_cpu_scale<double>(const int n, const double alpha, const double *x,
   cblas_dscal(n, alpha, y, 1);
 }
 
+// exp(x) for the x <= 0 that softmax, sigmoid and tanh feed it. Without MKL, vsExp is a loop
+// over the scalar libm exp; the float version here is a range reduction to
+// 2^n * exp(r), |r| <= ln(2) / 2, and the Cephes polynomial for exp(r), which
+// is within 2 ulp and which the compiler vectorizes.
+template <typename Dtype>
+static void softmax_exp(const int n, const Dtype* x, Dtype* y) {
+  caffe_exp(n, x, y);
+}
+
+#ifndef USE_MKL
+template <>
+void softmax_exp<float>(const int n, const float* x, float* y) {
+  // below exp(-87.3) the result would not be a normal float; clamped in a
+  // loop of its own, as the compare would keep the one below from vectorizing.
+  // NaN goes through both, as with exp.
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::min(std::max(x[i], -87.3f), 0.f);
+  }
+  for (int i = 0; i < n; ++i) {
+    const float v = y[i];
+    // round to nearest by adding 1.5 * 2^23: k is then in the low bits of t,
+    // without a conversion to int, which would be undefined for NaN
+    const float t = v * 1.44269504f + 12582912.f;
+    const float k = t - 12582912.f;
+    const float r = v - k * 0.693359375f + k * 2.12194440e-4f;
+    float p = 1.9875691500e-4f;
+    p = p * r + 1.3981999507e-3f;
+    p = p * r + 8.3334519073e-3f;
+    p = p * r + 4.1665795894e-2f;
+    p = p * r + 1.6666665459e-1f;
+    p = p * r + 5.0000001201e-1f;
+    p = p * r * r + r + 1.f;
+    uint32_t bits;
+    memcpy(&bits, &t, sizeof(bits));
+    bits = (bits - 0x4B400000u + 127u) << 23;
+    float two_k;
+    memcpy(&two_k, &bits, sizeof(two_k));
+    y[i] = p * two_k;
+  }
+}
+#endif
+
+template <typename Dtype>
+void caffe_cpu_softmax(const int outer_num, const int channels,
+    const int inner_num, const Dtype* x, Dtype* y) {
+  const int dim = channels * inner_num;
+  if (inner_num == 1) {
+    // Classifier outputs: each row is contiguous and stays in cache.
+#pragma omp parallel for
+    for (int i = 0; i < outer_num; ++i) {
+      const Dtype* x_i = x + i * dim;
+      Dtype* y_i = y + i * dim;
+      Dtype max_value = x_i[0];
+      for (int c = 1; c < channels; ++c) {
+        max_value = std::max(max_value, x_i[c]);
+      }
+      for (int c = 0; c < channels; ++c) {
+        y_i[c] = x_i[c] - max_value;
+      }
+      softmax_exp(channels, y_i, y_i);
+      Dtype sum = 0;
+      for (int c = 0; c < channels; ++c) {
+        sum += y_i[c];
+      }
+      const Dtype inv_sum = Dtype(1) / sum;
+      for (int c = 0; c < channels; ++c) {
+        y_i[c] *= inv_sum;
+      }
+    }
+    return;
+  }
+  // Dense outputs: the channels of a location are inner_num apart, so work on
+  // blocks of kBlock locations, whose rows are contiguous and whose max and
+  // sum fit on the stack. The blocks of all the outer slices are split among
+  // the threads, which keeps them busy when outer_num is 1.
+  const int kBlock = 256;
+  const int blocks = (inner_num + kBlock - 1) / kBlock;
+#pragma omp parallel for
+  for (int b = 0; b < outer_num * blocks; ++b) {
+    const int k0 = (b % blocks) * kBlock;
+    const int n = std::min(kBlock, inner_num - k0);
+    const Dtype* x_b = x + (b / blocks) * dim + k0;
+    Dtype* y_b = y + (b / blocks) * dim + k0;
+    Dtype scale[kBlock];
+    for (int k = 0; k < n; ++k) {
+      scale[k] = x_b[k];
+    }
+    for (int c = 1; c < channels; ++c) {
+      const Dtype* x_c = x_b + c * inner_num;
+      for (int k = 0; k < n; ++k) {
+        scale[k] = std::max(scale[k], x_c[k]);
+      }
+    }
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* x_c = x_b + c * inner_num;
+      Dtype* y_c = y_b + c * inner_num;
+      for (int k = 0; k < n; ++k) {
+        y_c[k] = x_c[k] - scale[k];
+      }
+      softmax_exp(n, y_c, y_c);
+    }
+    for (int k = 0; k < n; ++k) {
+      scale[k] = y_b[k];
+    }
+    for (int c = 1; c < channels; ++c) {
+      const Dtype* y_c = y_b + c * inner_num;
+      for (int k = 0; k < n; ++k) {
+        scale[k] += y_c[k];
+      }
+    }
+    for (int k = 0; k < n; ++k) {
+      scale[k] = Dtype(1) / scale[k];
+    }
+    for (int c = 0; c < channels; ++c) {
+      Dtype* y_c = y_b + c * inner_num;
+      for (int k = 0; k < n; ++k) {
+        y_c[k] *= scale[k];
+      }
+    }
+  }
+}
+
+template
+void caffe_cpu_softmax<float>(const int outer_num, const int channels,
+    const int inner_num, const float* x, float* y);
+template
+void caffe_cpu_softmax<double>(const int outer_num, const int channels,
+    const int inner_num, const double* x, double* y);
+
+// Both from e = exp(-|x|) (or exp(-2|x|)), which never overflows, then a
+// select on the sign of x; every loop vectorizes.
+template <typename Dtype>
+void caffe_cpu_sigmoid(const int n, const Dtype* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = -std::abs(x[i]);
+  }
+  softmax_exp(n, y, y);
+  for (int i = 0; i < n; ++i) {
+    y[i] = (x[i] >= 0 ? Dtype(1) : y[i]) / (1 + y[i]);
+  }
+}
+
+template
+void caffe_cpu_sigmoid<float>(const int n, const float* x, float* y);
+template
+void caffe_cpu_sigmoid<double>(const int n, const double* x, double* y);
+
+template <typename Dtype>
+void caffe_cpu_tanh(const int n, const Dtype* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = -2 * std::abs(x[i]);
+  }
+  softmax_exp(n, y, y);
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::copysign((1 - y[i]) / (1 + y[i]), x[i]);
+  }
+}
+
+template
+void caffe_cpu_tanh<float>(const int n, const float* x, float* y);
+template
+void caffe_cpu_tanh<double>(const int n, const double* x, double* y);
+
+template <typename Dtype>
+void caffe_cpu_quantize(const int n, const Dtype scale, const Dtype* x,
+    int8_t* y) {
+  for (int i = 0; i < n; ++i) {
+    const Dtype v =
+        std::min(std::max(scale * x[i], Dtype(-127)), Dtype(127));
+    y[i] = static_cast<int8_t>(v < 0 ? v - Dtype(0.5) : v + Dtype(0.5));
+  }
+}
+
+template
+void caffe_cpu_quantize<float>(const int n, const float scale,
+    const float* x, int8_t* y);
+template
+void caffe_cpu_quantize<double>(const int n, const double scale,
+    const double* x, int8_t* y);
+
+template <typename Dtype>
+void caffe_cpu_quantize_rows(const int M, const int N, const Dtype* x,
+    int8_t* y, Dtype* scales) {
+  for (int m = 0; m < M; ++m) {
+    Dtype max_abs = 0;
+    for (int n = 0; n < N; ++n) {
+      max_abs = std::max(max_abs, std::abs(x[m * N + n]));
+    }
+    scales[m] = max_abs > 0 ? Dtype(127) / max_abs : Dtype(1);
+    caffe_cpu_quantize(N, scales[m], x + m * N, y + m * N);
+  }
+}
+
+template
+void caffe_cpu_quantize_rows<float>(const int M, const int N, const float* x,
+    int8_t* y, float* scales);
+template
+void caffe_cpu_quantize_rows<double>(const int M, const int N,
+    const double* x, int8_t* y, double* scales);
+
 }  // namespace caffe
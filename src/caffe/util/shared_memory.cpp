@@ -0,0 +1,127 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "caffe/util/shared_memory.hpp"
+
+namespace caffe {
+
+// shm_open names start with a single slash.
+static string shm_name(const string& name) {
+  return name.size() && name[0] == '/' ? name : "/" + name;
+}
+
+// Where shm_open keeps its segments, to link them under another name.
+static string shm_path(const string& name) {
+  return "/dev/shm" + shm_name(name);
+}
+
+// The segment a publisher builds before it is linked under name.
+static string new_name(const string& name) {
+  return shm_name(name) + ".new";
+}
+
+// Held by the publisher from Create to Seal, the kernel drops it if the
+// publisher dies. Never a segment itself: it stays empty.
+static string lock_name(const string& name) {
+  return shm_name(name) + ".lock";
+}
+
+SharedMemorySegment* SharedMemorySegment::Create(const string& name,
+    size_t size) {
+  CHECK_GT(size, 0);
+  const int lock_fd = shm_open(lock_name(name).c_str(), O_RDWR | O_CREAT,
+                               0644);
+  CHECK_GE(lock_fd, 0) << "shm_open " << lock_name(name) << ": "
+      << strerror(errno);
+  if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+    CHECK_EQ(errno, EWOULDBLOCK) << "flock " << lock_name(name) << ": "
+        << strerror(errno);
+    close(lock_fd);
+    return NULL;
+  }
+  // Published since the caller looked for it.
+  struct stat st;
+  if (stat(shm_path(name).c_str(), &st) == 0) {
+    close(lock_fd);
+    return NULL;
+  }
+  // What a publisher that died left behind.
+  shm_unlink(new_name(name).c_str());
+  const int fd = shm_open(new_name(name).c_str(), O_RDWR | O_CREAT | O_EXCL,
+                          0644);
+  CHECK_GE(fd, 0) << "shm_open " << new_name(name) << ": " << strerror(errno);
+  const int truncated = ftruncate(fd, size);
+  CHECK_EQ(truncated, 0) << "Cannot size shared memory " << name << " to "
+      << size << " bytes: " << strerror(errno);
+  void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  CHECK(data != MAP_FAILED) << "mmap " << name << ": " << strerror(errno);
+  return new SharedMemorySegment(name, data, size, lock_fd);
+}
+
+SharedMemorySegment* SharedMemorySegment::Open(const string& name) {
+  const int fd = shm_open(shm_name(name).c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    CHECK_EQ(errno, ENOENT) << "shm_open " << name << ": " << strerror(errno);
+    return NULL;
+  }
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "fstat " << name << ": " << strerror(errno);
+  CHECK_GT(st.st_size, 0) << "Shared memory " << name << " is empty";
+  void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  CHECK(data != MAP_FAILED) << "mmap " << name << ": " << strerror(errno);
+  return new SharedMemorySegment(name, data, st.st_size, -1);
+}
+
+bool SharedMemorySegment::InCreation(const string& name) {
+  const int fd = shm_open(lock_name(name).c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    CHECK_EQ(errno, ENOENT) << "shm_open " << lock_name(name) << ": "
+        << strerror(errno);
+    return false;
+  }
+  const bool locked = flock(fd, LOCK_SH | LOCK_NB) != 0;
+  CHECK(!locked || errno == EWOULDBLOCK) << "flock " << lock_name(name)
+      << ": " << strerror(errno);
+  close(fd);
+  return locked;
+}
+
+bool SharedMemorySegment::Remove(const string& name) {
+  shm_unlink(lock_name(name).c_str());
+  return shm_unlink(shm_name(name).c_str()) == 0;
+}
+
+SharedMemorySegment::~SharedMemorySegment() {
+  munmap(data_, size_);
+  if (lock_fd_ >= 0) {
+    shm_unlink(new_name(name_).c_str());
+    close(lock_fd_);
+  }
+}
+
+bool SharedMemorySegment::Seal() {
+  CHECK_GE(lock_fd_, 0) << "Only a created segment is sealed";
+  CHECK_EQ(mprotect(data_, size_, PROT_READ), 0)
+      << "mprotect: " << strerror(errno);
+  // Others only ever see name fully written: link fails if it exists, which
+  // under the lock only happens when Remove unlinked the lock meanwhile.
+  const bool linked =
+      link(shm_path(new_name(name_)).c_str(), shm_path(name_).c_str()) == 0;
+  CHECK(linked || errno == EEXIST) << "link " << shm_path(name_) << ": "
+      << strerror(errno);
+  shm_unlink(new_name(name_).c_str());
+  close(lock_fd_);
+  lock_fd_ = -1;
+  return linked;
+}
+
+}  // namespace caffe
@@ -0,0 +1,135 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "caffe/util/io.hpp"
+#include "caffe/util/snapshot_writer.hpp"
+
+namespace caffe {
+
+class SnapshotWriter::sync {
+ public:
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+// Writes proto to a temporary file, syncs it and renames it to filename,
+// then syncs the directory so that the rename survives a crash as well.
+// Returns false, leaving filename as it was, if any step fails.
+static bool WriteProtoAtomically(const Message& proto, const string& filename) {
+  const string temp_filename = filename + ".tmp";
+  const int fd = open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                      0644);
+  if (fd < 0) {
+    LOG(ERROR) << "Cannot create " << temp_filename << ": "
+               << std::strerror(errno);
+    return false;
+  }
+  bool ok = proto.SerializeToFileDescriptor(fd);
+  if (!ok) {
+    LOG(ERROR) << "Cannot write " << temp_filename;
+  } else if (fsync(fd) != 0) {
+    LOG(ERROR) << "Cannot sync " << temp_filename << ": "
+               << std::strerror(errno);
+    ok = false;
+  }
+  if (close(fd) != 0 && ok) {
+    LOG(ERROR) << "Cannot close " << temp_filename << ": "
+               << std::strerror(errno);
+    ok = false;
+  }
+  if (ok && std::rename(temp_filename.c_str(), filename.c_str()) != 0) {
+    LOG(ERROR) << "Cannot rename " << temp_filename << " to " << filename
+               << ": " << std::strerror(errno);
+    ok = false;
+  }
+  if (!ok) {
+    std::remove(temp_filename.c_str());
+    return false;
+  }
+  string dirname = boost::filesystem::path(filename).parent_path().string();
+  if (dirname.empty()) dirname = ".";
+  const int dir_fd = open(dirname.c_str(), O_RDONLY);
+  if (dir_fd < 0 || fsync(dir_fd) != 0) {
+    // The file is complete, only the rename may not be durable yet.
+    LOG(WARNING) << "Cannot sync " << dirname << ": " << std::strerror(errno);
+  }
+  if (dir_fd >= 0) close(dir_fd);
+  return true;
+}
+
+SnapshotWriter::SnapshotWriter()
+    : sync_(new sync()), pending_(false), writing_(false) {
+  StartInternalThread();
+}
+
+SnapshotWriter::~SnapshotWriter() {
+  Flush();
+  StopInternalThread();
+}
+
+void SnapshotWriter::Write(NetParameter* net_param,
+    const string& model_filename, SolverState* state,
+    const string& state_filename) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (pending_) {
+    LOG(INFO) << "Snapshot writer busy, skipping " << pending_model_filename_;
+  }
+  pending_net_.Swap(net_param);
+  pending_state_.Swap(state);
+  pending_model_filename_ = model_filename;
+  pending_state_filename_ = state_filename;
+  pending_ = true;
+  lock.unlock();
+  sync_->condition_.notify_all();
+}
+
+void SnapshotWriter::Flush() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (pending_ || writing_) {
+    sync_->condition_.wait(lock);
+  }
+}
+
+void SnapshotWriter::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      string model_filename, state_filename;
+      {
+        boost::mutex::scoped_lock lock(sync_->mutex_);
+        while (!pending_) {
+          sync_->condition_.wait(lock);
+        }
+        net_.Swap(&pending_net_);
+        state_.Swap(&pending_state_);
+        model_filename = pending_model_filename_;
+        state_filename = pending_state_filename_;
+        pending_ = false;
+        writing_ = true;
+      }
+      // The state names the model, so the model goes first. A snapshot that
+      // cannot be written is dropped, training goes on.
+      if (WriteProtoAtomically(net_, model_filename)
+          && WriteProtoAtomically(state_, state_filename)) {
+        LOG(INFO) << "Snapshot written to " << model_filename << " and "
+                  << state_filename;
+      } else {
+        LOG(ERROR) << "Snapshot to " << model_filename << " dropped";
+      }
+      {
+        boost::mutex::scoped_lock lock(sync_->mutex_);
+        writing_ = false;
+      }
+      sync_->condition_.notify_all();
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+}  // namespace caffe
@@ -6,11 +6,17 @@
 // ------------------------------------------------------------------
 
 // modify by github.com/makefile
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
+
 #include "fpn_utils.hpp"
 #include "fpn_proposal_layer.m.hpp"
 #include "caffe/FRCNN/util/frcnn_utils.hpp"
 #include "caffe/FRCNN/util/frcnn_helper.hpp"
-#include "caffe/FRCNN/util/frcnn_param.hpp"  
+#include "caffe/FRCNN/util/frcnn_param.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "yaml-cpp/yaml.h"
 
 namespace caffe {
@@ -67,7 +73,9 @@ void FPNProposalLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype> *> &bottom,
   if (top.size() > 1) {//fyk discard the score top
     top[1]->Reshape(1, 1, 1, 1);
   }*/
-  if (this->phase_ == TEST) {
+  // In TEST the rois are also split into one top per level, unless the net
+  // pools them with MultiLevelROIAlign and only asks for 'rois' (and scores).
+  if (this->phase_ == TEST && top.size() > 2) {
     top[1]->Reshape(1, 5, 1, 1);
     top[2]->Reshape(1, 5, 1, 1);
     top[3]->Reshape(1, 5, 1, 1);
@@ -99,6 +107,7 @@ void FPNProposalLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype> *> &bottom,
     rpn_post_nms_top_n = FrcnnParam::test_rpn_post_nms_top_n;
     rpn_nms_thresh = FrcnnParam::test_rpn_nms_thresh;
     rpn_min_size = FrcnnParam::test_rpn_min_size;
+    this->cap_top_n(&rpn_pre_nms_top_n, &rpn_post_nms_top_n);
   }
   const float im_height = bottom_im_info[0];
   const float im_width = bottom_im_info[1];
@@ -121,139 +130,189 @@ void FPNProposalLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype> *> &bottom,
  //float arr[] = {0.5, 1, 2};
  //vector<float> anchor_ratios (arr, arr+3);
   const int config_n_anchors = _anchor_ratios.size() * _anchor_scales.size();
+  const int n_fpn = _feat_strides.size();
 
-  std::vector<Point4f<Dtype> > anchors;
-  typedef pair<Dtype, int> sort_pair;
-  std::vector<sort_pair> sort_vector;
-
- //for loop
- for(int fp_i = 0; fp_i<_feat_strides.size(); fp_i++) {
-  int score_blob_ind = fp_i * 2;
-  int bbox_blob_ind  = fp_i * 2 + 1;
-  const Dtype *bottom_rpn_score = bottom[score_blob_ind]->cpu_data();  // rpn_cls_prob_reshape
-  const Dtype *bottom_rpn_bbox  = bottom[bbox_blob_ind]->cpu_data();   // rpn_bbox_pred
-  const int num = bottom[bbox_blob_ind]->num();
-  const int channes = bottom[bbox_blob_ind]->channels();
-  const int height = bottom[bbox_blob_ind]->height();
-  const int width = bottom[bbox_blob_ind]->width();
-  CHECK(num == 1) << "only single item batches are supported";
-  CHECK(channes % 4 == 0) << "rpn bbox pred channels should be divided by 4";
-
-  DLOG(ERROR) << "========== generate anchors";
-  vector<vector<int> > param_anchors = generate_anchors(_feat_strides[fp_i], _anchor_ratios, _anchor_scales);
-  
-  for (int j = 0; j < height; j++) {
-    for (int i = 0; i < width; i++) {
-      for (int k = 0; k < config_n_anchors; k++) {
-        Dtype score = bottom_rpn_score[config_n_anchors * height * width +
-                                       k * height * width + j * width + i];
-        //const int index = i * height * config_n_anchors + j * config_n_anchors + k;
-        
-        Point4f<Dtype> anchor(
-           // FrcnnParam::anchors[k * 4 + 0] + i * FrcnnParam::feat_stride,  // shift_x[i][j];
-           // FrcnnParam::anchors[k * 4 + 1] + j * FrcnnParam::feat_stride,  // shift_y[i][j];
-           // FrcnnParam::anchors[k * 4 + 2] + i * FrcnnParam::feat_stride,  // shift_x[i][j];
-           // FrcnnParam::anchors[k * 4 + 3] + j * FrcnnParam::feat_stride); // shift_y[i][j];
-           param_anchors[k][0] + i * _feat_strides[fp_i],
-           param_anchors[k][1] + j * _feat_strides[fp_i],
-           param_anchors[k][2] + i * _feat_strides[fp_i],
-           param_anchors[k][3] + j * _feat_strides[fp_i]);
-
-        Point4f<Dtype> box_delta(
-            bottom_rpn_bbox[(k * 4 + 0) * height * width + j * width + i],
-            bottom_rpn_bbox[(k * 4 + 1) * height * width + j * width + i],
-            bottom_rpn_bbox[(k * 4 + 2) * height * width + j * width + i],
-            bottom_rpn_bbox[(k * 4 + 3) * height * width + j * width + i]);
+  // Every level decodes into its own slice of flat per-coordinate arrays.
+  // Inside a slice anchors keep the (j, i, k) order of the feature map, so the
+  // flat index breaks score ties the same way the sequential scan did.
+  vector<int> level_start(n_fpn + 1, 0);
+  for (int fp_i = 0; fp_i < n_fpn; fp_i++) {
+    const Blob<Dtype> *bbox_blob = bottom[fp_i * 2 + 1];
+    CHECK(bbox_blob->num() == 1) << "only single item batches are supported";
+    CHECK(bbox_blob->channels() % 4 == 0) << "rpn bbox pred channels should be divided by 4";
+    level_start[fp_i + 1] = level_start[fp_i]
+      + config_n_anchors * bbox_blob->height() * bbox_blob->width();
+  }
+  const int n_total = level_start[n_fpn];
+  vector<Dtype> x1(n_total), y1(n_total), x2(n_total), y2(n_total);
+  vector<Dtype> scores(n_total);
+  vector<char> keep(n_total);
 
-        Point4f<Dtype> cbox = bbox_transform_inv(anchor, box_delta);
-        
-        // 2. clip predicted boxes to image
-        for (int q = 0; q < 4; q++) {
-          cbox.Point[q] = std::max(Dtype(0), std::min(cbox[q], bounds[q]));
-        }
-        // 3. remove predicted boxes with either height or width < threshold
-        if((cbox[2] - cbox[0] + 1) >= min_size && (cbox[3] - cbox[1] + 1) >= min_size) {
-          const int now_index = sort_vector.size();
-          sort_vector.push_back(sort_pair(score, now_index)); 
-          anchors.push_back(cbox);
+  DLOG(ERROR) << "========== generate anchors and decode";
+  for (int fp_i = 0; fp_i < n_fpn; fp_i++) {
+    const Dtype *bottom_rpn_score = bottom[fp_i * 2]->cpu_data();      // rpn_cls_prob_reshape
+    const Dtype *bottom_rpn_bbox  = bottom[fp_i * 2 + 1]->cpu_data();  // rpn_bbox_pred
+    const int height = bottom[fp_i * 2 + 1]->height();
+    const int width = bottom[fp_i * 2 + 1]->width();
+    const int feat_stride = _feat_strides[fp_i];
+    const int plane = height * width;
+    const int start = level_start[fp_i];
+    vector<vector<int> > param_anchors = generate_anchors(feat_stride, _anchor_ratios, _anchor_scales);
+#pragma omp parallel for
+    for (int j = 0; j < height; j++) {
+      for (int i = 0; i < width; i++) {
+        for (int k = 0; k < config_n_anchors; k++) {
+          const int index = start + (j * width + i) * config_n_anchors + k;
+          Point4f<Dtype> anchor(
+             param_anchors[k][0] + i * feat_stride,
+             param_anchors[k][1] + j * feat_stride,
+             param_anchors[k][2] + i * feat_stride,
+             param_anchors[k][3] + j * feat_stride);
+          Point4f<Dtype> box_delta(
+              bottom_rpn_bbox[(k * 4 + 0) * plane + j * width + i],
+              bottom_rpn_bbox[(k * 4 + 1) * plane + j * width + i],
+              bottom_rpn_bbox[(k * 4 + 2) * plane + j * width + i],
+              bottom_rpn_bbox[(k * 4 + 3) * plane + j * width + i]);
+          Point4f<Dtype> cbox = bbox_transform_inv(anchor, box_delta);
+          // 2. clip predicted boxes to image
+          for (int q = 0; q < 4; q++) {
+            cbox.Point[q] = std::max(Dtype(0), std::min(cbox[q], bounds[q]));
+          }
+          x1[index] = cbox[0];
+          y1[index] = cbox[1];
+          x2[index] = cbox[2];
+          y2[index] = cbox[3];
+          scores[index] = bottom_rpn_score[config_n_anchors * plane + k * plane + j * width + i];
+          // 3. remove predicted boxes with either height or width < threshold
+          keep[index] = (cbox[2] - cbox[0] + 1) >= min_size && (cbox[3] - cbox[1] + 1) >= min_size;
         }
       }
     }
   }
- }//end loop FPN
-  DLOG(ERROR) << "========== after clip and remove size < threshold box " << (int)sort_vector.size();
 
-  std::sort(sort_vector.begin(), sort_vector.end(), std::greater<sort_pair>());
-  const int n_anchors = std::min((int)sort_vector.size(), rpn_pre_nms_top_n);
-  sort_vector.erase(sort_vector.begin() + n_anchors, sort_vector.end());
-  //anchors.erase(anchors.begin() + n_anchors, anchors.end());
+  // Any box of the global pre-nms top n is also in the top n of its own level,
+  // so each level only partially sorts its own candidates.
+  typedef pair<Dtype, int> sort_pair;
+  vector<vector<sort_pair> > level_top(n_fpn);
+#pragma omp parallel for
+  for (int fp_i = 0; fp_i < n_fpn; fp_i++) {
+    vector<sort_pair> &candidates = level_top[fp_i];
+    for (int index = level_start[fp_i]; index < level_start[fp_i + 1]; index++) {
+      if (keep[index]) {
+        candidates.push_back(sort_pair(scores[index], index));
+      }
+    }
+    if (static_cast<int>(candidates.size()) > rpn_pre_nms_top_n) {
+      std::nth_element(candidates.begin(), candidates.begin() + rpn_pre_nms_top_n,
+          candidates.end(), std::greater<sort_pair>());
+      candidates.resize(rpn_pre_nms_top_n);
+    }
+    std::sort(candidates.begin(), candidates.end(), std::greater<sort_pair>());
+  }
+
+  // k-way merge of the sorted levels into the global pre-nms order.
+  typedef pair<sort_pair, int> merge_item;  // (head of a level, level)
+  std::priority_queue<merge_item> heads;
+  vector<int> level_pos(n_fpn, 0);
+  for (int fp_i = 0; fp_i < n_fpn; fp_i++) {
+    if (!level_top[fp_i].empty()) {
+      heads.push(merge_item(level_top[fp_i][0], fp_i));
+    }
+  }
+  vector<sort_pair> sort_vector;
+  sort_vector.reserve(rpn_pre_nms_top_n);
+  while (!heads.empty() && static_cast<int>(sort_vector.size()) < rpn_pre_nms_top_n) {
+    const int fp_i = heads.top().second;
+    sort_vector.push_back(heads.top().first);
+    heads.pop();
+    if (++level_pos[fp_i] < static_cast<int>(level_top[fp_i].size())) {
+      heads.push(merge_item(level_top[fp_i][level_pos[fp_i]], fp_i));
+    }
+  }
+  const int n_anchors = sort_vector.size();
   std::vector<bool> select(n_anchors, true);
 
-  // apply nms
+  // apply nms, serially: a box is only suppressed by the boxes kept before it,
+  // so this loop stops early once rpn_post_nms_top_n boxes are kept.
   DLOG(ERROR) << "========== apply nms, pre nms number is : " << n_anchors;
-  std::vector<Point4f<Dtype> > box_final;
-  std::vector<Dtype> scores_;
-  for (int i = 0; i < n_anchors && box_final.size() < rpn_post_nms_top_n; i++) {
+  std::vector<Point4f<Dtype> > anchors(n_anchors);
+  for (int i = 0; i < n_anchors; i++) {
+    const int index = sort_vector[i].second;
+    anchors[i] = Point4f<Dtype>(x1[index], y1[index], x2[index], y2[index]);
+  }
+  std::vector<int> keep_indices;
+  for (int i = 0; i < n_anchors && static_cast<int>(keep_indices.size()) < rpn_post_nms_top_n; i++) {
     if (select[i]) {
-      const int cur_i = sort_vector[i].second;
       for (int j = i + 1; j < n_anchors; j++)
         if (select[j]) {
-          const int cur_j = sort_vector[j].second;
-          if (get_iou(anchors[cur_i], anchors[cur_j]) > rpn_nms_thresh) {
+          if (get_iou(anchors[i], anchors[j]) > rpn_nms_thresh) {
             select[j] = false;
           }
         }
-      box_final.push_back(anchors[cur_i]);
-      scores_.push_back(sort_vector[i].first);
+      keep_indices.push_back(i);
     }
   }
+  const int n_keep = keep_indices.size();
 
-  DLOG(ERROR) << "rpn number after nms: " <<  box_final.size();
+  DLOG(ERROR) << "rpn number after nms: " << n_keep;
 
   DLOG(ERROR) << "========== copy to top";
   int n_level = 0; // fpn_levels
-  if (this->phase_ == TEST) {
+  // Position of each kept roi in top[0]; identity unless rois are split.
+  vector<int> position(n_keep);
+  for (int i = 0; i < n_keep; i++) {
+    position[i] = i;
+  }
+  int n_rois = n_keep;
+  vector<int> level_offset;
+  if (this->phase_ == TEST && top.size() > 2) {
     n_level = 4;
-    vector<vector<Point4f<Dtype> > > level_rois (n_level);
-    vector<vector<Dtype> > level_scores (n_level, vector<Dtype>());
-    for (size_t i = 0; i < box_final.size(); i++) {
-      int level_idx = calc_level(box_final[i], n_level + 1) - 2;
-      level_rois[level_idx].push_back(box_final[i]);
-      level_scores[level_idx].push_back(scores_[i]);
+    // Counting sort of the rois by level, which keeps the score order inside
+    // each level. An empty level gets one dummy zero roi.
+    vector<int> levels(n_keep);
+    vector<int> level_count(n_level, 0);
+    for (int i = 0; i < n_keep; i++) {
+      levels[i] = calc_level(anchors[keep_indices[i]], n_level + 1) - 2;
+      level_count[levels[i]]++;
     }
-    // top_data[0] also need change
-    box_final.clear();
-    scores_.clear();
-    for (size_t j = 0; j < n_level; j++) {
-      if (level_rois[j].size() == 0) {
-        level_rois[j].push_back(Point4f<Dtype>());
-        box_final.push_back(Point4f<Dtype>());
-        scores_.push_back(0);
-      } else {
-        box_final.insert(box_final.end(), level_rois[j].begin(), level_rois[j].end());
-        scores_.insert(scores_.end(), level_scores[j].begin(), level_scores[j].end());
-      }
+    level_offset.resize(n_level + 1, 0);
+    for (int l = 0; l < n_level; l++) {
+      level_offset[l + 1] = level_offset[l] + std::max(level_count[l], 1);
+    }
+    n_rois = level_offset[n_level];
+    vector<int> level_fill(level_offset.begin(), level_offset.end() - 1);
+    for (int i = 0; i < n_keep; i++) {
+      position[i] = level_fill[levels[i]]++;
     }
-    split_top_rois_by_level(top,1,level_rois);
   }
   //train phase has proposal target layer,so there only output 1 total blob
-  top[0]->Reshape(box_final.size(), 5, 1, 1);
+  top[0]->Reshape(n_rois, 5, 1, 1);
   Dtype *top_data = top[0]->mutable_cpu_data();
-  CHECK_EQ(box_final.size(), scores_.size());
-  for (size_t i = 0; i < box_final.size(); i++) {
-    Point4f<Dtype> &box = box_final[i];
-    top_data[i * 5] = 0;
-    for (int j = 1; j < 5; j++) {
-      top_data[i * 5 + j] = box[j - 1];
-    }
-  }
+  caffe_set(top[0]->count(), Dtype(0), top_data);
+  Dtype *top_scores = NULL;
   // optional score output
   if (top.size() > 1 + n_level) {
-    top[1 + n_level]->Reshape(box_final.size(), 1, 1, 1);
-    for (size_t i = 0; i < box_final.size(); i++) {
-      top[1 + n_level]->mutable_cpu_data()[i] = scores_[i];
+    top[1 + n_level]->Reshape(n_rois, 1, 1, 1);
+    top_scores = top[1 + n_level]->mutable_cpu_data();
+    caffe_set(n_rois, Dtype(0), top_scores);
+  }
+  for (int i = 0; i < n_keep; i++) {
+    const Point4f<Dtype> &box = anchors[keep_indices[i]];
+    Dtype *roi = top_data + position[i] * 5;
+    for (int j = 1; j < 5; j++) {
+      roi[j] = box[j - 1];
+    }
+    if (top_scores) {
+      top_scores[position[i]] = sort_vector[keep_indices[i]].first;
     }
   }
+  // The per-level tops are contiguous slices of top[0].
+  for (int l = 0; l < n_level; l++) {
+    const int count = level_offset[l + 1] - level_offset[l];
+    top[1 + l]->Reshape(count, 5, 1, 1);
+    caffe_copy(count * 5, top_data + level_offset[l] * 5,
+        top[1 + l]->mutable_cpu_data());
+  }
 
   DLOG(ERROR) << "========== exit proposal layer";
 }
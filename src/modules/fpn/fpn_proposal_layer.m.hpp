@@ -11,6 +11,7 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/FRCNN/frcnn_proposal_layer.hpp"
 
 namespace caffe {
 
@@ -26,7 +27,7 @@ bottom: 'im_info'
 top: 'rpn_rois'
 **************************************************/
 template <typename Dtype>
-class FPNProposalLayer : public Layer<Dtype> {
+class FPNProposalLayer : public Layer<Dtype>, public ProposalCap {
  public:
   explicit FPNProposalLayer(const LayerParameter& param)
 #ifndef CPU_ONLY //fyk: fix problem of runtest
@@ -0,0 +1,256 @@
+// ------------------------------------------------------------------
+// FPN
+// Written by github.com/makefile
+// ------------------------------------------------------------------
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "fpn_utils.hpp"
+#include "multilevel_roi_align_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "yaml-cpp/yaml.h"
+
+namespace caffe {
+
+namespace Frcnn {
+
+using std::max;
+using std::min;
+
+static double cubic_coeff(double x) {
+  x = (x > 0) ? x : -x;
+  if (x < 1) {
+    return 1 - 2 * x * x + x * x * x;
+  } else if (x < 2) {
+    return 4 - 8 * x + 5 * x * x - x * x * x;
+  }
+  return 0;
+}
+
+// Neighbours and weights of every bin of one roi (taps = 4 for bilinear, 16
+// for bicubic), sampled at the bin centers exactly as ROIAlignLayer does with
+// pad_ratio 0.
+template <typename Dtype>
+static void roi_align_bins(const Dtype* roi, const Dtype spatial_scale,
+    const int height, const int width, const int pooled_height,
+    const int pooled_width, const int taps, int* index, Dtype* weight) {
+  Dtype roi_start_w = max(roi[1] * spatial_scale, Dtype(0));
+  Dtype roi_start_h = max(roi[2] * spatial_scale, Dtype(0));
+  const int img_width = round(width / spatial_scale);
+  const int img_height = round(height / spatial_scale);
+  Dtype roi_end_w = min(Dtype(img_width - 1), roi[3] * spatial_scale);
+  Dtype roi_end_h = min(Dtype(img_height - 1), roi[4] * spatial_scale);
+  const Dtype roi_height = max(roi_end_h - roi_start_h + 1, Dtype(1));
+  const Dtype roi_width = max(roi_end_w - roi_start_w + 1, Dtype(1));
+  const Dtype bin_size_h = roi_height / static_cast<Dtype>(pooled_height);
+  const Dtype bin_size_w = roi_width / static_cast<Dtype>(pooled_width);
+  for (int ph = 0; ph < pooled_height; ++ph) {
+    for (int pw = 0; pw < pooled_width; ++pw) {
+      Dtype hcenter = static_cast<Dtype>(ph + 0.5) * bin_size_h;
+      Dtype wcenter = static_cast<Dtype>(pw + 0.5) * bin_size_w;
+      hcenter = min(max(hcenter + roi_start_h, Dtype(0)), Dtype(height - 1));
+      wcenter = min(max(wcenter + roi_start_w, Dtype(0)), Dtype(width - 1));
+      const int hstart = hcenter;
+      const int wstart = wcenter;
+      int *bin_index = index + taps * (ph * pooled_width + pw);
+      Dtype *bin_weight = weight + taps * (ph * pooled_width + pw);
+      if (taps == 16) {
+        double A[4], C[4];
+        for (int distance = 1, s = 0; distance >= -2; distance--, s++) {
+          A[s] = cubic_coeff(wcenter - wstart + distance);
+          C[s] = cubic_coeff(hcenter - hstart + distance);
+        }
+        for (int s = 0; s < 4; s++) {
+          const int r = min(max(hstart - 1 + s, 0), height - 1);
+          for (int t = 0; t < 4; t++) {
+            const int c = min(max(wstart - 1 + t, 0), width - 1);
+            bin_index[s * 4 + t] = r * width + c;
+            bin_weight[s * 4 + t] = A[t] * C[s];
+          }
+        }
+      } else {
+        const int hend = min(hstart + 1, height - 1);
+        const int wend = min(wstart + 1, width - 1);
+        const Dtype fX0 = wcenter - wstart;
+        const Dtype fX1 = wend - wcenter;
+        const Dtype fY0 = hcenter - hstart;
+        const Dtype fY1 = hend - hcenter;
+        bin_index[0] = hstart * width + wstart;
+        bin_index[1] = hstart * width + wend;
+        bin_index[2] = hend * width + wstart;
+        bin_index[3] = hend * width + wend;
+        bin_weight[0] = fY1 * fX1;
+        bin_weight[1] = fY1 * fX0;
+        bin_weight[2] = fY0 * fX1;
+        bin_weight[3] = fY0 * fX0;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void MultiLevelROIAlignLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype> *> &bottom, const vector<Blob<Dtype> *> &top) {
+  YAML::Node params = YAML::Load(this->layer_param_.module_param().param_str());
+  CHECK(params["spatial_scales"]) << "not found as parameter.";
+  spatial_scales_.clear();
+  for (std::size_t i = 0; i < params["spatial_scales"].size(); i++) {
+    spatial_scales_.push_back(params["spatial_scales"][i].as<float>());
+  }
+  pooled_height_ = params["pooled_h"] ? params["pooled_h"].as<int>() : 7;
+  pooled_width_ = params["pooled_w"] ? params["pooled_w"].as<int>() : 7;
+  CHECK_GT(pooled_height_, 0) << "pooled_h must be > 0";
+  CHECK_GT(pooled_width_, 0) << "pooled_w must be > 0";
+  // Same default as roi_pooling_param.bi_type: 0 bilinear, 1 bicubic.
+  const int bi_type = params["bi_type"] ? params["bi_type"].as<int>() : 1;
+  CHECK(bi_type == 0 || bi_type == 1) << "bi_type must be 0 or 1.";
+  taps_ = bi_type == 1 ? 16 : 4;
+  n_level_ = bottom.size() - 1;
+  CHECK_EQ(spatial_scales_.size(), n_level_)
+    << "One spatial scale is needed for each pyramid level.";
+}
+
+template <typename Dtype>
+void MultiLevelROIAlignLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype> *> &bottom, const vector<Blob<Dtype> *> &top) {
+  channels_ = bottom[0]->channels();
+  for (int level = 1; level < n_level_; level++) {
+    CHECK_EQ(bottom[level]->num(), bottom[0]->num());
+    CHECK_EQ(bottom[level]->channels(), channels_);
+  }
+  top[0]->Reshape(bottom[n_level_]->num(), channels_, pooled_height_,
+      pooled_width_);
+}
+
+template <typename Dtype>
+void MultiLevelROIAlignLayer<Dtype>::assign_levels(
+    const vector<Blob<Dtype> *> &bottom) {
+  const Dtype *bottom_rois = bottom[n_level_]->cpu_data();
+  const int num_rois = bottom[n_level_]->num();
+  const int batch_size = bottom[0]->num();
+  roi_levels_.resize(num_rois);
+  level_starts_.assign(n_level_ + 1, 0);
+  for (int n = 0; n < num_rois; n++) {
+    const Dtype *roi = bottom_rois + n * 5;
+    CHECK_GE(roi[0], 0);
+    CHECK_LT(roi[0], batch_size);
+    Point4f<Dtype> box(roi[1], roi[2], roi[3], roi[4]);
+    roi_levels_[n] = calc_level(box, n_level_ + 1) - 2;
+    level_starts_[roi_levels_[n] + 1]++;
+  }
+  for (int level = 0; level < n_level_; level++) {
+    level_starts_[level + 1] += level_starts_[level];
+  }
+  level_rois_.Reshape(vector<int>(1, std::max(num_rois, 1)));
+  int *level_rois = level_rois_.mutable_cpu_data();
+  vector<int> next(level_starts_.begin(), level_starts_.end() - 1);
+  for (int n = 0; n < num_rois; n++) {
+    level_rois[next[roi_levels_[n]]++] = n;
+  }
+}
+
+template <typename Dtype>
+void MultiLevelROIAlignLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype> *> &bottom, const vector<Blob<Dtype> *> &top) {
+  const Dtype *bottom_rois = bottom[n_level_]->cpu_data();
+  const int num_rois = bottom[n_level_]->num();
+  const int pooled_size = pooled_height_ * pooled_width_;
+  Dtype *top_data = top[0]->mutable_cpu_data();
+  assign_levels(bottom);
+  // Outside the loop: cpu_data syncs the SyncedMemory of the level.
+  vector<const Dtype *> level_data(n_level_);
+  for (int level = 0; level < n_level_; level++) {
+    level_data[level] = bottom[level]->cpu_data();
+  }
+  // Every roi writes its own rows of top, so rois are pooled in parallel.
+#pragma omp parallel for
+  for (int n = 0; n < num_rois; n++) {
+    const Dtype *roi = bottom_rois + n * 5;
+    const Blob<Dtype> *feature = bottom[roi_levels_[n]];
+    const int height = feature->height();
+    const int width = feature->width();
+    vector<int> index(taps_ * pooled_size);
+    vector<Dtype> weight(taps_ * pooled_size);
+    roi_align_bins(roi, spatial_scales_[roi_levels_[n]], height, width,
+        pooled_height_, pooled_width_, taps_, &index[0], &weight[0]);
+    const Dtype *batch_data = level_data[roi_levels_[n]]
+      + feature->offset(static_cast<int>(roi[0]));
+    Dtype *roi_top = top_data + top[0]->offset(n);
+    for (int c = 0; c < channels_; c++) {
+      const Dtype *channel_data = batch_data + c * height * width;
+      Dtype *channel_top = roi_top + c * pooled_size;
+      for (int i = 0; i < pooled_size; i++) {
+        const int *idx = &index[taps_ * i];
+        const Dtype *w = &weight[taps_ * i];
+        Dtype value = 0;
+        for (int k = 0; k < taps_; k++) {
+          value += channel_data[idx[k]] * w[k];
+        }
+        channel_top[i] = value;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void MultiLevelROIAlignLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype> *> &top, const vector<bool> &propagate_down,
+    const vector<Blob<Dtype> *> &bottom) {
+  if (propagate_down[n_level_]) {
+    LOG(FATAL) << this->type()
+      << " Layer cannot backpropagate to roi inputs.";
+  }
+  vector<Dtype *> level_diff(n_level_, static_cast<Dtype *>(NULL));
+  for (int level = 0; level < n_level_; level++) {
+    if (propagate_down[level]) {
+      level_diff[level] = bottom[level]->mutable_cpu_diff();
+      caffe_set(bottom[level]->count(), Dtype(0), level_diff[level]);
+    }
+  }
+  const Dtype *bottom_rois = bottom[n_level_]->cpu_data();
+  const Dtype *top_diff = top[0]->cpu_diff();
+  const int num_rois = bottom[n_level_]->num();
+  const int pooled_size = pooled_height_ * pooled_width_;
+  vector<int> index(taps_ * pooled_size);
+  vector<Dtype> weight(taps_ * pooled_size);
+  // Rois may overlap, so they are accumulated one after the other and only
+  // the channels run in parallel.
+  for (int n = 0; n < num_rois; n++) {
+    const int level = roi_levels_[n];
+    if (!propagate_down[level]) {
+      continue;
+    }
+    const Dtype *roi = bottom_rois + n * 5;
+    const Blob<Dtype> *feature = bottom[level];
+    const int height = feature->height();
+    const int width = feature->width();
+    roi_align_bins(roi, spatial_scales_[level], height, width,
+        pooled_height_, pooled_width_, taps_, &index[0], &weight[0]);
+    Dtype *batch_diff = level_diff[level]
+      + feature->offset(static_cast<int>(roi[0]));
+    const Dtype *roi_top_diff = top_diff + top[0]->offset(n);
+#pragma omp parallel for
+    for (int c = 0; c < channels_; c++) {
+      Dtype *channel_diff = batch_diff + c * height * width;
+      const Dtype *channel_top_diff = roi_top_diff + c * pooled_size;
+      for (int i = 0; i < pooled_size; i++) {
+        for (int k = 0; k < taps_; k++) {
+          channel_diff[index[taps_ * i + k]] +=
+            channel_top_diff[i] * weight[taps_ * i + k];
+        }
+      }
+    }
+  }
+}
+
+#ifdef CPU_ONLY
+STUB_GPU(MultiLevelROIAlignLayer);
+#endif
+
+INSTANTIATE_CLASS(MultiLevelROIAlignLayer);
+EXPORT_LAYER_MODULE_CLASS(MultiLevelROIAlign);
+
+} // namespace frcnn
+
+} // namespace caffe
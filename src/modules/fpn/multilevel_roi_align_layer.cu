@@ -0,0 +1,196 @@
+// ------------------------------------------------------------------
+// FPN
+// Written by github.com/makefile
+// ------------------------------------------------------------------
+#include <vector>
+
+#include "multilevel_roi_align_layer.hpp"
+#include "caffe/util/gpu_util.cuh"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+namespace Frcnn {
+
+inline __device__ double cubic_coeff_gpu(double x) {
+  x = (x > 0) ? x : -x;
+  if (x < 1) {
+    return 1 - 2 * x * x + x * x * x;
+  } else if (x < 2) {
+    return 4 - 8 * x + 5 * x * x - x * x * x;
+  }
+  return 0;
+}
+
+// Neighbours and weights of bin (ph, pw) of roi, as roi_align_bins computes
+// them on the CPU; returns their number.
+template <typename Dtype>
+__device__ int roi_align_bin(const Dtype* roi, const Dtype spatial_scale,
+    const int height, const int width, const int pooled_height,
+    const int pooled_width, const int ph, const int pw, const bool bicubic,
+    int* index, Dtype* weight) {
+  const Dtype roi_start_w = max(roi[1] * spatial_scale, Dtype(0));
+  const Dtype roi_start_h = max(roi[2] * spatial_scale, Dtype(0));
+  const int img_width = round(width / spatial_scale);
+  const int img_height = round(height / spatial_scale);
+  const Dtype roi_end_w = min(Dtype(img_width - 1), roi[3] * spatial_scale);
+  const Dtype roi_end_h = min(Dtype(img_height - 1), roi[4] * spatial_scale);
+  const Dtype roi_height = max(roi_end_h - roi_start_h + 1, Dtype(1));
+  const Dtype roi_width = max(roi_end_w - roi_start_w + 1, Dtype(1));
+  const Dtype bin_size_h = roi_height / static_cast<Dtype>(pooled_height);
+  const Dtype bin_size_w = roi_width / static_cast<Dtype>(pooled_width);
+  Dtype hcenter = static_cast<Dtype>(ph + 0.5) * bin_size_h;
+  Dtype wcenter = static_cast<Dtype>(pw + 0.5) * bin_size_w;
+  hcenter = min(max(hcenter + roi_start_h, Dtype(0)), Dtype(height - 1));
+  wcenter = min(max(wcenter + roi_start_w, Dtype(0)), Dtype(width - 1));
+  const int hstart = hcenter;
+  const int wstart = wcenter;
+  if (bicubic) {
+    double A[4], C[4];
+    for (int distance = 1, s = 0; distance >= -2; distance--, s++) {
+      A[s] = cubic_coeff_gpu(wcenter - wstart + distance);
+      C[s] = cubic_coeff_gpu(hcenter - hstart + distance);
+    }
+    for (int s = 0; s < 4; s++) {
+      const int r = min(max(hstart - 1 + s, 0), height - 1);
+      for (int t = 0; t < 4; t++) {
+        const int c = min(max(wstart - 1 + t, 0), width - 1);
+        index[s * 4 + t] = r * width + c;
+        weight[s * 4 + t] = A[t] * C[s];
+      }
+    }
+    return 16;
+  }
+  const int hend = min(hstart + 1, height - 1);
+  const int wend = min(wstart + 1, width - 1);
+  const Dtype fX0 = wcenter - wstart;
+  const Dtype fX1 = wend - wcenter;
+  const Dtype fY0 = hcenter - hstart;
+  const Dtype fY1 = hend - hcenter;
+  index[0] = hstart * width + wstart;
+  index[1] = hstart * width + wend;
+  index[2] = hend * width + wstart;
+  index[3] = hend * width + wend;
+  weight[0] = fY1 * fX1;
+  weight[1] = fY1 * fX0;
+  weight[2] = fY0 * fX1;
+  weight[3] = fY0 * fX0;
+  return 4;
+}
+
+// One thread per output of the rois level_rois of a single level.
+template <typename Dtype>
+__global__ void MultiLevelROIAlignForward(const int nthreads,
+    const Dtype* feature, const Dtype spatial_scale, const int channels,
+    const int height, const int width, const int pooled_height,
+    const int pooled_width, const bool bicubic, const Dtype* rois,
+    const int* level_rois, Dtype* top_data) {
+  CUDA_KERNEL_LOOP(i, nthreads) {
+    const int pw = i % pooled_width;
+    const int ph = (i / pooled_width) % pooled_height;
+    const int c = (i / pooled_width / pooled_height) % channels;
+    const int n = level_rois[i / pooled_width / pooled_height / channels];
+    const Dtype* roi = rois + n * 5;
+    int index[16];
+    Dtype weight[16];
+    const int taps = roi_align_bin(roi, spatial_scale, height, width,
+        pooled_height, pooled_width, ph, pw, bicubic, index, weight);
+    const Dtype* channel_data = feature
+        + (static_cast<int>(roi[0]) * channels + c) * height * width;
+    Dtype value = 0;
+    for (int k = 0; k < taps; k++) {
+      value += channel_data[index[k]] * weight[k];
+    }
+    top_data[((n * channels + c) * pooled_height + ph) * pooled_width + pw] =
+        value;
+  }
+}
+
+// Rois may overlap, so the gradients are added atomically.
+template <typename Dtype>
+__global__ void MultiLevelROIAlignBackward(const int nthreads,
+    const Dtype* top_diff, const Dtype spatial_scale, const int channels,
+    const int height, const int width, const int pooled_height,
+    const int pooled_width, const bool bicubic, const Dtype* rois,
+    const int* level_rois, Dtype* feature_diff) {
+  CUDA_KERNEL_LOOP(i, nthreads) {
+    const int pw = i % pooled_width;
+    const int ph = (i / pooled_width) % pooled_height;
+    const int c = (i / pooled_width / pooled_height) % channels;
+    const int n = level_rois[i / pooled_width / pooled_height / channels];
+    const Dtype* roi = rois + n * 5;
+    int index[16];
+    Dtype weight[16];
+    const int taps = roi_align_bin(roi, spatial_scale, height, width,
+        pooled_height, pooled_width, ph, pw, bicubic, index, weight);
+    Dtype* channel_diff = feature_diff
+        + (static_cast<int>(roi[0]) * channels + c) * height * width;
+    const Dtype diff =
+        top_diff[((n * channels + c) * pooled_height + ph) * pooled_width + pw];
+    for (int k = 0; k < taps; k++) {
+      caffe_gpu_atomic_add(diff * weight[k], channel_diff + index[k]);
+    }
+  }
+}
+
+template <typename Dtype>
+void MultiLevelROIAlignLayer<Dtype>::Forward_gpu(
+    const vector<Blob<Dtype> *> &bottom, const vector<Blob<Dtype> *> &top) {
+  // The levels are assigned on the CPU, the rois are few.
+  assign_levels(bottom);
+  const Dtype *bottom_rois = bottom[n_level_]->gpu_data();
+  const int *level_rois = level_rois_.gpu_data();
+  Dtype *top_data = top[0]->mutable_gpu_data();
+  for (int level = 0; level < n_level_; level++) {
+    const int count = (level_starts_[level + 1] - level_starts_[level])
+        * channels_ * pooled_height_ * pooled_width_;
+    if (count == 0) {
+      continue;
+    }
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    MultiLevelROIAlignForward<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, bottom[level]->gpu_data(),
+        spatial_scales_[level], channels_, bottom[level]->height(),
+        bottom[level]->width(), pooled_height_, pooled_width_, taps_ == 16,
+        bottom_rois, level_rois + level_starts_[level], top_data);
+    CUDA_POST_KERNEL_CHECK;
+  }
+}
+
+template <typename Dtype>
+void MultiLevelROIAlignLayer<Dtype>::Backward_gpu(
+    const vector<Blob<Dtype> *> &top, const vector<bool> &propagate_down,
+    const vector<Blob<Dtype> *> &bottom) {
+  if (propagate_down[n_level_]) {
+    LOG(FATAL) << this->type()
+      << " Layer cannot backpropagate to roi inputs.";
+  }
+  const Dtype *bottom_rois = bottom[n_level_]->gpu_data();
+  const int *level_rois = level_rois_.gpu_data();
+  const Dtype *top_diff = top[0]->gpu_diff();
+  for (int level = 0; level < n_level_; level++) {
+    if (!propagate_down[level]) {
+      continue;
+    }
+    Dtype *feature_diff = bottom[level]->mutable_gpu_diff();
+    caffe_gpu_set(bottom[level]->count(), Dtype(0), feature_diff);
+    const int count = (level_starts_[level + 1] - level_starts_[level])
+        * channels_ * pooled_height_ * pooled_width_;
+    if (count == 0) {
+      continue;
+    }
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    MultiLevelROIAlignBackward<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, top_diff, spatial_scales_[level],
+        channels_, bottom[level]->height(), bottom[level]->width(),
+        pooled_height_, pooled_width_, taps_ == 16, bottom_rois,
+        level_rois + level_starts_[level], feature_diff);
+    CUDA_POST_KERNEL_CHECK;
+  }
+}
+
+INSTANTIATE_LAYER_GPU_FUNCS(MultiLevelROIAlignLayer);
+
+}  // namespace Frcnn
+
+}  // namespace caffe
@@ -0,0 +1,82 @@
+// ------------------------------------------------------------------
+// FPN
+// Written by github.com/makefile
+// ------------------------------------------------------------------
+#ifndef CAFFE_MULTILEVEL_ROI_ALIGN_LAYER_HPP_
+#define CAFFE_MULTILEVEL_ROI_ALIGN_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+namespace Frcnn {
+
+/*************************************************
+MultiLevelROIAlign pools every roi from the pyramid level chosen by
+calc_level, in a single layer: no per-level roi blobs, no dummy rois and no
+concat. Output n is the pooled feature of roi n, so rois keep their order.
+The sampling is the same as ROIAlign with pad_ratio 0: one point per bin,
+bicubic by default or bilinear with 'bi_type': 0.
+
+bottom: "fpn_p2" ... bottom: "fpn_p5"  (levels P2 .. P(k+1))
+bottom: "rois"                         (R x 5)
+top: "roi_pool"                        (R x C x pooled_h x pooled_w)
+type: "Module"
+module_param {
+  module: "modules"
+  type: "MultiLevelROIAlign"
+  param_str: "{'spatial_scales': [0.25, 0.125, 0.0625, 0.03125], 'pooled_h': 7, 'pooled_w': 7}"
+}
+**************************************************/
+template <typename Dtype>
+class MultiLevelROIAlignLayer : public Layer<Dtype> {
+ public:
+  explicit MultiLevelROIAlignLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "MultiLevelROIAlign"; }
+
+  virtual inline int MinBottomBlobs() const { return 2; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // Fills roi_levels_, level_rois_ and level_starts_ from the rois.
+  void assign_levels(const vector<Blob<Dtype>*>& bottom);
+
+  // Pyramid level of each roi, as an index into bottom, filled by Forward.
+  vector<int> roi_levels_;
+  // The rois of every level, by index, level after level: those of level l
+  // start at level_starts_[l]. The GPU pools one level at a time.
+  Blob<int> level_rois_;
+  vector<int> level_starts_;
+  vector<Dtype> spatial_scales_;
+  int n_level_;
+  int channels_;
+  int pooled_height_;
+  int pooled_width_;
+  int taps_;  // interpolation neighbours per bin: 4 bilinear, 16 bicubic
+};
+
+}  // namespace frcnn
+
+}  // namespace caffe
+
+#endif  // CAFFE_MULTILEVEL_ROI_ALIGN_LAYER_HPP_
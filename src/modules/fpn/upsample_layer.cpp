@@ -16,7 +16,14 @@ layer {
     param_str: "{'scale': 2}"
   }
 }
+
+In the FPN top-down path the lateral 1x1 conv can be given as a second bottom,
+which replaces the Eltwise SUM that follows the upsample:
+  bottom: "fpn_p5"
+  bottom: "fpn_inner_res4"
+  top: "fpn_p4_sum"
 */
+#include <algorithm>
 #include <vector>
 #include "upsample_layer.hpp"
 #include "yaml-cpp/yaml.h"
@@ -39,36 +46,56 @@ void UpsampleLayer<Dtype>::LayerSetUp(
 template <typename Dtype>
 void UpsampleLayer<Dtype>::Reshape(
   const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  vector<int> out_shape;
-  for (int i = 0; i < bottom[0]->num_axes(); i++) {
-    out_shape.push_back(bottom[0]->shape(i));
+  CHECK_EQ(4, bottom[0]->num_axes()) << "Upsample expects N x C x H x W input.";
+  vector<int> out_shape(bottom[0]->shape());
+  out_shape[2] *= scale_;
+  out_shape[3] *= scale_;
+  if (bottom.size() > 1) {
+    CHECK(bottom[1]->shape() == out_shape)
+      << "The lateral bottom must have the upsampled shape of bottom 0, got "
+      << bottom[1]->shape_string();
   }
-
-  out_shape[bottom[0]->num_axes() - 1] *= scale_;
-  out_shape[bottom[0]->num_axes() - 2] *= scale_;
   top[0]->Reshape(out_shape);
 }
 
 template <typename Dtype>
 void UpsampleLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-
-  int N = top[0]->shape(0);
-  int C = top[0]->shape(1);
-  int H = top[0]->shape(2);
-  int W = top[0]->shape(3);
-
+  const int planes = bottom[0]->shape(0) * bottom[0]->shape(1);
+  const int height = bottom[0]->shape(2);
+  const int width = bottom[0]->shape(3);
+  const int top_width = width * scale_;
+  const int top_plane = height * scale_ * top_width;
   const Dtype *input = bottom[0]->cpu_data();
+  const Dtype *lateral = bottom.size() > 1 ? bottom[1]->cpu_data() : NULL;
   Dtype *output = top[0]->mutable_cpu_data();
-  for (int n = 0; n < N; n++) {
-    for (int c = 0; c < C; c++) {
-      for (int h = 0; h < H; h++) {
-        for (int w = 0; w < W; w++) {
-          int nw = w/scale_;
-          int nh = h/scale_;
-          int out_idx = (((n * C + c) * H) + h) * W + w;
-          int in_idx = (((n * C + c) * (H / scale_)) + nh) * (W / scale_) + nw;
-          output[out_idx] = input[in_idx];
+#pragma omp parallel for
+  for (int p = 0; p < planes; p++) {
+    for (int h = 0; h < height; h++) {
+      const Dtype *in_row = input + (p * height + h) * width;
+      Dtype *out_row = output + p * top_plane + h * scale_ * top_width;
+      if (lateral == NULL) {
+        // Replicate the columns once, then copy the row scale_ - 1 times
+        // (std::copy: caffe_copy reads the mode of the calling thread, which
+        // is not set in the OpenMP workers).
+        for (int w = 0; w < width; w++) {
+          for (int s = 0; s < scale_; s++) {
+            out_row[w * scale_ + s] = in_row[w];
+          }
+        }
+        for (int s = 1; s < scale_; s++) {
+          std::copy(out_row, out_row + top_width, out_row + s * top_width);
+        }
+      } else {
+        const Dtype *lat_row = lateral + (out_row - output);
+        for (int s = 0; s < scale_; s++) {
+          for (int w = 0; w < width; w++) {
+            for (int t = 0; t < scale_; t++) {
+              out_row[w * scale_ + t] = in_row[w] + lat_row[w * scale_ + t];
+            }
+          }
+          out_row += top_width;
+          lat_row += top_width;
         }
       }
     }
@@ -78,28 +105,30 @@ void UpsampleLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void UpsampleLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  int N = bottom[0]->shape(0);
-  int C = bottom[0]->shape(1);
-  int H = bottom[0]->shape(2);
-  int W = bottom[0]->shape(3);
+  if (bottom.size() > 1 && propagate_down[1]) {
+    caffe_copy(top[0]->count(), top[0]->cpu_diff(),
+        bottom[1]->mutable_cpu_diff());
+  }
+  if (!propagate_down[0]) { return; }
+  const int planes = bottom[0]->shape(0) * bottom[0]->shape(1);
+  const int height = bottom[0]->shape(2);
+  const int width = bottom[0]->shape(3);
+  const int top_width = width * scale_;
   const Dtype *output_grad = top[0]->cpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
-  for (int n = 0; n < N; n++) {
-    for (int c = 0; c < C; c++) {
-      for (int h = 0; h < H; h++) {
-        for (int w = 0; w < W; w++) {
-          for (int i = 0; i < scale_; i++) {
-            for (int j = 0; j < scale_; j++) {
-              int nw = w * scale_ + i;
-              int nh = h * scale_ + j;
-              int out_idx = (((n * C + c) * H) + h) * W + w;
-              int in_idx = (((n * C + c) * (H * scale_))
-                  + nh) * (W * scale_) + nw;
-              bottom_diff[out_idx] += output_grad[in_idx];
-            }
+#pragma omp parallel for
+  for (int p = 0; p < planes; p++) {
+    for (int h = 0; h < height; h++) {
+      Dtype *diff_row = bottom_diff + (p * height + h) * width;
+      const Dtype *grad_row = output_grad + (p * height + h) * scale_ * top_width;
+      for (int w = 0; w < width; w++) {
+        Dtype sum = 0;
+        for (int s = 0; s < scale_; s++) {
+          for (int t = 0; t < scale_; t++) {
+            sum += grad_row[s * top_width + w * scale_ + t];
           }
         }
+        diff_row[w] = sum;
       }
     }
   }
@@ -48,6 +48,16 @@ __global__ void upscale(const Dtype *input, Dtype *output,
   output[ii]=input[ipidx];
 }
 
+template <typename Dtype>
+__global__ void upscale_add(const Dtype *input, const Dtype *lateral,
+        Dtype *output, int no_elements, int scale_factor, int d1, int d2,
+        int d3) {
+  int ii = threadIdx.x + blockDim.x * blockIdx.x;
+  if (ii >= no_elements) return;
+  int ipidx = translate_idx(ii, d1, d2, d3, scale_factor);
+  output[ii] = input[ipidx] + lateral[ii];
+}
+
 template <typename Dtype>
 __global__ void downscale(Dtype *gradInput_data, const Dtype *gradOutput_data,
                           int no_elements, int scale_factor, int d1, int d2,
@@ -75,6 +85,13 @@ void UpsampleLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
 
   int no_elements = top[0]->count();
 
+  if (bottom.size() > 1) {
+    upscale_add<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
+        <<<CAFFE_GET_BLOCKS(no_elements), CAFFE_CUDA_NUM_THREADS>>>(
+        bottom[0]->gpu_data(), bottom[1]->gpu_data(),
+        top[0]->mutable_gpu_data(), no_elements, scale_, d1, d2, d3);
+    return;
+  }
   upscale<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
       <<<CAFFE_GET_BLOCKS(no_elements), CAFFE_CUDA_NUM_THREADS>>>(
       bottom[0]->gpu_data(),
@@ -84,6 +101,11 @@ void UpsampleLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void UpsampleLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (bottom.size() > 1 && propagate_down[1]) {
+    caffe_copy(top[0]->count(), top[0]->gpu_diff(),
+        bottom[1]->mutable_gpu_diff());
+  }
+  if (!propagate_down[0]) { return; }
   int d1, d2, d3;
   Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
   d1 = bottom[0]->shape(1);
@@ -21,7 +21,9 @@ class UpsampleLayer : public Layer<Dtype> {
 
   virtual inline const char* type() const { return "Upsample"; }
   virtual inline int MinBottomBlobs() const { return 1; }
-  virtual inline int MaxBottomBlobs() const { return 1; }
+  // An optional second bottom of the top's shape is added to the upsampled
+  // map, which fuses the lateral Eltwise SUM of the FPN top-down path.
+  virtual inline int MaxBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
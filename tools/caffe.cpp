@@ -6,12 +6,19 @@ namespace bp = boost::python;
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "boost/bind.hpp"
+#include "boost/thread.hpp"
 #include "caffe/caffe.hpp"
 #include "caffe/util/signal_handler.h"
 
@@ -30,6 +37,10 @@ DEFINE_string(gpu, "",
     "Optional; run in GPU mode on given device IDs separated by ','."
     "Use '-gpu all' to run on all available GPUs. The effective training "
     "batch size is multiplied by the number of devices.");
+DEFINE_int32(cpu_workers, 1,
+    "Optional; train in CPU mode with this many data parallel solvers, each "
+    "in its own thread. As with GPUs, the effective training batch size is "
+    "multiplied by the number of workers.");
 DEFINE_string(solver, "",
     "The solver definition protocol buffer text file.");
 DEFINE_string(model, "",
@@ -48,6 +59,15 @@ DEFINE_string(weights, "",
     "separated by ','. Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_int32(warmup, 1,
+    "Optional; for 'time', untimed iterations to run first.");
+DEFINE_int32(streams, 1,
+    "Optional; for 'time', the number of net replicas, each run on its own "
+    "thread. They share the weights in the TEST phase, in TRAIN each has "
+    "its own. Layers parallelized with OpenMP share the cores with all of "
+    "them: set OMP_NUM_THREADS accordingly.");
+DEFINE_string(json, "",
+    "Optional; for 'time', also write the results as JSON to this file.");
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
               "snapshot, stop or none.");
@@ -207,10 +227,16 @@ int train() {
 
   vector<int> gpus;
   get_gpus(&gpus);
+  CHECK_GE(FLAGS_cpu_workers, 1);
   if (gpus.size() == 0) {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
+    if (FLAGS_cpu_workers > 1) {
+      LOG(INFO) << "Using " << FLAGS_cpu_workers << " CPU workers";
+      Caffe::set_solver_count(FLAGS_cpu_workers);
+    }
   } else {
+    CHECK_EQ(FLAGS_cpu_workers, 1) << "--cpu_workers needs CPU mode";
     ostringstream s;
     for (int i = 0; i < gpus.size(); ++i) {
       s << (i ? ", " : "") << gpus[i];
@@ -253,6 +279,10 @@ int train() {
 #else
     LOG(FATAL) << "Multi-GPU execution not available - rebuild with USE_NCCL";
 #endif
+  } else if (FLAGS_cpu_workers > 1) {
+    caffe::CPUSync<float> sync(solver);
+    sync.Run(FLAGS_cpu_workers,
+             FLAGS_snapshot.size() > 0 ? FLAGS_snapshot.c_str() : NULL);
   } else {
     solver->Solve();
   }
@@ -335,9 +365,127 @@ int test() {
 RegisterBrewFunction(test);
 
 
+// Per-iteration times of one net replica in 'time', in microseconds.
+struct StreamTimes {
+  vector<vector<float> > forward_layer;  // [layer][iteration]
+  vector<vector<float> > backward_layer;
+  vector<float> forward;
+  vector<float> backward;
+};
+
+// Runs the warm-up and then the timed iterations of one replica. The
+// replicas start timing together, once all are warm.
+static void time_stream(Net<float>* net, int device, int stream,
+    boost::barrier* start, StreamTimes* times) {
+  if (device >= 0) {
+    Caffe::SetDevice(device);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    Caffe::set_mode(Caffe::CPU);
+  }
+  const vector<shared_ptr<Layer<float> > >& layers = net->layers();
+  const vector<vector<Blob<float>*> >& bottom_vecs = net->bottom_vecs();
+  const vector<vector<Blob<float>*> >& top_vecs = net->top_vecs();
+  const vector<vector<bool> >& bottom_need_backward =
+      net->bottom_need_backward();
+  // Clean forward and backward passes, so that memory allocation are done
+  // and the timed iterations are more stable.
+  for (int j = 0; j < FLAGS_warmup; ++j) {
+    float loss;
+    net->Forward(&loss);
+    if (stream == 0 && j == 0) {
+      LOG(INFO) << "Initial loss: " << loss;
+    }
+    net->Backward();
+  }
+  times->forward_layer.assign(layers.size(), vector<float>());
+  times->backward_layer.assign(layers.size(), vector<float>());
+  start->wait();
+  Timer forward_timer;
+  Timer backward_timer;
+  Timer timer;
+  for (int j = 0; j < FLAGS_iterations; ++j) {
+    forward_timer.Start();
+    for (int i = 0; i < layers.size(); ++i) {
+      timer.Start();
+      layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
+      times->forward_layer[i].push_back(timer.MicroSeconds());
+    }
+    times->forward.push_back(forward_timer.MicroSeconds());
+    backward_timer.Start();
+    for (int i = layers.size() - 1; i >= 0; --i) {
+      timer.Start();
+      layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
+                          bottom_vecs[i]);
+      times->backward_layer[i].push_back(timer.MicroSeconds());
+    }
+    times->backward.push_back(backward_timer.MicroSeconds());
+    if (stream == 0) {
+      LOG(INFO) << "Iteration: " << j + 1 << " forward-backward time: "
+        << (times->forward.back() + times->backward.back()) / 1000 << " ms.";
+    }
+  }
+}
+
+// Mean and percentiles of a set of times, in ms.
+struct TimeSummary {
+  explicit TimeSummary(vector<float> us) : mean(0), p50(0), p90(0), p99(0) {
+    if (us.empty()) { return; }
+    std::sort(us.begin(), us.end());
+    for (int i = 0; i < us.size(); ++i) {
+      mean += us[i];
+    }
+    mean /= 1000 * us.size();
+    // Nearest rank.
+    p50 = us[(us.size() * 50 + 99) / 100 - 1] / 1000;
+    p90 = us[(us.size() * 90 + 99) / 100 - 1] / 1000;
+    p99 = us[(us.size() * 99 + 99) / 100 - 1] / 1000;
+  }
+  double mean, p50, p90, p99;
+};
+
+static string json_string(const string& s) {
+  ostringstream out;
+  out << '"';
+  for (int i = 0; i < s.size(); ++i) {
+    if (s[i] == '"' || s[i] == '\\') {
+      out << '\\' << s[i];
+    } else if (static_cast<unsigned char>(s[i]) < 0x20) {
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+          << static_cast<int>(s[i]) << std::dec;
+    } else {
+      out << s[i];
+    }
+  }
+  out << '"';
+  return out.str();
+}
+
+// NaN and inf are not JSON; 17 digits print any double back exactly.
+static string json_number(double value) {
+  if (!std::isfinite(value)) {
+    return "null";
+  }
+  ostringstream out;
+  out << std::setprecision(17) << value;
+  return out.str();
+}
+
+static string json_summary(const TimeSummary& t) {
+  ostringstream out;
+  out << "{\"mean\": " << json_number(t.mean)
+      << ", \"p50\": " << json_number(t.p50)
+      << ", \"p90\": " << json_number(t.p90)
+      << ", \"p99\": " << json_number(t.p99) << "}";
+  return out.str();
+}
+
 // Time: benchmark the execution time of a model.
 int time() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
+  CHECK_GT(FLAGS_streams, 0);
+  CHECK_GT(FLAGS_iterations, 0);
+  CHECK_GE(FLAGS_warmup, 0);
   caffe::Phase phase = get_phase_from_flags(caffe::TRAIN);
   vector<string> stages = get_stages_from_flags();
 
@@ -352,76 +500,183 @@ int time() {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
   }
-  // Instantiate the caffe net.
-  Net<float> caffe_net(FLAGS_model, phase, FLAGS_level, &stages);
+  // Instantiate the caffe net, and its replicas. In TRAIN, layers update
+  // their blobs in Forward (BatchNorm statistics), so the replicas only
+  // share the weights in TEST.
+  vector<shared_ptr<Net<float> > > nets;
+  for (int s = 0; s < FLAGS_streams; ++s) {
+    nets.push_back(shared_ptr<Net<float> >(
+        new Net<float>(FLAGS_model, phase, FLAGS_level, &stages)));
+    if (s == 0 && FLAGS_streams > 1) {
+      // Layers with a data_param read their source through a DataReader,
+      // of which there is one per layer name and source in the process.
+      const vector<shared_ptr<Layer<float> > >& layers = nets[0]->layers();
+      for (int i = 0; i < layers.size(); ++i) {
+        CHECK(!layers[i]->layer_param().has_data_param())
+            << "--streams > 1 needs a net without database layers, layer "
+            << layers[i]->layer_param().name() << " reads "
+            << layers[i]->layer_param().data_param().source()
+            << ": time the net with an Input layer instead.";
+      }
+    }
+    if (s > 0 && phase == caffe::TEST) {
+      nets[s]->ShareTrainedLayersWith(nets[0].get());
+    }
+  }
+  Net<float>& caffe_net = *nets[0];
+  // The weights shared by the streams go to the device here, rather than in
+  // the first forward of every stream at the same time.
+  if (gpus.size() && FLAGS_streams > 1 && phase == caffe::TEST) {
+    const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
+    for (int i = 0; i < layers.size(); ++i) {
+      for (int j = 0; j < layers[i]->blobs().size(); ++j) {
+        layers[i]->blobs()[j]->gpu_data();
+      }
+    }
+  }
 
-  // Do a clean forward and backward pass, so that memory allocation are done
-  // and future iterations will be more stable.
-  LOG(INFO) << "Performing Forward";
   // Note that for the speed benchmark, we will assume that the network does
   // not take any input blobs.
-  float initial_loss;
-  caffe_net.Forward(&initial_loss);
-  LOG(INFO) << "Initial loss: " << initial_loss;
-  LOG(INFO) << "Performing Backward";
-  caffe_net.Backward();
+  LOG(INFO) << "*** Benchmark begins ***";
+  LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations on "
+      << FLAGS_streams << " streams, after " << FLAGS_warmup
+      << " warm-up iterations.";
+  vector<StreamTimes> times(FLAGS_streams);
+  boost::barrier start(FLAGS_streams + 1);
+  boost::thread_group streams;
+  for (int s = 0; s < FLAGS_streams; ++s) {
+    streams.create_thread(boost::bind(&time_stream, nets[s].get(),
+        gpus.size() ? gpus[0] : -1, s, &start, &times[s]));
+  }
+  start.wait();
+  caffe::CPUTimer total_timer;
+  total_timer.Start();
+  streams.join_all();
+  total_timer.Stop();
 
+  // Merge the streams.
   const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
+  vector<vector<float> > forward_layer(layers.size());
+  vector<vector<float> > backward_layer(layers.size());
+  vector<float> forward, backward, forward_backward;
+  for (int s = 0; s < FLAGS_streams; ++s) {
+    for (int i = 0; i < layers.size(); ++i) {
+      forward_layer[i].insert(forward_layer[i].end(),
+          times[s].forward_layer[i].begin(), times[s].forward_layer[i].end());
+      backward_layer[i].insert(backward_layer[i].end(),
+          times[s].backward_layer[i].begin(),
+          times[s].backward_layer[i].end());
+    }
+    forward.insert(forward.end(), times[s].forward.begin(),
+        times[s].forward.end());
+    backward.insert(backward.end(), times[s].backward.begin(),
+        times[s].backward.end());
+    for (int j = 0; j < FLAGS_iterations; ++j) {
+      forward_backward.push_back(times[s].forward[j] + times[s].backward[j]);
+    }
+  }
+  // Bytes per replica: the tops each layer computes (not in place), and the
+  // parameters it owns.
   const vector<vector<Blob<float>*> >& bottom_vecs = caffe_net.bottom_vecs();
   const vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
-  const vector<vector<bool> >& bottom_need_backward =
-      caffe_net.bottom_need_backward();
-  LOG(INFO) << "*** Benchmark begins ***";
-  LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
-  Timer total_timer;
-  total_timer.Start();
-  Timer forward_timer;
-  Timer backward_timer;
-  Timer timer;
-  std::vector<double> forward_time_per_layer(layers.size(), 0.0);
-  std::vector<double> backward_time_per_layer(layers.size(), 0.0);
-  double forward_time = 0.0;
-  double backward_time = 0.0;
-  for (int j = 0; j < FLAGS_iterations; ++j) {
-    Timer iter_timer;
-    iter_timer.Start();
-    forward_timer.Start();
-    for (int i = 0; i < layers.size(); ++i) {
-      timer.Start();
-      layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
-      forward_time_per_layer[i] += timer.MicroSeconds();
+  vector<size_t> top_bytes(layers.size(), 0);
+  vector<size_t> param_bytes(layers.size(), 0);
+  size_t total_param_bytes = 0;
+  std::set<const caffe::SyncedMemory*> seen_params;
+  for (int i = 0; i < layers.size(); ++i) {
+    for (int j = 0; j < top_vecs[i].size(); ++j) {
+      if (std::find(bottom_vecs[i].begin(), bottom_vecs[i].end(),
+          top_vecs[i][j]) == bottom_vecs[i].end()) {
+        top_bytes[i] += top_vecs[i][j]->count() * sizeof(float);
+      }
     }
-    forward_time += forward_timer.MicroSeconds();
-    backward_timer.Start();
-    for (int i = layers.size() - 1; i >= 0; --i) {
-      timer.Start();
-      layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
-                          bottom_vecs[i]);
-      backward_time_per_layer[i] += timer.MicroSeconds();
+    for (int j = 0; j < layers[i]->blobs().size(); ++j) {
+      const Blob<float>& blob = *layers[i]->blobs()[j];
+      if (seen_params.insert(blob.data().get()).second) {
+        param_bytes[i] += blob.count() * sizeof(float);
+      }
     }
-    backward_time += backward_timer.MicroSeconds();
-    LOG(INFO) << "Iteration: " << j + 1 << " forward-backward time: "
-      << iter_timer.MilliSeconds() << " ms.";
+    total_param_bytes += param_bytes[i];
   }
+  const size_t activation_bytes = caffe_net.memory_used() * sizeof(float);
+  const int batch_size = caffe_net.blobs()[0]->num_axes() > 0 ?
+      caffe_net.blobs()[0]->shape(0) : 1;
+  const double wall_ms = total_timer.MilliSeconds();
+  // NaN for a run too short for the timer, written as null in the JSON.
+  const double images_per_second = wall_ms > 0 ?
+      1000. * FLAGS_streams * FLAGS_iterations * batch_size / wall_ms : NAN;
+
   LOG(INFO) << "Average time per layer: ";
+  vector<TimeSummary> forward_summary, backward_summary;
   for (int i = 0; i < layers.size(); ++i) {
+    forward_summary.push_back(TimeSummary(forward_layer[i]));
+    backward_summary.push_back(TimeSummary(backward_layer[i]));
     const caffe::string& layername = layers[i]->layer_param().name();
     LOG(INFO) << std::setfill(' ') << std::setw(10) << layername <<
-      "\tforward: " << forward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
+      "\tforward: " << forward_summary[i].mean << " ms.";
     LOG(INFO) << std::setfill(' ') << std::setw(10) << layername  <<
-      "\tbackward: " << backward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
+      "\tbackward: " << backward_summary[i].mean << " ms.";
   }
-  total_timer.Stop();
-  LOG(INFO) << "Average Forward pass: " << forward_time / 1000 /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Average Backward pass: " << backward_time / 1000 /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
+  LOG(INFO) << "p50 / p90 / p99 time and bytes per layer: ";
+  for (int i = 0; i < layers.size(); ++i) {
+    LOG(INFO) << std::setfill(' ') << std::setw(10)
+      << layers[i]->layer_param().name()
+      << "\tforward: " << forward_summary[i].p50 << " / "
+      << forward_summary[i].p90 << " / " << forward_summary[i].p99
+      << " ms.\tbackward: " << backward_summary[i].p50 << " / "
+      << backward_summary[i].p90 << " / " << backward_summary[i].p99
+      << " ms.\ttop: " << top_bytes[i] << " B, params: " << param_bytes[i]
+      << " B.";
+  }
+  const TimeSummary forward_total(forward), backward_total(backward);
+  const TimeSummary forward_backward_total(forward_backward);
+  LOG(INFO) << "Average Forward pass: " << forward_total.mean << " ms.";
+  LOG(INFO) << "Average Backward pass: " << backward_total.mean << " ms.";
+  LOG(INFO) << "Average Forward-Backward: " << forward_backward_total.mean
+    << " ms.";
+  LOG(INFO) << "Forward-Backward p50 / p90 / p99: "
+    << forward_backward_total.p50 << " / " << forward_backward_total.p90
+    << " / " << forward_backward_total.p99 << " ms.";
+  LOG(INFO) << "Throughput: " << images_per_second << " images/s ("
+    << FLAGS_streams << " streams of batch " << batch_size << ").";
+  LOG(INFO) << "Memory per replica: " << activation_bytes
+    << " B of activations, " << total_param_bytes << " B of parameters.";
+  LOG(INFO) << "Total Time: " << wall_ms << " ms.";
   LOG(INFO) << "*** Benchmark ends ***";
+
+  if (FLAGS_json.size()) {
+    std::ofstream json(FLAGS_json.c_str());
+    CHECK(json) << "Unable to write " << FLAGS_json;
+    json << "{\n"
+      << "  \"model\": " << json_string(FLAGS_model) << ",\n"
+      << "  \"phase\": \"" << (phase == caffe::TRAIN ? "TRAIN" : "TEST")
+      << "\",\n"
+      << "  \"mode\": \"" << (gpus.size() ? "GPU" : "CPU") << "\",\n"
+      << "  \"streams\": " << json_number(FLAGS_streams) << ",\n"
+      << "  \"iterations\": " << json_number(FLAGS_iterations) << ",\n"
+      << "  \"warmup\": " << json_number(FLAGS_warmup) << ",\n"
+      << "  \"batch_size\": " << json_number(batch_size) << ",\n"
+      << "  \"images_per_second\": " << json_number(images_per_second)
+      << ",\n"
+      << "  \"forward_ms\": " << json_summary(forward_total) << ",\n"
+      << "  \"backward_ms\": " << json_summary(backward_total) << ",\n"
+      << "  \"forward_backward_ms\": "
+      << json_summary(forward_backward_total) << ",\n"
+      << "  \"activation_bytes\": " << json_number(activation_bytes) << ",\n"
+      << "  \"param_bytes\": " << json_number(total_param_bytes) << ",\n"
+      << "  \"layers\": [";
+    for (int i = 0; i < layers.size(); ++i) {
+      json << (i ? ",\n" : "\n")
+        << "    {\"name\": " << json_string(layers[i]->layer_param().name())
+        << ", \"type\": " << json_string(layers[i]->type())
+        << ", \"forward_ms\": " << json_summary(forward_summary[i])
+        << ", \"backward_ms\": " << json_summary(backward_summary[i])
+        << ", \"top_bytes\": " << json_number(top_bytes[i])
+        << ", \"param_bytes\": " << json_number(param_bytes[i]) << "}";
+    }
+    json << "\n  ]\n}\n";
+    LOG(INFO) << "Wrote " << FLAGS_json;
+  }
   return 0;
 }
 RegisterBrewFunction(time);